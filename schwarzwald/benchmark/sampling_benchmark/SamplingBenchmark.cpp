@@ -0,0 +1,229 @@
+#include "datastructures/PointBuffer.h"
+#include "tiling/OctreeAlgorithms.h"
+#include "tiling/Sampling.h"
+#include "tiling/TilingContext.h"
+#include "types/Units.h"
+
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+namespace bpo = boost::program_options;
+
+using IndexedPoints = std::vector<IndexedPoint64>;
+using IndexedPointsIter = IndexedPoints::iterator;
+
+struct Args
+{
+  std::string sampling_strategy;
+  size_t point_count;
+  size_t max_points_per_node;
+  float spacing_at_root;
+  size_t iterations;
+};
+
+static Args
+parse_args(int argc, char** argv)
+{
+  Args args;
+
+  bpo::options_description options("Options");
+  options.add_options()("help,h", "Produce help message")(
+    "sampling",
+    bpo::value<std::string>(&args.sampling_strategy)->default_value("RANDOM_GRID"),
+    "Sampling strategy, one of RANDOM_GRID, GRID_CENTER, MIN_DISTANCE, MIN_DISTANCE_FAST")(
+    "points",
+    bpo::value<size_t>(&args.point_count)->default_value(10'000'000),
+    "Number of random points to sample")(
+    "max-points-per-node",
+    bpo::value<size_t>(&args.max_points_per_node)->default_value(20'000),
+    "Maximum number of points per node")(
+    "spacing",
+    bpo::value<float>(&args.spacing_at_root)->default_value(1.f / 128.f),
+    "Spacing at the root node, relative to a root node with side length 1")(
+    "iterations",
+    bpo::value<size_t>(&args.iterations)->default_value(5),
+    "Number of iterations per dispatch method, the fastest iteration is reported");
+
+  bpo::variables_map variables;
+  try {
+    bpo::store(bpo::command_line_parser(argc, argv).options(options).run(), variables);
+
+    if (variables.count("help")) {
+      std::cout << "Usage: " << argv[0] << " [options]\n";
+      options.print(std::cout);
+      std::exit(EXIT_SUCCESS);
+    }
+
+    bpo::notify(variables);
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  return args;
+}
+
+static SamplingStrategy
+make_sampling_strategy(const Args& args)
+{
+  if (args.sampling_strategy == "RANDOM_GRID")
+    return RandomSortedGridSampling{ args.max_points_per_node };
+  if (args.sampling_strategy == "GRID_CENTER")
+    return GridCenterSampling{ args.max_points_per_node };
+  if (args.sampling_strategy == "MIN_DISTANCE")
+    return PoissonDiskSampling{ args.max_points_per_node };
+  if (args.sampling_strategy == "MIN_DISTANCE_FAST")
+    return AdaptivePoissonDiskSampling{ args.max_points_per_node,
+                                        [](int32_t) -> float { return 1.f; } };
+
+  std::cerr << "Invalid sampling strategy \"" << args.sampling_strategy << "\"" << std::endl;
+  std::exit(EXIT_FAILURE);
+}
+
+/**
+ * Sample the node with the given points and recursively sample all its children from the remaining
+ * points, the same way the tiling algorithms process the octree. Nodes with at most
+ * 'max_points_per_node' points take all their points. Returns the number of processed nodes
+ */
+template<typename Sampler>
+static size_t
+sample_octree(IndexedPointsIter begin,
+              IndexedPointsIter end,
+              MortonIndex64 node_key,
+              int32_t node_level,
+              IndexedPoints& scratch_buffer,
+              const Sampler& sampler)
+{
+  const auto remaining_end =
+    sampler(begin, end, std::begin(scratch_buffer), begin, node_key, node_level).second;
+
+  const auto child_level = node_level + 1;
+  if (begin == remaining_end || child_level >= static_cast<int32_t>(MortonIndex64::MaxLevels)) {
+    return 1;
+  }
+
+  // Remaining points are still sorted, so each child is a contiguous subrange
+  size_t processed_nodes = 1;
+  auto child_begin = begin;
+  for (uint8_t octant = 0; octant < 8 && child_begin != remaining_end; ++octant) {
+    const auto child_end =
+      std::partition_point(child_begin, remaining_end, [child_level, octant](const auto& point) {
+        return point.morton_index.get_octant_at_level(static_cast<uint32_t>(child_level)) ==
+               octant;
+      });
+    if (child_begin == child_end)
+      continue;
+
+    auto child_key = node_key;
+    child_key.set_octant_at_level(static_cast<uint32_t>(child_level), octant);
+    processed_nodes +=
+      sample_octree(child_begin, child_end, child_key, child_level, scratch_buffer, sampler);
+    child_begin = child_end;
+  }
+  return processed_nodes;
+}
+
+template<typename Sampler>
+static void
+run_benchmark(const std::string& name,
+              const IndexedPoints& indexed_points,
+              size_t iterations,
+              const Sampler& sampler)
+{
+  IndexedPoints points;
+  IndexedPoints scratch_buffer(indexed_points.size());
+  auto best_time = std::chrono::nanoseconds::max();
+  size_t processed_nodes = 0;
+
+  for (size_t iteration = 0; iteration < iterations; ++iteration) {
+    points = indexed_points;
+
+    const auto start_time = std::chrono::high_resolution_clock::now();
+    processed_nodes = sample_octree(
+      std::begin(points), std::end(points), MortonIndex64{}, -1, scratch_buffer, sampler);
+    const auto end_time = std::chrono::high_resolution_clock::now();
+
+    best_time = std::min(
+      best_time, std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time));
+  }
+
+  const auto seconds = best_time.count() / 1e9;
+  std::cout << "\t" << std::left << std::setw(20) << name
+            << unit::format_with_metric_prefix(seconds, 2) << "s\t"
+            << unit::format_with_metric_prefix(indexed_points.size() / seconds, 2)
+            << " points/s\t" << processed_nodes << " nodes\n";
+}
+
+int
+main(int argc, char** argv)
+{
+  const auto args = parse_args(argc, argv);
+
+  auto sampling_strategy = make_sampling_strategy(args);
+  const AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  const TilingContext tiling_context{ bounds, args.spacing_at_root };
+
+  std::mt19937 rnd{ 42 };
+  std::uniform_real_distribution<double> dist{ 0, 1 };
+  std::vector<Vector3<double>> positions;
+  positions.reserve(args.point_count);
+  std::generate_n(std::back_inserter(positions), args.point_count, [&]() {
+    return Vector3<double>{ dist(rnd), dist(rnd), dist(rnd) };
+  });
+  PointBuffer points{ positions.size(), std::move(positions) };
+
+  IndexedPoints indexed_points;
+  indexed_points.reserve(points.count());
+  index_points<MortonIndex64::MaxLevels>(std::begin(points),
+                                         std::end(points),
+                                         std::back_inserter(indexed_points),
+                                         bounds,
+                                         OutlierPointsBehaviour::ClampToBounds);
+  std::sort(std::begin(indexed_points), std::end(indexed_points));
+
+  std::cout << "Sampling " << indexed_points.size() << " points with " << args.sampling_strategy
+            << ":\n";
+
+  run_benchmark(
+    "std::visit",
+    indexed_points,
+    args.iterations,
+    [&](auto begin, auto end, auto selected_out, auto rejected_out, auto key, auto level) {
+      return sample_points_into(sampling_strategy,
+                                begin,
+                                end,
+                                selected_out,
+                                rejected_out,
+                                key,
+                                level,
+                                tiling_context,
+                                SamplingBehaviour::TakeAllWhenCountBelowMaxPoints);
+    });
+
+  // Visiting the strategy once and sampling all nodes through the concrete type, as the tiling
+  // algorithms do
+  std::visit(
+    [&](auto& concrete_strategy) {
+      run_benchmark(
+        "concrete type",
+        indexed_points,
+        args.iterations,
+        [&](auto begin, auto end, auto selected_out, auto rejected_out, auto key, auto level) {
+          return sample_points_into(concrete_strategy,
+                                    begin,
+                                    end,
+                                    selected_out,
+                                    rejected_out,
+                                    key,
+                                    level,
+                                    tiling_context,
+                                    SamplingBehaviour::TakeAllWhenCountBelowMaxPoints);
+        });
+    },
+    sampling_strategy);
+
+  return 0;
+}
@@ -398,7 +398,11 @@ private:
 
   static tl::expected<OctreeNodeIndex, std::string> from_string_potree(std::string_view str)
   {
-    if (str.size() > MaxLevels) {
+    if (str.empty() || str[0] != 'r') {
+      return tl::make_unexpected("Node names in Potree format must start with 'r'");
+    }
+    // The leading 'r' is the root node and does not count as a level
+    if (str.size() > MaxLevels + 1) {
       return tl::make_unexpected("String size exceeds MaxLevels");
     }
 
@@ -461,25 +465,20 @@ private:
 
   static std::string to_string_simple(const OctreeNodeIndex& index)
   {
-    std::stringstream ss;
+    std::string str(index._levels, '0');
     for (uint32_t level = 1; level <= index._levels; ++level) {
-      const auto cur_char =
-        static_cast<char>('0' + static_cast<char>(index.octant_at_level(level)));
-      ss << cur_char;
+      str[level - 1] = static_cast<char>('0' + static_cast<char>(index.octant_at_level(level)));
     }
-    return ss.str();
+    return str;
   }
 
   static std::string to_string_potree(const OctreeNodeIndex& index)
   {
-    std::stringstream ss;
-    ss << "r";
+    std::string str(index._levels + 1, 'r');
     for (uint32_t level = 1; level <= index._levels; ++level) {
-      const auto cur_char =
-        static_cast<char>('0' + static_cast<char>(index.octant_at_level(level)));
-      ss << cur_char;
+      str[level] = static_cast<char>('0' + static_cast<char>(index.octant_at_level(level)));
     }
-    return ss.str();
+    return str;
   }
 
   static std::string to_string_entwine(const OctreeNodeIndex& index)
@@ -528,4 +527,15 @@ using OctreeNodeIndex64 = OctreeNodeIndex<21>;
 /**
  * OctreeNodeIndex that can hold 32 bits and, as such, 10 levels
  */
-using OctreeNodeIndex32 = OctreeNodeIndex<10>;
\ No newline at end of file
+using OctreeNodeIndex32 = OctreeNodeIndex<10>;
+
+/**
+ * Returns the name of the node with the given index, which is 'r' followed by the octant of each
+ * level (the Potree naming convention). Nodes are identified by their OctreeNodeIndex64, names are
+ * only created where a file path or a human-readable name is required
+ */
+inline std::string
+node_name_from_index(const OctreeNodeIndex64& node_index)
+{
+  return OctreeNodeIndex64::to_string(node_index, MortonIndexNamingConvention::Potree);
+}
@@ -342,7 +342,13 @@ PointBuffer::get_point(size_t point_index)
 void
 PointBuffer::append_buffer(const PointBuffer& other)
 {
-  _positions.insert(_positions.end(), other.positions().begin(), other.positions().end());
+  append_buffer(other.view());
+}
+
+void
+PointBuffer::append_buffer(const PointBufferView& other)
+{
+  _positions.insert(_positions.end(), other.positions.begin(), other.positions.end());
 
   const auto appendAttributes = [](auto& sourceAttributeContainer,
                                    const auto& targetAttributeContainer,
@@ -363,64 +369,128 @@ PointBuffer::append_buffer(const PointBuffer& other)
     }
   };
 
-  appendAttributes(
-    _rgbColors, other.rgbColors(), hasColors(), other.hasColors(), count(), other.count());
-  appendAttributes(
-    _normals, other.normals(), hasNormals(), other.hasNormals(), count(), other.count());
+  appendAttributes(_rgbColors,
+                   other.rgb_colors,
+                   hasColors(),
+                   !other.rgb_colors.empty(),
+                   count(),
+                   other.count);
+  appendAttributes(_normals,
+                   other.normals,
+                   hasNormals(),
+                   !other.normals.empty(),
+                   count(),
+                   other.count);
   appendAttributes(_intensities,
-                   other.intensities(),
+                   other.intensities,
                    hasIntensities(),
-                   other.hasIntensities(),
+                   !other.intensities.empty(),
                    count(),
-                   other.count());
+                   other.count);
   appendAttributes(_classifications,
-                   other.classifications(),
+                   other.classifications,
                    hasClassifications(),
-                   other.hasClassifications(),
+                   !other.classifications.empty(),
                    count(),
-                   other.count());
+                   other.count);
   appendAttributes(_edge_of_flight_lines,
-                   other.edge_of_flight_lines(),
+                   other.edge_of_flight_lines,
                    has_edge_of_flight_lines(),
-                   other.has_edge_of_flight_lines(),
+                   !other.edge_of_flight_lines.empty(),
+                   count(),
+                   other.count);
+  appendAttributes(_gps_times,
+                   other.gps_times,
+                   has_gps_times(),
+                   !other.gps_times.empty(),
                    count(),
-                   other.count());
-  appendAttributes(
-    _gps_times, other.gps_times(), has_gps_times(), other.has_gps_times(), count(), other.count());
+                   other.count);
   appendAttributes(_number_of_returns,
-                   other.number_of_returns(),
+                   other.number_of_returns,
                    has_number_of_returns(),
-                   other.has_number_of_returns(),
+                   !other.number_of_returns.empty(),
                    count(),
-                   other.count());
+                   other.count);
   appendAttributes(_return_numbers,
-                   other.return_numbers(),
+                   other.return_numbers,
                    has_return_numbers(),
-                   other.has_return_numbers(),
+                   !other.return_numbers.empty(),
                    count(),
-                   other.count());
+                   other.count);
   appendAttributes(_point_source_ids,
-                   other.point_source_ids(),
+                   other.point_source_ids,
                    has_point_source_ids(),
-                   other.has_point_source_ids(),
+                   !other.point_source_ids.empty(),
                    count(),
-                   other.count());
+                   other.count);
   appendAttributes(_scan_direction_flags,
-                   other.scan_direction_flags(),
+                   other.scan_direction_flags,
                    has_scan_direction_flags(),
-                   other.has_scan_direction_flags(),
+                   !other.scan_direction_flags.empty(),
                    count(),
-                   other.count());
+                   other.count);
   appendAttributes(_scan_angle_ranks,
-                   other.scan_angle_ranks(),
+                   other.scan_angle_ranks,
                    has_scan_angle_ranks(),
-                   other.has_scan_angle_ranks(),
+                   !other.scan_angle_ranks.empty(),
+                   count(),
+                   other.count);
+  appendAttributes(_user_data,
+                   other.user_data,
+                   has_user_data(),
+                   !other.user_data.empty(),
                    count(),
-                   other.count());
-  appendAttributes(
-    _user_data, other.user_data(), has_user_data(), other.has_user_data(), count(), other.count());
+                   other.count);
+
+  _count += other.count;
+}
 
-  _count += other.count();
+PointBufferView
+PointBuffer::view() const
+{
+  PointBufferView view;
+  view.count = _count;
+  view.positions = _positions;
+  view.rgb_colors = _rgbColors;
+  view.normals = _normals;
+  view.intensities = _intensities;
+  view.classifications = _classifications;
+  view.edge_of_flight_lines = _edge_of_flight_lines;
+  view.gps_times = _gps_times;
+  view.number_of_returns = _number_of_returns;
+  view.return_numbers = _return_numbers;
+  view.point_source_ids = _point_source_ids;
+  view.scan_direction_flags = _scan_direction_flags;
+  view.scan_angle_ranks = _scan_angle_ranks;
+  view.user_data = _user_data;
+  return view;
+}
+
+void
+PointBuffer::resize_like(const PointBuffer& schema, size_t count)
+{
+  const auto resize_column = [count](auto& column, const auto& schema_column) {
+    if (schema_column.empty()) {
+      column.clear();
+    } else {
+      column.resize(count);
+    }
+  };
+
+  _count = count;
+  _positions.resize(count);
+  resize_column(_rgbColors, schema._rgbColors);
+  resize_column(_normals, schema._normals);
+  resize_column(_intensities, schema._intensities);
+  resize_column(_classifications, schema._classifications);
+  resize_column(_edge_of_flight_lines, schema._edge_of_flight_lines);
+  resize_column(_gps_times, schema._gps_times);
+  resize_column(_number_of_returns, schema._number_of_returns);
+  resize_column(_return_numbers, schema._return_numbers);
+  resize_column(_point_source_ids, schema._point_source_ids);
+  resize_column(_scan_direction_flags, schema._scan_direction_flags);
+  resize_column(_scan_angle_ranks, schema._scan_angle_ranks);
+  resize_column(_user_data, schema._user_data);
 }
 
 void
@@ -4,13 +4,39 @@
 #include "math/Vector3.h"
 #include "pointcloud/PointAttributes.h"
 
+#include <algorithm>
 #include <gsl/gsl>
+#include <iterator>
 #include <optional>
+#include <type_traits>
 #include <vector>
 
 // TECH_DEBT Make attributes more dynamic (map<AttributeType, GenericAttribute*>
 // or something like that)
 
+/**
+ * Read-only view of the attributes of multiple points that are stored in a structure-of-array
+ * fashion outside of a PointBuffer, for example in a memory-mapped file. Attributes that the points
+ * don't have are empty spans
+ */
+struct PointBufferView
+{
+  size_t count = 0;
+  gsl::span<const Vector3<double>> positions;
+  gsl::span<const Vector3<uint8_t>> rgb_colors;
+  gsl::span<const Vector3<float>> normals;
+  gsl::span<const uint16_t> intensities;
+  gsl::span<const uint8_t> classifications;
+  gsl::span<const uint8_t> edge_of_flight_lines;
+  gsl::span<const double> gps_times;
+  gsl::span<const uint8_t> number_of_returns;
+  gsl::span<const uint8_t> return_numbers;
+  gsl::span<const uint16_t> point_source_ids;
+  gsl::span<const uint8_t> scan_direction_flags;
+  gsl::span<const int8_t> scan_angle_ranks;
+  gsl::span<const uint8_t> user_data;
+};
+
 /// <summary>
 /// Buffer structure that stores point attributes (position, color etc.) for
 /// multiple points at once in a structure-of-array fashion. Compared to storing
@@ -158,6 +184,28 @@ struct PointBuffer
   /// </summary>
   void append_buffer(const PointBuffer& other);
 
+  /**
+   * Appends the points of the given view to this PointBuffer, with the same semantics as appending
+   * a PointBuffer
+   */
+  void append_buffer(const PointBufferView& other);
+
+  /**
+   * Replaces the contents of this PointBuffer with copies of the points in [begin, end), which has
+   * to dereference to PointReference or PointConstReference. The points are copied one attribute at
+   * a time, so that every column is a single gather by point index instead of a loop over all
+   * attributes of each point. The attributes are those of the PointBuffer of the first point.
+   * Allocated memory is kept, so a PointBuffer can be reused as scratch memory for many gathers
+   */
+  template<typename Iter>
+  void gather(Iter begin, Iter end);
+
+  /**
+   * Returns a read-only view of all points in this PointBuffer. The view is invalidated by all
+   * operations that modify the PointBuffer
+   */
+  PointBufferView view() const;
+
   /**
    * Applies a new attribute schema to this PointBuffer. Clears all attributes that are not in the
    * new schema and fills all attributes that are in the new schema but weren't in the PointBuffers
@@ -288,6 +336,11 @@ struct PointBuffer
   PointConstIterator end() const;
 
 private:
+  /**
+   * Resizes all attributes that 'schema' has to 'count' points and clears all other attributes
+   */
+  void resize_like(const PointBuffer& schema, size_t count);
+
   size_t _count;
   std::vector<Vector3<double>> _positions;
   std::vector<Vector3<uint8_t>> _rgbColors;
@@ -304,6 +357,62 @@ private:
   std::vector<uint8_t> _user_data;
 };
 
+template<typename Iter>
+void
+PointBuffer::gather(Iter begin, Iter end)
+{
+  const auto count = static_cast<size_t>(std::distance(begin, end));
+  if (!count) {
+    clear();
+    return;
+  }
+
+  resize_like(*(*begin)._pointBuffer, count);
+
+  // The points of a node usually reference a single PointBuffer, but they can be spread over
+  // several, so each run of points from the same PointBuffer is gathered separately
+  size_t run_offset = 0;
+  while (begin != end) {
+    const auto source = (*begin)._pointBuffer;
+    auto run_end = std::next(begin);
+    while (run_end != end && (*run_end)._pointBuffer == source) {
+      ++run_end;
+    }
+    const auto run_length = static_cast<size_t>(std::distance(begin, run_end));
+
+    const auto gather_column = [&](auto& dst_column, const auto& src_column) {
+      using Value = typename std::decay_t<decltype(dst_column)>::value_type;
+      if (dst_column.empty())
+        return;
+      auto dst = dst_column.begin() + run_offset;
+      if (src_column.empty()) {
+        std::fill(dst, dst + run_length, Value{});
+        return;
+      }
+      for (auto iter = begin; iter != run_end; ++iter) {
+        *dst++ = src_column[(*iter)._index];
+      }
+    };
+
+    gather_column(_positions, source->_positions);
+    gather_column(_rgbColors, source->_rgbColors);
+    gather_column(_normals, source->_normals);
+    gather_column(_intensities, source->_intensities);
+    gather_column(_classifications, source->_classifications);
+    gather_column(_edge_of_flight_lines, source->_edge_of_flight_lines);
+    gather_column(_gps_times, source->_gps_times);
+    gather_column(_number_of_returns, source->_number_of_returns);
+    gather_column(_return_numbers, source->_return_numbers);
+    gather_column(_point_source_ids, source->_point_source_ids);
+    gather_column(_scan_direction_flags, source->_scan_direction_flags);
+    gather_column(_scan_angle_ranks, source->_scan_angle_ranks);
+    gather_column(_user_data, source->_user_data);
+
+    run_offset += run_length;
+    begin = run_end;
+  }
+}
+
 namespace std {
 template<>
 struct iterator_traits<::PointBuffer::PointIterator>
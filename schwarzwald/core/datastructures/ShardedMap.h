@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+/**
+ * Hash map that many threads can write to concurrently. The entries are spread over 'NumShards'
+ * independent maps by the hash of their key, each with a lock of its own, so two writers only
+ * contend if their keys fall into the same shard. Meant for bookkeeping that is written during
+ * processing and read once all writers are done, e.g. the hierarchy of all persisted nodes
+ */
+template<typename Key, typename Value, size_t NumShards = 64, typename Hash = std::hash<Key>>
+struct ShardedMap
+{
+  static_assert(NumShards && !(NumShards & (NumShards - 1)), "NumShards must be a power of two");
+
+  ShardedMap()
+    : _shards(std::make_unique<Shard[]>(NumShards))
+  {}
+  ShardedMap(const ShardedMap&) = delete;
+  ShardedMap(ShardedMap&&) = default;
+  ShardedMap& operator=(const ShardedMap&) = delete;
+  ShardedMap& operator=(ShardedMap&&) = default;
+
+  void insert_or_assign(const Key& key, Value value)
+  {
+    auto& shard = shard_for_key(key);
+    std::lock_guard guard{ shard.lock };
+    shard.entries.insert_or_assign(key, std::move(value));
+  }
+
+  /**
+   * Calls 'update(value)' with the value of the given key while holding the lock of its shard and
+   * returns its result. A missing value is default-constructed first
+   */
+  template<typename Update>
+  decltype(auto) update(const Key& key, Update update)
+  {
+    auto& shard = shard_for_key(key);
+    std::lock_guard guard{ shard.lock };
+    return update(shard.entries[key]);
+  }
+
+  /**
+   * Removes the entry of the given key and returns its value, or std::nullopt if there is none
+   */
+  std::optional<Value> extract(const Key& key)
+  {
+    if (!_shards)
+      return std::nullopt;
+    auto& shard = shard_for_key(key);
+    std::lock_guard guard{ shard.lock };
+    auto node = shard.entries.extract(key);
+    if (!node)
+      return std::nullopt;
+    return std::make_optional(std::move(node.mapped()));
+  }
+
+  bool contains(const Key& key) const
+  {
+    const auto& shard = shard_for_key(key);
+    std::lock_guard guard{ shard.lock };
+    return shard.entries.find(key) != std::end(shard.entries);
+  }
+
+  /**
+   * Number of entries in all shards. Only exact if no other thread writes concurrently
+   */
+  size_t size() const
+  {
+    size_t size = 0;
+    for (size_t idx = 0; _shards && idx < NumShards; ++idx) {
+      std::lock_guard guard{ _shards[idx].lock };
+      size += _shards[idx].entries.size();
+    }
+    return size;
+  }
+
+  /**
+   * Is the map empty? A moved-from ShardedMap is always empty
+   */
+  bool empty() const { return size() == 0; }
+
+  /**
+   * Returns a copy of the entries of all shards as a single map
+   */
+  std::unordered_map<Key, Value, Hash> collect() const
+  {
+    std::unordered_map<Key, Value, Hash> entries;
+    entries.reserve(size());
+    for (size_t idx = 0; _shards && idx < NumShards; ++idx) {
+      std::lock_guard guard{ _shards[idx].lock };
+      entries.insert(std::begin(_shards[idx].entries), std::end(_shards[idx].entries));
+    }
+    return entries;
+  }
+
+  /**
+   * Removes all entries for which 'predicate(key, value)' is true and returns them as a single
+   * map. Entries that other threads write concurrently may or may not be extracted
+   */
+  template<typename Predicate>
+  std::unordered_map<Key, Value, Hash> extract_if(Predicate predicate)
+  {
+    std::unordered_map<Key, Value, Hash> extracted;
+    for (size_t idx = 0; _shards && idx < NumShards; ++idx) {
+      auto& shard = _shards[idx];
+      std::lock_guard guard{ shard.lock };
+      for (auto iter = std::begin(shard.entries); iter != std::end(shard.entries);) {
+        if (predicate(iter->first, iter->second)) {
+          extracted.insert(shard.entries.extract(iter++));
+        } else {
+          ++iter;
+        }
+      }
+    }
+    return extracted;
+  }
+
+private:
+  // Shards are aligned to cache lines, so that locking one shard does not slow down its neighbours
+  struct alignas(64) Shard
+  {
+    mutable std::mutex lock;
+    std::unordered_map<Key, Value, Hash> entries;
+  };
+
+  Shard& shard_for_key(const Key& key) const
+  {
+    // Fibonacci hashing spreads keys with similar hashes over all shards
+    const auto hash = static_cast<uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull;
+    return _shards[static_cast<size_t>(hash >> 32) & (NumShards - 1)];
+  }
+
+  std::unique_ptr<Shard[]> _shards;
+};
@@ -0,0 +1,478 @@
+#include "io/BinaryCodec.h"
+#include "util/stuff.h"
+
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <boost/format.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <lz4.h>
+#include <zstd.h>
+
+namespace bio = boost::iostreams;
+
+static void
+compress_deflate(int level, gsl::span<const std::byte> src, std::vector<std::byte>& dst)
+{
+  thread_local std::vector<char> deflate_buffer;
+  deflate_buffer.clear();
+
+  bio::zlib_params zlib_params;
+  zlib_params.level = level;
+
+  bio::filtering_ostream stream;
+  stream.push(bio::zlib_compressor{ zlib_params, 1 << 18 });
+  stream.push(bio::back_inserter(deflate_buffer));
+  stream.write(reinterpret_cast<const char*>(src.data()), static_cast<std::streamsize>(src.size()));
+  stream.reset();
+
+  const auto offset = dst.size();
+  dst.resize(offset + deflate_buffer.size());
+  std::memcpy(dst.data() + offset, deflate_buffer.data(), deflate_buffer.size());
+}
+
+static void
+compress_lz4(int acceleration, gsl::span<const std::byte> src, std::vector<std::byte>& dst)
+{
+  if (static_cast<size_t>(src.size()) > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+    throw std::runtime_error{
+      (boost::format("Can't compress %1% bytes with LZ4, the maximum is %2% bytes") % src.size() %
+       LZ4_MAX_INPUT_SIZE)
+        .str()
+    };
+  }
+
+  const auto src_size = static_cast<int>(src.size());
+  const auto bound = LZ4_compressBound(src_size);
+  const auto offset = dst.size();
+  dst.resize(offset + static_cast<size_t>(bound));
+
+  const auto compressed_size = LZ4_compress_fast(reinterpret_cast<const char*>(src.data()),
+                                                 reinterpret_cast<char*>(dst.data() + offset),
+                                                 src_size,
+                                                 bound,
+                                                 acceleration);
+  if (compressed_size <= 0) {
+    throw std::runtime_error{ "LZ4 compression failed" };
+  }
+  dst.resize(offset + static_cast<size_t>(compressed_size));
+}
+
+static void
+compress_zstd(int level, gsl::span<const std::byte> src, std::vector<std::byte>& dst)
+{
+  // Compression contexts are expensive to create, so every thread keeps one around
+  thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context{ ZSTD_createCCtx(),
+                                                                             &ZSTD_freeCCtx };
+
+  const auto bound = ZSTD_compressBound(src.size());
+  const auto offset = dst.size();
+  dst.resize(offset + bound);
+
+  const auto compressed_size = ZSTD_compressCCtx(
+    context.get(), dst.data() + offset, bound, src.data(), src.size(), level);
+  if (ZSTD_isError(compressed_size)) {
+    throw std::runtime_error{ concat("Zstd compression failed (",
+                                     ZSTD_getErrorName(compressed_size),
+                                     ")") };
+  }
+  dst.resize(offset + compressed_size);
+}
+
+/**
+ * Writes byte 'byte_index' of component 'component' of every point into its own plane of 'count'
+ * bytes. Planes are ordered by component, then by byte
+ */
+static std::byte*
+shuffle_bytes(const bin::ColumnLayout& layout,
+              size_t count,
+              const std::byte* src,
+              std::byte* dst)
+{
+  const auto stride = layout.bytes_per_point();
+  for (size_t component = 0; component < layout.components; ++component) {
+    for (size_t byte_index = 0; byte_index < layout.component_size; ++byte_index) {
+      const auto component_src = src + component * layout.component_size + byte_index;
+      for (size_t idx = 0; idx < count; ++idx) {
+        *dst++ = component_src[idx * stride];
+      }
+    }
+  }
+  return dst;
+}
+
+static const std::byte*
+unshuffle_bytes(const bin::ColumnLayout& layout,
+                size_t count,
+                const std::byte* src,
+                std::byte* dst)
+{
+  const auto stride = layout.bytes_per_point();
+  for (size_t component = 0; component < layout.components; ++component) {
+    for (size_t byte_index = 0; byte_index < layout.component_size; ++byte_index) {
+      const auto component_dst = dst + component * layout.component_size + byte_index;
+      for (size_t idx = 0; idx < count; ++idx) {
+        component_dst[idx * stride] = *src++;
+      }
+    }
+  }
+  return src;
+}
+
+template<typename UInt>
+static std::byte*
+delta_shuffle(const bin::ColumnLayout& layout, size_t count, const std::byte* src, std::byte* dst)
+{
+  constexpr auto Bits = sizeof(UInt) * 8;
+  const auto stride = layout.bytes_per_point();
+  for (size_t component = 0; component < layout.components; ++component) {
+    const auto component_src = src + component * sizeof(UInt);
+    const auto planes = dst + component * sizeof(UInt) * count;
+    UInt previous = 0;
+    for (size_t idx = 0; idx < count; ++idx) {
+      UInt value;
+      std::memcpy(&value, component_src + idx * stride, sizeof(UInt));
+      const auto delta = static_cast<UInt>(value - previous);
+      previous = value;
+      // Zigzag encoding maps small negative differences to small positive numbers, so that the
+      // high bytes of the differences are zero
+      const auto sign = static_cast<UInt>(0) - static_cast<UInt>(delta >> (Bits - 1));
+      const auto zigzag = static_cast<UInt>(static_cast<UInt>(delta << 1) ^ sign);
+      for (size_t byte_index = 0; byte_index < sizeof(UInt); ++byte_index) {
+        planes[byte_index * count + idx] = static_cast<std::byte>(zigzag >> (byte_index * 8));
+      }
+    }
+  }
+  return dst + layout.bytes_per_point() * count;
+}
+
+template<typename UInt>
+static const std::byte*
+undelta_unshuffle(const bin::ColumnLayout& layout,
+                  size_t count,
+                  const std::byte* src,
+                  std::byte* dst)
+{
+  const auto stride = layout.bytes_per_point();
+  for (size_t component = 0; component < layout.components; ++component) {
+    const auto component_dst = dst + component * sizeof(UInt);
+    const auto planes = src + component * sizeof(UInt) * count;
+    UInt previous = 0;
+    for (size_t idx = 0; idx < count; ++idx) {
+      UInt zigzag = 0;
+      for (size_t byte_index = 0; byte_index < sizeof(UInt); ++byte_index) {
+        zigzag |= static_cast<UInt>(static_cast<UInt>(planes[byte_index * count + idx])
+                                    << (byte_index * 8));
+      }
+      const auto delta =
+        static_cast<UInt>((zigzag >> 1) ^ (static_cast<UInt>(0) - static_cast<UInt>(zigzag & 1)));
+      const auto value = static_cast<UInt>(previous + delta);
+      previous = value;
+      std::memcpy(component_dst + idx * stride, &value, sizeof(UInt));
+    }
+  }
+  return src + layout.bytes_per_point() * count;
+}
+
+static std::byte*
+run_length_encode(size_t count, const std::byte* src, std::byte* dst)
+{
+  size_t idx = 0;
+  while (idx < count) {
+    const auto value = src[idx];
+    size_t run_length = 1;
+    while (idx + run_length < count && src[idx + run_length] == value) {
+      ++run_length;
+    }
+    idx += run_length;
+
+    *dst++ = value;
+    // Run length as LEB128 variable-length integer
+    while (run_length >= 0x80) {
+      *dst++ = static_cast<std::byte>((run_length & 0x7F) | 0x80);
+      run_length >>= 7;
+    }
+    *dst++ = static_cast<std::byte>(run_length);
+  }
+  return dst;
+}
+
+static const std::byte*
+run_length_decode(size_t count, const std::byte* src, const std::byte* src_end, std::byte* dst)
+{
+  const auto truncated = []() { return std::runtime_error{ "Run-length encoded data is corrupted" }; };
+
+  size_t idx = 0;
+  while (idx < count) {
+    if (src == src_end)
+      throw truncated();
+    const auto value = *src++;
+
+    size_t run_length = 0;
+    for (size_t shift = 0;; shift += 7) {
+      if (src == src_end || shift >= 64)
+        throw truncated();
+      const auto byte = static_cast<uint8_t>(*src++);
+      run_length |= static_cast<size_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        break;
+    }
+
+    if (run_length == 0 || run_length > count - idx)
+      throw truncated();
+    std::memset(dst + idx, static_cast<int>(value), run_length);
+    idx += run_length;
+  }
+  return src;
+}
+
+size_t
+bin::max_encoded_column_size(ColumnFilter filter, const ColumnLayout& layout, size_t count)
+{
+  // A run of a single value takes two bytes, every other run takes less than two bytes per value
+  if (filter == ColumnFilter::RunLength)
+    return 2 * count;
+  return layout.bytes_per_point() * count;
+}
+
+std::byte*
+bin::encode_column(ColumnFilter filter,
+                   const ColumnLayout& layout,
+                   size_t count,
+                   const std::byte* src,
+                   std::byte* dst)
+{
+  switch (filter) {
+    case ColumnFilter::None:
+      std::memcpy(dst, src, layout.bytes_per_point() * count);
+      return dst + layout.bytes_per_point() * count;
+    case ColumnFilter::Shuffle:
+      return shuffle_bytes(layout, count, src, dst);
+    case ColumnFilter::DeltaShuffle:
+      switch (layout.component_size) {
+        case 1:
+          return delta_shuffle<uint8_t>(layout, count, src, dst);
+        case 2:
+          return delta_shuffle<uint16_t>(layout, count, src, dst);
+        case 4:
+          return delta_shuffle<uint32_t>(layout, count, src, dst);
+        case 8:
+          return delta_shuffle<uint64_t>(layout, count, src, dst);
+        default:
+          throw std::invalid_argument{ "Delta filter requires components of 1, 2, 4 or 8 bytes" };
+      }
+    case ColumnFilter::RunLength:
+      if (layout.bytes_per_point() != 1) {
+        throw std::invalid_argument{ "Run-length filter requires single-byte values" };
+      }
+      return run_length_encode(count, src, dst);
+    default:
+      throw std::invalid_argument{ "Invalid ColumnFilter" };
+  }
+}
+
+const std::byte*
+bin::decode_column(ColumnFilter filter,
+                   const ColumnLayout& layout,
+                   size_t count,
+                   const std::byte* src,
+                   const std::byte* src_end,
+                   std::byte* dst)
+{
+  if (filter == ColumnFilter::RunLength) {
+    if (layout.bytes_per_point() != 1) {
+      throw std::invalid_argument{ "Run-length filter requires single-byte values" };
+    }
+    return run_length_decode(count, src, src_end, dst);
+  }
+
+  const auto encoded_size = layout.bytes_per_point() * count;
+  if (static_cast<size_t>(src_end - src) < encoded_size) {
+    throw std::runtime_error{ "Encoded column is truncated" };
+  }
+
+  switch (filter) {
+    case ColumnFilter::None:
+      std::memcpy(dst, src, encoded_size);
+      return src + encoded_size;
+    case ColumnFilter::Shuffle:
+      return unshuffle_bytes(layout, count, src, dst);
+    case ColumnFilter::DeltaShuffle:
+      switch (layout.component_size) {
+        case 1:
+          return undelta_unshuffle<uint8_t>(layout, count, src, dst);
+        case 2:
+          return undelta_unshuffle<uint16_t>(layout, count, src, dst);
+        case 4:
+          return undelta_unshuffle<uint32_t>(layout, count, src, dst);
+        case 8:
+          return undelta_unshuffle<uint64_t>(layout, count, src, dst);
+        default:
+          throw std::invalid_argument{ "Delta filter requires components of 1, 2, 4 or 8 bytes" };
+      }
+    default:
+      throw std::invalid_argument{ "Invalid ColumnFilter" };
+  }
+}
+
+int
+bin::default_codec_level(BinaryCodec codec)
+{
+  switch (codec) {
+    case BinaryCodec::Deflate:
+      return bio::zlib::best_speed;
+    case BinaryCodec::LZ4:
+      return 1;
+    case BinaryCodec::Zstd:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+void
+bin::write_file_header(gsl::span<std::byte> dst,
+                       BinaryCodec codec,
+                       BinaryEncoding encoding,
+                       uint64_t uncompressed_size)
+{
+  assert(static_cast<size_t>(dst.size()) >= FileHeader::Size);
+
+  const uint32_t magic = FileHeader::Magic;
+  const uint8_t version = FileHeader::CurrentVersion;
+  const uint8_t reserved = 0;
+
+  auto header = dst.data();
+  std::memcpy(header, &magic, sizeof(uint32_t));
+  std::memcpy(header + 4, &version, sizeof(uint8_t));
+  std::memcpy(header + 5, &codec, sizeof(BinaryCodec));
+  std::memcpy(header + 6, &encoding, sizeof(BinaryEncoding));
+  std::memcpy(header + 7, &reserved, sizeof(uint8_t));
+  std::memcpy(header + 8, &uncompressed_size, sizeof(uint64_t));
+}
+
+bool
+bin::read_file_header(gsl::span<const std::byte> src, FileHeader& header)
+{
+  if (static_cast<size_t>(src.size()) < FileHeader::Size)
+    return false;
+
+  uint32_t magic;
+  std::memcpy(&magic, src.data(), sizeof(uint32_t));
+  if (magic != FileHeader::Magic)
+    return false;
+
+  std::memcpy(&header.version, src.data() + 4, sizeof(uint8_t));
+  std::memcpy(&header.codec, src.data() + 5, sizeof(BinaryCodec));
+  std::memcpy(&header.encoding, src.data() + 6, sizeof(BinaryEncoding));
+  std::memcpy(&header.uncompressed_size, src.data() + 8, sizeof(uint64_t));
+
+  if (header.version > FileHeader::CurrentVersion) {
+    throw std::runtime_error{
+      (boost::format("Unsupported binary file version %1%") % static_cast<int>(header.version))
+        .str()
+    };
+  }
+  return true;
+}
+
+void
+bin::compress(BinaryCodec codec,
+              int level,
+              gsl::span<const std::byte> src,
+              std::vector<std::byte>& dst)
+{
+  if (level == 0) {
+    level = default_codec_level(codec);
+  }
+
+  switch (codec) {
+    case BinaryCodec::None: {
+      const auto offset = dst.size();
+      dst.resize(offset + src.size());
+      std::memcpy(dst.data() + offset, src.data(), src.size());
+      break;
+    }
+    case BinaryCodec::Deflate:
+      compress_deflate(level, src, dst);
+      break;
+    case BinaryCodec::LZ4:
+      compress_lz4(level, src, dst);
+      break;
+    case BinaryCodec::Zstd:
+      compress_zstd(level, src, dst);
+      break;
+    default:
+      throw std::invalid_argument{
+        (boost::format("Invalid BinaryCodec %1%") % static_cast<int>(codec)).str()
+      };
+  }
+}
+
+void
+bin::decompress(BinaryCodec codec, gsl::span<const std::byte> src, gsl::span<std::byte> dst)
+{
+  const auto src_size = static_cast<size_t>(src.size());
+  const auto dst_size = static_cast<size_t>(dst.size());
+
+  switch (codec) {
+    case BinaryCodec::None: {
+      if (src_size != dst_size) {
+        throw std::runtime_error{ "Size of uncompressed binary data does not match its header" };
+      }
+      std::memcpy(dst.data(), src.data(), src_size);
+      break;
+    }
+    case BinaryCodec::Deflate: {
+      bio::filtering_istream stream;
+      stream.push(bio::zlib_decompressor{});
+      stream.push(bio::array_source{ reinterpret_cast<const char*>(src.data()), src_size });
+      stream.read(reinterpret_cast<char*>(dst.data()), static_cast<std::streamsize>(dst_size));
+      if (static_cast<size_t>(stream.gcount()) != dst_size) {
+        throw std::runtime_error{ "Deflate data is truncated" };
+      }
+      break;
+    }
+    case BinaryCodec::LZ4: {
+      if (dst_size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+        throw std::runtime_error{ "LZ4 data exceeds the maximum size" };
+      }
+      const auto decompressed_size = LZ4_decompress_safe(reinterpret_cast<const char*>(src.data()),
+                                                         reinterpret_cast<char*>(dst.data()),
+                                                         static_cast<int>(src_size),
+                                                         static_cast<int>(dst_size));
+      if (decompressed_size < 0 || static_cast<size_t>(decompressed_size) != dst_size) {
+        throw std::runtime_error{ "LZ4 data is corrupted" };
+      }
+      break;
+    }
+    case BinaryCodec::Zstd: {
+      thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context{
+        ZSTD_createDCtx(), &ZSTD_freeDCtx
+      };
+      const auto decompressed_size =
+        ZSTD_decompressDCtx(context.get(), dst.data(), dst_size, src.data(), src_size);
+      if (ZSTD_isError(decompressed_size)) {
+        throw std::runtime_error{ concat("Zstd decompression failed (",
+                                         ZSTD_getErrorName(decompressed_size),
+                                         ")") };
+      }
+      if (decompressed_size != dst_size) {
+        throw std::runtime_error{ "Zstd data is truncated" };
+      }
+      break;
+    }
+    default:
+      throw std::runtime_error{
+        (boost::format("Unknown codec %1% in binary file") % static_cast<int>(codec)).str()
+      };
+  }
+}
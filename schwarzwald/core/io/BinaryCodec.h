@@ -0,0 +1,135 @@
+#pragma once
+
+#include "util/Definitions.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <gsl/gsl>
+
+namespace bin {
+
+/**
+ * Header that precedes the (possibly compressed) contents of every file written by
+ * BinaryPersistence. Files written before the header was introduced start directly with the
+ * properties bitmask, which never has the high bits of 'Magic' set, so both can be told apart
+ */
+struct FileHeader
+{
+  constexpr static uint32_t Magic = 0x4E425753; // 'SWBN'
+  // Since version 3, the columns of unfiltered point data are aligned to 8 bytes
+  constexpr static uint8_t CurrentVersion = 3;
+  constexpr static size_t Size = 16;
+
+  uint8_t version;
+  BinaryCodec codec;
+  // Version 1 files have no encoding and are always BinaryEncoding::Plain
+  BinaryEncoding encoding;
+  uint64_t uncompressed_size;
+};
+
+/**
+ * Transformations that are applied to single attribute columns before compression. They exploit
+ * that neighbouring points in a node are close to each other, because points are sorted in Morton
+ * order. All filters are lossless
+ */
+enum class ColumnFilter
+{
+  // Copy the column unchanged
+  None,
+  // Split every component into its bytes and store all first bytes, then all second bytes etc.
+  // The high bytes of similar values are then stored next to each other
+  Shuffle,
+  // Store the difference of every component to the same component of the previous point, zigzag
+  // encoded, then shuffle the bytes of the differences. Floating point components are treated as
+  // their bit patterns, which are monotonic in the value for values of equal sign
+  DeltaShuffle,
+  // Store runs of equal values as the value followed by the run length as a variable-length
+  // integer. Only supported for single-byte values
+  RunLength
+};
+
+/**
+ * Layout of an attribute column, with 'components' values of 'component_size' bytes per point
+ */
+struct ColumnLayout
+{
+  size_t component_size;
+  size_t components;
+
+  size_t bytes_per_point() const { return component_size * components; }
+};
+
+/**
+ * Maximum number of bytes that encode_column writes for 'count' points
+ */
+size_t
+max_encoded_column_size(ColumnFilter filter, const ColumnLayout& layout, size_t count);
+
+/**
+ * Encodes the column of 'count' points at 'src' with the given filter into 'dst'. Returns the end
+ * of the encoded data
+ */
+std::byte*
+encode_column(ColumnFilter filter,
+              const ColumnLayout& layout,
+              size_t count,
+              const std::byte* src,
+              std::byte* dst);
+
+/**
+ * Decodes a column of 'count' points that was encoded with the given filter from 'src' into 'dst'.
+ * Returns the end of the encoded data. Throws if the encoded data would extend beyond 'src_end'
+ */
+const std::byte*
+decode_column(ColumnFilter filter,
+              const ColumnLayout& layout,
+              size_t count,
+              const std::byte* src,
+              const std::byte* src_end,
+              std::byte* dst);
+
+/**
+ * Level that is used for the given codec if no level is specified. The defaults favour speed,
+ * since binary files are mostly used as an intermediate format
+ */
+int
+default_codec_level(BinaryCodec codec);
+
+/**
+ * Writes the header for a file with the given codec and encoding into the first FileHeader::Size
+ * bytes of 'dst'
+ */
+void
+write_file_header(gsl::span<std::byte> dst,
+                  BinaryCodec codec,
+                  BinaryEncoding encoding,
+                  uint64_t uncompressed_size);
+
+/**
+ * Tries to read a FileHeader from the start of 'src'. Returns false if 'src' does not start with a
+ * header, which is the case for files in the legacy format
+ */
+bool
+read_file_header(gsl::span<const std::byte> src, FileHeader& header);
+
+/**
+ * Compresses 'src' with the given codec and level and appends the compressed data to 'dst'. A level
+ * of 0 selects the default level of the codec. For LZ4, the level is the acceleration factor, so
+ * higher levels are faster but compress less
+ */
+void
+compress(BinaryCodec codec,
+         int level,
+         gsl::span<const std::byte> src,
+         std::vector<std::byte>& dst);
+
+/**
+ * Decompresses 'src', which was compressed with the given codec, into 'dst'. The size of 'dst' has
+ * to be the exact uncompressed size
+ */
+void
+decompress(BinaryCodec codec, gsl::span<const std::byte> src, gsl::span<std::byte> dst);
+
+} // namespace bin
@@ -1,8 +1,16 @@
 #include "io/BinaryPersistence.h"
+#include "io/AsyncFileWriter.h"
 
 #include "util/Transformation.h"
 
 #include <experimental/filesystem>
+#include <fstream>
+
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
 
 namespace bio = boost::iostreams;
 
@@ -35,11 +43,28 @@ BinaryPersistence::BinaryPersistence(const std::string& work_dir,
                                      const PointAttributes& input_attributes,
                                      const PointAttributes& output_attributes,
                                      Compressed compressed)
+  : BinaryPersistence(work_dir,
+                      input_attributes,
+                      output_attributes,
+                      compressed == Compressed::Yes ? BinaryCodec::LZ4 : BinaryCodec::None,
+                      0,
+                      compressed == Compressed::Yes ? BinaryEncoding::Filtered
+                                                    : BinaryEncoding::Plain)
+{}
+
+BinaryPersistence::BinaryPersistence(const std::string& work_dir,
+                                     const PointAttributes& input_attributes,
+                                     const PointAttributes& output_attributes,
+                                     BinaryCodec codec,
+                                     int codec_level,
+                                     BinaryEncoding encoding)
   : _work_dir(work_dir)
   , _input_attributes(input_attributes)
   , _output_attributes(output_attributes)
-  , _compressed(compressed)
-  , _file_extension(compressed == Compressed::Yes ? ".binz" : ".bin")
+  , _codec(codec)
+  , _codec_level(codec_level)
+  , _encoding(encoding)
+  , _file_extension(codec == BinaryCodec::None ? ".bin" : ".binz")
 {
   // Support for schema conversions (e.g. writing intensity values as RGB) is not currently
   // implemented for BinaryPersistence
@@ -57,320 +82,553 @@ BinaryPersistence::BinaryPersistence(const std::string& work_dir,
 
 BinaryPersistence::~BinaryPersistence() {}
 
-void
-BinaryPersistence::persist_points(PointBuffer const& points,
-                                  const AABB&,
-                                  const std::string& node_name)
+std::string
+BinaryPersistence::node_file_path(const OctreeNodeIndex64& node_index) const
 {
-  if (!points.count())
-    throw std::runtime_error{ "No points selected" };
+  return concat(_work_dir, "/", node_name_from_index(node_index), _file_extension);
+}
 
-  const auto file_path = concat(_work_dir, "/", node_name, _file_extension);
+namespace {
+struct Column
+{
+  // Bit in the properties bitmask, or 0 for positions, which every file contains
+  uint32_t bit;
+  bin::ColumnLayout layout;
+  // Filter that is applied to the column for BinaryEncoding::Filtered. Changing a filter changes
+  // the file format!
+  bin::ColumnFilter filter;
+};
+
+/**
+ * All attribute columns in the order in which they are stored
+ */
+const Column COLUMNS[] = {
+  { 0, { sizeof(double), 3 }, bin::ColumnFilter::DeltaShuffle },
+  { BinaryPersistence::COLOR_BIT, { sizeof(uint8_t), 3 }, bin::ColumnFilter::Shuffle },
+  { BinaryPersistence::NORMAL_BIT, { sizeof(float), 3 }, bin::ColumnFilter::Shuffle },
+  { BinaryPersistence::INTENSITY_BIT, { sizeof(uint16_t), 1 }, bin::ColumnFilter::DeltaShuffle },
+  { BinaryPersistence::CLASSIFICATION_BIT, { sizeof(uint8_t), 1 }, bin::ColumnFilter::RunLength },
+  { BinaryPersistence::EDGE_OF_FLIGHT_LINE_BIT,
+    { sizeof(uint8_t), 1 },
+    bin::ColumnFilter::RunLength },
+  { BinaryPersistence::GPS_TIME_BIT, { sizeof(double), 1 }, bin::ColumnFilter::DeltaShuffle },
+  { BinaryPersistence::NUMBER_OF_RETURN_BIT, { sizeof(uint8_t), 1 }, bin::ColumnFilter::RunLength },
+  { BinaryPersistence::RETURN_NUMBER_BIT, { sizeof(uint8_t), 1 }, bin::ColumnFilter::RunLength },
+  { BinaryPersistence::POINT_SOURCE_ID_BIT,
+    { sizeof(uint16_t), 1 },
+    bin::ColumnFilter::DeltaShuffle },
+  { BinaryPersistence::SCAN_ANGLE_RANK_BIT, { sizeof(int8_t), 1 }, bin::ColumnFilter::RunLength },
+  { BinaryPersistence::SCAN_DIRECTION_FLAG_BIT,
+    { sizeof(uint8_t), 1 },
+    bin::ColumnFilter::RunLength },
+  { BinaryPersistence::USER_DATA_BIT, { sizeof(uint8_t), 1 }, bin::ColumnFilter::RunLength },
+};
 
-  bio::file_sink fs{ file_path, std::ios::out | std::ios::binary };
-  if (!fs.is_open()) {
-    std::cerr << "Could not write points file " << file_path << std::endl;
-    return;
-  }
+bool
+has_column(const Column& column, uint32_t properties_bitmask)
+{
+  return !column.bit || (properties_bitmask & column.bit);
+}
+
+constexpr size_t PayloadHeaderSize = sizeof(uint32_t) + sizeof(uint64_t);
 
-  bio::filtering_ostream stream;
-  if (_compressed == Compressed::Yes) {
-    bio::zlib_params zlib_params;
-    zlib_params.level = bio::zlib::best_speed;
-    stream.push(bio::zlib_compressor{ zlib_params, 1 << 18 });
+size_t
+align_offset(size_t offset, size_t alignment)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+void
+read_payload_header(gsl::span<const std::byte> payload,
+                    uint32_t& properties_bitmask,
+                    uint64_t& points_count)
+{
+  if (static_cast<size_t>(payload.size()) < PayloadHeaderSize) {
+    throw std::runtime_error{ "Points file is truncated" };
   }
-  stream.push(fs);
+  std::memcpy(&properties_bitmask, payload.data(), sizeof(uint32_t));
+  std::memcpy(&points_count, payload.data() + sizeof(uint32_t), sizeof(uint64_t));
+}
 
-  const auto has_colors =
-    (points.hasColors() && has_attribute(_output_attributes, PointAttribute::RGB));
-  const auto has_normals =
-    (points.hasNormals() && has_attribute(_output_attributes, PointAttribute::Normal));
-  const auto has_intensities =
-    (points.hasIntensities() && has_attribute(_output_attributes, PointAttribute::Intensity));
-  const auto has_classifications =
-    (points.hasClassifications() &&
-     has_attribute(_output_attributes, PointAttribute::Classification));
-  const auto has_edge_of_flight_lines =
-    (points.has_edge_of_flight_lines() &&
-     has_attribute(_output_attributes, PointAttribute::EdgeOfFlightLine));
-  const auto has_gps_times =
-    (points.has_gps_times() && has_attribute(_output_attributes, PointAttribute::GPSTime));
-  const auto has_number_of_returns =
-    (points.has_number_of_returns() &&
-     has_attribute(_output_attributes, PointAttribute::NumberOfReturns));
-  const auto has_return_numbers = (points.has_return_numbers() &&
-                                   has_attribute(_output_attributes, PointAttribute::ReturnNumber));
-  const auto has_point_source_ids =
-    (points.has_point_source_ids() &&
-     has_attribute(_output_attributes, PointAttribute::PointSourceID));
-  const auto has_scan_angle_ranks =
-    (points.has_scan_angle_ranks() &&
-     has_attribute(_output_attributes, PointAttribute::ScanAngleRank));
-  const auto has_scan_direction_flags =
-    (points.has_scan_direction_flags() &&
-     has_attribute(_output_attributes, PointAttribute::ScanDirectionFlag));
-  const auto has_user_data =
-    (points.has_user_data() && has_attribute(_output_attributes, PointAttribute::UserData));
+/**
+ * Calls 'func' with every column that exists for the given properties bitmask and the offset of
+ * the column in the plain point data, where columns start at multiples of 'alignment'. Returns the
+ * size of the plain point data
+ */
+template<typename Func>
+size_t
+for_each_column(uint32_t properties_bitmask,
+                uint64_t points_count,
+                size_t alignment,
+                Func func)
+{
+  auto offset = align_offset(PayloadHeaderSize, alignment);
+  for (auto& column : COLUMNS) {
+    if (!has_column(column, properties_bitmask))
+      continue;
+    func(column, offset);
+    offset = align_offset(offset + column.layout.bytes_per_point() * points_count, alignment);
+  }
+  return offset;
+}
 
-  const uint32_t properties_bitmask =
-    (has_colors ? COLOR_BIT : 0u) | (has_normals ? NORMAL_BIT : 0u) |
-    (has_intensities ? INTENSITY_BIT : 0u) | (has_classifications ? CLASSIFICATION_BIT : 0u) |
-    (has_edge_of_flight_lines ? EDGE_OF_FLIGHT_LINE_BIT : 0u) |
-    (has_gps_times ? GPS_TIME_BIT : 0u) | (has_number_of_returns ? NUMBER_OF_RETURN_BIT : 0u) |
-    (has_return_numbers ? RETURN_NUMBER_BIT : 0u) |
-    (has_point_source_ids ? POINT_SOURCE_ID_BIT : 0u) |
-    (has_scan_angle_ranks ? SCAN_ANGLE_RANK_BIT : 0u) |
-    (has_scan_direction_flags ? SCAN_DIRECTION_FLAG_BIT : 0u) |
-    (has_user_data ? USER_DATA_BIT : 0u);
+/**
+ * Copies 'payload', whose columns are either filtered or stored without alignment, into 'decoded'
+ * so that all columns are unfiltered and aligned. Returns the aligned point data
+ */
+gsl::span<const std::byte>
+decode_payload(gsl::span<const std::byte> payload,
+               bool filtered,
+               size_t alignment,
+               std::vector<std::byte>& decoded)
+{
+  uint32_t properties_bitmask;
+  uint64_t points_count;
+  read_payload_header(payload, properties_bitmask, points_count);
+
+  decoded.resize(for_each_column(properties_bitmask, points_count, alignment, [](auto&, auto) {}));
+  std::fill(std::begin(decoded), std::end(decoded), std::byte{ 0 });
+  std::memcpy(decoded.data(), payload.data(), PayloadHeaderSize);
+
+  auto src = payload.data() + PayloadHeaderSize;
+  const auto src_end = payload.data() + payload.size();
+  for_each_column(
+    properties_bitmask, points_count, alignment, [&](const Column& column, size_t offset) {
+      const auto filter = filtered ? column.filter : bin::ColumnFilter::None;
+      src = bin::decode_column(
+        filter, column.layout, points_count, src, src_end, decoded.data() + offset);
+    });
+
+  return decoded;
+}
 
-  write_binary(properties_bitmask, stream);
-  write_binary(static_cast<uint64_t>(points.count()), stream);
+template<typename T>
+gsl::span<const T>
+view_column(gsl::span<const std::byte> payload, size_t offset, uint64_t points_count)
+{
+  return { reinterpret_cast<const T*>(payload.data() + offset),
+           static_cast<std::ptrdiff_t>(points_count) };
+}
 
-  // OPTIMIZATION attributes are stored as struct of arrays, so writing one
-  // attribute for all points should be: write_binary(points.ATTRIBUTE, stream)
+/**
+ * Returns a view of the points in the given unfiltered, aligned point data
+ */
+PointBufferView
+view_payload(gsl::span<const std::byte> payload, size_t alignment, const std::string& file_path)
+{
+  uint32_t properties_bitmask;
+  uint64_t points_count;
+  read_payload_header(payload, properties_bitmask, points_count);
 
-  for (auto point : points) {
-    write_binary(point.position(), stream);
+  const auto payload_size =
+    for_each_column(properties_bitmask, points_count, alignment, [](auto&, auto) {});
+  if (static_cast<size_t>(payload.size()) < payload_size) {
+    throw std::runtime_error{ concat("Points file ", file_path, " is truncated") };
   }
 
-  if (has_colors) {
-    for (auto point : points) {
-      write_binary(*point.rgbColor(), stream);
-    }
-  }
+  // TODO BinaryPersistence does not yet support reading different attributes than it writes, but
+  // once it does, we potentially have to skip some data while reading
 
-  if (has_normals) {
-    for (auto point : points) {
-      write_binary(*point.normal(), stream);
-    }
-  }
+  PointBufferView view;
+  view.count = points_count;
+  for_each_column(
+    properties_bitmask, points_count, alignment, [&](const Column& column, size_t offset) {
+      switch (column.bit) {
+        case 0:
+          view.positions = view_column<Vector3<double>>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::COLOR_BIT:
+          view.rgb_colors = view_column<Vector3<uint8_t>>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::NORMAL_BIT:
+          view.normals = view_column<Vector3<float>>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::INTENSITY_BIT:
+          view.intensities = view_column<uint16_t>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::CLASSIFICATION_BIT:
+          view.classifications = view_column<uint8_t>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::EDGE_OF_FLIGHT_LINE_BIT:
+          view.edge_of_flight_lines = view_column<uint8_t>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::GPS_TIME_BIT:
+          view.gps_times = view_column<double>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::NUMBER_OF_RETURN_BIT:
+          view.number_of_returns = view_column<uint8_t>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::RETURN_NUMBER_BIT:
+          view.return_numbers = view_column<uint8_t>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::POINT_SOURCE_ID_BIT:
+          view.point_source_ids = view_column<uint16_t>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::SCAN_ANGLE_RANK_BIT:
+          view.scan_angle_ranks = view_column<int8_t>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::SCAN_DIRECTION_FLAG_BIT:
+          view.scan_direction_flags = view_column<uint8_t>(payload, offset, points_count);
+          break;
+        case BinaryPersistence::USER_DATA_BIT:
+          view.user_data = view_column<uint8_t>(payload, offset, points_count);
+          break;
+      }
+    });
+  return view;
+}
 
-  if (has_intensities) {
-    for (auto point : points) {
-      write_binary(*point.intensity(), stream);
-    }
-  }
+/**
+ * Decompresses a file in the legacy format, which has no header and is compressed with zlib
+ */
+void
+decompress_legacy_payload(gsl::span<const std::byte> file_data, std::vector<std::byte>& payload)
+{
+  std::vector<char> decompressed;
+  bio::filtering_istream stream;
+  stream.push(bio::zlib_decompressor{});
+  stream.push(bio::array_source{ reinterpret_cast<const char*>(file_data.data()),
+                                 static_cast<size_t>(file_data.size()) });
+  bio::copy(stream, bio::back_inserter(decompressed));
 
-  if (has_classifications) {
-    for (auto point : points) {
-      write_binary(*point.classification(), stream);
-    }
-  }
+  payload.resize(decompressed.size());
+  std::memcpy(payload.data(), decompressed.data(), decompressed.size());
+}
 
-  if (has_edge_of_flight_lines) {
-    for (auto point : points) {
-      write_binary(*point.edge_of_flight_line(), stream);
+/**
+ * Returns a view of the points in the given file. Uncompressed, unfiltered files are viewed in
+ * place, all other files are decompressed into 'decompressed' and decoded into 'decoded' first
+ */
+PointBufferView
+view_file(gsl::span<const std::byte> file_data,
+          bool legacy_compressed,
+          size_t alignment,
+          const std::string& file_path,
+          std::vector<std::byte>& decompressed,
+          std::vector<std::byte>& decoded)
+{
+  bin::FileHeader header;
+  if (!bin::read_file_header(file_data, header)) {
+    if (legacy_compressed) {
+      decompress_legacy_payload(file_data, decompressed);
+      file_data = decompressed;
     }
+    return view_payload(decode_payload(file_data, false, alignment, decoded), alignment, file_path);
   }
 
-  if (has_gps_times) {
-    for (auto point : points) {
-      write_binary(*point.gps_time(), stream);
-    }
+  auto stored_payload = file_data.subspan(bin::FileHeader::Size);
+  if (header.codec != BinaryCodec::None) {
+    decompressed.resize(header.uncompressed_size);
+    bin::decompress(header.codec, stored_payload, decompressed);
+    stored_payload = decompressed;
   }
 
-  if (has_number_of_returns) {
-    for (auto point : points) {
-      write_binary(*point.number_of_returns(), stream);
-    }
+  switch (header.encoding) {
+    case BinaryEncoding::Plain:
+      // Files before version 3 have no padding between their columns
+      if (header.version < 3) {
+        stored_payload = decode_payload(stored_payload, false, alignment, decoded);
+      }
+      return view_payload(stored_payload, alignment, file_path);
+    case BinaryEncoding::Filtered:
+      return view_payload(
+        decode_payload(stored_payload, true, alignment, decoded), alignment, file_path);
+    default:
+      throw std::runtime_error{ concat(
+        "Unknown encoding ", static_cast<int>(header.encoding), " in points file ", file_path) };
   }
+}
 
-  if (has_return_numbers) {
-    for (auto point : points) {
-      write_binary(*point.return_number(), stream);
-    }
+/**
+ * Memory-maps the given file. Returns false if the file could not be opened
+ */
+bool
+map_file(const std::string& file_path, bio::mapped_file_source& file)
+{
+  try {
+    file.open(file_path);
+  } catch (const std::exception&) {
+    std::cerr << "Could not read points file " << file_path << std::endl;
+    return false;
   }
+  return file.is_open();
+}
 
-  if (has_point_source_ids) {
-    for (auto point : points) {
-      write_binary(*point.point_source_id(), stream);
-    }
-  }
+gsl::span<const std::byte>
+mapped_data(const bio::mapped_file_source& file)
+{
+  return { reinterpret_cast<const std::byte*>(file.data()),
+           static_cast<std::ptrdiff_t>(file.size()) };
+}
+} // namespace
+
+static_assert(sizeof(Vector3<double>) == 3 * sizeof(double),
+              "Vector3<double> is padded. This breaks BinaryPersistence encoding!");
+static_assert(sizeof(Vector3<float>) == 3 * sizeof(float),
+              "Vector3<float> is padded. This breaks BinaryPersistence encoding!");
+static_assert(sizeof(Vector3<uint8_t>) == 3 * sizeof(uint8_t),
+              "Vector3<uint8_t> is padded. This breaks BinaryPersistence encoding!");
+
+/**
+ * Applies the column filters to the point data behind the header in 'file_buffer'. Returns a
+ * buffer with room for the header followed by the filtered point data, which has no padding
+ * between its columns
+ */
+static gsl::span<std::byte>
+filter_file_buffer(gsl::span<const std::byte> file_buffer, size_t alignment)
+{
+  const auto payload = file_buffer.subspan(bin::FileHeader::Size);
+  uint32_t properties_bitmask;
+  uint64_t points_count;
+  read_payload_header(payload, properties_bitmask, points_count);
 
-  if (has_scan_angle_ranks) {
-    for (auto point : points) {
-      write_binary(*point.scan_angle_rank(), stream);
+  size_t max_size = bin::FileHeader::Size + PayloadHeaderSize;
+  for (auto& column : COLUMNS) {
+    if (has_column(column, properties_bitmask)) {
+      max_size += bin::max_encoded_column_size(column.filter, column.layout, points_count);
     }
   }
 
-  if (has_scan_direction_flags) {
-    for (auto point : points) {
-      write_binary(*point.scan_direction_flag(), stream);
-    }
-  }
+  thread_local std::vector<std::byte> encoded_buffer;
+  encoded_buffer.resize(max_size);
 
-  if (has_user_data) {
-    for (auto point : points) {
-      write_binary(*point.user_data(), stream);
-    }
-  }
+  std::memcpy(encoded_buffer.data() + bin::FileHeader::Size, payload.data(), PayloadHeaderSize);
+  auto dst = encoded_buffer.data() + bin::FileHeader::Size + PayloadHeaderSize;
+  for_each_column(
+    properties_bitmask, points_count, alignment, [&](const Column& column, size_t offset) {
+      dst = bin::encode_column(
+        column.filter, column.layout, points_count, payload.data() + offset, dst);
+    });
 
-  stream.pop();
+  return { encoded_buffer.data(), dst };
 }
 
-void
-BinaryPersistence::retrieve_points(const std::string& node_name, PointBuffer& points)
+gsl::span<std::byte>
+BinaryPersistence::prepare_file_buffer(uint32_t properties_bitmask, size_t points_count)
 {
-  const auto file_path = concat(_work_dir, "/", node_name, _file_extension);
-  if (!std::experimental::filesystem::exists(file_path))
-    return;
+  thread_local std::vector<std::byte> file_buffer;
+  file_buffer.resize(bin::FileHeader::Size + for_each_column(properties_bitmask,
+                                                             points_count,
+                                                             ColumnAlignment,
+                                                             [](auto&, auto) {}));
+  assert(reinterpret_cast<uintptr_t>(file_buffer.data()) % ColumnAlignment == 0);
+
+  const uint64_t points_count_64 = points_count;
+  auto dst = file_buffer.data() + bin::FileHeader::Size;
+  std::memcpy(dst, &properties_bitmask, sizeof(uint32_t));
+  std::memcpy(dst + sizeof(uint32_t), &points_count_64, sizeof(uint64_t));
+  std::memset(dst + PayloadHeaderSize, 0, PayloadOffset - bin::FileHeader::Size - PayloadHeaderSize);
+
+  return { file_buffer.data(), static_cast<std::ptrdiff_t>(file_buffer.size()) };
+}
 
-  bio::file_source fs{ file_path, std::ios::in | std::ios::binary };
-  if (!fs.is_open()) {
-    std::cerr << "Could not read points file " << file_path << std::endl;
-    return;
+gsl::span<const std::byte>
+BinaryPersistence::encode_file_buffer(gsl::span<std::byte> file_buffer) const
+{
+  if (_encoding == BinaryEncoding::Filtered) {
+    file_buffer = filter_file_buffer(file_buffer, ColumnAlignment);
   }
 
-  bio::filtering_istream stream;
-  if (_compressed == Compressed::Yes) {
-    stream.push(bio::zlib_decompressor{});
-  }
-  stream.push(fs);
+  const auto payload = file_buffer.subspan(bin::FileHeader::Size);
+  const auto payload_size = static_cast<uint64_t>(payload.size());
 
-  uint32_t properties_bitmask;
-  uint64_t points_count;
-
-  read_binary(properties_bitmask, stream);
-  read_binary(points_count, stream);
+  if (_codec == BinaryCodec::None) {
+    // The point data is already in place behind the header, so no copy is necessary
+    bin::write_file_header(file_buffer, _codec, _encoding, payload_size);
+    return file_buffer;
+  }
 
-  // TODO BinaryPersistence does not yet support reading different attributes than it writes, but
-  // once it does, we potentially have to skip some data while reading
+  thread_local std::vector<std::byte> compressed_buffer;
+  compressed_buffer.resize(bin::FileHeader::Size);
+  bin::compress(_codec, _codec_level, payload, compressed_buffer);
+  bin::write_file_header(compressed_buffer, _codec, _encoding, payload_size);
+  return { compressed_buffer.data(), static_cast<std::ptrdiff_t>(compressed_buffer.size()) };
+}
 
-  const auto has_colors = (properties_bitmask & COLOR_BIT) != 0;
-  const auto has_normals = (properties_bitmask & NORMAL_BIT) != 0;
-  const auto has_intensities = (properties_bitmask & INTENSITY_BIT) != 0;
-  const auto has_classifications = (properties_bitmask & CLASSIFICATION_BIT) != 0;
-  const auto has_edge_of_flight_lines = (properties_bitmask & EDGE_OF_FLIGHT_LINE_BIT) != 0;
-  const auto has_gps_times = (properties_bitmask & GPS_TIME_BIT) != 0;
-  const auto has_number_of_returns = (properties_bitmask & NUMBER_OF_RETURN_BIT) != 0;
-  const auto has_return_numbers = (properties_bitmask & RETURN_NUMBER_BIT) != 0;
-  const auto has_point_source_ids = (properties_bitmask & POINT_SOURCE_ID_BIT) != 0;
-  const auto has_scan_angle_ranks = (properties_bitmask & SCAN_ANGLE_RANK_BIT) != 0;
-  const auto has_scan_direction_flags = (properties_bitmask & SCAN_DIRECTION_FLAG_BIT) != 0;
-  const auto has_user_data = (properties_bitmask & USER_DATA_BIT) != 0;
-
-  std::vector<Vector3<double>> positions;
-  std::vector<Vector3<uint8_t>> colors;
-  std::vector<Vector3<float>> normals;
-  std::vector<uint16_t> intensities;
-  std::vector<uint8_t> classifications;
-  std::vector<uint8_t> edge_of_flight_lines;
-  std::vector<double> gps_times;
-  std::vector<uint8_t> number_of_returns;
-  std::vector<uint8_t> return_numbers;
-  std::vector<uint16_t> point_source_ids;
-  std::vector<int8_t> scan_angle_ranks;
-  std::vector<uint8_t> scan_direction_flags;
-  std::vector<uint8_t> user_data;
-
-  positions.resize(points_count);
-  for (auto& position : positions) {
-    read_binary(position, stream);
+void
+BinaryPersistence::write_file(const std::string& file_path,
+                              gsl::span<const std::byte> file_contents)
+{
+  if (!write_file_async(
+        file_path, file_contents.data(), static_cast<size_t>(file_contents.size()))) {
+    std::cerr << "Could not write points file " << file_path << std::endl;
   }
+}
 
-  if (has_colors) {
-    colors.resize(points_count);
-    for (auto& color : colors) {
-      read_binary(color, stream);
-    }
-  }
+gsl::span<const std::byte>
+BinaryPersistence::encode_points(const PointBuffer& points) const
+{
+  if (points.empty())
+    return {};
 
-  if (has_normals) {
-    normals.resize(points_count);
-    for (auto& normal : normals) {
-      read_binary(normal, stream);
-    }
-  }
+  const auto has_colors =
+    points.hasColors() && has_attribute(_output_attributes, PointAttribute::RGB);
+  const auto has_normals =
+    points.hasNormals() && has_attribute(_output_attributes, PointAttribute::Normal);
+  const auto has_intensities =
+    points.hasIntensities() && has_attribute(_output_attributes, PointAttribute::Intensity);
+  const auto has_classifications =
+    points.hasClassifications() &&
+    has_attribute(_output_attributes, PointAttribute::Classification);
+  const auto has_edge_of_flight_lines =
+    points.has_edge_of_flight_lines() &&
+    has_attribute(_output_attributes, PointAttribute::EdgeOfFlightLine);
+  const auto has_gps_times =
+    points.has_gps_times() && has_attribute(_output_attributes, PointAttribute::GPSTime);
+  const auto has_number_of_returns =
+    points.has_number_of_returns() &&
+    has_attribute(_output_attributes, PointAttribute::NumberOfReturns);
+  const auto has_return_numbers =
+    points.has_return_numbers() && has_attribute(_output_attributes, PointAttribute::ReturnNumber);
+  const auto has_point_source_ids =
+    points.has_point_source_ids() &&
+    has_attribute(_output_attributes, PointAttribute::PointSourceID);
+  const auto has_scan_angle_ranks =
+    points.has_scan_angle_ranks() &&
+    has_attribute(_output_attributes, PointAttribute::ScanAngleRank);
+  const auto has_scan_direction_flags =
+    points.has_scan_direction_flags() &&
+    has_attribute(_output_attributes, PointAttribute::ScanDirectionFlag);
+  const auto has_user_data =
+    points.has_user_data() && has_attribute(_output_attributes, PointAttribute::UserData);
 
-  if (has_intensities) {
-    intensities.resize(points_count);
-    for (auto& intensity : intensities) {
-      read_binary(intensity, stream);
-    }
-  }
+  const uint32_t properties_bitmask =
+    (has_colors ? COLOR_BIT : 0u) | (has_normals ? NORMAL_BIT : 0u) |
+    (has_intensities ? INTENSITY_BIT : 0u) | (has_classifications ? CLASSIFICATION_BIT : 0u) |
+    (has_edge_of_flight_lines ? EDGE_OF_FLIGHT_LINE_BIT : 0u) |
+    (has_gps_times ? GPS_TIME_BIT : 0u) | (has_number_of_returns ? NUMBER_OF_RETURN_BIT : 0u) |
+    (has_return_numbers ? RETURN_NUMBER_BIT : 0u) |
+    (has_point_source_ids ? POINT_SOURCE_ID_BIT : 0u) |
+    (has_scan_angle_ranks ? SCAN_ANGLE_RANK_BIT : 0u) |
+    (has_scan_direction_flags ? SCAN_DIRECTION_FLAG_BIT : 0u) |
+    (has_user_data ? USER_DATA_BIT : 0u);
 
-  if (has_classifications) {
-    classifications.resize(points_count);
-    for (auto& classification : classifications) {
-      read_binary(classification, stream);
-    }
-  }
+  auto file_buffer = prepare_file_buffer(properties_bitmask, points.count());
+  auto dst = file_buffer.data() + PayloadOffset;
+
+  dst = write_column(dst, points.positions());
+  if (has_colors)
+    dst = write_column(dst, points.rgbColors());
+  if (has_normals)
+    dst = write_column(dst, points.normals());
+  if (has_intensities)
+    dst = write_column(dst, points.intensities());
+  if (has_classifications)
+    dst = write_column(dst, points.classifications());
+  if (has_edge_of_flight_lines)
+    dst = write_column(dst, points.edge_of_flight_lines());
+  if (has_gps_times)
+    dst = write_column(dst, points.gps_times());
+  if (has_number_of_returns)
+    dst = write_column(dst, points.number_of_returns());
+  if (has_return_numbers)
+    dst = write_column(dst, points.return_numbers());
+  if (has_point_source_ids)
+    dst = write_column(dst, points.point_source_ids());
+  if (has_scan_angle_ranks)
+    dst = write_column(dst, points.scan_angle_ranks());
+  if (has_scan_direction_flags)
+    dst = write_column(dst, points.scan_direction_flags());
+  if (has_user_data)
+    dst = write_column(dst, points.user_data());
+
+  assert(dst == file_buffer.data() + file_buffer.size());
+
+  return encode_file_buffer(file_buffer);
+}
 
-  if (has_edge_of_flight_lines) {
-    edge_of_flight_lines.resize(points_count);
-    for (auto& edge_of_flight_line : edge_of_flight_lines) {
-      read_binary(edge_of_flight_line, stream);
-    }
-  }
+void
+BinaryPersistence::persist_points(PointBuffer const& points,
+                                  const AABB& bounds,
+                                  const OctreeNodeIndex64& node_index)
+{
+  if (!points.count())
+    throw std::runtime_error{ "No points selected" };
 
-  if (has_gps_times) {
-    gps_times.resize(points_count);
-    for (auto& gps_time : gps_times) {
-      read_binary(gps_time, stream);
-    }
-  }
+  write_file(node_file_path(node_index), encode_points(points));
+}
 
-  if (has_number_of_returns) {
-    number_of_returns.resize(points_count);
-    for (auto& number : number_of_returns) {
-      read_binary(number, stream);
-    }
-  }
+void
+BinaryPersistence::retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
+{
+  const auto file_path = node_file_path(node_index);
+  wait_for_file_write(file_path);
+  if (!std::experimental::filesystem::exists(file_path))
+    return;
 
-  if (has_return_numbers) {
-    return_numbers.resize(points_count);
-    for (auto& return_number : return_numbers) {
-      read_binary(return_number, stream);
-    }
-  }
+  bio::mapped_file_source file;
+  if (!map_file(file_path, file))
+    return;
 
-  if (has_point_source_ids) {
-    point_source_ids.resize(points_count);
-    for (auto& id : point_source_ids) {
-      read_binary(id, stream);
-    }
-  }
+  thread_local std::vector<std::byte> decompressed;
+  thread_local std::vector<std::byte> decoded;
+  const auto view = view_file(mapped_data(file),
+                              _file_extension == ".binz",
+                              ColumnAlignment,
+                              file_path,
+                              decompressed,
+                              decoded);
+
+  points = {};
+  points.append_buffer(view);
+}
 
-  if (has_scan_angle_ranks) {
-    scan_angle_ranks.resize(points_count);
-    for (auto& rank : scan_angle_ranks) {
-      read_binary(rank, stream);
-    }
-  }
+std::optional<BinaryPersistence::MappedPoints>
+BinaryPersistence::map_points(const OctreeNodeIndex64& node_index) const
+{
+  const auto file_path = node_file_path(node_index);
+  wait_for_file_write(file_path);
+  if (!std::experimental::filesystem::exists(file_path))
+    return std::nullopt;
+
+  MappedPoints mapped_points;
+  if (!map_file(file_path, mapped_points.file))
+    return std::nullopt;
+
+  mapped_points.points = view_file(mapped_data(mapped_points.file),
+                                   _file_extension == ".binz",
+                                   ColumnAlignment,
+                                   file_path,
+                                   mapped_points.decompressed_data,
+                                   mapped_points.decoded_data);
+  return std::make_optional(std::move(mapped_points));
+}
 
-  if (has_scan_direction_flags) {
-    scan_direction_flags.resize(points_count);
-    for (auto& flag : scan_direction_flags) {
-      read_binary(flag, stream);
-    }
-  }
+void
+BinaryPersistence::append_points(const OctreeNodeIndex64& node_index, PointBuffer& points) const
+{
+  const auto file_path = node_file_path(node_index);
+  wait_for_file_write(file_path);
+  if (!std::experimental::filesystem::exists(file_path))
+    return;
 
-  if (has_user_data) {
-    user_data.resize(points_count);
-    for (auto& data : user_data) {
-      read_binary(data, stream);
-    }
-  }
+  bio::mapped_file_source file;
+  if (!map_file(file_path, file))
+    return;
 
-  points = { points_count,
-             std::move(positions),
-             std::move(colors),
-             std::move(normals),
-             std::move(intensities),
-             std::move(classifications),
-             std::move(edge_of_flight_lines),
-             std::move(gps_times),
-             std::move(number_of_returns),
-             std::move(return_numbers),
-             std::move(point_source_ids),
-             std::move(scan_direction_flags),
-             std::move(scan_angle_ranks),
-             std::move(user_data) };
+  thread_local std::vector<std::byte> decompressed;
+  thread_local std::vector<std::byte> decoded;
+  points.append_buffer(view_file(mapped_data(file),
+                                 _file_extension == ".binz",
+                                 ColumnAlignment,
+                                 file_path,
+                                 decompressed,
+                                 decoded));
+}
+
+PointBufferView
+BinaryPersistence::view_encoded_points(gsl::span<const std::byte> data,
+                                       const std::string& source,
+                                       std::vector<std::byte>& decompressed,
+                                       std::vector<std::byte>& decoded)
+{
+  return view_file(data, false, ColumnAlignment, source, decompressed, decoded);
 }
 
 bool
-BinaryPersistence::node_exists(const std::string& node_name) const
+BinaryPersistence::node_exists(const OctreeNodeIndex64& node_index) const
 {
-  const auto file_path = concat(_work_dir, "/", node_name, _file_extension);
+  const auto file_path = node_file_path(node_index);
+  wait_for_file_write(file_path);
   return fs::exists(file_path);
 }
\ No newline at end of file
@@ -1,22 +1,26 @@
 #pragma once
 
+#include "datastructures/OctreeNodeIndex.h"
 #include "datastructures/PointBuffer.h"
+#include "io/BinaryCodec.h"
 #include "io/io_util.h"
 #include "math/AABB.h"
 #include "pointcloud/PointAttributes.h"
 #include "util/Definitions.h"
 #include "util/stuff.h"
 
-#include <boost/iostreams/copy.hpp>
-#include <boost/iostreams/device/file.hpp>
-#include <boost/iostreams/filter/zlib.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/scope_exit.hpp>
+#include <cassert>
+#include <cstring>
+#include <optional>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <gsl/gsl>
 
 struct SRSTransformHelper;
 
 /**
- * Sink for writing binary point files
+ * Sink for writing binary point files. Each file consists of a bin::FileHeader followed by the
+ * point data, which is compressed with the BinaryCodec that is stored in the header
  */
 struct BinaryPersistence
 {
@@ -36,68 +40,83 @@ struct BinaryPersistence
 
   static PointAttributes supported_output_attributes();
 
+  /**
+   * Creates a BinaryPersistence that writes uncompressed files or filters and compresses them with
+   * LZ4, which is the fastest of the supported codecs
+   */
   BinaryPersistence(const std::string& work_dir,
                     const PointAttributes& input_attributes,
                     const PointAttributes& output_attributes,
                     Compressed compressed = Compressed::Yes);
+  /**
+   * Creates a BinaryPersistence that compresses all files with the given codec. A 'codec_level' of
+   * 0 selects the default level of the codec. With BinaryEncoding::Filtered, the attribute columns
+   * are delta-, shuffle- or run-length-encoded before compression
+   */
+  BinaryPersistence(const std::string& work_dir,
+                    const PointAttributes& input_attributes,
+                    const PointAttributes& output_attributes,
+                    BinaryCodec codec,
+                    int codec_level = 0,
+                    BinaryEncoding encoding = BinaryEncoding::Filtered);
   ~BinaryPersistence();
 
   template<typename Iter>
   void persist_points(Iter points_begin,
                       Iter points_end,
                       const AABB& bounds,
-                      const std::string& node_name)
+                      const OctreeNodeIndex64& node_index)
   {
-    const auto points_count = std::distance(points_begin, points_end);
-    if (!points_count)
+    const auto encoded_points = encode_points(points_begin, points_end);
+    if (encoded_points.empty())
       return;
 
-    const auto file_path = concat(_work_dir, "/", node_name, _file_extension);
-
-    boost::iostreams::file_sink fs{ file_path, std::ios::out | std::ios::binary };
-    if (!fs.is_open()) {
-      std::cerr << "Could not write points file " << file_path << std::endl;
-      return;
-    }
+    write_file(node_file_path(node_index), encoded_points);
+  }
 
-    boost::iostreams::filtering_ostream stream;
-    if (_compressed == Compressed::Yes) {
-      boost::iostreams::zlib_params zlib_params;
-      zlib_params.level = boost::iostreams::zlib::best_speed;
-      stream.push(boost::iostreams::zlib_compressor{ zlib_params, 1 << 18 });
-    }
-    stream.push(fs);
+  /**
+   * Encodes the given points into the contents of a points file, i.e. a bin::FileHeader followed by
+   * the (possibly filtered and compressed) point data. The returned memory is reused by the next
+   * call from the same thread. Returns an empty span if there are no points
+   */
+  template<typename Iter>
+  gsl::span<const std::byte> encode_points(Iter points_begin, Iter points_end) const
+  {
+    const auto points_count = std::distance(points_begin, points_end);
+    if (!points_count)
+      return {};
 
-    const auto has_colors = ((points_begin->rgbColor() != nullptr) &&
+    const auto& first_point = *points_begin;
+    const auto has_colors = ((first_point.rgbColor() != nullptr) &&
                              has_attribute(_output_attributes, PointAttribute::RGB));
-    const auto has_normals = ((points_begin->normal() != nullptr) &&
+    const auto has_normals = ((first_point.normal() != nullptr) &&
                               has_attribute(_output_attributes, PointAttribute::Normal));
-    const auto has_intensities = ((points_begin->intensity() != nullptr) &&
+    const auto has_intensities = ((first_point.intensity() != nullptr) &&
                                   has_attribute(_output_attributes, PointAttribute::Intensity));
     const auto has_classifications =
-      ((points_begin->classification() != nullptr) &&
+      ((first_point.classification() != nullptr) &&
        has_attribute(_output_attributes, PointAttribute::Classification));
     const auto has_edge_of_flight_lines =
-      ((points_begin->edge_of_flight_line() != nullptr) &&
+      ((first_point.edge_of_flight_line() != nullptr) &&
        has_attribute(_output_attributes, PointAttribute::EdgeOfFlightLine));
-    const auto has_gps_times = ((points_begin->gps_time() != nullptr) &&
+    const auto has_gps_times = ((first_point.gps_time() != nullptr) &&
                                 has_attribute(_output_attributes, PointAttribute::GPSTime));
     const auto has_number_of_returns =
-      ((points_begin->number_of_returns() != nullptr) &&
+      ((first_point.number_of_returns() != nullptr) &&
        has_attribute(_output_attributes, PointAttribute::NumberOfReturns));
     const auto has_return_numbers =
-      ((points_begin->return_number() != nullptr) &&
+      ((first_point.return_number() != nullptr) &&
        has_attribute(_output_attributes, PointAttribute::ReturnNumber));
     const auto has_point_source_ids =
-      ((points_begin->point_source_id() != nullptr) &&
+      ((first_point.point_source_id() != nullptr) &&
        has_attribute(_output_attributes, PointAttribute::PointSourceID));
     const auto has_scan_angle_ranks =
-      ((points_begin->scan_angle_rank() != nullptr) &&
+      ((first_point.scan_angle_rank() != nullptr) &&
        has_attribute(_output_attributes, PointAttribute::ScanAngleRank));
     const auto has_scan_direction_flags =
-      ((points_begin->scan_direction_flag() != nullptr) &&
+      ((first_point.scan_direction_flag() != nullptr) &&
        has_attribute(_output_attributes, PointAttribute::ScanDirectionFlag));
-    const auto has_user_data = ((points_begin->user_data() != nullptr) &&
+    const auto has_user_data = ((first_point.user_data() != nullptr) &&
                                 has_attribute(_output_attributes, PointAttribute::UserData));
 
     const uint32_t properties_bitmask =
@@ -111,99 +130,206 @@ struct BinaryPersistence
       (has_scan_direction_flags ? SCAN_DIRECTION_FLAG_BIT : 0u) |
       (has_user_data ? USER_DATA_BIT : 0u);
 
-    write_binary(properties_bitmask, stream);
-    write_binary(static_cast<uint64_t>(points_count), stream);
+    auto file_buffer = prepare_file_buffer(properties_bitmask, static_cast<size_t>(points_count));
+    auto dst = file_buffer.data() + PayloadOffset;
 
-    std::for_each(
-      points_begin, points_end, [&stream](auto& point) { write_binary(point.position(), stream); });
+    dst = write_column(
+      dst, points_begin, points_end, [](const auto& point) { return point.position(); });
 
     if (has_colors) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.rgbColor(), stream);
-      });
+      dst = write_column(
+        dst, points_begin, points_end, [](const auto& point) { return *point.rgbColor(); });
     }
 
     if (has_normals) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.normal(), stream);
-      });
+      dst = write_column(
+        dst, points_begin, points_end, [](const auto& point) { return *point.normal(); });
     }
 
     if (has_intensities) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.intensity(), stream);
-      });
+      dst = write_column(
+        dst, points_begin, points_end, [](const auto& point) { return *point.intensity(); });
     }
 
     if (has_classifications) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.classification(), stream);
-      });
+      dst = write_column(
+        dst, points_begin, points_end, [](const auto& point) { return *point.classification(); });
     }
 
     if (has_edge_of_flight_lines) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.edge_of_flight_line(), stream);
+      dst = write_column(dst, points_begin, points_end, [](const auto& point) {
+        return *point.edge_of_flight_line();
       });
     }
 
     if (has_gps_times) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.gps_time(), stream);
-      });
+      dst = write_column(
+        dst, points_begin, points_end, [](const auto& point) { return *point.gps_time(); });
     }
 
     if (has_number_of_returns) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.number_of_returns(), stream);
+      dst = write_column(dst, points_begin, points_end, [](const auto& point) {
+        return *point.number_of_returns();
       });
     }
 
     if (has_return_numbers) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.return_number(), stream);
-      });
+      dst = write_column(
+        dst, points_begin, points_end, [](const auto& point) { return *point.return_number(); });
     }
 
     if (has_point_source_ids) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.point_source_id(), stream);
-      });
+      dst = write_column(
+        dst, points_begin, points_end, [](const auto& point) { return *point.point_source_id(); });
     }
 
     if (has_scan_angle_ranks) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.scan_angle_rank(), stream);
-      });
+      dst = write_column(
+        dst, points_begin, points_end, [](const auto& point) { return *point.scan_angle_rank(); });
     }
 
     if (has_scan_direction_flags) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.scan_direction_flag(), stream);
+      dst = write_column(dst, points_begin, points_end, [](const auto& point) {
+        return *point.scan_direction_flag();
       });
     }
 
     if (has_user_data) {
-      std::for_each(points_begin, points_end, [&stream](auto& point) {
-        write_binary(*point.user_data(), stream);
-      });
+      dst = write_column(
+        dst, points_begin, points_end, [](const auto& point) { return *point.user_data(); });
     }
 
-    stream.pop();
+    assert(dst == file_buffer.data() + file_buffer.size());
+
+    return encode_file_buffer(file_buffer);
   }
 
-  void persist_points(PointBuffer const& points, const AABB& bounds, const std::string& node_name);
+  /**
+   * Same as the iterator overload, but every attribute column is copied from 'points' with a single
+   * memcpy
+   */
+  gsl::span<const std::byte> encode_points(const PointBuffer& points) const;
 
-  void retrieve_points(const std::string& node_name, PointBuffer& points);
+  void persist_points(PointBuffer const& points,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index);
+
+  void retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points);
 
-  bool node_exists(const std::string& node_name) const;
+  /**
+   * Points of a single node, viewed in the memory-mapped file of the node
+   */
+  struct MappedPoints
+  {
+    boost::iostreams::mapped_file_source file;
+    // Compressed and filtered files can't be viewed in place and are decoded into these buffers
+    std::vector<std::byte> decompressed_data;
+    std::vector<std::byte> decoded_data;
+    PointBufferView points;
+  };
+
+  /**
+   * Maps the file of the given node into memory and returns a view of its points. Uncompressed,
+   * unfiltered files are viewed in place without any copy, all other files are decoded first.
+   * Returns std::nullopt if the node does not exist
+   */
+  std::optional<MappedPoints> map_points(const OctreeNodeIndex64& node_index) const;
+
+  /**
+   * Appends the points of the given node to 'points', without reading them into an intermediate
+   * PointBuffer first
+   */
+  void append_points(const OctreeNodeIndex64& node_index, PointBuffer& points) const;
+
+  /**
+   * Returns a view of the points in 'data', which are the contents of a points file as returned by
+   * encode_points. Unless the data is uncompressed and unfiltered, the points are decoded into
+   * 'decompressed' and 'decoded' first. 'source' names the data in error messages
+   */
+  static PointBufferView view_encoded_points(gsl::span<const std::byte> data,
+                                             const std::string& source,
+                                             std::vector<std::byte>& decompressed,
+                                             std::vector<std::byte>& decoded);
+
+  bool node_exists(const OctreeNodeIndex64& node_index) const;
 
   inline bool is_lossless() const { return true; }
 
 private:
+  /**
+   * Path of the file that stores the points of the given node
+   */
+  std::string node_file_path(const OctreeNodeIndex64& node_index) const;
+
+  /**
+   * All columns of the uncompressed point data start at a multiple of this many bytes from the start
+   * of the file, so that they can be viewed in place
+   */
+  constexpr static size_t ColumnAlignment = 8;
+
+  /**
+   * The uncompressed point data starts with the properties bitmask and the number of points, padded
+   * to ColumnAlignment, which is followed by the attribute columns
+   */
+  constexpr static size_t PayloadOffset = bin::FileHeader::Size + 16;
+
+  /**
+   * Returns a buffer of the right size for the header and the uncompressed point data of a file.
+   * Everything up to PayloadOffset is already written. The buffer is reused by all files that are
+   * written from the same thread
+   */
+  static gsl::span<std::byte> prepare_file_buffer(uint32_t properties_bitmask,
+                                                  size_t points_count);
+
+  /**
+   * Writes one attribute column and the zero padding that aligns the next column. The file buffer
+   * itself is aligned, so padding to an aligned address aligns the offset in the file
+   */
+  template<typename Iter, typename Accessor>
+  static std::byte* write_column(std::byte* dst, Iter begin, Iter end, Accessor accessor)
+  {
+    for (; begin != end; ++begin) {
+      const auto value = accessor(*begin);
+      std::memcpy(dst, &value, sizeof(value));
+      dst += sizeof(value);
+    }
+    while (reinterpret_cast<uintptr_t>(dst) % ColumnAlignment) {
+      *dst++ = std::byte{ 0 };
+    }
+    return dst;
+  }
+
+  /**
+   * Copies a whole attribute column and writes the zero padding that aligns the next column
+   */
+  template<typename T>
+  static std::byte* write_column(std::byte* dst, const std::vector<T>& column)
+  {
+    const auto column_size = column.size() * sizeof(T);
+    std::memcpy(dst, column.data(), column_size);
+    dst += column_size;
+    while (reinterpret_cast<uintptr_t>(dst) % ColumnAlignment) {
+      *dst++ = std::byte{ 0 };
+    }
+    return dst;
+  }
+
+  /**
+   * Filters and compresses the point data in 'file_buffer' and writes the header in front of it.
+   * Returns the encoded file contents
+   */
+  gsl::span<const std::byte> encode_file_buffer(gsl::span<std::byte> file_buffer) const;
+
+  /**
+   * Writes the encoded file contents to 'file_path'
+   */
+  static void write_file(const std::string& file_path, gsl::span<const std::byte> file_contents);
+
   std::string _work_dir;
   PointAttributes _input_attributes;
   PointAttributes _output_attributes;
-  Compressed _compressed;
+  BinaryCodec _codec;
+  int _codec_level;
+  BinaryEncoding _encoding;
   std::string _file_extension;
 };
\ No newline at end of file
@@ -1,24 +1,104 @@
 #include "io/Cesium3DTilesPersistence.h"
 
-#include "datastructures/DynamicMortonIndex.h"
 #include "datastructures/OctreeNodeIndex.h"
+#include "io/AsyncFileWriter.h"
+#include "io/GLBReader.h"
 #include "io/PNTSReader.h"
 #include "io/PNTSWriter.h"
 #include "io/TileSetWriter.h"
+#include "io/io_util.h"
 #include "pointcloud/PointAttributes.h"
-#include "threading/Parallel.h"
 #include "tiling/OctreeAlgorithms.h"
 #include "util/Transformation.h"
 #include "util/stuff.h"
 
+#include <algorithm>
+#include <array>
 #include <fstream>
 #include <queue>
-#include <taskflow/taskflow.hpp>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <unordered_set>
+
+namespace {
+// Tiles and subtrees of implicit tilesets are named like the nodes of Entwine
+const std::string ImplicitTileName = "{level}-{x}-{y}-{z}";
+const std::string ImplicitSubtreeUri = ImplicitTileName + ".subtree";
+
+// Maximum depth from a tileset JSON file at which PNTS files are included
+// directly in the tileset. Below this depth, tilesets are included as
+// external tilesets. This creates a tree of JSON files where each JSON file
+// includes a tree of MAX_DEPTH depth of PNTS files
+constexpr uint32_t MAX_DEPTH = 2;
+// JSON files start at the root and every MAX_DEPTH + 1 levels below
+constexpr uint32_t LevelsPerJSON = MAX_DEPTH + 1;
+
+/**
+ * Level of the first tiles at or below 'level' that have JSON files of their own
+ */
+uint32_t
+first_tileset_json_level(uint32_t level)
+{
+  return ((level + LevelsPerJSON - 1) / LevelsPerJSON) * LevelsPerJSON;
+}
+
+/**
+ * The tile with a JSON file of its own whose JSON file contains the given tile
+ */
+OctreeNodeIndex64
+containing_tileset_json_root(const OctreeNodeIndex64& tile_index)
+{
+  return tile_index.parent_at_level((tile_index.levels() / LevelsPerJSON) * LevelsPerJSON);
+}
+
+void
+iterate_tileset_children(Tileset const& current_tileset,
+                         std::queue<Tileset const*>& working_queue,
+                         uint32_t remaining_levels)
+{
+  if (remaining_levels == 0) {
+    for (auto& child : current_tileset.children) {
+      working_queue.push(&child);
+    }
+  } else {
+    for (auto& child : current_tileset.children) {
+      iterate_tileset_children(child, working_queue, remaining_levels - 1);
+    }
+  }
+}
+
+/**
+ * Returns the tiles of the given tileset that have JSON files of their own, starting with the root
+ * of the tileset
+ */
+std::vector<Tileset const*>
+tileset_json_roots(const Tileset& root_tileset)
+{
+  std::vector<Tileset const*> roots;
+  std::queue<Tileset const*> working_queue;
+
+  working_queue.push(&root_tileset);
+
+  while (!working_queue.empty()) {
+    auto current_root = working_queue.front();
+    working_queue.pop();
+
+    roots.push_back(current_root);
+
+    // Find children that are MAX_DEPTH away from current_root
+    iterate_tileset_children(*current_root, working_queue, MAX_DEPTH);
+  }
+
+  return roots;
+}
+} // namespace
 
 PointAttributes
 Cesium3DTilesPersistence::supported_output_attributes()
 {
-  return { PointAttribute::Position, PointAttribute::RGB, PointAttribute::Intensity };
+  return {
+    PointAttribute::Position, PointAttribute::RGB, PointAttribute::Intensity, PointAttribute::Normal
+  };
 }
 
 Cesium3DTilesPersistence::Cesium3DTilesPersistence(const std::string& work_dir,
@@ -26,192 +106,387 @@ Cesium3DTilesPersistence::Cesium3DTilesPersistence(const std::string& work_dir,
                                                    const PointAttributes& output_attributes,
                                                    RGBMapping rgb_mapping,
                                                    float spacing_at_root,
-                                                   Vector3<double> const& global_offset)
+                                                   Vector3<double> const& global_offset,
+                                                   PNTSEncoding pnts_encoding,
+                                                   TilesetLayout tileset_layout,
+                                                   TileContentFormat content_format,
+                                                   GLBCompression glb_compression)
   : _work_dir(work_dir)
   , _input_attributes(input_attributes)
   , _output_attributes(output_attributes)
   , _rgb_mapping(rgb_mapping)
   , _spacing_at_root(spacing_at_root)
   , _global_offset(global_offset)
-  , _tilesets_lock(std::make_unique<std::mutex>())
+  , _pnts_encoding(pnts_encoding)
+  , _tileset_layout(tileset_layout)
+  , _content_format(content_format)
+  , _glb_compression(glb_compression)
 {
   if (!attributes_are_subset(_input_attributes, _output_attributes)) {
     throw std::invalid_argument{
       "Cesium3DTilesPersistence requires that input_attributes are a subset of output_attributes!"
     };
   }
+  if (_tileset_layout == TilesetLayout::Implicit) {
+    _implicit_tileset = std::make_unique<ImplicitTileset>();
+  }
 }
 
 Cesium3DTilesPersistence::~Cesium3DTilesPersistence()
 {
-  if (!_root_tileset)
+  if (_tileset_layout == TilesetLayout::Implicit) {
+    // Moved-from instances have no implicit tileset
+    if (_implicit_tileset && _implicit_tileset->root_bounds) {
+      write_implicit_tileset(_implicit_tileset->tile_availability, *_implicit_tileset->root_bounds);
+    }
+    return;
+  }
+
+  // Moved-from instances have no written nodes either
+  if (_written_nodes_per_json_root.empty() && _finalized_tilesets.empty())
     return;
 
-  write_tilesets();
+  std::unordered_map<OctreeNodeIndex64, AABB> written_nodes;
+  for (const auto& [json_root, json_root_nodes] : _written_nodes_per_json_root.collect()) {
+    written_nodes.insert(std::begin(json_root_nodes), std::end(json_root_nodes));
+  }
+  // Tiles with finished JSON files are still referenced by the JSON files above them
+  const auto finalized_tilesets = _finalized_tilesets.collect();
+  written_nodes.insert(std::begin(finalized_tilesets), std::end(finalized_tilesets));
+
+  // All nodes agree on the bounds of the root, so any node can be used to compute them
+  const auto& [some_node_index, some_node_bounds] = *std::begin(written_nodes);
+  const auto root_bounds = get_root_bounds_from_node(some_node_index, some_node_bounds);
+  const auto root_tileset = build_tileset(written_nodes, OctreeNodeIndex64{}, root_bounds);
+
+  std::unordered_set<std::string> finalized_names;
+  for (const auto& finalized_tileset : finalized_tilesets) {
+    finalized_names.insert(node_name_from_index(finalized_tileset.first));
+  }
+  auto json_roots = tileset_json_roots(root_tileset);
+  json_roots.erase(std::remove_if(std::begin(json_roots),
+                                  std::end(json_roots),
+                                  [&finalized_names](Tileset const* json_root) {
+                                    return finalized_names.count(json_root->name) != 0;
+                                  }),
+                   std::end(json_roots));
+
+  // Most JSON files have been written by 'finalize_subtree' already, the few that are left are
+  // written sequentially instead of starting a thread pool for them
+  for (auto json_root : json_roots) {
+    write_tileset_json(*json_root);
+  }
+}
+
+void
+Cesium3DTilesPersistence::finalize_subtree(const OctreeNodeIndex64& subtree_root)
+{
+  if (_tileset_layout != TilesetLayout::Explicit)
+    return;
+
+  // Nodes between the subtree root and the first JSON files below it belong to the JSON files
+  // above the subtree, which have to wait for the destructor
+  const auto subtree_levels = subtree_root.levels();
+  const auto json_level = first_tileset_json_level(subtree_levels);
+  std::vector<OctreeNodeIndex64> json_roots;
+  if (json_level == subtree_levels) {
+    json_roots.push_back(subtree_root);
+  } else {
+    const auto parent_json_root = containing_tileset_json_root(subtree_root);
+    _child_json_roots.update(parent_json_root, [&](auto& child_json_roots) {
+      for (auto iter = std::begin(child_json_roots); iter != std::end(child_json_roots);) {
+        if (iter->parent_at_level(subtree_levels) == subtree_root) {
+          json_roots.push_back(*iter);
+          iter = child_json_roots.erase(iter);
+        } else {
+          ++iter;
+        }
+      }
+    });
+  }
+
+  // The calling thread is already one of many that finish subtrees, so the JSON files of a single
+  // subtree are written sequentially
+  for (const auto& json_root : json_roots) {
+    // Collects the nodes of all JSON files below the JSON root, without looking at other subtrees
+    std::unordered_map<OctreeNodeIndex64, AABB> json_root_nodes;
+    std::vector<OctreeNodeIndex64> pending_json_roots = { json_root };
+    while (!pending_json_roots.empty()) {
+      const auto current_json_root = pending_json_roots.back();
+      pending_json_roots.pop_back();
+      if (auto nodes = _written_nodes_per_json_root.extract(current_json_root)) {
+        json_root_nodes.merge(*nodes);
+      }
+      if (auto child_json_roots = _child_json_roots.extract(current_json_root)) {
+        pending_json_roots.insert(std::end(pending_json_roots),
+                                  std::begin(*child_json_roots),
+                                  std::end(*child_json_roots));
+      }
+    }
+    if (json_root_nodes.empty())
+      continue;
+
+    const auto& [some_node_index, some_node_bounds] = *std::begin(json_root_nodes);
+    const auto root_bounds = get_root_bounds_from_node(some_node_index, some_node_bounds);
+    const auto json_root_bounds = get_bounds_from_node_index(json_root, root_bounds);
+    const auto tileset = build_tileset(json_root_nodes, json_root, json_root_bounds);
+    for (auto tileset_json_root : tileset_json_roots(tileset)) {
+      write_tileset_json(*tileset_json_root);
+    }
+    _finalized_tilesets.insert_or_assign(json_root, json_root_bounds);
+  }
 }
 
 void
 Cesium3DTilesPersistence::persist_points(PointBuffer const& points,
                                          const AABB& bounds,
-                                         const std::string& node_name)
+                                         const OctreeNodeIndex64& node_index)
 {
   if (points.empty()) {
     throw std::runtime_error{ "persist_points requires a non-empty range" };
   }
 
-  PNTSWriter writer{ concat(_work_dir, "/", node_name, ".pnts"), _output_attributes, _rgb_mapping };
-  writer.write_points(points);
-  writer.flush(_global_offset);
+  if (_content_format == TileContentFormat::PNTS) {
+    write_pnts_file(content_file_path(node_index),
+                    points,
+                    _output_attributes,
+                    _rgb_mapping,
+                    _global_offset,
+                    _pnts_encoding,
+                    bounds);
+  } else {
+    write_content_file(std::begin(points), std::end(points), bounds, node_index);
+  }
 
-  on_write_node(node_name, bounds);
+  on_write_node(node_index, bounds);
 }
 
 void
-Cesium3DTilesPersistence::retrieve_points(const std::string& node_name, PointBuffer& points)
+Cesium3DTilesPersistence::retrieve_points(const OctreeNodeIndex64& node_index,
+                                          PointBuffer& points)
 {
-  const auto file_path = concat(_work_dir, "/", node_name, ".pnts");
+  const auto file_path = content_file_path(node_index);
+  wait_for_file_write(file_path);
   if (!std::experimental::filesystem::exists(file_path))
     return;
 
+  if (_content_format == TileContentFormat::GLB) {
+    auto glb_content = read_glb_file(file_path, _input_attributes);
+    points = std::move(glb_content->points);
+    return;
+  }
+
   auto pnts_content = readPNTSFile(file_path, _input_attributes);
   points = std::move(pnts_content->points);
 }
 
-void
-Cesium3DTilesPersistence::on_write_node(const std::string& node_name, const AABB& node_bounds)
+const char*
+Cesium3DTilesPersistence::content_file_extension() const
 {
-  std::lock_guard _{ *_tilesets_lock };
-
-  const auto setup_tileset =
-    [this](Tileset& tileset, const std::string& node_name, const AABB& node_bounds) {
-      const auto node_morton_index =
-        DynamicMortonIndex::parse_string(node_name, MortonIndexNamingConvention::Potree).value();
-
-      tileset.boundingVolume = boundingVolumeFromAABB(node_bounds.translate(_global_offset));
-      tileset.content_url = concat(node_name, ".pnts");
-      tileset.url = concat(node_name, ".json");
-      tileset.geometricError =
-        _spacing_at_root / std::pow(2.0, static_cast<double>(node_morton_index.depth()));
-      tileset.name = node_name;
-    };
-
-  if (!_root_tileset) {
-    const auto node_index = OctreeNodeIndex64::from_string(node_name.substr(1)).value();
-    const auto root_bounds = get_root_bounds_from_node(node_index, node_bounds);
-
-    _root_tileset = Tileset{};
-    setup_tileset(*_root_tileset, "r", root_bounds);
-
-    auto current_tileset = &*_root_tileset;
-    auto current_bounds = root_bounds;
+  return (_content_format == TileContentFormat::GLB) ? ".glb" : ".pnts";
+}
 
-    for (uint32_t level = 0; level < node_index.levels(); ++level) {
-      const auto current_octant = node_index.octant_at_level(level);
-      current_bounds = get_octant_bounds(current_octant, current_bounds);
-      const auto child_name = current_tileset->name + (static_cast<char>('0' + current_octant));
+std::string
+Cesium3DTilesPersistence::content_file_path(const OctreeNodeIndex64& node_index) const
+{
+  if (_tileset_layout == TilesetLayout::Explicit) {
+    return concat(_work_dir, "/", node_name_from_index(node_index), content_file_extension());
+  }
 
-      auto& child = current_tileset->children.emplace_back();
-      setup_tileset(child, child_name, current_bounds);
+  const auto tile_key = implicit_tiling::tile_key_from_node_index(node_index);
+  return concat(_work_dir,
+                "/",
+                implicit_tiling::expand_uri_template(ImplicitTileName, tile_key),
+                content_file_extension());
+}
 
-      current_tileset = &child;
+void
+Cesium3DTilesPersistence::on_write_node(const OctreeNodeIndex64& node_index,
+                                        const AABB& node_bounds)
+{
+  if (_tileset_layout == TilesetLayout::Implicit) {
+    const auto tile_key = implicit_tiling::tile_key_from_node_index(node_index);
+    std::lock_guard guard{ _implicit_tileset->lock };
+    _implicit_tileset->tile_availability.set_content_available(tile_key);
+    if (!_implicit_tileset->root_bounds) {
+      _implicit_tileset->root_bounds = get_root_bounds_from_node(node_index, node_bounds);
     }
-
     return;
   }
 
-  // Find the matching tileset or one of its parents, and create all the missing
-  // tilesets between the next parent and this node
-  const auto node_index = OctreeNodeIndex64::from_string(node_name.substr(1)).value();
-  auto current_tileset = &*_root_tileset;
-  auto current_bounds = get_root_bounds_from_node(node_index, node_bounds);
-
-  for (size_t idx = 1; idx < node_name.size(); ++idx) {
-    const auto child_index = node_index.parent_at_level(idx);
-    const auto octant = child_index.octant_at_level(idx);
-
-    auto substr = node_name.substr(0, idx + 1);
-    auto child_iter =
-      std::find_if(std::begin(current_tileset->children),
-                   std::end(current_tileset->children),
-                   [&substr](const Tileset& tileset) { return tileset.name == substr; });
-
-    const auto child_bounds = get_octant_bounds(octant, current_bounds);
-
-    if (child_iter == std::end(current_tileset->children)) {
-
-      auto& child = current_tileset->children.emplace_back();
-      setup_tileset(child, substr, child_bounds);
-
-      child_iter = std::prev(std::end(current_tileset->children));
+  const auto json_root = containing_tileset_json_root(node_index);
+  _written_nodes_per_json_root.update(json_root, [&](auto& json_root_nodes) {
+    json_root_nodes.insert_or_assign(node_index, node_bounds);
+  });
+
+  // Links the JSON root to the JSON roots above it, up to the first link that exists already
+  auto child_json_root = json_root;
+  while (child_json_root.levels() > 0) {
+    const auto parent_json_root =
+      child_json_root.parent_at_level(child_json_root.levels() - LevelsPerJSON);
+    const auto is_new_link =
+      _child_json_roots.update(parent_json_root, [&](auto& child_json_roots) {
+        return child_json_roots.insert(child_json_root).second;
+      });
+    if (!is_new_link)
+      break;
+    child_json_root = parent_json_root;
+  }
+}
 
-      if (idx == node_name.size() - 1) {
+Tileset
+Cesium3DTilesPersistence::build_tileset(
+  const std::unordered_map<OctreeNodeIndex64, AABB>& written_nodes,
+  const OctreeNodeIndex64& tileset_root,
+  const AABB& tileset_root_bounds) const
+{
+  // Tiles for all written nodes and their ancestors, as a bitmask of the octants of the child tiles
+  // of each tile
+  std::unordered_map<OctreeNodeIndex64, uint8_t> child_octants;
+  child_octants[tileset_root];
+  for (const auto& [node_index, node_bounds] : written_nodes) {
+    auto tile_index = node_index;
+    while (tile_index.levels() > tileset_root.levels()) {
+      const auto octant = tile_index.octant_at_level(tile_index.levels());
+      tile_index = tile_index.parent();
+      auto& octants = child_octants[tile_index];
+      if (octants & (1u << octant))
         break;
-      }
+      octants |= static_cast<uint8_t>(1u << octant);
     }
-
-    current_tileset = &*child_iter;
-    current_bounds = child_bounds;
   }
-}
 
-static void
-iterate_tileset_children(Tileset const& current_tileset,
-                         std::queue<Tileset const*>& working_queue,
-                         uint32_t remaining_levels)
-{
-  if (remaining_levels == 0) {
-    for (auto& child : current_tileset.children) {
-      working_queue.push(&child);
+  const auto setup_tileset = [&](Tileset& tileset,
+                                 const OctreeNodeIndex64& tile_index,
+                                 const AABB& tile_bounds,
+                                 const auto& setup_children) -> void {
+    const auto tile_name = node_name_from_index(tile_index);
+
+    tileset.boundingVolume = boundingVolumeFromAABB(tile_bounds.translate(_global_offset));
+    tileset.content_url = concat(tile_name, content_file_extension());
+    if (_content_format == TileContentFormat::GLB) {
+      tileset.version = "1.1";
     }
-  } else {
-    for (auto& child : current_tileset.children) {
-      iterate_tileset_children(child, working_queue, remaining_levels - 1);
+    tileset.url = concat(tile_name, ".json");
+    tileset.geometricError =
+      _spacing_at_root / std::pow(2.0, static_cast<double>(tile_index.levels()));
+    tileset.name = tile_name;
+
+    const auto octants_iter = child_octants.find(tile_index);
+    if (octants_iter == std::end(child_octants))
+      return;
+
+    const auto octants = octants_iter->second;
+    for (uint8_t octant = 0; octant < 8; ++octant) {
+      if (!(octants & (1u << octant)))
+        continue;
+      auto& child = tileset.children.emplace_back();
+      setup_children(
+        child, tile_index.child(octant), get_octant_bounds(octant, tile_bounds), setup_children);
     }
-  }
+  };
+
+  Tileset root_tileset;
+  setup_tileset(root_tileset, tileset_root, tileset_root_bounds, setup_tileset);
+  return root_tileset;
 }
 
 void
-Cesium3DTilesPersistence::write_tilesets() const
+Cesium3DTilesPersistence::write_tileset_json(const Tileset& json_root) const
 {
-  // Maximum depth from a tileset JSON file at which PNTS files are included
-  // directly in the tileset. Below this depth, tilesets are included as
-  // external tilesets. This creates a tree of JSON files where each JSON file
-  // includes a tree of MAX_DEPTH depth of PNTS files
-  constexpr uint32_t MAX_DEPTH = 2;
-
-  std::vector<Tileset const*> roots;
-  std::queue<Tileset const*> working_queue;
-
-  working_queue.push(&*_root_tileset);
-
-  while (!working_queue.empty()) {
-    auto current_root = working_queue.front();
-    working_queue.pop();
-
-    roots.push_back(current_root);
+  const auto filepath = concat(_work_dir, "/", json_root.name, ".json");
+  writeTilesetJSON(filepath, json_root, MAX_DEPTH + 1);
+}
 
-    // Find children that are MAX_DEPTH away from current_root
-    iterate_tileset_children(*current_root, working_queue, MAX_DEPTH);
+void
+Cesium3DTilesPersistence::write_implicit_tileset(
+  const implicit_tiling::TileAvailability& tile_availability,
+  const AABB& root_bounds) const
+{
+  const auto subtree_roots = tile_availability.subtree_roots();
+
+  // Subtree files are small and there are few of them compared to the tiles, so they are written
+  // sequentially instead of starting a thread pool for them
+  for (const auto& subtree_root : subtree_roots) {
+    const auto subtree =
+      implicit_tiling::encode_subtree(tile_availability.subtree_availability(subtree_root),
+                                      tile_availability.tiles_per_subtree(),
+                                      tile_availability.child_subtrees_per_subtree());
+    const auto file_path = concat(
+      _work_dir, "/", implicit_tiling::expand_uri_template(ImplicitSubtreeUri, subtree_root));
+    if (!write_file_unbuffered(file_path, subtree.data(), subtree.size())) {
+      std::cerr << "Could not write subtree file " << file_path << std::endl;
+    }
   }
 
-  tf::Taskflow taskflow;
-  parallel::for_each(
-    std::begin(roots),
-    std::end(roots),
-    [this](Tileset const* root) {
-      const auto filepath = concat(_work_dir, "/", root->name, ".json");
-      writeTilesetJSON(filepath, *root, MAX_DEPTH + 1);
-    },
-    taskflow,
-    std::thread::hardware_concurrency());
-
-  tf::Executor executor{ std::thread::hardware_concurrency() };
-  executor.run(taskflow).wait();
+  // Children of implicit tiles split the bounding box of their parent in half along each axis, so
+  // the box has to use the half extent of the root bounds
+  const auto shifted_root_bounds = root_bounds.translate(_global_offset);
+  const auto center = shifted_root_bounds.getCenter();
+  const auto half_extent = shifted_root_bounds.extent() / 2;
+  const std::array<double, 12> box = { center.x,      center.y, center.z, half_extent.x, 0, 0, 0,
+                                       half_extent.y, 0,        0,        0,             half_extent.z };
+
+  rapidjson::StringBuffer json_buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> json{ json_buffer };
+  json.StartObject();
+  json.Key("asset");
+  json.StartObject();
+  json.Key("version");
+  json.String("1.1");
+  json.EndObject();
+  json.Key("geometricError");
+  json.Double(_spacing_at_root);
+
+  json.Key("root");
+  json.StartObject();
+  json.Key("boundingVolume");
+  json.StartObject();
+  json.Key("box");
+  json.StartArray();
+  for (auto value : box) {
+    json.Double(value);
+  }
+  json.EndArray();
+  json.EndObject();
+  // The geometric error of each level is half the error of the level above, as for explicit
+  // tilesets
+  json.Key("geometricError");
+  json.Double(_spacing_at_root);
+  json.Key("refine");
+  json.String("ADD");
+  json.Key("content");
+  json.StartObject();
+  json.Key("uri");
+  json.String(concat(ImplicitTileName, content_file_extension()).c_str());
+  json.EndObject();
+  json.Key("implicitTiling");
+  json.StartObject();
+  json.Key("subdivisionScheme");
+  json.String("OCTREE");
+  json.Key("subtreeLevels");
+  json.Uint(tile_availability.subtree_levels());
+  json.Key("availableLevels");
+  json.Uint(tile_availability.available_levels());
+  json.Key("subtrees");
+  json.StartObject();
+  json.Key("uri");
+  json.String(ImplicitSubtreeUri.c_str());
+  json.EndObject();
+  json.EndObject();
+  json.EndObject();
+  json.EndObject();
+
+  const auto file_path = concat(_work_dir, "/tileset.json");
+  if (!write_file_unbuffered(file_path, json_buffer.GetString(), json_buffer.GetSize())) {
+    std::cerr << "Error writing tileset JSON to \"" << file_path << "\"" << std::endl;
+  }
 }
 
 bool
-Cesium3DTilesPersistence::node_exists(const std::string& node_name) const
+Cesium3DTilesPersistence::node_exists(const OctreeNodeIndex64& node_index) const
 {
-  const auto file_path = concat(_work_dir, "/", node_name, ".pnts");
+  const auto file_path = content_file_path(node_index);
+  wait_for_file_write(file_path);
   return fs::exists(file_path);
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "datastructures/OctreeNodeIndex.h"
 #include "datastructures/PointBuffer.h"
+#include "datastructures/ShardedMap.h"
+#include "io/GLBWriter.h"
+#include "io/ImplicitTiling.h"
 #include "io/PNTSWriter.h"
 #include "math/AABB.h"
 #include "pointcloud/PointAttributes.h"
@@ -11,9 +15,34 @@
 #include <mutex>
 #include <optional>
 #include <unordered_map>
+#include <unordered_set>
 
 struct SRSTransformHelper;
 
+/**
+ * How the tiles of a 3D Tiles output are described
+ */
+enum class TilesetLayout
+{
+  // A tree of JSON files, where every JSON file contains a few levels of tiles and refers to
+  // external tilesets for the levels below
+  Explicit,
+  // A single 'tileset.json' with a 3D Tiles 1.1 implicit octree, plus '.subtree' files with the
+  // availability of the tiles. Tiles are named after their level and coordinates
+  Implicit
+};
+
+/**
+ * File format of the tile contents of a 3D Tiles output
+ */
+enum class TileContentFormat
+{
+  // Point Cloud files (.pnts)
+  PNTS,
+  // glTF binary files (.glb) with a single point primitive. glTF content requires 3D Tiles 1.1
+  GLB
+};
+
 /**
  * Sink for writing 3D Tiles files
  */
@@ -26,7 +55,11 @@ struct Cesium3DTilesPersistence
                            const PointAttributes& output_attributes,
                            RGBMapping rgb_mapping,
                            float spacing_at_root,
-                           const Vector3<double>& global_offset);
+                           const Vector3<double>& global_offset,
+                           PNTSEncoding pnts_encoding = PNTSEncoding::Float,
+                           TilesetLayout tileset_layout = TilesetLayout::Explicit,
+                           TileContentFormat content_format = TileContentFormat::PNTS,
+                           GLBCompression glb_compression = GLBCompression::None);
   Cesium3DTilesPersistence(Cesium3DTilesPersistence&&) = default;
   ~Cesium3DTilesPersistence();
 
@@ -34,37 +67,108 @@ struct Cesium3DTilesPersistence
   void persist_points(Iter points_begin,
                       Iter points_end,
                       const AABB& bounds,
-                      const std::string& node_name)
+                      const OctreeNodeIndex64& node_index)
   {
     if (std::distance(points_begin, points_end) == 0) {
       throw std::runtime_error{ "persist_points requires a non-empty range" };
     }
 
-    PNTSWriter writer{ concat(_work_dir, "/", node_name, ".pnts"),
-                       _output_attributes,
-                       _rgb_mapping };
-    // OPTIMIZATION This is not optimal, writer should be able to take iterator
-    // pair
-    PointBuffer tmp_points;
-    std::for_each(points_begin, points_end, [&tmp_points](const auto& point_ref) {
-      tmp_points.push_point(point_ref);
-    });
-    writer.write_points(tmp_points);
-    writer.flush(_global_offset);
-
-    on_write_node(node_name, bounds);
+    write_content_file(points_begin, points_end, bounds, node_index);
+
+    on_write_node(node_index, bounds);
   }
-  void persist_points(PointBuffer const& points, const AABB& bounds, const std::string& node_name);
+  void persist_points(PointBuffer const& points,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index);
+
+  void retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points);
 
-  void retrieve_points(const std::string& node_name, PointBuffer& points);
+  bool node_exists(const OctreeNodeIndex64& node_index) const;
 
-  bool node_exists(const std::string& node_name) const;
+  inline bool is_lossless() const { return _pnts_encoding == PNTSEncoding::Float; }
 
-  inline bool is_lossless() const { return true; }
+  /**
+   * Signals that no more nodes will be written below 'subtree_root'. The tileset JSON files of
+   * explicit tilesets that lie completely within the subtree are written right away and the
+   * bookkeeping for their nodes is released. Only the JSON files that contain tiles above the
+   * subtree are left for the destructor. Implicit tilesets are always written on destruction
+   */
+  void finalize_subtree(const OctreeNodeIndex64& subtree_root);
+
+  /**
+   * Number of levels of the octree that are described by each .subtree file of an implicit tileset
+   */
+  constexpr static uint32_t SubtreeLevels = 4;
 
 private:
-  void on_write_node(const std::string& node_name, const AABB& node_bounds);
-  void write_tilesets() const;
+  template<typename Iter>
+  void write_content_file(Iter points_begin,
+                          Iter points_end,
+                          const AABB& bounds,
+                          const OctreeNodeIndex64& node_index)
+  {
+    if (_content_format == TileContentFormat::GLB) {
+      write_glb_file(content_file_path(node_index),
+                     points_begin,
+                     points_end,
+                     _output_attributes,
+                     _rgb_mapping,
+                     _global_offset,
+                     _pnts_encoding,
+                     _glb_compression,
+                     bounds);
+      return;
+    }
+
+    write_pnts_file(content_file_path(node_index),
+                    points_begin,
+                    points_end,
+                    _output_attributes,
+                    _rgb_mapping,
+                    _global_offset,
+                    _pnts_encoding,
+                    bounds);
+  }
+
+  /**
+   * File extension of the tile contents, including the dot
+   */
+  const char* content_file_extension() const;
+  std::string content_file_path(const OctreeNodeIndex64& node_index) const;
+
+  /**
+   * Records the given node for the tileset. Explicit tilesets are only built once all nodes are
+   * written, writers that record different nodes concurrently rarely have to wait for each other.
+   * For implicit tilesets, the tile is marked as available right away
+   */
+  void on_write_node(const OctreeNodeIndex64& node_index, const AABB& node_bounds);
+
+  /**
+   * Builds the tree of tiles below 'tileset_root' for the given written nodes, which all have to be
+   * in the subtree of 'tileset_root'. Ancestors of written nodes get a tile as well, children are
+   * sorted by their octant
+   */
+  Tileset build_tileset(const std::unordered_map<OctreeNodeIndex64, AABB>& written_nodes,
+                        const OctreeNodeIndex64& tileset_root,
+                        const AABB& tileset_root_bounds) const;
+  /**
+   * Writes the JSON file of the given tile, which contains the tile and the next levels of tiles
+   * below it, down to the tiles that have JSON files of their own
+   */
+  void write_tileset_json(const Tileset& json_root) const;
+  void write_implicit_tileset(const implicit_tiling::TileAvailability& tile_availability,
+                              const AABB& root_bounds) const;
+
+  /**
+   * Availability of the tiles of an implicit tileset, which is updated whenever a node is written
+   */
+  struct ImplicitTileset
+  {
+    std::mutex lock;
+    implicit_tiling::TileAvailability tile_availability{ SubtreeLevels };
+    // Known once the first node is written
+    std::optional<AABB> root_bounds;
+  };
 
   std::string _work_dir;
   PointAttributes _input_attributes;
@@ -72,7 +176,22 @@ private:
   RGBMapping _rgb_mapping;
   float _spacing_at_root;
   Vector3<double> _global_offset;
+  // Also used for .glb contents, where quantized positions and normals use KHR_mesh_quantization
+  PNTSEncoding _pnts_encoding;
+  TilesetLayout _tileset_layout;
+  TileContentFormat _content_format;
+  GLBCompression _glb_compression;
 
-  std::unique_ptr<std::mutex> _tilesets_lock;
-  std::optional<Tileset> _root_tileset;
+  // Bounds of all nodes that were written, grouped by the tile whose JSON file contains them. The
+  // tileset is built from them on destruction. Nodes whose tileset JSON files were written by
+  // 'finalize_subtree' are removed again
+  ShardedMap<OctreeNodeIndex64, std::unordered_map<OctreeNodeIndex64, AABB>>
+    _written_nodes_per_json_root;
+  // Tiles with JSON files of their own below each tile with a JSON file, so that 'finalize_subtree'
+  // only visits the nodes of its subtree
+  ShardedMap<OctreeNodeIndex64, std::unordered_set<OctreeNodeIndex64>> _child_json_roots;
+  // Only used for implicit tilesets, which need no bookkeeping per node
+  std::unique_ptr<ImplicitTileset> _implicit_tileset;
+  // Bounds of the tiles whose JSON files were already written by 'finalize_subtree'
+  ShardedMap<OctreeNodeIndex64, AABB> _finalized_tilesets;
 };
\ No newline at end of file
@@ -0,0 +1,567 @@
+#include "io/CopcPersistence.h"
+
+#include <algorithm>
+#include <array>
+#include <experimental/filesystem>
+#include <fstream>
+#include <set>
+#include <tuple>
+
+namespace {
+constexpr uint16_t HierarchyRecordID = 1000;
+constexpr uint16_t InfoRecordID = 1;
+constexpr uint16_t LASzipRecordID = 22204;
+constexpr uint32_t VariableChunkSize = 0xFFFFFFFF;
+
+// Offsets of fields in the LAS 1.4 public header block
+constexpr size_t HeaderSizeOffset = 94;
+constexpr size_t OffsetToPointDataOffset = 96;
+constexpr size_t NumberOfVLRsOffset = 100;
+constexpr size_t MaxXOffset = 179;
+constexpr size_t StartOfFirstEVLROffset = 235;
+constexpr size_t NumberOfEVLRsOffset = 243;
+constexpr size_t NumberOfPointRecordsOffset = 247;
+constexpr size_t NumberOfPointsByReturnOffset = 255;
+// Offset of the chunk size in the payload of the LASzip VLR
+constexpr size_t LASzipChunkSizeOffset = 12;
+
+template<typename T>
+void
+write_value(std::string& dst, size_t offset, const T& value)
+{
+  std::memcpy(dst.data() + offset, &value, sizeof(T));
+}
+
+template<typename T>
+T
+read_value(const std::string& src, size_t offset)
+{
+  T value;
+  std::memcpy(&value, src.data() + offset, sizeof(T));
+  return value;
+}
+
+template<typename T>
+void
+append_value(std::string& dst, const T& value)
+{
+  dst.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void
+append_string(std::string& dst, std::string_view str, size_t field_length)
+{
+  const auto length = std::min(str.size(), field_length);
+  dst.append(str.data(), length);
+  dst.append(field_length - length, '\0');
+}
+
+/**
+ * Header of a VLR (or EVLR, if 'extended' is true) with the given user ID, record ID and length of
+ * the payload
+ */
+std::string
+vlr_header(std::string_view user_id,
+           uint16_t record_id,
+           uint64_t record_length,
+           std::string_view description,
+           bool extended)
+{
+  std::string header;
+  append_value(header, uint16_t{ 0 }); // reserved
+  append_string(header, user_id, 16);
+  append_value(header, record_id);
+  if (extended) {
+    append_value(header, record_length);
+  } else {
+    append_value(header, static_cast<uint16_t>(record_length));
+  }
+  append_string(header, description, 32);
+  return header;
+}
+
+void
+write_at(std::fstream& file, uint64_t offset, const char* data, size_t size)
+{
+  file.seekp(static_cast<std::streamoff>(offset));
+  file.write(data, static_cast<std::streamsize>(size));
+}
+} // namespace
+
+copc::VoxelKey
+copc::VoxelKey::ancestor_at_depth(int32_t depth) const
+{
+  const auto shift = d - depth;
+  return { depth, x >> shift, y >> shift, z >> shift };
+}
+
+bool
+copc::VoxelKey::operator==(const VoxelKey& other) const
+{
+  return d == other.d && x == other.x && y == other.y && z == other.z;
+}
+
+bool
+copc::VoxelKey::operator<(const VoxelKey& other) const
+{
+  return std::tie(d, x, y, z) < std::tie(other.d, other.x, other.y, other.z);
+}
+
+copc::VoxelKey
+copc::voxel_key_from_node_index(const OctreeNodeIndex64& node_index)
+{
+  // Same axis order as the Entwine naming convention of OctreeNodeIndex
+  VoxelKey key{ static_cast<int32_t>(node_index.levels()), 0, 0, 0 };
+  for (uint32_t level = 1; level <= node_index.levels(); ++level) {
+    const auto octant = node_index.octant_at_level(level);
+    key.x = (key.x << 1) | ((octant >> 2) & 1);
+    key.y = (key.y << 1) | ((octant >> 1) & 1);
+    key.z = (key.z << 1) | (octant & 1);
+  }
+  return key;
+}
+
+copc::EncodedHierarchy
+copc::encode_hierarchy(std::vector<HierarchyEntry> entries, uint64_t payload_offset)
+{
+  EncodedHierarchy encoded;
+  encoded.root_page_size = 0;
+  if (entries.empty())
+    return encoded;
+
+  const auto page_root_of = [](const VoxelKey& key) {
+    return key.ancestor_at_depth((key.d / HierarchyPageDepth) * HierarchyPageDepth);
+  };
+
+  // Every node goes into the page of its nearest ancestor at a multiple of HierarchyPageDepth, and
+  // every page is referenced from the page above it
+  std::sort(std::begin(entries), std::end(entries), [](const auto& l, const auto& r) {
+    return l.key < r.key;
+  });
+  std::map<VoxelKey, std::vector<const HierarchyEntry*>> page_entries;
+  std::map<VoxelKey, std::set<VoxelKey>> child_pages;
+  for (auto& entry : entries) {
+    auto page_root = page_root_of(entry.key);
+    page_entries[page_root].push_back(&entry);
+    while (page_root.d > 0) {
+      const auto parent_page_root = page_root_of(page_root.ancestor_at_depth(page_root.d - 1));
+      child_pages[parent_page_root].insert(page_root);
+      page_entries[parent_page_root];
+      page_root = parent_page_root;
+    }
+  }
+
+  // The root page has the smallest key, so it comes first
+  std::map<VoxelKey, std::pair<uint64_t, uint64_t>> page_locations;
+  auto page_offset = payload_offset;
+  for (auto& [page_root, page] : page_entries) {
+    const auto page_size = (page.size() + child_pages[page_root].size()) * HierarchyEntrySize;
+    page_locations[page_root] = { page_offset, page_size };
+    page_offset += page_size;
+  }
+  encoded.root_page_size = std::begin(page_locations)->second.second;
+
+  encoded.data.resize(page_offset - payload_offset);
+  auto dst = encoded.data.data();
+  const auto write_entry = [&dst](const HierarchyEntry& entry) {
+    const std::array<int32_t, 4> key = { entry.key.d, entry.key.x, entry.key.y, entry.key.z };
+    std::memcpy(dst, key.data(), sizeof(key));
+    std::memcpy(dst + 16, &entry.offset, sizeof(uint64_t));
+    std::memcpy(dst + 24, &entry.byte_size, sizeof(int32_t));
+    std::memcpy(dst + 28, &entry.point_count, sizeof(int32_t));
+    dst += HierarchyEntrySize;
+  };
+  for (auto& [page_root, page] : page_entries) {
+    for (auto entry : page) {
+      write_entry(*entry);
+    }
+    for (auto& child_page_root : child_pages[page_root]) {
+      const auto& [child_offset, child_size] = page_locations[child_page_root];
+      write_entry({ child_page_root, child_offset, static_cast<int32_t>(child_size), -1 });
+    }
+  }
+
+  return encoded;
+}
+
+las::PointRecordFields
+copc::point_record_fields_for_attributes(const PointAttributes& attributes)
+{
+  las::PointRecordFields fields;
+  fields.rgb = has_attribute(attributes, PointAttribute::RGB);
+  fields.intensity = has_attribute(attributes, PointAttribute::Intensity);
+  fields.classification = has_attribute(attributes, PointAttribute::Classification);
+  fields.edge_of_flight_line = has_attribute(attributes, PointAttribute::EdgeOfFlightLine);
+  fields.gps_time = has_attribute(attributes, PointAttribute::GPSTime);
+  fields.number_of_returns = has_attribute(attributes, PointAttribute::NumberOfReturns);
+  fields.return_number = has_attribute(attributes, PointAttribute::ReturnNumber);
+  fields.point_source_id = has_attribute(attributes, PointAttribute::PointSourceID);
+  fields.scan_angle_rank = has_attribute(attributes, PointAttribute::ScanAngleRank);
+  fields.scan_direction_flag = has_attribute(attributes, PointAttribute::ScanDirectionFlag);
+  fields.user_data = has_attribute(attributes, PointAttribute::UserData);
+  return fields;
+}
+
+bool
+copc::decompress_node(const std::string& laz_file,
+                      const PointAttributes& attributes,
+                      PointBuffer& points)
+{
+  laszip_POINTER lasreader = nullptr;
+  laszip_create(&lasreader);
+  if (!lasreader)
+    return false;
+
+  BOOST_SCOPE_EXIT(&lasreader) { laszip_destroy(lasreader); }
+  BOOST_SCOPE_EXIT_END
+
+  std::istringstream stream{ laz_file };
+  laszip_BOOL is_compressed;
+  laszip_header* las_header;
+  laszip_point* laspoint;
+  if (laszip_open_reader_stream(lasreader, stream, &is_compressed) ||
+      laszip_get_header_pointer(lasreader, &las_header) ||
+      laszip_get_point_pointer(lasreader, &laspoint)) {
+    std::cerr << "Could not decompress COPC node (" << las::laszip_error_message(lasreader)
+              << ")\n";
+    return false;
+  }
+
+  const auto num_points = static_cast<size_t>(las_header->number_of_point_records
+                                                ? las_header->number_of_point_records
+                                                : las_header->extended_number_of_point_records);
+  PointBuffer node_points{ num_points, attributes };
+  for (auto point : node_points) {
+    if (laszip_read_point(lasreader)) {
+      std::cerr << "Could not decompress COPC node (" << las::laszip_error_message(lasreader)
+                << ")\n";
+      return false;
+    }
+
+    point.position() = { las_header->x_offset + laspoint->X * las_header->x_scale_factor,
+                         las_header->y_offset + laspoint->Y * las_header->y_scale_factor,
+                         las_header->z_offset + laspoint->Z * las_header->z_scale_factor };
+    if (point.rgbColor()) {
+      point.rgbColor()->x = static_cast<uint8_t>(laspoint->rgb[0] >> 8);
+      point.rgbColor()->y = static_cast<uint8_t>(laspoint->rgb[1] >> 8);
+      point.rgbColor()->z = static_cast<uint8_t>(laspoint->rgb[2] >> 8);
+    }
+    if (point.intensity()) {
+      *point.intensity() = laspoint->intensity;
+    }
+    if (point.classification()) {
+      *point.classification() = laspoint->extended_classification;
+    }
+    if (point.edge_of_flight_line()) {
+      *point.edge_of_flight_line() = laspoint->edge_of_flight_line;
+    }
+    if (point.gps_time()) {
+      *point.gps_time() = laspoint->gps_time;
+    }
+    if (point.number_of_returns()) {
+      *point.number_of_returns() = laspoint->extended_number_of_returns;
+    }
+    if (point.return_number()) {
+      *point.return_number() = laspoint->extended_return_number;
+    }
+    if (point.point_source_id()) {
+      *point.point_source_id() = laspoint->point_source_ID;
+    }
+    if (point.scan_angle_rank()) {
+      const auto scan_angle = std::round(laspoint->extended_scan_angle * 0.006);
+      *point.scan_angle_rank() = static_cast<int8_t>(std::clamp(scan_angle, -128.0, 127.0));
+    }
+    if (point.scan_direction_flag()) {
+      *point.scan_direction_flag() = laspoint->scan_direction_flag;
+    }
+    if (point.user_data()) {
+      *point.user_data() = laspoint->user_data;
+    }
+  }
+
+  laszip_close_reader(lasreader);
+  points = std::move(node_points);
+  return true;
+}
+
+PointAttributes
+CopcPersistence::supported_output_attributes()
+{
+  return LASPersistence::supported_output_attributes();
+}
+
+CopcPersistence::CopcPersistence(const std::string& work_dir,
+                                 const PointAttributes& input_attributes,
+                                 const PointAttributes& output_attributes,
+                                 const AABB& cubic_bounds,
+                                 float spacing)
+  : _file_path(concat(work_dir, "/pointcloud.copc.laz"))
+  , _input_attributes(input_attributes)
+  , _output_attributes(output_attributes)
+  , _fields(copc::point_record_fields_for_attributes(output_attributes))
+  , _cubic_bounds(cubic_bounds)
+  , _spacing(spacing)
+  , _scale(compute_las_scale_from_bounds(cubic_bounds))
+  , _lock(std::make_unique<std::mutex>())
+  , _finalized(false)
+{
+  if (input_attributes != output_attributes) {
+    throw std::invalid_argument{
+      "CopcPersistence requires that input and output attributes are equal"
+    };
+  }
+  if (!attributes_are_subset(output_attributes, supported_output_attributes())) {
+    throw std::invalid_argument{ "Output attributes must be a subset of the supported attributes "
+                                 "(CopcPersistence::supported_output_attributes)" };
+  }
+
+  // LASzip writes the header and its VLR, which only depend on the point record fields. They are
+  // taken from an empty LAZ file and patched for variable chunk sizes
+  const PointBuffer no_points;
+  const auto empty_file =
+    copc::compress_node(std::begin(no_points), std::end(no_points), _fields, _cubic_bounds, _scale);
+  const auto empty_chunks = las::read_laz_chunks(empty_file);
+  if (!empty_chunks ||
+      read_value<uint16_t>(empty_file, HeaderSizeOffset) != copc::HeaderSize ||
+      read_value<uint32_t>(empty_file, NumberOfVLRsOffset) != 1 ||
+      read_value<uint16_t>(empty_file, copc::HeaderSize + 18) != LASzipRecordID) {
+    throw std::runtime_error{ "Could not create LAZ header for COPC file" };
+  }
+  _header_template = empty_file.substr(0, empty_chunks->first);
+  write_value(_header_template,
+              copc::HeaderSize + copc::VLRHeaderSize + LASzipChunkSizeOffset,
+              VariableChunkSize);
+
+  // The COPC info VLR goes in front of the LASzip VLR, followed by the offset to the chunk table
+  _point_data_offset = _header_template.size() + copc::VLRHeaderSize + copc::InfoVLRSize;
+  _next_chunk_offset = _point_data_offset + sizeof(int64_t);
+
+  std::ofstream writer{ _file_path, std::ios::out | std::ios::binary | std::ios::trunc };
+  const std::string header_placeholder(_next_chunk_offset, '\0');
+  writer.write(header_placeholder.data(), static_cast<std::streamsize>(header_placeholder.size()));
+  if (!writer.good()) {
+    throw std::runtime_error{ concat("Could not open COPC file ", _file_path) };
+  }
+}
+
+CopcPersistence::~CopcPersistence()
+{
+  // Moved-from instances have no lock and nothing to write
+  if (!_lock || _finalized)
+    return;
+
+  try {
+    finalize();
+  } catch (const std::exception& ex) {
+    std::cerr << "Could not finalize COPC file " << _file_path << " (" << ex.what() << ")"
+              << std::endl;
+  }
+}
+
+void
+CopcPersistence::persist_points(PointBuffer const& points,
+                                const AABB& bounds,
+                                const OctreeNodeIndex64& node_index)
+{
+  persist_points(std::begin(points), std::end(points), bounds, node_index);
+}
+
+void
+CopcPersistence::retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
+{
+  const auto key = copc::voxel_key_from_node_index(node_index);
+  ChunkLocation location;
+  {
+    std::lock_guard<std::mutex> lock{ *_lock };
+    const auto iter = _chunks.find(key);
+    if (iter == std::end(_chunks))
+      return;
+    location = iter->second;
+  }
+
+  // The chunk is read into a LAZ file of its own, with the header of the COPC file
+  auto laz_file = _header_template;
+  write_value(laz_file, NumberOfPointRecordsOffset, uint64_t{ location.point_count });
+  write_value(laz_file, NumberOfPointsByReturnOffset, uint64_t{ location.point_count });
+  append_value(laz_file,
+               static_cast<int64_t>(_header_template.size() + sizeof(int64_t) + location.byte_size));
+
+  const auto chunk_begin = laz_file.size();
+  laz_file.resize(chunk_begin + location.byte_size);
+  std::ifstream reader{ _file_path, std::ios::in | std::ios::binary };
+  reader.seekg(static_cast<std::streamoff>(location.offset));
+  reader.read(laz_file.data() + chunk_begin, static_cast<std::streamsize>(location.byte_size));
+  if (!reader.good()) {
+    std::cerr << "Could not read node " << node_name_from_index(node_index) << " from COPC file "
+              << _file_path << std::endl;
+    return;
+  }
+
+  const auto chunk_table = las::encode_chunk_table({ location.byte_size }, { location.point_count });
+  laz_file.append(reinterpret_cast<const char*>(chunk_table.data()), chunk_table.size());
+
+  if (!copc::decompress_node(laz_file, _input_attributes, points)) {
+    std::cerr << "Could not read node " << node_name_from_index(node_index) << " from COPC file "
+              << _file_path << std::endl;
+  }
+}
+
+bool
+CopcPersistence::node_exists(const OctreeNodeIndex64& node_index) const
+{
+  const auto key = copc::voxel_key_from_node_index(node_index);
+  std::lock_guard<std::mutex> lock{ *_lock };
+  return _chunks.find(key) != std::end(_chunks);
+}
+
+void
+CopcPersistence::write_chunk(const OctreeNodeIndex64& node_index,
+                             std::string_view chunk,
+                             uint32_t point_count,
+                             const NodeBounds& node_bounds)
+{
+  const auto key = copc::voxel_key_from_node_index(node_index);
+  if (chunk.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    throw std::runtime_error{ concat(
+      "Node ", node_name_from_index(node_index), " is too large for a COPC file") };
+  }
+
+  uint64_t offset;
+  {
+    std::lock_guard<std::mutex> lock{ *_lock };
+    if (_finalized) {
+      throw std::runtime_error{ concat("COPC file ", _file_path, " is already finalized") };
+    }
+    offset = _next_chunk_offset;
+    _next_chunk_offset += chunk.size();
+  }
+
+  // Chunks are written at their reserved offsets without holding the lock
+  std::fstream writer;
+  writer.rdbuf()->pubsetbuf(nullptr, 0);
+  writer.open(_file_path, std::ios::in | std::ios::out | std::ios::binary);
+  write_at(writer, offset, chunk.data(), chunk.size());
+  if (!writer.good()) {
+    throw std::runtime_error{ concat(
+      "Could not write node ", node_name_from_index(node_index), " to COPC file ", _file_path) };
+  }
+
+  std::lock_guard<std::mutex> lock{ *_lock };
+  _chunks[key] = { offset, static_cast<uint32_t>(chunk.size()), point_count };
+  _file_bounds.bounds.update(node_bounds.bounds);
+  _file_bounds.gps_time_min = std::min(_file_bounds.gps_time_min, node_bounds.gps_time_min);
+  _file_bounds.gps_time_max = std::max(_file_bounds.gps_time_max, node_bounds.gps_time_max);
+}
+
+void
+CopcPersistence::finalize()
+{
+  std::lock_guard<std::mutex> lock{ *_lock };
+  if (_finalized)
+    return;
+  _finalized = true;
+
+  std::fstream file{ _file_path, std::ios::in | std::ios::out | std::ios::binary };
+  if (!file.is_open()) {
+    throw std::runtime_error{ concat("Could not open COPC file ", _file_path) };
+  }
+
+  // Chunks are moved to the front in the order in which they were written, which removes the old
+  // chunks of nodes that were persisted more than once
+  std::vector<ChunkLocation*> chunks;
+  chunks.reserve(_chunks.size());
+  for (auto& [key, location] : _chunks) {
+    chunks.push_back(&location);
+  }
+  std::sort(std::begin(chunks), std::end(chunks), [](const auto* l, const auto* r) {
+    return l->offset < r->offset;
+  });
+
+  std::vector<uint32_t> chunk_byte_sizes;
+  std::vector<uint32_t> chunk_point_counts;
+  chunk_byte_sizes.reserve(chunks.size());
+  chunk_point_counts.reserve(chunks.size());
+  uint64_t chunk_offset = _point_data_offset + sizeof(int64_t);
+  uint64_t total_point_count = 0;
+  std::vector<char> chunk_buffer;
+  for (auto location : chunks) {
+    if (location->offset != chunk_offset) {
+      chunk_buffer.resize(location->byte_size);
+      file.seekg(static_cast<std::streamoff>(location->offset));
+      file.read(chunk_buffer.data(), static_cast<std::streamsize>(location->byte_size));
+      write_at(file, chunk_offset, chunk_buffer.data(), chunk_buffer.size());
+      location->offset = chunk_offset;
+    }
+    chunk_offset += location->byte_size;
+    chunk_byte_sizes.push_back(location->byte_size);
+    chunk_point_counts.push_back(location->point_count);
+    total_point_count += location->point_count;
+  }
+
+  const auto chunk_table_offset = chunk_offset;
+  const auto chunk_table = las::encode_chunk_table(chunk_byte_sizes, chunk_point_counts);
+  write_at(file,
+           chunk_table_offset,
+           reinterpret_cast<const char*>(chunk_table.data()),
+           chunk_table.size());
+
+  std::vector<copc::HierarchyEntry> entries;
+  entries.reserve(_chunks.size());
+  for (auto& [key, location] : _chunks) {
+    entries.push_back({ key,
+                        location.offset,
+                        static_cast<int32_t>(location.byte_size),
+                        static_cast<int32_t>(location.point_count) });
+  }
+  const auto hierarchy_evlr_offset = chunk_table_offset + chunk_table.size();
+  const auto root_page_offset = hierarchy_evlr_offset + copc::EVLRHeaderSize;
+  const auto hierarchy = copc::encode_hierarchy(std::move(entries), root_page_offset);
+  const auto hierarchy_header =
+    vlr_header("copc", HierarchyRecordID, hierarchy.data.size(), "EPT hierarchy", true);
+  write_at(file, hierarchy_evlr_offset, hierarchy_header.data(), hierarchy_header.size());
+  write_at(file,
+           root_page_offset,
+           reinterpret_cast<const char*>(hierarchy.data.data()),
+           hierarchy.data.size());
+
+  // Header, COPC info VLR and LASzip VLR
+  auto header = _header_template.substr(0, copc::HeaderSize);
+  const auto& bounds = chunks.empty() ? _cubic_bounds : _file_bounds.bounds;
+  write_value(header, OffsetToPointDataOffset, static_cast<uint32_t>(_point_data_offset));
+  write_value(header, NumberOfVLRsOffset, uint32_t{ 2 });
+  const std::array<double, 6> header_bounds = { bounds.max.x, bounds.min.x, bounds.max.y,
+                                                bounds.min.y, bounds.max.z, bounds.min.z };
+  write_value(header, MaxXOffset, header_bounds);
+  write_value(header, StartOfFirstEVLROffset, uint64_t{ hierarchy_evlr_offset });
+  write_value(header, NumberOfEVLRsOffset, uint32_t{ 1 });
+  write_value(header, NumberOfPointRecordsOffset, total_point_count);
+  write_value(header, NumberOfPointsByReturnOffset, total_point_count);
+
+  header += vlr_header("copc", InfoRecordID, copc::InfoVLRSize, "COPC info", false);
+  const auto center = _cubic_bounds.getCenter();
+  append_value(header, center.x);
+  append_value(header, center.y);
+  append_value(header, center.z);
+  append_value(header, _cubic_bounds.extent().x / 2);
+  append_value(header, static_cast<double>(_spacing));
+  append_value(header, uint64_t{ root_page_offset });
+  append_value(header, hierarchy.root_page_size);
+  const auto has_gps_times = _fields.gps_time && !chunks.empty();
+  append_value(header, has_gps_times ? _file_bounds.gps_time_min : 0.0);
+  append_value(header, has_gps_times ? _file_bounds.gps_time_max : 0.0);
+  header.append(11 * sizeof(uint64_t), '\0'); // reserved
+
+  header.append(_header_template, copc::HeaderSize, std::string::npos);
+  append_value(header, static_cast<int64_t>(chunk_table_offset));
+  assert(header.size() == _point_data_offset + sizeof(int64_t));
+  write_at(file, 0, header.data(), header.size());
+
+  if (!file.good()) {
+    throw std::runtime_error{ concat("Could not write COPC file ", _file_path) };
+  }
+  file.close();
+
+  // Drop the space of chunks that were replaced
+  std::experimental::filesystem::resize_file(_file_path,
+                                             root_page_offset + hierarchy.data.size());
+}
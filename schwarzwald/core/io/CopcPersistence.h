@@ -0,0 +1,369 @@
+#pragma once
+
+#include "datastructures/OctreeNodeIndex.h"
+#include "datastructures/PointBuffer.h"
+#include "io/LASPersistence.h"
+#include "io/LASWriter.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+#include "util/stuff.h"
+
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/scope_exit.hpp>
+
+namespace copc {
+
+// Sizes of the structures of LAS 1.4 and COPC files, see https://copc.io/copc-specification-1.0.pdf
+constexpr uint16_t HeaderSize = 375;
+constexpr size_t VLRHeaderSize = 54;
+constexpr size_t EVLRHeaderSize = 60;
+constexpr size_t InfoVLRSize = 160;
+constexpr size_t HierarchyEntrySize = 32;
+// Every hierarchy page contains the nodes of this many levels of the octree
+constexpr int32_t HierarchyPageDepth = 5;
+
+/**
+ * Key of a node in the octree of a COPC file, which is the same as the key of the node in Entwine
+ */
+struct VoxelKey
+{
+  int32_t d;
+  int32_t x;
+  int32_t y;
+  int32_t z;
+
+  /**
+   * Key of the ancestor of this node at the given depth
+   */
+  VoxelKey ancestor_at_depth(int32_t depth) const;
+
+  bool operator==(const VoxelKey& other) const;
+  bool operator<(const VoxelKey& other) const;
+};
+
+/**
+ * Key of the node with the given index
+ */
+VoxelKey
+voxel_key_from_node_index(const OctreeNodeIndex64& node_index);
+
+/**
+ * Entry of the hierarchy of a COPC file, which locates the compressed chunk of a single node
+ */
+struct HierarchyEntry
+{
+  VoxelKey key;
+  uint64_t offset;
+  int32_t byte_size;
+  int32_t point_count;
+};
+
+struct EncodedHierarchy
+{
+  std::vector<std::byte> data;
+  uint64_t root_page_size;
+};
+
+/**
+ * Encodes the hierarchy of all nodes as COPC hierarchy pages. Every page holds the nodes of
+ * HierarchyPageDepth levels below its root node, and points to the pages below it with entries that
+ * have a point count of -1. The root page comes first. 'payload_offset' is the offset in the file at
+ * which the returned data will be written
+ */
+EncodedHierarchy
+encode_hierarchy(std::vector<HierarchyEntry> entries, uint64_t payload_offset);
+
+/**
+ * Fields of the LAS 1.4 point records for points with the given attributes
+ */
+las::PointRecordFields
+point_record_fields_for_attributes(const PointAttributes& attributes);
+
+/**
+ * COPC files use LAS 1.4 point data format 6, or 7 if the points have colors
+ */
+inline uint8_t
+point_data_format(const las::PointRecordFields& fields)
+{
+  return fields.rgb ? 7 : 6;
+}
+
+inline uint16_t
+point_record_length(const las::PointRecordFields& fields)
+{
+  return fields.rgb ? 36 : 30;
+}
+
+/**
+ * Compresses the points in [begin, end) as a LAS 1.4 LAZ file with a single chunk and returns the
+ * whole file. Offset and bounds of the file are taken from 'file_bounds', so that chunks of all
+ * nodes can be stored in the same file. Returns an empty string on failure
+ */
+template<typename Iter>
+std::string
+compress_node(Iter begin,
+              Iter end,
+              const las::PointRecordFields& fields,
+              const AABB& file_bounds,
+              double scale)
+{
+  const auto num_points = static_cast<uint32_t>(std::distance(begin, end));
+
+  laszip_POINTER laswriter = nullptr;
+  laszip_create(&laswriter);
+  if (!laswriter)
+    return {};
+
+  BOOST_SCOPE_EXIT_TPL(&laswriter) { laszip_destroy(laswriter); }
+  BOOST_SCOPE_EXIT_END
+
+  const auto fail = [&laswriter]() {
+    std::cerr << "Could not compress COPC node (" << las::laszip_error_message(laswriter) << ")\n";
+    return std::string{};
+  };
+
+  laszip_header* las_header;
+  if (!las::setup_laszip_header(laswriter, num_points, fields, file_bounds, scale) ||
+      laszip_get_header_pointer(laswriter, &las_header)) {
+    return fail();
+  }
+
+  // The legacy point counts have to be zero for point data formats 6 and above
+  las_header->version_minor = 4;
+  las_header->header_size = HeaderSize;
+  las_header->offset_to_point_data = HeaderSize;
+  las_header->global_encoding = 1 << 4; // WKT
+  las_header->point_data_format = point_data_format(fields);
+  las_header->point_data_record_length = point_record_length(fields);
+  las_header->number_of_point_records = 0;
+  las_header->number_of_points_by_return[0] = 0;
+  las_header->extended_number_of_point_records = num_points;
+  las_header->extended_number_of_points_by_return[0] = num_points;
+
+  std::ostringstream stream;
+  if (laszip_request_native_extension(laswriter, 1) ||
+      laszip_set_chunk_size(laswriter, std::max(num_points, 1u)) ||
+      laszip_open_writer_stream(laswriter, stream, 1, 0)) {
+    return fail();
+  }
+
+  laszip_point* laspoint;
+  if (laszip_get_point_pointer(laswriter, &laspoint))
+    return fail();
+
+  auto points_written = true;
+  for (; begin != end; ++begin) {
+    const auto& point_ref = *begin;
+    const auto pos = point_ref.position();
+    laszip_F64 coordinates[3] = { pos.x, pos.y, pos.z };
+    if (laszip_set_coordinates(laswriter, coordinates)) {
+      points_written = false;
+      break;
+    }
+
+    if (fields.rgb) {
+      // See comment in las::write_points_with_laszip for an explanation of the bit-shift
+      const auto rgb = point_ref.rgbColor();
+      laspoint->rgb[0] = rgb->x << 8;
+      laspoint->rgb[1] = rgb->y << 8;
+      laspoint->rgb[2] = rgb->z << 8;
+    }
+    if (fields.intensity) {
+      laspoint->intensity = *point_ref.intensity();
+    }
+    if (fields.classification) {
+      // LASzip requires that the legacy classification matches the extended one where it can
+      const auto classification = *point_ref.classification();
+      laspoint->extended_classification = classification;
+      laspoint->classification = (classification < 32) ? classification : 0;
+    }
+    if (fields.edge_of_flight_line) {
+      laspoint->edge_of_flight_line = *point_ref.edge_of_flight_line();
+    }
+    if (fields.gps_time) {
+      laspoint->gps_time = *point_ref.gps_time();
+    }
+    if (fields.number_of_returns) {
+      laspoint->extended_number_of_returns = *point_ref.number_of_returns();
+    }
+    if (fields.return_number) {
+      laspoint->extended_return_number = *point_ref.return_number();
+    }
+    if (fields.point_source_id) {
+      laspoint->point_source_ID = *point_ref.point_source_id();
+    }
+    if (fields.scan_angle_rank) {
+      // The extended scan angle is stored in increments of 0.006 degrees
+      laspoint->extended_scan_angle =
+        static_cast<laszip_I16>(std::round(*point_ref.scan_angle_rank() / 0.006));
+    }
+    if (fields.scan_direction_flag) {
+      laspoint->scan_direction_flag = *point_ref.scan_direction_flag();
+    }
+    if (fields.user_data) {
+      laspoint->user_data = *point_ref.user_data();
+    }
+
+    if (laszip_write_point(laswriter)) {
+      points_written = false;
+      break;
+    }
+  }
+
+  if (laszip_close_writer(laswriter) || !points_written)
+    return fail();
+
+  return stream.str();
+}
+
+/**
+ * Decompresses a LAS 1.4 LAZ file that was written by 'compress_node' (or that contains a single
+ * chunk of a COPC file) into 'points'. Returns false on failure
+ */
+bool
+decompress_node(const std::string& laz_file,
+                const PointAttributes& attributes,
+                PointBuffer& points);
+
+} // namespace copc
+
+/**
+ * Sink that writes all nodes into a single Cloud Optimized Point Cloud (COPC) file, which is a LAZ
+ * 1.4 file where every node of the octree is a chunk of its own. Chunks are compressed
+ * independently and written concurrently at offsets that are reserved when a node is persisted. The
+ * hierarchy of all nodes, the chunk table and the final header are written when the sink is
+ * finalized, which happens on destruction at the latest
+ */
+struct CopcPersistence
+{
+  static PointAttributes supported_output_attributes();
+
+  /**
+   * Creates a CopcPersistence that writes to 'pointcloud.copc.laz' in 'work_dir'. 'cubic_bounds' are
+   * the bounds of the root node and 'spacing' is the point spacing at the root node
+   */
+  CopcPersistence(const std::string& work_dir,
+                  const PointAttributes& input_attributes,
+                  const PointAttributes& output_attributes,
+                  const AABB& cubic_bounds,
+                  float spacing);
+  CopcPersistence(const CopcPersistence&) = delete;
+  CopcPersistence(CopcPersistence&&) = default;
+  CopcPersistence& operator=(const CopcPersistence&) = delete;
+  CopcPersistence& operator=(CopcPersistence&&) = default;
+  ~CopcPersistence();
+
+  template<typename Iter>
+  void persist_points(Iter points_begin,
+                      Iter points_end,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index)
+  {
+    const auto num_points = static_cast<uint32_t>(std::distance(points_begin, points_end));
+    if (!num_points)
+      return;
+
+    const auto fields = las::point_record_fields_for_points(*points_begin, _output_attributes);
+    if (fields.rgb != _fields.rgb) {
+      throw std::runtime_error{ concat("Points of node ",
+                                       node_name_from_index(node_index),
+                                       " do not have the same attributes as the COPC file") };
+    }
+
+    const auto laz_file =
+      copc::compress_node(points_begin, points_end, fields, _cubic_bounds, _scale);
+    const auto chunk = las::read_laz_chunks(laz_file);
+    if (!chunk) {
+      throw std::runtime_error{ concat("Could not compress node ",
+                                       node_name_from_index(node_index)) };
+    }
+
+    NodeBounds node_bounds;
+    for (auto iter = points_begin; iter != points_end; ++iter) {
+      const auto& point = *iter;
+      node_bounds.bounds.update(point.position());
+      if (fields.gps_time) {
+        node_bounds.gps_time_min = std::min(node_bounds.gps_time_min, *point.gps_time());
+        node_bounds.gps_time_max = std::max(node_bounds.gps_time_max, *point.gps_time());
+      }
+    }
+
+    write_chunk(node_index, chunk->second, num_points, node_bounds);
+  }
+
+  void persist_points(PointBuffer const& points,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index);
+
+  void retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points);
+
+  bool node_exists(const OctreeNodeIndex64& node_index) const;
+
+  inline bool is_lossless() const { return false; }
+
+  /**
+   * Writes the hierarchy, the chunk table and the final header of the COPC file. No points can be
+   * persisted afterwards. This is called on destruction if it has not been called before
+   */
+  void finalize();
+
+  /**
+   * Path of the COPC file
+   */
+  const std::string& file_path() const { return _file_path; }
+
+private:
+  struct ChunkLocation
+  {
+    uint64_t offset;
+    uint32_t byte_size;
+    uint32_t point_count;
+  };
+
+  /**
+   * Tight bounds of the points of a node
+   */
+  struct NodeBounds
+  {
+    AABB bounds;
+    double gps_time_min = std::numeric_limits<double>::max();
+    double gps_time_max = std::numeric_limits<double>::lowest();
+  };
+
+  /**
+   * Reserves space for the given chunk in the file, writes the chunk and adds it to the hierarchy.
+   * A node that is persisted again gets a new chunk, the old chunk is removed when the file is
+   * finalized
+   */
+  void write_chunk(const OctreeNodeIndex64& node_index,
+                   std::string_view chunk,
+                   uint32_t point_count,
+                   const NodeBounds& node_bounds);
+
+  std::string _file_path;
+  PointAttributes _input_attributes;
+  PointAttributes _output_attributes;
+  las::PointRecordFields _fields;
+  AABB _cubic_bounds;
+  float _spacing;
+  double _scale;
+  // Header and LASzip VLR of a LAZ file with the fields of this file. The COPC info VLR is inserted
+  // between them when the file is finalized
+  std::string _header_template;
+  uint64_t _point_data_offset;
+
+  std::unique_ptr<std::mutex> _lock;
+  uint64_t _next_chunk_offset;
+  std::map<copc::VoxelKey, ChunkLocation> _chunks;
+  NodeBounds _file_bounds;
+  bool _finalized;
+};
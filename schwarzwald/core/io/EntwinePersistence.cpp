@@ -1,17 +1,36 @@
 #include "io/EntwinePersistence.h"
 
-#include "datastructures/DynamicMortonIndex.h"
 #include "datastructures/OctreeNodeIndex.h"
+#include "io/AsyncFileWriter.h"
+#include "io/io_util.h"
 #include "util/Error.h"
 #include "util/stuff.h"
 
+#include <algorithm>
+#include <tuple>
+
 #include <rapidjson/document.h>
 #include <rapidjson/error/en.h>
 #include <rapidjson/filewritestream.h>
+#include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 
 namespace rj = rapidjson;
 
+/**
+ * Order of the attributes in the EPT schema, which follows the order of the LAS point record
+ * formats
+ */
+static const std::array<PointAttribute, 13> EPT_ATTRIBUTE_ORDER = {
+  PointAttribute::Position,          PointAttribute::Intensity,
+  PointAttribute::ReturnNumber,      PointAttribute::NumberOfReturns,
+  PointAttribute::ScanDirectionFlag, PointAttribute::EdgeOfFlightLine,
+  PointAttribute::Classification,    PointAttribute::ScanAngleRank,
+  PointAttribute::UserData,          PointAttribute::PointSourceID,
+  PointAttribute::GPSTime,           PointAttribute::RGB,
+  PointAttribute::Normal
+};
+
 static std::string
 extension_from_entwine_format(EntwineFormat format)
 {
@@ -20,8 +39,8 @@ extension_from_entwine_format(EntwineFormat format)
       return ".las";
     case EntwineFormat::LAZ:
       return ".laz";
-    // case EntwineFormat::Binary:
-    //   return ".bin";
+    case EntwineFormat::Binary:
+      return ".bin";
     default:
       throw std::runtime_error{ concat("Unrecognized EntwineFormat: ",
                                        static_cast<uint32_t>(format)) };
@@ -50,7 +69,7 @@ create_ept_folder_structure(const fs::path& root_dir)
 
 static void
 create_hierarchy_files(const fs::path& root_dir,
-                       const std::unordered_map<std::string, size_t>& hierarchy)
+                       const std::unordered_map<OctreeNodeIndex64, size_t>& hierarchy)
 {
   // Split large tree into subtrees of defined depth
   constexpr uint32_t SPLIT_DEPTH = 5;
@@ -68,45 +87,41 @@ create_hierarchy_files(const fs::path& root_dir,
     return parent_index;
   };
 
+  // Pages are written straight from their entries with a single write per file, without building a
+  // JSON document first. Entries are sorted by level, so that the files are deterministic
   const auto write_hierarchy_json = [&root_dir](const OctreeNodeIndex64& parent,
                                                 const Hierarchy& hierarchy) {
-    rj::Document document;
-    auto& allocator = document.GetAllocator();
-
-    document.SetObject();
-
+    std::vector<std::tuple<uint32_t, std::string, int64_t>> entries;
+    entries.reserve(hierarchy.size());
     for (auto& kv : hierarchy) {
-      const auto entry_name =
-        OctreeNodeIndex64::to_string(kv.first, MortonIndexNamingConvention::Entwine);
-      rj::Value entry_name_value{ entry_name.c_str(),
-                                  static_cast<rj::SizeType>(entry_name.size()),
-                                  allocator };
-      document.AddMember(entry_name_value, kv.second, allocator);
+      entries.emplace_back(
+        kv.first.levels(),
+        OctreeNodeIndex64::to_string(kv.first, MortonIndexNamingConvention::Entwine),
+        kv.second);
     }
+    std::sort(std::begin(entries), std::end(entries));
+
+    rj::StringBuffer buffer;
+    rj::Writer<rj::StringBuffer> writer{ buffer };
+    writer.StartObject();
+    for (const auto& [level, entry_name, count] : entries) {
+      writer.Key(entry_name.c_str(), static_cast<rj::SizeType>(entry_name.size()));
+      writer.Int64(count);
+    }
+    writer.EndObject();
 
     const auto file_path =
       concat(root_dir.string(),
              "/ept-hierarchy/",
              OctreeNodeIndex64::to_string(parent, MortonIndexNamingConvention::Entwine),
              ".json");
-
-    try {
-      write_json_to_file(document, file_path);
-    } catch (const std::exception& ex) {
-      throw util::chain_error(ex, "Could not write hierarchy file");
+    if (!write_file_unbuffered(file_path, buffer.GetString(), buffer.GetSize())) {
+      throw std::runtime_error{ concat("Could not write hierarchy file ", file_path) };
     }
   };
 
   for (auto& kv : hierarchy) {
-    const auto maybe_node_index =
-      OctreeNodeIndex64::from_string(kv.first, MortonIndexNamingConvention::Entwine);
-    if (!maybe_node_index.has_value()) {
-      std::cerr << "Could not include node " << kv.first
-                << " into ept-hierarchy: " << maybe_node_index.error() << "\n";
-      continue;
-    }
-
-    const auto node_index = maybe_node_index.value();
+    const auto& node_index = kv.first;
     const auto parent = get_parent_index_in_hierarchy(node_index);
 
     auto hierarchy_iter = split_hierarchies.find(parent);
@@ -130,11 +145,14 @@ create_hierarchy_files(const fs::path& root_dir,
 }
 
 std::vector<EptSchemaEntry>
-point_attributes_to_ept_schema(const PointAttributes& point_attributes)
+point_attributes_to_ept_schema(const PointAttributes& point_attributes, EntwineFormat format)
 {
   std::vector<EptSchemaEntry> schema;
   // TECH_DEBT Refactor
-  for (auto& attribute : point_attributes) {
+  for (auto attribute : EPT_ATTRIBUTE_ORDER) {
+    if (!has_attribute(point_attributes, attribute))
+      continue;
+
     switch (attribute) {
       case PointAttribute::Classification:
         schema.push_back({ "Classification", std::nullopt, std::nullopt, 1, "unsigned" });
@@ -160,6 +178,12 @@ point_attributes_to_ept_schema(const PointAttributes& point_attributes)
         schema.push_back({ "PointSourceID", std::nullopt, std::nullopt, 2, "unsigned" });
         break;
       case PointAttribute::Position:
+        if (format == EntwineFormat::Binary) {
+          schema.push_back({ "X", std::nullopt, std::nullopt, 8, "float" });
+          schema.push_back({ "Y", std::nullopt, std::nullopt, 8, "float" });
+          schema.push_back({ "Z", std::nullopt, std::nullopt, 8, "float" });
+          break;
+        }
         // TODO Offset and scale, where do they come from if we have multiple
         // source files?
         schema.push_back({ "X", 0, 1, 4, "signed" });
@@ -193,6 +217,230 @@ point_attributes_to_ept_schema(const PointAttributes& point_attributes)
   return schema;
 }
 
+ept::BinaryLayout
+ept::binary_layout_for_attributes(const PointAttributes& attributes)
+{
+  BinaryLayout layout;
+  layout.record_size = 0;
+  const auto schema = point_attributes_to_ept_schema(attributes, EntwineFormat::Binary);
+  auto schema_entry = std::begin(schema);
+  for (auto attribute : EPT_ATTRIBUTE_ORDER) {
+    if (!has_attribute(attributes, attribute))
+      continue;
+
+    // Attributes with multiple components span multiple dimensions of the schema
+    const auto num_dimensions =
+      (attribute == PointAttribute::Position || attribute == PointAttribute::RGB ||
+       attribute == PointAttribute::Normal)
+        ? 3
+        : 1;
+    layout.columns.push_back({ attribute, layout.record_size });
+    for (int dimension = 0; dimension < num_dimensions; ++dimension, ++schema_entry) {
+      layout.record_size += schema_entry->size;
+    }
+  }
+  return layout;
+}
+
+/**
+ * Encodes the given column of a PointBuffer, or default values if the PointBuffer doesn't have the
+ * attribute
+ */
+template<typename T, typename GetValue>
+static void
+encode_buffer_column(const std::vector<T>& values,
+                     size_t count,
+                     std::byte* dst,
+                     uint32_t stride,
+                     GetValue get_value)
+{
+  if (!values.empty()) {
+    ept::encode_binary_column(std::begin(values), std::end(values), dst, stride, get_value);
+    return;
+  }
+
+  const auto default_value = get_value(T{});
+  for (size_t idx = 0; idx < count; ++idx) {
+    std::memcpy(dst, &default_value, sizeof(default_value));
+    dst += stride;
+  }
+}
+
+void
+ept::encode_binary_points(const PointBuffer& points,
+                          const BinaryLayout& layout,
+                          std::vector<std::byte>& dst)
+{
+  const auto count = points.count();
+  dst.resize(count * layout.record_size);
+
+  const auto identity = [](auto value) { return value; };
+  for (const auto& column : layout.columns) {
+    const auto column_begin = dst.data() + column.byte_offset;
+    const auto stride = layout.record_size;
+    switch (column.attribute) {
+      case PointAttribute::Position:
+        encode_buffer_column(
+          points.positions(), count, column_begin, stride, [](const auto& position) {
+            return std::array<double, 3>{ position.x, position.y, position.z };
+          });
+        break;
+      case PointAttribute::Intensity:
+        encode_buffer_column(points.intensities(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::ReturnNumber:
+        encode_buffer_column(points.return_numbers(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::NumberOfReturns:
+        encode_buffer_column(points.number_of_returns(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::ScanDirectionFlag:
+        encode_buffer_column(points.scan_direction_flags(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::EdgeOfFlightLine:
+        encode_buffer_column(points.edge_of_flight_lines(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::Classification:
+        encode_buffer_column(points.classifications(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::ScanAngleRank:
+        encode_buffer_column(points.scan_angle_ranks(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::UserData:
+        encode_buffer_column(points.user_data(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::PointSourceID:
+        encode_buffer_column(points.point_source_ids(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::GPSTime:
+        encode_buffer_column(points.gps_times(), count, column_begin, stride, identity);
+        break;
+      case PointAttribute::RGB:
+        // Colors are stored with 16 bits, like in the iterator overload
+        encode_buffer_column(
+          points.rgbColors(), count, column_begin, stride, [](const auto& color) {
+            return std::array<uint16_t, 3>{ static_cast<uint16_t>(color.x << 8),
+                                            static_cast<uint16_t>(color.y << 8),
+                                            static_cast<uint16_t>(color.z << 8) };
+          });
+        break;
+      case PointAttribute::Normal:
+        encode_buffer_column(points.normals(), count, column_begin, stride, [](const auto& normal) {
+          return std::array<float, 3>{ normal.x, normal.y, normal.z };
+        });
+        break;
+      default:
+        throw std::runtime_error{ "Unhandled PointAttribute in switch statement" };
+    }
+  }
+}
+
+template<typename T, typename SetValue>
+static void
+decode_binary_column(const std::byte* src, size_t count, uint32_t stride, SetValue set_value)
+{
+  T value;
+  for (size_t idx = 0; idx < count; ++idx) {
+    std::memcpy(&value, src, sizeof(T));
+    set_value(idx, value);
+    src += stride;
+  }
+}
+
+bool
+ept::decode_binary_points(gsl::span<const std::byte> data,
+                          const BinaryLayout& layout,
+                          const PointAttributes& attributes,
+                          PointBuffer& points)
+{
+  if (!layout.record_size || data.size() % layout.record_size != 0)
+    return false;
+
+  const auto count = static_cast<size_t>(data.size()) / layout.record_size;
+  PointBuffer decoded{ count, attributes };
+  const auto stride = layout.record_size;
+  for (const auto& column : layout.columns) {
+    if (!has_attribute(attributes, column.attribute))
+      continue;
+
+    const auto src = data.data() + column.byte_offset;
+    switch (column.attribute) {
+      case PointAttribute::Position:
+        decode_binary_column<std::array<double, 3>>(
+          src, count, stride, [&](size_t idx, const auto& value) {
+            decoded.positions()[idx] = { value[0], value[1], value[2] };
+          });
+        break;
+      case PointAttribute::Intensity:
+        decode_binary_column<uint16_t>(
+          src, count, stride, [&](size_t idx, auto value) { decoded.intensities()[idx] = value; });
+        break;
+      case PointAttribute::ReturnNumber:
+        decode_binary_column<uint8_t>(src, count, stride, [&](size_t idx, auto value) {
+          decoded.return_numbers()[idx] = value;
+        });
+        break;
+      case PointAttribute::NumberOfReturns:
+        decode_binary_column<uint8_t>(src, count, stride, [&](size_t idx, auto value) {
+          decoded.number_of_returns()[idx] = value;
+        });
+        break;
+      case PointAttribute::ScanDirectionFlag:
+        decode_binary_column<uint8_t>(src, count, stride, [&](size_t idx, auto value) {
+          decoded.scan_direction_flags()[idx] = value;
+        });
+        break;
+      case PointAttribute::EdgeOfFlightLine:
+        decode_binary_column<uint8_t>(src, count, stride, [&](size_t idx, auto value) {
+          decoded.edge_of_flight_lines()[idx] = value;
+        });
+        break;
+      case PointAttribute::Classification:
+        decode_binary_column<uint8_t>(src, count, stride, [&](size_t idx, auto value) {
+          decoded.classifications()[idx] = value;
+        });
+        break;
+      case PointAttribute::ScanAngleRank:
+        decode_binary_column<int8_t>(src, count, stride, [&](size_t idx, auto value) {
+          decoded.scan_angle_ranks()[idx] = value;
+        });
+        break;
+      case PointAttribute::UserData:
+        decode_binary_column<uint8_t>(
+          src, count, stride, [&](size_t idx, auto value) { decoded.user_data()[idx] = value; });
+        break;
+      case PointAttribute::PointSourceID:
+        decode_binary_column<uint16_t>(src, count, stride, [&](size_t idx, auto value) {
+          decoded.point_source_ids()[idx] = value;
+        });
+        break;
+      case PointAttribute::GPSTime:
+        decode_binary_column<double>(
+          src, count, stride, [&](size_t idx, auto value) { decoded.gps_times()[idx] = value; });
+        break;
+      case PointAttribute::RGB:
+        decode_binary_column<std::array<uint16_t, 3>>(
+          src, count, stride, [&](size_t idx, const auto& value) {
+            decoded.rgbColors()[idx] = { static_cast<uint8_t>(value[0] >> 8),
+                                         static_cast<uint8_t>(value[1] >> 8),
+                                         static_cast<uint8_t>(value[2] >> 8) };
+          });
+        break;
+      case PointAttribute::Normal:
+        decode_binary_column<std::array<float, 3>>(
+          src, count, stride, [&](size_t idx, const auto& value) {
+            decoded.normals()[idx] = { value[0], value[1], value[2] };
+          });
+        break;
+      default:
+        throw std::runtime_error{ "Unhandled PointAttribute in switch statement" };
+    }
+  }
+
+  points = std::move(decoded);
+  return true;
+}
+
 void
 write_ept_json(const fs::path& file_path, const EptJson& ept_json)
 {
@@ -227,6 +475,9 @@ write_ept_json(const fs::path& file_path, const EptJson& ept_json)
     case EntwineFormat::LAZ:
       document.AddMember("dataType", "laszip", allocator);
       break;
+    case EntwineFormat::Binary:
+      document.AddMember("dataType", "binary", allocator);
+      break;
     default:
       throw std::runtime_error{ "Unhandled enum constant for enum EntwineFormat" };
   }
@@ -275,59 +526,107 @@ EntwinePersistence::EntwinePersistence(const std::string& work_dir,
   : _work_dir(work_dir)
   , _format(format)
   , _file_extension(extension_from_entwine_format(format))
+  , _input_attributes(input_attributes)
+  , _binary_layout(ept::binary_layout_for_attributes(output_attributes))
   , _las_persistence(concat(work_dir, "/ept-data"),
                      input_attributes,
                      output_attributes,
-                     format == EntwineFormat::LAZ ? Compressed::Yes : Compressed::No)
-  , _hierarchy_lock(std::make_unique<std::mutex>())
+                     format == EntwineFormat::LAZ ? Compressed::Yes : Compressed::No,
+                     MortonIndexNamingConvention::Entwine)
 {
   create_ept_folder_structure(work_dir);
 }
 
 EntwinePersistence::~EntwinePersistence()
 {
-  create_hierarchy_files(_work_dir, _hierarchy);
+  create_hierarchy_files(_work_dir, _hierarchy.collect());
 }
 
 void
 EntwinePersistence::persist_points(PointBuffer const& points,
                                    const AABB& bounds,
-                                   const std::string& node_name)
+                                   const OctreeNodeIndex64& node_index)
 {
-  if (!points.count())
+  if (points.empty())
     return;
 
-  const auto entwine_name = potree_name_to_entwine_name(node_name);
+  if (_format == EntwineFormat::Binary) {
+    thread_local std::vector<std::byte> records;
+    ept::encode_binary_points(points, _binary_layout, records);
+    write_binary_file(entwine_name_from_index(node_index), records);
+  } else {
+    _las_persistence.persist_points(points, bounds, node_index);
+  }
 
-  _las_persistence.persist_points(points, bounds, entwine_name);
+  _hierarchy.insert_or_assign(node_index, points.count());
+}
 
-  std::lock_guard guard{ *_hierarchy_lock };
-  _hierarchy[entwine_name] = points.count();
+void
+EntwinePersistence::persist_points(PointBuffer const& points,
+                                   const AABB& bounds,
+                                   const OctreeNodeIndex64& node_index,
+                                   tf::Subflow& subflow)
+{
+  if (_format == EntwineFormat::Binary || points.empty()) {
+    persist_points(points, bounds, node_index);
+    return;
+  }
+
+  _las_persistence.persist_points(points, bounds, node_index, subflow);
+  _hierarchy.insert_or_assign(node_index, points.count());
 }
 
 void
-EntwinePersistence::retrieve_points(const std::string& node_name, PointBuffer& points)
+EntwinePersistence::retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
 {
-  const auto entwine_name = potree_name_to_entwine_name(node_name);
+  if (_format != EntwineFormat::Binary) {
+    _las_persistence.retrieve_points(node_index, points);
+    return;
+  }
 
-  _las_persistence.retrieve_points(entwine_name, points);
+  const auto entwine_name = entwine_name_from_index(node_index);
+  const auto file_path = concat(_work_dir.string(), "/ept-data/", entwine_name, _file_extension);
+  wait_for_file_write(file_path);
+  std::ifstream reader{ file_path, std::ios::in | std::ios::binary };
+  if (!reader.is_open())
+    return;
+
+  reader.seekg(0, std::ios::end);
+  std::vector<std::byte> records(static_cast<size_t>(reader.tellg()));
+  reader.seekg(0, std::ios::beg);
+  reader.read(reinterpret_cast<char*>(records.data()),
+              static_cast<std::streamsize>(records.size()));
+  if (!reader.good() ||
+      !ept::decode_binary_points(records, _binary_layout, _input_attributes, points)) {
+    std::cerr << "Could not read points file " << file_path << std::endl;
+  }
 }
 
 bool
-EntwinePersistence::node_exists(const std::string& node_name) const
+EntwinePersistence::node_exists(const OctreeNodeIndex64& node_index) const
 {
-  const auto entwine_name = potree_name_to_entwine_name(node_name);
+  if (_format != EntwineFormat::Binary) {
+    return _las_persistence.node_exists(node_index);
+  }
 
+  const auto entwine_name = entwine_name_from_index(node_index);
   const auto file_path = concat(_work_dir.string(), "/ept-data/", entwine_name, _file_extension);
+  wait_for_file_write(file_path);
   return fs::exists(file_path);
 }
 
+void
+EntwinePersistence::write_binary_file(const std::string& entwine_name,
+                                      gsl::span<const std::byte> records)
+{
+  const auto file_path = concat(_work_dir.string(), "/ept-data/", entwine_name, _file_extension);
+  if (!write_file_async(file_path, records.data(), static_cast<size_t>(records.size()))) {
+    std::cerr << "Could not write points file " << file_path << std::endl;
+  }
+}
+
 std::string
-EntwinePersistence::potree_name_to_entwine_name(const std::string& potree_name)
+EntwinePersistence::entwine_name_from_index(const OctreeNodeIndex64& node_index)
 {
-  return DynamicMortonIndex::parse_string(potree_name, MortonIndexNamingConvention::Potree)
-    .map([](const DynamicMortonIndex& idx) {
-      return to_string(idx, MortonIndexNamingConvention::Entwine);
-    })
-    .value();
+  return OctreeNodeIndex64::to_string(node_index, MortonIndexNamingConvention::Entwine);
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "datastructures/OctreeNodeIndex.h"
 #include "datastructures/PointBuffer.h"
+#include "datastructures/ShardedMap.h"
 #include "io/LASFile.h"
 #include "io/LASPersistence.h"
 #include "math/AABB.h"
@@ -8,14 +10,19 @@
 #include "util/Definitions.h"
 #include "util/stuff.h"
 
-#include <mutex>
+#include <array>
+#include <cassert>
+#include <cstring>
 #include <unordered_map>
 
+#include <gsl/gsl>
+
 enum class EntwineFormat
 {
   LAS,
-  LAZ
-  // Binary
+  LAZ,
+  // Uncompressed point records as described by the schema in ept.json
+  Binary
 };
 
 struct EptSchemaEntry
@@ -28,10 +35,169 @@ struct EptSchemaEntry
 };
 
 /**
- * Converts PointAttributes to an Entwine schema
+ * Converts PointAttributes to an Entwine schema. The dimensions are always in the same order, which
+ * is the order of the point records of binary node files. For EntwineFormat::Binary, positions are
+ * stored as unscaled 64-bit floats
  */
 std::vector<EptSchemaEntry>
-point_attributes_to_ept_schema(const PointAttributes& point_attributes);
+point_attributes_to_ept_schema(const PointAttributes& point_attributes,
+                               EntwineFormat format = EntwineFormat::LAS);
+
+namespace ept {
+
+/**
+ * A single attribute in the point records of binary node files
+ */
+struct BinaryColumn
+{
+  PointAttribute attribute;
+  /**
+   * Offset of this attribute relative to the start of a point record
+   */
+  uint32_t byte_offset;
+};
+
+/**
+ * Layout of the point records of binary node files, which store all dimensions of a point next to
+ * each other in the order of the schema
+ */
+struct BinaryLayout
+{
+  std::vector<BinaryColumn> columns;
+  uint32_t record_size;
+};
+
+BinaryLayout
+binary_layout_for_attributes(const PointAttributes& attributes);
+
+/**
+ * Writes the value returned by 'get_value' for each point in [begin, end) to 'dst', with 'stride'
+ * bytes between consecutive values
+ */
+template<typename Iter, typename GetValue>
+void
+encode_binary_column(Iter begin, Iter end, std::byte* dst, uint32_t stride, GetValue get_value)
+{
+  for (; begin != end; ++begin) {
+    const auto value = get_value(*begin);
+    std::memcpy(dst, &value, sizeof(value));
+    dst += stride;
+  }
+}
+
+/**
+ * Encodes the points in [begin, end) as point records with the given layout into 'dst'
+ *
+ * 'Iter' has to dereference to PointBuffer::PointReference or PointBuffer::PointConstReference
+ */
+template<typename Iter>
+void
+encode_binary_points(Iter begin, Iter end, const BinaryLayout& layout, std::vector<std::byte>& dst)
+{
+  const auto num_points = static_cast<size_t>(std::distance(begin, end));
+  dst.resize(num_points * layout.record_size);
+
+  for (const auto& column : layout.columns) {
+    const auto column_begin = dst.data() + column.byte_offset;
+    const auto stride = layout.record_size;
+    switch (column.attribute) {
+      case PointAttribute::Position:
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          const auto& position = point.position();
+          return std::array<double, 3>{ position.x, position.y, position.z };
+        });
+        break;
+      case PointAttribute::Intensity:
+        encode_binary_column(
+          begin, end, column_begin, stride, [](const auto& point) { return *point.intensity(); });
+        break;
+      case PointAttribute::ReturnNumber:
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          return *point.return_number();
+        });
+        break;
+      case PointAttribute::NumberOfReturns:
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          return *point.number_of_returns();
+        });
+        break;
+      case PointAttribute::ScanDirectionFlag:
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          return *point.scan_direction_flag();
+        });
+        break;
+      case PointAttribute::EdgeOfFlightLine:
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          return *point.edge_of_flight_line();
+        });
+        break;
+      case PointAttribute::Classification:
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          return *point.classification();
+        });
+        break;
+      case PointAttribute::ScanAngleRank:
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          return *point.scan_angle_rank();
+        });
+        break;
+      case PointAttribute::UserData:
+        encode_binary_column(
+          begin, end, column_begin, stride, [](const auto& point) { return *point.user_data(); });
+        break;
+      case PointAttribute::PointSourceID:
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          return *point.point_source_id();
+        });
+        break;
+      case PointAttribute::GPSTime:
+        encode_binary_column(
+          begin, end, column_begin, stride, [](const auto& point) { return *point.gps_time(); });
+        break;
+      case PointAttribute::RGB:
+        // Colors are stored with 16 bits like in the LAS files, see comment in
+        // las::write_points_with_laszip
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          const auto color = point.rgbColor();
+          assert(color != nullptr);
+          return std::array<uint16_t, 3>{ static_cast<uint16_t>(color->x << 8),
+                                          static_cast<uint16_t>(color->y << 8),
+                                          static_cast<uint16_t>(color->z << 8) };
+        });
+        break;
+      case PointAttribute::Normal:
+        encode_binary_column(begin, end, column_begin, stride, [](const auto& point) {
+          const auto normal = point.normal();
+          assert(normal != nullptr);
+          return std::array<float, 3>{ normal->x, normal->y, normal->z };
+        });
+        break;
+      default:
+        throw std::runtime_error{ "Unhandled PointAttribute in switch statement" };
+    }
+  }
+}
+
+/**
+ * Same as the iterator overload, but encodes the columns of 'points' directly. Attributes of the
+ * layout that 'points' doesn't have are written with default values
+ */
+void
+encode_binary_points(const PointBuffer& points,
+                     const BinaryLayout& layout,
+                     std::vector<std::byte>& dst);
+
+/**
+ * Decodes the point records in 'data' into 'points', which get the given attributes. Returns false
+ * if 'data' does not contain a whole number of point records
+ */
+bool
+decode_binary_points(gsl::span<const std::byte> data,
+                     const BinaryLayout& layout,
+                     const PointAttributes& attributes,
+                     PointBuffer& points);
+
+} // namespace ept
 
 struct EptSRS
 {
@@ -71,39 +237,60 @@ struct EntwinePersistence
   void persist_points(Iter points_begin,
                       Iter points_end,
                       const AABB& bounds,
-                      const std::string& node_name)
+                      const OctreeNodeIndex64& node_index)
   {
     const auto num_points = std::distance(points_begin, points_end);
     if (!num_points)
       return;
 
-    const auto entwine_name = potree_name_to_entwine_name(node_name);
+    if (_format == EntwineFormat::Binary) {
+      thread_local std::vector<std::byte> records;
+      ept::encode_binary_points(points_begin, points_end, _binary_layout, records);
+      write_binary_file(entwine_name_from_index(node_index), records);
+    } else {
+      _las_persistence.persist_points(points_begin, points_end, bounds, node_index);
+    }
 
-    _las_persistence.persist_points(points_begin, points_end, bounds, entwine_name);
-
-    std::lock_guard guard{ *_hierarchy_lock };
-    _hierarchy[entwine_name] = num_points;
+    _hierarchy.insert_or_assign(node_index, static_cast<size_t>(num_points));
   }
 
-  void persist_points(PointBuffer const& points, const AABB& bounds, const std::string& node_name);
+  void persist_points(PointBuffer const& points,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index);
+
+  /**
+   * Like 'persist_points' above, but compresses large LAZ files as chunks on 'subflow'
+   */
+  void persist_points(PointBuffer const& points,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index,
+                      tf::Subflow& subflow);
 
-  void retrieve_points(const std::string& node_name, PointBuffer& points);
+  void retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points);
 
-  bool node_exists(const std::string& node_name) const;
+  bool node_exists(const OctreeNodeIndex64& node_index) const;
 
-  inline bool is_lossless() const { return false; }
+  // Binary node files store positions as 64-bit floats
+  inline bool is_lossless() const { return _format == EntwineFormat::Binary; }
 
   auto& las_persistence() { return _las_persistence; }
 
+  /**
+   * Name of the given node in the Entwine convention ('D-X-Y-Z')
+   */
+  static std::string entwine_name_from_index(const OctreeNodeIndex64& node_index);
+
 private:
+  void write_binary_file(const std::string& entwine_name, gsl::span<const std::byte> records);
+
   fs::path _work_dir;
   EntwineFormat _format;
   std::string _file_extension;
+  PointAttributes _input_attributes;
+  ept::BinaryLayout _binary_layout;
 
   LASPersistence _las_persistence;
 
-  std::unique_ptr<std::mutex> _hierarchy_lock;
-  std::unordered_map<std::string, size_t> _hierarchy;
-
-  static std::string potree_name_to_entwine_name(const std::string& potree_name);
+  // Point counts of all written nodes, concurrent writers only contend within a shard
+  ShardedMap<OctreeNodeIndex64, size_t> _hierarchy;
 };
\ No newline at end of file
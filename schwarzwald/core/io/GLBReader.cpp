@@ -0,0 +1,238 @@
+#include "io/GLBReader.h"
+
+#include "io/MeshoptCodec.h"
+#include "util/stuff.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <rapidjson/document.h>
+#include <rapidjson/error/en.h>
+
+namespace rs = rapidjson;
+
+namespace {
+constexpr uint32_t GLBMagic = 0x46546C67;      // 'glTF'
+constexpr uint32_t JSONChunkType = 0x4E4F534A; // 'JSON'
+constexpr uint32_t BINChunkType = 0x004E4942;  // 'BIN'
+
+constexpr uint32_t ComponentTypeByte = 5120;
+constexpr uint32_t ComponentTypeFloat = 5126;
+
+uint32_t
+read_uint32(const std::vector<std::byte>& data, size_t offset)
+{
+  uint32_t value;
+  std::memcpy(&value, data.data() + offset, sizeof(uint32_t));
+  return value;
+}
+
+/**
+ * Strided view of the values of a single accessor
+ */
+struct AccessorView
+{
+  const std::byte* data;
+  uint32_t byte_stride;
+  uint32_t component_type;
+
+  template<typename T>
+  T at(size_t index) const
+  {
+    T value;
+    std::memcpy(static_cast<void*>(&value), data + index * byte_stride, sizeof(T));
+    return value;
+  }
+};
+} // namespace
+
+std::optional<GLBFile>
+read_glb_file(const std::string& file_path, const PointAttributes& input_attributes)
+{
+  // Only the attributes that write_glb_file writes can be read back
+  for (auto attribute : input_attributes) {
+    switch (attribute) {
+      case PointAttribute::Position:
+      case PointAttribute::RGB:
+      case PointAttribute::Intensity:
+      case PointAttribute::Classification:
+      case PointAttribute::Normal:
+        break;
+      default:
+        throw std::runtime_error{ concat(
+          "Reading ", util::to_string(attribute), " from .glb files is not supported") };
+    }
+  }
+
+  std::ifstream fs{ file_path, std::ios_base::in | std::ios_base::binary };
+  if (!fs.is_open()) {
+    std::cerr << "Could not open .glb file \"" << file_path << "\"!" << std::endl;
+    return std::nullopt;
+  }
+
+  fs.seekg(0, std::ios::end);
+  std::vector<std::byte> data(static_cast<size_t>(fs.tellg()));
+  fs.seekg(0, std::ios::beg);
+  fs.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+  if (data.size() < 20 || read_uint32(data, 0) != GLBMagic || read_uint32(data, 4) != 2) {
+    std::cerr << "\"" << file_path << "\" is not a glTF 2.0 binary file" << std::endl;
+    return std::nullopt;
+  }
+
+  const auto json_length = read_uint32(data, 12);
+  const auto binary_chunk_offset = size_t{ 20 } + json_length;
+  if (read_uint32(data, 16) != JSONChunkType || binary_chunk_offset + 8 > data.size() ||
+      read_uint32(data, binary_chunk_offset + 4) != BINChunkType ||
+      binary_chunk_offset + 8 + read_uint32(data, binary_chunk_offset) > data.size()) {
+    std::cerr << "Invalid chunks in .glb file \"" << file_path << "\"" << std::endl;
+    return std::nullopt;
+  }
+  const auto binary = data.data() + binary_chunk_offset + 8;
+  const auto binary_length = read_uint32(data, binary_chunk_offset);
+
+  // The JSON chunk is not null-terminated
+  const std::string json_string{ reinterpret_cast<const char*>(data.data()) + 20, json_length };
+  rs::Document json;
+  if (json.Parse(json_string.c_str()).HasParseError()) {
+    std::cerr << "Could not parse glTF JSON in \"" << file_path << "\" ("
+              << rs::GetParseError_En(json.GetParseError()) << ")" << std::endl;
+    return std::nullopt;
+  }
+
+  // TECH_DEBT Error handling for JSON members that are missing because the file was not written by
+  // write_glb_file
+
+  GLBFile glb_file;
+  const auto& nodes = json["nodes"];
+  const auto& root_matrix = nodes[0]["matrix"];
+  // The root node rotates from Z-up to Y-up, so the translation is rotated as well
+  glb_file.rtc_center = { root_matrix[12].GetDouble(),
+                          -root_matrix[14].GetDouble(),
+                          root_matrix[13].GetDouble() };
+
+  Vector3<double> quantization_offset{ 0, 0, 0 };
+  double quantization_scale = 1;
+  const auto& mesh_node = nodes[1];
+  if (mesh_node.HasMember("translation")) {
+    const auto& translation = mesh_node["translation"];
+    quantization_offset = { translation[0].GetDouble(),
+                            translation[1].GetDouble(),
+                            translation[2].GetDouble() };
+  }
+  if (mesh_node.HasMember("scale")) {
+    quantization_scale = mesh_node["scale"][0].GetDouble();
+  }
+
+  const auto& accessors = json["accessors"];
+  const auto& buffer_views = json["bufferViews"];
+  const auto& primitive_attributes = json["meshes"][0]["primitives"][0]["attributes"];
+
+  uint32_t num_points = 0;
+  // Decompressed buffer views have to outlive the AccessorViews that point into them
+  std::vector<std::vector<std::byte>> decompressed_views;
+  const auto find_accessor = [&](const char* attribute_name) -> std::optional<AccessorView> {
+    const auto attribute = primitive_attributes.FindMember(attribute_name);
+    if (attribute == primitive_attributes.MemberEnd())
+      return std::nullopt;
+
+    const auto& accessor = accessors[attribute->value.GetUint()];
+    const auto& buffer_view = buffer_views[accessor["bufferView"].GetUint()];
+    num_points = accessor["count"].GetUint();
+    const auto accessor_offset =
+      accessor.HasMember("byteOffset") ? accessor["byteOffset"].GetUint() : 0u;
+    const auto byte_stride = buffer_view["byteStride"].GetUint();
+
+    const auto extensions = buffer_view.FindMember("extensions");
+    if (extensions == buffer_view.MemberEnd() ||
+        !extensions->value.HasMember("EXT_meshopt_compression")) {
+      const auto byte_offset = buffer_view["byteOffset"].GetUint() + accessor_offset;
+      if (byte_offset + static_cast<uint64_t>(num_points) * byte_stride > binary_length)
+        throw std::runtime_error{ concat("Accessor ", attribute_name, " is out of bounds") };
+      return AccessorView{ binary + byte_offset, byte_stride, accessor["componentType"].GetUint() };
+    }
+
+    const auto& compressed = extensions->value["EXT_meshopt_compression"];
+    const auto compressed_offset = compressed["byteOffset"].GetUint();
+    const auto compressed_length = compressed["byteLength"].GetUint();
+    if (compressed_offset + static_cast<uint64_t>(compressed_length) > binary_length)
+      throw std::runtime_error{ concat("Compressed ", attribute_name, " is out of bounds") };
+
+    const auto count = compressed["count"].GetUint();
+    auto& decompressed = decompressed_views.emplace_back(static_cast<size_t>(count) * byte_stride);
+    meshopt::decode_vertex_buffer(
+      { binary + compressed_offset, static_cast<std::ptrdiff_t>(compressed_length) },
+      count,
+      byte_stride,
+      decompressed);
+    return AccessorView{ decompressed.data() + accessor_offset,
+                         byte_stride,
+                         accessor["componentType"].GetUint() };
+  };
+
+  const auto positions_view = find_accessor("POSITION");
+  if (!positions_view) {
+    std::cerr << "Missing POSITION in \"" << file_path << "\"" << std::endl;
+    return std::nullopt;
+  }
+
+  std::vector<Vector3<double>> positions;
+  positions.reserve(num_points);
+  for (uint32_t idx = 0; idx < num_points; ++idx) {
+    if (positions_view->component_type == ComponentTypeFloat) {
+      positions.push_back(Vector3<float>::cast<double>(positions_view->at<Vector3<float>>(idx)));
+    } else {
+      const auto quantized = positions_view->at<Vector3<uint16_t>>(idx);
+      positions.push_back({ quantization_offset.x + quantized.x * quantization_scale,
+                            quantization_offset.y + quantized.y * quantization_scale,
+                            quantization_offset.z + quantized.z * quantization_scale });
+    }
+  }
+
+  std::vector<Vector3<uint8_t>> colors;
+  if (has_attribute(input_attributes, PointAttribute::RGB)) {
+    if (const auto view = find_accessor("COLOR_0")) {
+      for (uint32_t idx = 0; idx < num_points; ++idx) {
+        colors.push_back(view->at<Vector3<uint8_t>>(idx));
+      }
+    }
+  }
+
+  std::vector<Vector3<float>> normals;
+  if (has_attribute(input_attributes, PointAttribute::Normal)) {
+    if (const auto view = find_accessor("NORMAL")) {
+      for (uint32_t idx = 0; idx < num_points; ++idx) {
+        if (view->component_type == ComponentTypeByte) {
+          const auto encoded = view->at<Vector3<int8_t>>(idx);
+          const Vector3<float> normal{ encoded.x / 127.f, encoded.y / 127.f, encoded.z / 127.f };
+          normals.push_back(normal / normal.length());
+        } else {
+          normals.push_back(view->at<Vector3<float>>(idx));
+        }
+      }
+    }
+  }
+
+  std::vector<uint16_t> intensities;
+  if (has_attribute(input_attributes, PointAttribute::Intensity)) {
+    if (const auto view = find_accessor("_INTENSITY")) {
+      for (uint32_t idx = 0; idx < num_points; ++idx) {
+        intensities.push_back(view->at<uint16_t>(idx));
+      }
+    }
+  }
+
+  std::vector<uint8_t> classifications;
+  if (has_attribute(input_attributes, PointAttribute::Classification)) {
+    if (const auto view = find_accessor("_CLASSIFICATION")) {
+      for (uint32_t idx = 0; idx < num_points; ++idx) {
+        classifications.push_back(view->at<uint8_t>(idx));
+      }
+    }
+  }
+
+  glb_file.points = { num_points,         std::move(positions),   std::move(colors),
+                      std::move(normals), std::move(intensities), std::move(classifications) };
+  return std::make_optional<GLBFile>(std::move(glb_file));
+}
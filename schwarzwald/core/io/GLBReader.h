@@ -0,0 +1,19 @@
+#pragma once
+
+#include "datastructures/PointBuffer.h"
+
+#include <optional>
+#include <string>
+
+struct GLBFile
+{
+  Vector3<double> rtc_center;
+  PointBuffer points;
+};
+
+/**
+ * Tries to read the given .glb file that was written with write_glb_file. Positions are returned
+ * relative to the RTC center, like readPNTSFile does. Returns std::nullopt on failure
+ */
+std::optional<GLBFile>
+read_glb_file(const std::string& file_path, const PointAttributes& input_attributes);
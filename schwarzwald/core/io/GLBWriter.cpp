@@ -0,0 +1,429 @@
+#include "io/GLBWriter.h"
+#include "io/AsyncFileWriter.h"
+
+#include "io/MeshoptCodec.h"
+#include "io/io_util.h"
+#include "util/stuff.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+namespace {
+constexpr uint32_t GLBMagic = 0x46546C67;     // 'glTF'
+constexpr uint32_t GLBVersion = 2;
+constexpr uint32_t JSONChunkType = 0x4E4F534A; // 'JSON'
+constexpr uint32_t BINChunkType = 0x004E4942;  // 'BIN'
+constexpr uint32_t HeaderSize = 12;
+constexpr uint32_t ChunkHeaderSize = 8;
+
+constexpr uint32_t ComponentTypeByte = 5120;
+constexpr uint32_t ComponentTypeUnsignedByte = 5121;
+constexpr uint32_t ComponentTypeUnsignedShort = 5123;
+constexpr uint32_t ComponentTypeFloat = 5126;
+constexpr uint32_t TargetArrayBuffer = 34962;
+constexpr uint32_t PrimitiveModePoints = 0;
+
+/**
+ * How a column is described in the glTF JSON
+ */
+struct AccessorDescription
+{
+  const char* attribute_name;
+  uint32_t component_type;
+  const char* type;
+  bool normalized;
+  uint32_t value_size;
+};
+
+AccessorDescription
+describe_column(pnts::ColumnType type)
+{
+  switch (type) {
+    case pnts::ColumnType::Position:
+      return { "POSITION", ComponentTypeFloat, "VEC3", false, 12 };
+    case pnts::ColumnType::PositionQuantized:
+      return { "POSITION", ComponentTypeUnsignedShort, "VEC3", false, 6 };
+    case pnts::ColumnType::RGB:
+    case pnts::ColumnType::RGBFromIntensityLinear:
+    case pnts::ColumnType::RGBFromIntensityLogarithmic:
+      return { "COLOR_0", ComponentTypeUnsignedByte, "VEC3", true, 3 };
+    case pnts::ColumnType::Intensity:
+      return { "_INTENSITY", ComponentTypeUnsignedShort, "SCALAR", false, 2 };
+    case pnts::ColumnType::Classification:
+      return { "_CLASSIFICATION", ComponentTypeUnsignedByte, "SCALAR", false, 1 };
+    case pnts::ColumnType::Normal:
+      return { "NORMAL", ComponentTypeFloat, "VEC3", false, 12 };
+    case pnts::ColumnType::NormalOct16P:
+      return { "NORMAL", ComponentTypeByte, "VEC3", true, 3 };
+  }
+  throw std::invalid_argument{ "Invalid column type" };
+}
+
+uint32_t
+align_to_4(uint32_t value)
+{
+  return (value + 3) & ~3u;
+}
+
+/**
+ * Minimum and maximum of the position column, which glTF requires for POSITION accessors
+ */
+template<typename T>
+std::pair<std::array<T, 3>, std::array<T, 3>>
+position_min_max(const std::byte* column, uint32_t byte_stride, uint32_t num_points)
+{
+  std::array<T, 3> min, max;
+  std::memcpy(min.data(), column, sizeof(min));
+  max = min;
+  for (uint32_t idx = 1; idx < num_points; ++idx) {
+    std::array<T, 3> position;
+    std::memcpy(position.data(), column + idx * byte_stride, sizeof(position));
+    for (size_t axis = 0; axis < 3; ++axis) {
+      min[axis] = std::min(min[axis], position[axis]);
+      max[axis] = std::max(max[axis], position[axis]);
+    }
+  }
+  return { min, max };
+}
+
+template<typename Writer, typename T>
+void
+write_array(Writer& json, const std::array<T, 3>& values)
+{
+  json.StartArray();
+  for (auto value : values) {
+    json.Double(static_cast<double>(value));
+  }
+  json.EndArray();
+}
+} // namespace
+
+glb::VertexLayout
+glb::compute_vertex_layout(uint32_t num_points, const std::vector<pnts::ColumnType>& column_types)
+{
+  VertexLayout layout;
+  layout.num_points = num_points;
+  layout.byte_length = 0;
+  for (auto type : column_types) {
+    const auto byte_stride = align_to_4(describe_column(type).value_size);
+    layout.columns.push_back({ type, layout.byte_length, byte_stride });
+    layout.byte_length += byte_stride * num_points;
+  }
+  return layout;
+}
+
+gsl::span<std::byte>
+glb::prepare_vertex_buffer(const VertexLayout& layout)
+{
+  thread_local std::vector<std::byte> vertex_buffer;
+  // Padding bytes between strided values are never written, so they have to be zero to get
+  // deterministic files that compress well
+  vertex_buffer.assign(layout.byte_length, std::byte{ 0 });
+  return { vertex_buffer.data(), static_cast<std::ptrdiff_t>(vertex_buffer.size()) };
+}
+
+glb::PositionQuantization
+glb::position_quantization(const AABB& bounds)
+{
+  const auto extent = bounds.extent();
+  const auto max_extent = std::max({ extent.x, extent.y, extent.z });
+  const auto scale = (max_extent > 0) ? (max_extent / std::numeric_limits<uint16_t>::max()) : 1.0;
+  return { bounds.min, scale };
+}
+
+Vector3<uint16_t>
+glb::quantize_position(const Vector3<double>& position, const PositionQuantization& quantization)
+{
+  const auto quantize = [&quantization](double value, double offset) -> uint16_t {
+    const auto quantized = std::lround((value - offset) / quantization.scale);
+    return static_cast<uint16_t>(
+      std::clamp(quantized, 0l, static_cast<long>(std::numeric_limits<uint16_t>::max())));
+  };
+  return { quantize(position.x, quantization.offset.x),
+           quantize(position.y, quantization.offset.y),
+           quantize(position.z, quantization.offset.z) };
+}
+
+Vector3<int8_t>
+glb::encode_normal_snorm8(const Vector3<float>& normal)
+{
+  const auto to_snorm8 = [](float value) {
+    return static_cast<int8_t>(std::lround(std::clamp(value, -1.f, 1.f) * 127.f));
+  };
+  return { to_snorm8(normal.x), to_snorm8(normal.y), to_snorm8(normal.z) };
+}
+
+std::vector<std::byte>
+glb::encode_glb(const VertexLayout& layout,
+                gsl::span<const std::byte> vertex_data,
+                const Vector3<double>& rtc_center,
+                const PositionQuantization& quantization,
+                GLBCompression compression)
+{
+  // With compression, the binary chunk holds the compressed columns and the uncompressed layout
+  // only exists in a fallback buffer without data, as EXT_meshopt_compression requires
+  std::vector<std::byte> binary;
+  std::vector<std::pair<uint32_t, uint32_t>> compressed_ranges;
+  if (compression == GLBCompression::Meshopt) {
+    for (auto& column : layout.columns) {
+      const auto encoded = meshopt::encode_vertex_buffer(
+        vertex_data.subspan(column.byte_offset,
+                            static_cast<std::ptrdiff_t>(column.byte_stride) * layout.num_points),
+        layout.num_points,
+        column.byte_stride);
+      compressed_ranges.emplace_back(static_cast<uint32_t>(binary.size()),
+                                     static_cast<uint32_t>(encoded.size()));
+      binary.insert(std::end(binary), std::begin(encoded), std::end(encoded));
+      binary.resize(align_to_4(static_cast<uint32_t>(binary.size())));
+    }
+  } else {
+    binary.assign(std::begin(vertex_data), std::end(vertex_data));
+  }
+
+  const auto has_column = [&layout](pnts::ColumnType type) {
+    return std::any_of(std::begin(layout.columns),
+                       std::end(layout.columns),
+                       [type](const auto& column) { return column.type == type; });
+  };
+  const auto has_quantized_positions = has_column(pnts::ColumnType::PositionQuantized);
+  const auto has_quantized_attributes =
+    has_quantized_positions || has_column(pnts::ColumnType::NormalOct16P);
+
+  rapidjson::StringBuffer json_buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> json{ json_buffer };
+  json.StartObject();
+  json.Key("asset");
+  json.StartObject();
+  json.Key("version");
+  json.String("2.0");
+  json.Key("generator");
+  json.String("Schwarzwald");
+  json.EndObject();
+
+  std::vector<const char*> extensions;
+  if (has_quantized_attributes)
+    extensions.push_back("KHR_mesh_quantization");
+  if (compression == GLBCompression::Meshopt)
+    extensions.push_back("EXT_meshopt_compression");
+  if (!extensions.empty()) {
+    for (auto key : { "extensionsUsed", "extensionsRequired" }) {
+      json.Key(key);
+      json.StartArray();
+      for (auto extension : extensions) {
+        json.String(extension);
+      }
+      json.EndArray();
+    }
+  }
+
+  json.Key("scene");
+  json.Uint(0);
+  json.Key("scenes");
+  json.StartArray();
+  json.StartObject();
+  json.Key("nodes");
+  json.StartArray();
+  json.Uint(0);
+  json.EndArray();
+  json.EndObject();
+  json.EndArray();
+
+  // The root node rotates from Z-up into the Y-up frame of glTF (which 3D Tiles rotates back) and
+  // applies the RTC center. The mesh node applies the quantization
+  json.Key("nodes");
+  json.StartArray();
+  json.StartObject();
+  json.Key("matrix");
+  json.StartArray();
+  for (auto value : { 1.0, 0.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0, 0.0, 1.0, 0.0, 0.0 }) {
+    json.Double(value);
+  }
+  json.Double(rtc_center.x);
+  json.Double(rtc_center.z);
+  json.Double(-rtc_center.y);
+  json.Double(1.0);
+  json.EndArray();
+  json.Key("children");
+  json.StartArray();
+  json.Uint(1);
+  json.EndArray();
+  json.EndObject();
+  json.StartObject();
+  json.Key("mesh");
+  json.Uint(0);
+  if (has_quantized_positions) {
+    json.Key("translation");
+    write_array(json,
+                std::array<double, 3>{
+                  quantization.offset.x, quantization.offset.y, quantization.offset.z });
+    json.Key("scale");
+    write_array(json,
+                std::array<double, 3>{ quantization.scale, quantization.scale, quantization.scale });
+  }
+  json.EndObject();
+  json.EndArray();
+
+  json.Key("meshes");
+  json.StartArray();
+  json.StartObject();
+  json.Key("primitives");
+  json.StartArray();
+  json.StartObject();
+  json.Key("attributes");
+  json.StartObject();
+  for (size_t idx = 0; idx < layout.columns.size(); ++idx) {
+    json.Key(describe_column(layout.columns[idx].type).attribute_name);
+    json.Uint(static_cast<unsigned>(idx));
+  }
+  json.EndObject();
+  json.Key("mode");
+  json.Uint(PrimitiveModePoints);
+  json.EndObject();
+  json.EndArray();
+  json.EndObject();
+  json.EndArray();
+
+  json.Key("accessors");
+  json.StartArray();
+  for (size_t idx = 0; idx < layout.columns.size(); ++idx) {
+    const auto& column = layout.columns[idx];
+    const auto description = describe_column(column.type);
+    json.StartObject();
+    json.Key("bufferView");
+    json.Uint(static_cast<unsigned>(idx));
+    json.Key("componentType");
+    json.Uint(description.component_type);
+    if (description.normalized) {
+      json.Key("normalized");
+      json.Bool(true);
+    }
+    json.Key("count");
+    json.Uint(layout.num_points);
+    json.Key("type");
+    json.String(description.type);
+
+    const auto column_data = vertex_data.data() + column.byte_offset;
+    if (column.type == pnts::ColumnType::Position) {
+      const auto [min, max] =
+        position_min_max<float>(column_data, column.byte_stride, layout.num_points);
+      json.Key("min");
+      write_array(json, min);
+      json.Key("max");
+      write_array(json, max);
+    } else if (column.type == pnts::ColumnType::PositionQuantized) {
+      const auto [min, max] =
+        position_min_max<uint16_t>(column_data, column.byte_stride, layout.num_points);
+      json.Key("min");
+      write_array(json, min);
+      json.Key("max");
+      write_array(json, max);
+    }
+    json.EndObject();
+  }
+  json.EndArray();
+
+  const auto uncompressed_buffer = (compression == GLBCompression::Meshopt) ? 1u : 0u;
+  json.Key("bufferViews");
+  json.StartArray();
+  for (size_t idx = 0; idx < layout.columns.size(); ++idx) {
+    const auto& column = layout.columns[idx];
+    json.StartObject();
+    json.Key("buffer");
+    json.Uint(uncompressed_buffer);
+    json.Key("byteOffset");
+    json.Uint(column.byte_offset);
+    json.Key("byteLength");
+    json.Uint(column.byte_stride * layout.num_points);
+    json.Key("byteStride");
+    json.Uint(column.byte_stride);
+    json.Key("target");
+    json.Uint(TargetArrayBuffer);
+    if (compression == GLBCompression::Meshopt) {
+      json.Key("extensions");
+      json.StartObject();
+      json.Key("EXT_meshopt_compression");
+      json.StartObject();
+      json.Key("buffer");
+      json.Uint(0);
+      json.Key("byteOffset");
+      json.Uint(compressed_ranges[idx].first);
+      json.Key("byteLength");
+      json.Uint(compressed_ranges[idx].second);
+      json.Key("byteStride");
+      json.Uint(column.byte_stride);
+      json.Key("count");
+      json.Uint(layout.num_points);
+      json.Key("mode");
+      json.String("ATTRIBUTES");
+      json.EndObject();
+      json.EndObject();
+    }
+    json.EndObject();
+  }
+  json.EndArray();
+
+  json.Key("buffers");
+  json.StartArray();
+  json.StartObject();
+  json.Key("byteLength");
+  json.Uint(static_cast<unsigned>(binary.size()));
+  json.EndObject();
+  if (compression == GLBCompression::Meshopt) {
+    json.StartObject();
+    json.Key("byteLength");
+    json.Uint(layout.byte_length);
+    json.Key("extensions");
+    json.StartObject();
+    json.Key("EXT_meshopt_compression");
+    json.StartObject();
+    json.Key("fallback");
+    json.Bool(true);
+    json.EndObject();
+    json.EndObject();
+    json.EndObject();
+  }
+  json.EndArray();
+  json.EndObject();
+
+  // Both chunks have to be aligned to 4 bytes, the JSON chunk is padded with spaces
+  const auto json_chunk_length = align_to_4(static_cast<uint32_t>(json_buffer.GetSize()));
+  const auto binary_chunk_length = align_to_4(static_cast<uint32_t>(binary.size()));
+  const auto total_length =
+    HeaderSize + 2 * ChunkHeaderSize + json_chunk_length + binary_chunk_length;
+
+  std::vector<std::byte> glb(total_length, std::byte{ 0 });
+  auto dst = glb.data();
+  const auto write_uint32 = [&dst](uint32_t value) {
+    std::memcpy(dst, &value, sizeof(uint32_t));
+    dst += sizeof(uint32_t);
+  };
+
+  write_uint32(GLBMagic);
+  write_uint32(GLBVersion);
+  write_uint32(total_length);
+
+  write_uint32(json_chunk_length);
+  write_uint32(JSONChunkType);
+  std::memcpy(dst, json_buffer.GetString(), json_buffer.GetSize());
+  std::fill(dst + json_buffer.GetSize(), dst + json_chunk_length, std::byte{ ' ' });
+  dst += json_chunk_length;
+
+  write_uint32(binary_chunk_length);
+  write_uint32(BINChunkType);
+  std::copy(std::begin(binary), std::end(binary), dst);
+
+  return glb;
+}
+
+void
+glb::write_file(const std::string& file_path, gsl::span<const std::byte> bytes)
+{
+  if (!write_file_async(file_path, bytes.data(), bytes.size())) {
+    std::cerr << "Could not write .glb file \"" << file_path << "\" (" << strerror(errno) << ")"
+              << std::endl;
+  }
+}
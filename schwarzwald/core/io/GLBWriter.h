@@ -0,0 +1,234 @@
+#pragma once
+
+#include "io/PNTSWriter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gsl/gsl>
+
+/**
+ * How the vertex data of .glb tiles is compressed
+ */
+enum class GLBCompression
+{
+  // All attributes are stored uncompressed
+  None,
+  // All attributes are compressed with the meshopt vertex codec (EXT_meshopt_compression). This is
+  // lossless and decodes very fast on the client
+  Meshopt
+};
+
+/**
+ * Writing point clouds as glTF 2.0 binary files (.glb) with a single primitive of mode POINTS,
+ * which 3D Tiles 1.1 supports as tile content. Every attribute has its own buffer view, so that
+ * each one can be compressed on its own. Positions are stored in the Z-up frame of the point
+ * cloud, the rotation into the Y-up frame of glTF and the RTC center are applied by the root node
+ */
+namespace glb {
+
+/**
+ * A single vertex attribute in the binary chunk of a .glb file
+ */
+struct VertexColumn
+{
+  pnts::ColumnType type;
+  /**
+   * Offset of this column relative to the start of the uncompressed vertex data
+   */
+  uint32_t byte_offset;
+  /**
+   * Distance between the values of consecutive points. glTF requires that vertex attributes are
+   * aligned to 4 bytes, so this can be larger than the size of a single value
+   */
+  uint32_t byte_stride;
+};
+
+/**
+ * Layout of the uncompressed vertex data of a .glb file
+ */
+struct VertexLayout
+{
+  uint32_t num_points;
+  std::vector<VertexColumn> columns;
+  uint32_t byte_length;
+};
+
+/**
+ * Computes the layout of the vertex data for the given columns. Columns are stored one after
+ * another in the given order
+ */
+VertexLayout
+compute_vertex_layout(uint32_t num_points, const std::vector<pnts::ColumnType>& column_types);
+
+/**
+ * Returns a zeroed buffer for vertex data with the given layout. The buffer is reused between all
+ * files that are written on the calling thread
+ */
+gsl::span<std::byte>
+prepare_vertex_buffer(const VertexLayout& layout);
+
+/**
+ * Quantization of positions to 16 bits per axis (KHR_mesh_quantization). The scale is the same on
+ * all axes, as a non-uniform scale on the mesh node would distort the normals
+ */
+struct PositionQuantization
+{
+  Vector3<double> offset;
+  double scale;
+};
+
+PositionQuantization
+position_quantization(const AABB& bounds);
+
+Vector3<uint16_t>
+quantize_position(const Vector3<double>& position, const PositionQuantization& quantization);
+
+/**
+ * Encodes the given unit normal as three normalized signed bytes, as KHR_mesh_quantization
+ * allows for NORMAL
+ */
+Vector3<int8_t>
+encode_normal_snorm8(const Vector3<float>& normal);
+
+/**
+ * Writes the value returned by 'get_value' for each point in [begin, end) to 'dst', with
+ * 'byte_stride' bytes between consecutive values
+ */
+template<typename Iter, typename GetValue>
+void
+write_strided_column(Iter begin, Iter end, std::byte* dst, uint32_t byte_stride, GetValue get_value)
+{
+  for (; begin != end; ++begin) {
+    const auto value = get_value(*begin);
+    std::memcpy(dst, &value, sizeof(value));
+    dst += byte_stride;
+  }
+}
+
+/**
+ * Creates a complete .glb file from the given vertex data. 'quantization' is only used if there is
+ * a PositionQuantized column
+ */
+std::vector<std::byte>
+encode_glb(const VertexLayout& layout,
+           gsl::span<const std::byte> vertex_data,
+           const Vector3<double>& rtc_center,
+           const PositionQuantization& quantization,
+           GLBCompression compression);
+
+/**
+ * Write the given bytes to the given file with a single write
+ */
+void
+write_file(const std::string& file_path, gsl::span<const std::byte> bytes);
+
+} // namespace glb
+
+/**
+ * Writes the points in [points_begin, points_end) as a .glb file. The same columns are written as
+ * for .pnts files: With PNTSEncoding::Quantized, positions are quantized relative to 'bounds' and
+ * normals are stored with 8 bits per component. All columns are written straight from the range
+ * of points into a single buffer, which is then optionally compressed
+ *
+ * 'Iter' has to dereference to PointBuffer::PointReference or PointBuffer::PointConstReference
+ */
+template<typename Iter>
+void
+write_glb_file(const std::string& file_path,
+               Iter points_begin,
+               Iter points_end,
+               const PointAttributes& point_attributes,
+               RGBMapping rgb_mapping,
+               const Vector3<double>& rtc_center,
+               PNTSEncoding encoding,
+               GLBCompression compression,
+               const AABB& bounds)
+{
+  const auto num_points = static_cast<uint32_t>(std::distance(points_begin, points_end));
+  if (!num_points)
+    return;
+
+  const auto layout = glb::compute_vertex_layout(
+    num_points,
+    pnts::column_types_for_points(*points_begin, point_attributes, rgb_mapping, encoding));
+  const auto vertex_data = glb::prepare_vertex_buffer(layout);
+  const auto quantization = glb::position_quantization(bounds);
+
+  for (auto& column : layout.columns) {
+    const auto column_begin = vertex_data.data() + column.byte_offset;
+    const auto stride = column.byte_stride;
+    switch (column.type) {
+      case pnts::ColumnType::Position:
+        glb::write_strided_column(
+          points_begin, points_end, column_begin, stride, [](const auto& point) -> Vector3<float> {
+            const auto& position = point.position();
+            return { static_cast<float>(position.x),
+                     static_cast<float>(position.y),
+                     static_cast<float>(position.z) };
+          });
+        break;
+      case pnts::ColumnType::PositionQuantized:
+        glb::write_strided_column(
+          points_begin, points_end, column_begin, stride, [&quantization](const auto& point) {
+            return glb::quantize_position(point.position(), quantization);
+          });
+        break;
+      case pnts::ColumnType::RGB:
+        glb::write_strided_column(
+          points_begin, points_end, column_begin, stride, [](const auto& point) -> RGB {
+            const auto color = point.rgbColor();
+            assert(color != nullptr);
+            return { color->x, color->y, color->z };
+          });
+        break;
+      case pnts::ColumnType::RGBFromIntensityLinear:
+        glb::write_strided_column(
+          points_begin, points_end, column_begin, stride, [](const auto& point) {
+            assert(point.intensity() != nullptr);
+            return pnts::rgb_from_intensity_linear(*point.intensity());
+          });
+        break;
+      case pnts::ColumnType::RGBFromIntensityLogarithmic:
+        glb::write_strided_column(
+          points_begin, points_end, column_begin, stride, [](const auto& point) {
+            assert(point.intensity() != nullptr);
+            return pnts::rgb_from_intensity_logarithmic(*point.intensity());
+          });
+        break;
+      case pnts::ColumnType::Intensity:
+        glb::write_strided_column(
+          points_begin, points_end, column_begin, stride, [](const auto& point) -> uint16_t {
+            assert(point.intensity() != nullptr);
+            return *point.intensity();
+          });
+        break;
+      case pnts::ColumnType::Classification:
+        glb::write_strided_column(
+          points_begin, points_end, column_begin, stride, [](const auto& point) -> uint8_t {
+            assert(point.classification() != nullptr);
+            return *point.classification();
+          });
+        break;
+      case pnts::ColumnType::Normal:
+        glb::write_strided_column(
+          points_begin, points_end, column_begin, stride, [](const auto& point) -> Vector3<float> {
+            assert(point.normal() != nullptr);
+            return *point.normal();
+          });
+        break;
+      case pnts::ColumnType::NormalOct16P:
+        glb::write_strided_column(
+          points_begin, points_end, column_begin, stride, [](const auto& point) {
+            assert(point.normal() != nullptr);
+            return glb::encode_normal_snorm8(*point.normal());
+          });
+        break;
+    }
+  }
+
+  glb::write_file(file_path,
+                  glb::encode_glb(layout, vertex_data, rtc_center, quantization, compression));
+}
@@ -0,0 +1,349 @@
+#include "io/ImplicitTiling.h"
+
+#include "util/stuff.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+namespace {
+constexpr uint32_t SubtreeMagic = 0x74627573; // 'subt'
+constexpr uint32_t SubtreeVersion = 1;
+constexpr size_t SubtreeHeaderSize = 24;
+constexpr uint32_t MaxSubtreeLevels = 10;
+
+/**
+ * Number of tiles in all levels above the given level of a subtree
+ */
+size_t
+level_offset(uint32_t level)
+{
+  return ((size_t{ 1 } << (3 * level)) - 1) / 7;
+}
+
+/**
+ * Index of a tile within its level of a subtree, which is the Morton index of the tile with x in
+ * the lowest bit
+ */
+size_t
+morton_index(uint32_t x, uint32_t y, uint32_t z, uint32_t levels)
+{
+  size_t index = 0;
+  for (uint32_t bit = 0; bit < levels; ++bit) {
+    index |= static_cast<size_t>((x >> bit) & 1) << (3 * bit);
+    index |= static_cast<size_t>((y >> bit) & 1) << (3 * bit + 1);
+    index |= static_cast<size_t>((z >> bit) & 1) << (3 * bit + 2);
+  }
+  return index;
+}
+
+bool
+get_bit(const std::vector<uint8_t>& bitstream, size_t bit)
+{
+  return (bitstream[bit / 8] >> (bit % 8)) & 1;
+}
+
+void
+set_bit(std::vector<uint8_t>& bitstream, size_t bit)
+{
+  bitstream[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+}
+
+size_t
+count_bits(const std::vector<uint8_t>& bitstream, size_t count)
+{
+  size_t set_bits = 0;
+  for (size_t bit = 0; bit < count; ++bit) {
+    set_bits += get_bit(bitstream, bit);
+  }
+  return set_bits;
+}
+} // namespace
+
+implicit_tiling::TileKey
+implicit_tiling::TileKey::ancestor_at_level(uint32_t ancestor_level) const
+{
+  const auto shift = level - ancestor_level;
+  return { ancestor_level, x >> shift, y >> shift, z >> shift };
+}
+
+bool
+implicit_tiling::TileKey::operator==(const TileKey& other) const
+{
+  return level == other.level && x == other.x && y == other.y && z == other.z;
+}
+
+size_t
+implicit_tiling::TileKeyHash::operator()(const TileKey& key) const
+{
+  // Levels are below 32, so the level and the lower bits of all coordinates fit into the hash
+  const auto hash = (static_cast<uint64_t>(key.level) << 59) ^
+                    (static_cast<uint64_t>(key.x) << 38) ^ (static_cast<uint64_t>(key.y) << 19) ^
+                    static_cast<uint64_t>(key.z);
+  return std::hash<uint64_t>{}(hash);
+}
+
+std::optional<implicit_tiling::TileKey>
+implicit_tiling::tile_key_from_node_name(const std::string& node_name)
+{
+  if (node_name.empty() || node_name[0] != 'r' || node_name.size() > 32)
+    return std::nullopt;
+
+  TileKey key{ static_cast<uint32_t>(node_name.size() - 1), 0, 0, 0 };
+  for (size_t idx = 1; idx < node_name.size(); ++idx) {
+    const auto octant = node_name[idx] - '0';
+    if (octant < 0 || octant > 7)
+      return std::nullopt;
+
+    // Octants are numbered like in get_octant_bounds, with x in the highest bit
+    key.x = (key.x << 1) | ((octant >> 2) & 1);
+    key.y = (key.y << 1) | ((octant >> 1) & 1);
+    key.z = (key.z << 1) | (octant & 1);
+  }
+  return std::make_optional(key);
+}
+
+implicit_tiling::TileKey
+implicit_tiling::tile_key_from_node_index(const OctreeNodeIndex64& node_index)
+{
+  TileKey key{ node_index.levels(), 0, 0, 0 };
+  for (uint32_t level = 1; level <= node_index.levels(); ++level) {
+    const auto octant = node_index.octant_at_level(level);
+    key.x = (key.x << 1) | ((octant >> 2) & 1);
+    key.y = (key.y << 1) | ((octant >> 1) & 1);
+    key.z = (key.z << 1) | (octant & 1);
+  }
+  return key;
+}
+
+std::string
+implicit_tiling::expand_uri_template(const std::string& uri_template, const TileKey& key)
+{
+  std::string uri;
+  uri.reserve(uri_template.size());
+  for (size_t idx = 0; idx < uri_template.size(); ++idx) {
+    const auto remaining = std::string_view{ uri_template }.substr(idx);
+    if (remaining.substr(0, 7) == "{level}") {
+      uri += std::to_string(key.level);
+      idx += 6;
+    } else if (remaining.substr(0, 3) == "{x}") {
+      uri += std::to_string(key.x);
+      idx += 2;
+    } else if (remaining.substr(0, 3) == "{y}") {
+      uri += std::to_string(key.y);
+      idx += 2;
+    } else if (remaining.substr(0, 3) == "{z}") {
+      uri += std::to_string(key.z);
+      idx += 2;
+    } else {
+      uri += uri_template[idx];
+    }
+  }
+  return uri;
+}
+
+implicit_tiling::TileAvailability::TileAvailability(uint32_t subtree_levels)
+  : _subtree_levels(subtree_levels)
+  , _tiles_per_subtree(level_offset(subtree_levels))
+  , _child_subtrees_per_subtree(size_t{ 1 } << (3 * subtree_levels))
+  , _available_levels(0)
+{
+  if (subtree_levels == 0 || subtree_levels > MaxSubtreeLevels) {
+    throw std::invalid_argument{ concat(
+      "Subtree levels must be between 1 and ", MaxSubtreeLevels, " (got ", subtree_levels, ")") };
+  }
+}
+
+void
+implicit_tiling::TileAvailability::set_content_available(const TileKey& key)
+{
+  _available_levels = std::max(_available_levels, key.level + 1);
+
+  const auto content_bit = bit_index(key);
+  set_bit(get_or_create_subtree(content_bit.subtree_root).contents, content_bit.bit);
+
+  // Walk up until a tile is found that is available already, its ancestors are available as well
+  auto current = key;
+  while (true) {
+    const auto tile_bit = bit_index(current);
+    auto& tiles = get_or_create_subtree(tile_bit.subtree_root).tiles;
+    if (get_bit(tiles, tile_bit.bit))
+      break;
+    set_bit(tiles, tile_bit.bit);
+
+    if (current.level == 0)
+      break;
+    current = current.ancestor_at_level(current.level - 1);
+  }
+}
+
+bool
+implicit_tiling::TileAvailability::is_available(const TileKey& key) const
+{
+  const auto tile_bit = bit_index(key);
+  const auto subtree = _subtrees.find(tile_bit.subtree_root);
+  return subtree != std::end(_subtrees) && get_bit(subtree->second.tiles, tile_bit.bit);
+}
+
+bool
+implicit_tiling::TileAvailability::is_content_available(const TileKey& key) const
+{
+  const auto tile_bit = bit_index(key);
+  const auto subtree = _subtrees.find(tile_bit.subtree_root);
+  return subtree != std::end(_subtrees) && get_bit(subtree->second.contents, tile_bit.bit);
+}
+
+std::vector<implicit_tiling::TileKey>
+implicit_tiling::TileAvailability::subtree_roots() const
+{
+  std::vector<TileKey> roots;
+  roots.reserve(_subtrees.size());
+  for (auto& [root, subtree] : _subtrees) {
+    roots.push_back(root);
+  }
+  return roots;
+}
+
+const implicit_tiling::SubtreeAvailability&
+implicit_tiling::TileAvailability::subtree_availability(const TileKey& subtree_root) const
+{
+  const auto subtree = _subtrees.find(subtree_root);
+  if (subtree == std::end(_subtrees)) {
+    throw std::invalid_argument{ concat("No subtree at level ",
+                                        subtree_root.level,
+                                        " (",
+                                        subtree_root.x,
+                                        ", ",
+                                        subtree_root.y,
+                                        ", ",
+                                        subtree_root.z,
+                                        ")") };
+  }
+  return subtree->second;
+}
+
+implicit_tiling::TileAvailability::BitIndex
+implicit_tiling::TileAvailability::bit_index(const TileKey& key) const
+{
+  const auto subtree_root = key.ancestor_at_level((key.level / _subtree_levels) * _subtree_levels);
+  const auto local_level = key.level - subtree_root.level;
+  const auto local_index = morton_index(key.x - (subtree_root.x << local_level),
+                                        key.y - (subtree_root.y << local_level),
+                                        key.z - (subtree_root.z << local_level),
+                                        local_level);
+  return { subtree_root, level_offset(local_level) + local_index };
+}
+
+implicit_tiling::SubtreeAvailability&
+implicit_tiling::TileAvailability::get_or_create_subtree(const TileKey& subtree_root)
+{
+  // References into an unordered_map stay valid when new subtrees are inserted
+  auto& subtree = _subtrees[subtree_root];
+  if (!subtree.tiles.empty())
+    return subtree;
+
+  subtree.tiles.resize((_tiles_per_subtree + 7) / 8);
+  subtree.contents.resize((_tiles_per_subtree + 7) / 8);
+  subtree.child_subtrees.resize((_child_subtrees_per_subtree + 7) / 8);
+
+  if (subtree_root.level > 0) {
+    const auto parent_root = subtree_root.ancestor_at_level(subtree_root.level - _subtree_levels);
+    auto& parent = get_or_create_subtree(parent_root);
+    set_bit(parent.child_subtrees,
+            morton_index(subtree_root.x - (parent_root.x << _subtree_levels),
+                         subtree_root.y - (parent_root.y << _subtree_levels),
+                         subtree_root.z - (parent_root.z << _subtree_levels),
+                         _subtree_levels));
+  }
+
+  return subtree;
+}
+
+std::vector<std::byte>
+implicit_tiling::encode_subtree(const SubtreeAvailability& availability,
+                                size_t tile_count,
+                                size_t child_subtree_count)
+{
+  rapidjson::StringBuffer json_buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> json{ json_buffer };
+
+  // Bitstreams are stored in the binary chunk, each one aligned to 8 bytes
+  std::vector<std::byte> binary;
+  std::vector<std::pair<size_t, size_t>> buffer_views;
+  const auto write_availability = [&](const std::vector<uint8_t>& bitstream, size_t count) {
+    const auto available_count = count_bits(bitstream, count);
+    json.StartObject();
+    if (available_count == 0 || available_count == count) {
+      json.Key("constant");
+      json.Uint(available_count ? 1 : 0);
+    } else {
+      const auto byte_length = (count + 7) / 8;
+      json.Key("bitstream");
+      json.Uint(static_cast<unsigned>(buffer_views.size()));
+      json.Key("availableCount");
+      json.Uint64(available_count);
+
+      buffer_views.emplace_back(binary.size(), byte_length);
+      const auto begin = reinterpret_cast<const std::byte*>(bitstream.data());
+      binary.insert(std::end(binary), begin, begin + byte_length);
+      binary.resize((binary.size() + 7) / 8 * 8);
+    }
+    json.EndObject();
+  };
+
+  // Buffers and buffer views are known only after all bitstreams are written, so they go last
+  json.StartObject();
+  json.Key("tileAvailability");
+  write_availability(availability.tiles, tile_count);
+  json.Key("contentAvailability");
+  json.StartArray();
+  write_availability(availability.contents, tile_count);
+  json.EndArray();
+  json.Key("childSubtreeAvailability");
+  write_availability(availability.child_subtrees, child_subtree_count);
+  if (!buffer_views.empty()) {
+    json.Key("buffers");
+    json.StartArray();
+    json.StartObject();
+    json.Key("byteLength");
+    json.Uint64(binary.size());
+    json.EndObject();
+    json.EndArray();
+
+    json.Key("bufferViews");
+    json.StartArray();
+    for (auto& [byte_offset, byte_length] : buffer_views) {
+      json.StartObject();
+      json.Key("buffer");
+      json.Uint(0);
+      json.Key("byteOffset");
+      json.Uint64(byte_offset);
+      json.Key("byteLength");
+      json.Uint64(byte_length);
+      json.EndObject();
+    }
+    json.EndArray();
+  }
+  json.EndObject();
+
+  // The JSON chunk is padded with spaces, so that the binary chunk starts at a multiple of 8 bytes
+  std::string json_chunk{ json_buffer.GetString(), json_buffer.GetSize() };
+  json_chunk.resize((json_chunk.size() + 7) / 8 * 8, ' ');
+
+  std::vector<std::byte> subtree(SubtreeHeaderSize + json_chunk.size() + binary.size());
+  const uint64_t json_byte_length = json_chunk.size();
+  const uint64_t binary_byte_length = binary.size();
+  std::memcpy(subtree.data(), &SubtreeMagic, sizeof(uint32_t));
+  std::memcpy(subtree.data() + 4, &SubtreeVersion, sizeof(uint32_t));
+  std::memcpy(subtree.data() + 8, &json_byte_length, sizeof(uint64_t));
+  std::memcpy(subtree.data() + 16, &binary_byte_length, sizeof(uint64_t));
+  std::memcpy(subtree.data() + SubtreeHeaderSize, json_chunk.data(), json_chunk.size());
+  std::copy(std::begin(binary),
+            std::end(binary),
+            std::next(std::begin(subtree), SubtreeHeaderSize + json_chunk.size()));
+  return subtree;
+}
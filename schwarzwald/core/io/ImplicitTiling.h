@@ -0,0 +1,152 @@
+#pragma once
+
+#include "datastructures/OctreeNodeIndex.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Helpers for writing 3D Tiles 1.1 implicit tilesets with octree subdivision, see
+ * https://github.com/CesiumGS/3d-tiles/tree/main/specification/ImplicitTiling
+ */
+namespace implicit_tiling {
+
+/**
+ * Key of a tile in an implicit octree. The children of a tile have the coordinates '2 * x + i',
+ * '2 * y + j' and '2 * z + k' on the next level
+ */
+struct TileKey
+{
+  uint32_t level;
+  uint32_t x;
+  uint32_t y;
+  uint32_t z;
+
+  /**
+   * Key of the ancestor of this tile at the given level
+   */
+  TileKey ancestor_at_level(uint32_t ancestor_level) const;
+
+  bool operator==(const TileKey& other) const;
+};
+
+struct TileKeyHash
+{
+  size_t operator()(const TileKey& key) const;
+};
+
+/**
+ * Converts a node name in the Potree convention ('r0123') to the key of the corresponding tile.
+ * Returns std::nullopt if the name is malformed
+ */
+std::optional<TileKey>
+tile_key_from_node_name(const std::string& node_name);
+
+/**
+ * Converts the index of an octree node to the key of the corresponding tile
+ */
+TileKey
+tile_key_from_node_index(const OctreeNodeIndex64& node_index);
+
+/**
+ * Expands the URI template of an implicit tileset ('{level}', '{x}', '{y}' and '{z}') for the given
+ * tile
+ */
+std::string
+expand_uri_template(const std::string& uri_template, const TileKey& key);
+
+/**
+ * Availability of the tiles, contents and child subtrees of a single subtree, as bitstreams in the
+ * layout of the .subtree format. Bits are stored least significant bit first
+ */
+struct SubtreeAvailability
+{
+  std::vector<uint8_t> tiles;
+  std::vector<uint8_t> contents;
+  std::vector<uint8_t> child_subtrees;
+};
+
+/**
+ * Keeps track of which tiles of an implicit octree are available. Each tile with content sets the
+ * availability bits of itself and its ancestors in the subtree that contains it, so no explicit tree
+ * of tiles has to be kept in memory. Not thread-safe
+ */
+struct TileAvailability
+{
+  explicit TileAvailability(uint32_t subtree_levels);
+
+  /**
+   * Marks the content of the given tile as available. The tile and all its ancestors become
+   * available as well
+   */
+  void set_content_available(const TileKey& key);
+
+  bool is_available(const TileKey& key) const;
+  bool is_content_available(const TileKey& key) const;
+
+  bool empty() const { return _subtrees.empty(); }
+
+  /**
+   * Number of levels that contain available tiles
+   */
+  uint32_t available_levels() const { return _available_levels; }
+
+  uint32_t subtree_levels() const { return _subtree_levels; }
+
+  /**
+   * Keys of the root tiles of all subtrees that contain available tiles
+   */
+  std::vector<TileKey> subtree_roots() const;
+
+  /**
+   * Availability of the subtree with the given root tile, which has to be one of 'subtree_roots'
+   */
+  const SubtreeAvailability& subtree_availability(const TileKey& subtree_root) const;
+
+  /**
+   * Number of bits in the tile and content bitstreams of each subtree
+   */
+  size_t tiles_per_subtree() const { return _tiles_per_subtree; }
+
+  /**
+   * Number of bits in the child subtree bitstream of each subtree
+   */
+  size_t child_subtrees_per_subtree() const { return _child_subtrees_per_subtree; }
+
+private:
+  struct BitIndex
+  {
+    TileKey subtree_root;
+    size_t bit;
+  };
+
+  BitIndex bit_index(const TileKey& key) const;
+
+  /**
+   * Returns the subtree with the given root tile. A new subtree is marked as available in the
+   * subtree above it
+   */
+  SubtreeAvailability& get_or_create_subtree(const TileKey& subtree_root);
+
+  uint32_t _subtree_levels;
+  size_t _tiles_per_subtree;
+  size_t _child_subtrees_per_subtree;
+  uint32_t _available_levels;
+  std::unordered_map<TileKey, SubtreeAvailability, TileKeyHash> _subtrees;
+};
+
+/**
+ * Encodes the given availability as a binary .subtree file. Bitstreams in which all bits are equal
+ * are stored as constants. 'tile_count' and 'child_subtree_count' are the number of bits that are
+ * used in the bitstreams
+ */
+std::vector<std::byte>
+encode_subtree(const SubtreeAvailability& availability,
+               size_t tile_count,
+               size_t child_subtree_count);
+
+} // namespace implicit_tiling
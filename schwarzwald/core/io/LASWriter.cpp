@@ -0,0 +1,694 @@
+#include "io/LASWriter.h"
+
+#include <ctime>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include <boost/scope_exit.hpp>
+
+static_assert(sizeof(Vector3<uint16_t>) == 3 * sizeof(uint16_t),
+              "RGB values of LAS point records have to be tightly packed");
+
+gsl::span<std::byte>
+las::prepare_file_buffer(const FileHeader& header)
+{
+  thread_local std::vector<std::byte> file_buffer;
+  file_buffer.resize(header.total_byte_length());
+  std::fill(std::begin(file_buffer), std::end(file_buffer), std::byte{ 0 });
+
+  auto dst = file_buffer.data();
+  const auto write = [&dst](const auto& value) {
+    std::memcpy(dst, &value, sizeof(value));
+    dst += sizeof(value);
+  };
+  const auto write_string = [&dst](const char* str, size_t field_length) {
+    std::memcpy(dst, str, std::min(std::strlen(str), field_length));
+    dst += field_length;
+  };
+
+  const auto now = std::time(nullptr);
+  const auto calendar_time = *std::gmtime(&now);
+
+  // LAS 1.2 public header block, see
+  // https://www.asprs.org/a/society/committees/standards/asprs_las_format_v12.pdf
+  write_string("LASF", 4);
+  write(uint16_t{ 0 }); // file source ID
+  write(uint16_t{ 0 }); // global encoding
+  dst += 16;            // project ID (GUID)
+  write(uint8_t{ 1 });  // version major
+  write(uint8_t{ 2 });  // version minor
+  write_string("", 32); // system identifier
+  write_string("pointcloud_tiler", 32);
+  write(static_cast<uint16_t>(calendar_time.tm_yday + 1));
+  write(static_cast<uint16_t>(calendar_time.tm_year + 1900));
+  write(FileHeader::HeaderSize);
+  write(static_cast<uint32_t>(FileHeader::HeaderSize)); // offset to point data
+  write(uint32_t{ 0 });                                 // number of variable length records
+  write(header.fields.point_data_format());
+  write(header.fields.point_record_length());
+  write(header.num_points);
+  write(header.num_points); // number of points by return, all points are counted as first returns
+  dst += 4 * sizeof(uint32_t);
+  write(header.scale);
+  write(header.scale);
+  write(header.scale);
+  write(header.offset.x);
+  write(header.offset.y);
+  write(header.offset.z);
+  write(header.bounds.max.x);
+  write(header.bounds.min.x);
+  write(header.bounds.max.y);
+  write(header.bounds.min.y);
+  write(header.bounds.max.z);
+  write(header.bounds.min.z);
+
+  assert(dst == file_buffer.data() + FileHeader::HeaderSize);
+
+  return { file_buffer.data(), static_cast<std::ptrdiff_t>(file_buffer.size()) };
+}
+
+std::string
+las::laszip_error_message(laszip_POINTER laszip)
+{
+  char* las_error = nullptr;
+  if (!laszip || laszip_get_error(laszip, &las_error) || !las_error)
+    return "unknown error";
+  return las_error;
+}
+
+bool
+las::setup_laszip_header(laszip_POINTER laswriter,
+                         uint32_t num_points,
+                         const PointRecordFields& fields,
+                         const AABB& bounds,
+                         double scale)
+{
+  laszip_header* las_header;
+  if (laszip_get_header_pointer(laswriter, &las_header))
+    return false;
+
+  las_header->number_of_point_records = num_points;
+  las_header->number_of_points_by_return[0] = num_points;
+  las_header->number_of_points_by_return[1] = las_header->number_of_points_by_return[2] =
+    las_header->number_of_points_by_return[3] = las_header->number_of_points_by_return[4] = 0;
+  las_header->version_major = 1;
+  las_header->version_minor = 2;
+  std::memcpy(las_header->generating_software, "pointcloud_tiler", sizeof("pointcloud_tiler"));
+  las_header->offset_to_point_data = las_header->header_size;
+  las_header->number_of_variable_length_records = 0;
+  las_header->point_data_format = fields.point_data_format();
+  las_header->point_data_record_length = fields.point_record_length();
+
+  las_header->x_offset = bounds.min.x;
+  las_header->y_offset = bounds.min.y;
+  las_header->z_offset = bounds.min.z;
+  las_header->min_x = bounds.min.x;
+  las_header->min_y = bounds.min.y;
+  las_header->min_z = bounds.min.z;
+  las_header->max_x = bounds.max.x;
+  las_header->max_y = bounds.max.y;
+  las_header->max_z = bounds.max.z;
+
+  las_header->x_scale_factor = las_header->y_scale_factor = las_header->z_scale_factor = scale;
+
+  return true;
+}
+
+bool
+las::write_points_with_laszip(laszip_POINTER laswriter,
+                              const PointBuffer& points,
+                              size_t begin_index,
+                              size_t end_index,
+                              const PointRecordFields& fields)
+{
+  laszip_point* laspoint;
+  if (laszip_get_point_pointer(laswriter, &laspoint))
+    return false;
+
+  for (size_t idx = begin_index; idx < end_index; ++idx) {
+    const auto& pos = points.positions()[idx];
+    laszip_F64 coordinates[3] = { pos.x, pos.y, pos.z };
+    if (laszip_set_coordinates(laswriter, coordinates))
+      return false;
+
+    if (fields.rgb) {
+      // See the iterator overload of 'write_points_with_laszip' for the bit-shift
+      const auto& rgb = points.rgbColors()[idx];
+      laspoint->rgb[0] = rgb.x << 8;
+      laspoint->rgb[1] = rgb.y << 8;
+      laspoint->rgb[2] = rgb.z << 8;
+    }
+    if (fields.intensity) {
+      laspoint->intensity = points.intensities()[idx];
+    }
+    if (fields.classification) {
+      laspoint->classification = points.classifications()[idx];
+    }
+    if (fields.edge_of_flight_line) {
+      laspoint->edge_of_flight_line = points.edge_of_flight_lines()[idx];
+    }
+    if (fields.gps_time) {
+      laspoint->gps_time = points.gps_times()[idx];
+    }
+    if (fields.number_of_returns) {
+      laspoint->number_of_returns = points.number_of_returns()[idx];
+    }
+    if (fields.return_number) {
+      laspoint->return_number = points.return_numbers()[idx];
+    }
+    if (fields.point_source_id) {
+      laspoint->point_source_ID = points.point_source_ids()[idx];
+    }
+    if (fields.scan_angle_rank) {
+      laspoint->scan_angle_rank = points.scan_angle_ranks()[idx];
+    }
+    if (fields.scan_direction_flag) {
+      laspoint->scan_direction_flag = points.scan_direction_flags()[idx];
+    }
+    if (fields.user_data) {
+      laspoint->user_data = points.user_data()[idx];
+    }
+
+    if (laszip_write_point(laswriter))
+      return false;
+  }
+
+  return true;
+}
+
+void
+las::write_laz_file(const std::string& file_path,
+                    uint32_t num_points,
+                    const PointRecordFields& fields,
+                    const AABB& bounds,
+                    double scale,
+                    const std::function<bool(laszip_POINTER)>& write_points)
+{
+  laszip_POINTER laswriter = nullptr;
+  laszip_create(&laswriter);
+  if (!laswriter) {
+    std::cerr << "Could not create LAS writer for file " << file_path << std::endl;
+    return;
+  }
+
+  BOOST_SCOPE_EXIT(&laswriter) { laszip_destroy(laswriter); }
+  BOOST_SCOPE_EXIT_END
+
+  if (!setup_laszip_header(laswriter, num_points, fields, bounds, scale) ||
+      laszip_open_writer(laswriter, file_path.c_str(), 1)) {
+    std::cerr << "Could not write LAS file " << file_path << " ("
+              << laszip_error_message(laswriter) << ") (errno " << errno << ": "
+              << strerror(errno) << ")\n";
+    return;
+  }
+
+  const auto points_written = write_points(laswriter);
+  if (laszip_close_writer(laswriter) || !points_written) {
+    std::cerr << "Could not write LAS points to file " << file_path << " ("
+              << laszip_error_message(laswriter) << ")\n";
+  }
+}
+
+namespace {
+// The chunk table of LAZ files is entropy coded with the arithmetic coder of LASzip, which is not
+// part of the LASzip API. The following is the encoding half of ArithmeticEncoder,
+// ArithmeticModel, ArithmeticBitModel and IntegerCompressor from LASzip, reduced to what is
+// needed for writing chunk tables. See 'laswritepoint.cpp' in LASzip for the reference
+constexpr uint32_t AC_MinLength = 0x01000000U;
+constexpr uint32_t AC_MaxLength = 0xFFFFFFFFU;
+constexpr uint32_t BM_LengthShift = 13;
+constexpr uint32_t BM_MaxCount = 1U << BM_LengthShift;
+constexpr uint32_t DM_LengthShift = 15;
+constexpr uint32_t DM_MaxCount = 1U << DM_LengthShift;
+
+struct ArithmeticModel
+{
+  explicit ArithmeticModel(uint32_t symbols)
+    : symbols(symbols)
+    , last_symbol(symbols - 1)
+    , distribution(symbols)
+    , symbol_count(symbols, 1)
+    , total_count(0)
+    , update_cycle(symbols)
+  {
+    update();
+    symbols_until_update = update_cycle = (symbols + 6) >> 1;
+  }
+
+  void update()
+  {
+    // Halve counts when a threshold is reached
+    if ((total_count += update_cycle) > DM_MaxCount) {
+      total_count = 0;
+      for (auto& count : symbol_count) {
+        total_count += (count = (count + 1) >> 1);
+      }
+    }
+
+    uint32_t sum = 0;
+    const auto scale = 0x80000000U / total_count;
+    for (uint32_t symbol = 0; symbol < symbols; ++symbol) {
+      distribution[symbol] = (scale * sum) >> (31 - DM_LengthShift);
+      sum += symbol_count[symbol];
+    }
+
+    update_cycle = (5 * update_cycle) >> 2;
+    const auto max_cycle = (symbols + 6) << 3;
+    if (update_cycle > max_cycle)
+      update_cycle = max_cycle;
+    symbols_until_update = update_cycle;
+  }
+
+  uint32_t symbols;
+  uint32_t last_symbol;
+  std::vector<uint32_t> distribution;
+  std::vector<uint32_t> symbol_count;
+  uint32_t total_count;
+  uint32_t update_cycle;
+  uint32_t symbols_until_update;
+};
+
+struct ArithmeticBitModel
+{
+  void update()
+  {
+    // Halve counts when a threshold is reached
+    if ((bit_count += update_cycle) > BM_MaxCount) {
+      bit_count = (bit_count + 1) >> 1;
+      bit_0_count = (bit_0_count + 1) >> 1;
+      if (bit_0_count == bit_count)
+        ++bit_count;
+    }
+
+    const auto scale = 0x80000000U / bit_count;
+    bit_0_prob = (bit_0_count * scale) >> (31 - BM_LengthShift);
+
+    update_cycle = (5 * update_cycle) >> 2;
+    if (update_cycle > 64)
+      update_cycle = 64;
+    bits_until_update = update_cycle;
+  }
+
+  uint32_t bit_0_count = 1;
+  uint32_t bit_count = 2;
+  uint32_t bit_0_prob = 1U << (BM_LengthShift - 1);
+  uint32_t update_cycle = 4;
+  uint32_t bits_until_update = 4;
+};
+
+struct ArithmeticEncoder
+{
+  void encode_bit(ArithmeticBitModel& model, uint32_t bit)
+  {
+    const auto x = model.bit_0_prob * (_length >> BM_LengthShift);
+    if (bit == 0) {
+      _length = x;
+      ++model.bit_0_count;
+    } else {
+      const auto init_base = _base;
+      _base += x;
+      _length -= x;
+      if (init_base > _base)
+        propagate_carry();
+    }
+
+    if (_length < AC_MinLength)
+      renormalize();
+    if (--model.bits_until_update == 0)
+      model.update();
+  }
+
+  void encode_symbol(ArithmeticModel& model, uint32_t symbol)
+  {
+    const auto init_base = _base;
+    if (symbol == model.last_symbol) {
+      const auto x = model.distribution[symbol] * (_length >> DM_LengthShift);
+      _base += x;
+      _length -= x;
+    } else {
+      const auto x = model.distribution[symbol] * (_length >>= DM_LengthShift);
+      _base += x;
+      _length = model.distribution[symbol + 1] * _length - x;
+    }
+
+    if (init_base > _base)
+      propagate_carry();
+    if (_length < AC_MinLength)
+      renormalize();
+
+    ++model.symbol_count[symbol];
+    if (--model.symbols_until_update == 0)
+      model.update();
+  }
+
+  void write_bits(uint32_t bits, uint32_t value)
+  {
+    if (bits > 19) {
+      write_raw(16, value & 0xFFFF);
+      value >>= 16;
+      bits -= 16;
+    }
+    write_raw(bits, value);
+  }
+
+  /**
+   * Flushes the encoder and returns all encoded bytes
+   */
+  std::vector<uint8_t> done()
+  {
+    const auto init_base = _base;
+    auto another_byte = true;
+    if (_length > 2 * AC_MinLength) {
+      _base += AC_MinLength;
+      _length = AC_MinLength >> 1;
+    } else {
+      _base += AC_MinLength >> 1;
+      _length = AC_MinLength >> 9;
+      another_byte = false;
+    }
+
+    if (init_base > _base)
+      propagate_carry();
+    renormalize();
+
+    // Two or three zero bytes keep the decoder in sync with its byte reads
+    _bytes.insert(std::end(_bytes), another_byte ? 3 : 2, 0);
+    return std::move(_bytes);
+  }
+
+private:
+  void write_raw(uint32_t bits, uint32_t value)
+  {
+    const auto init_base = _base;
+    _base += value * (_length >>= bits);
+    if (init_base > _base)
+      propagate_carry();
+    if (_length < AC_MinLength)
+      renormalize();
+  }
+
+  void propagate_carry()
+  {
+    for (auto idx = _bytes.size(); idx-- > 0;) {
+      if (_bytes[idx] != 0xFF) {
+        ++_bytes[idx];
+        return;
+      }
+      _bytes[idx] = 0;
+    }
+  }
+
+  void renormalize()
+  {
+    do {
+      _bytes.push_back(static_cast<uint8_t>(_base >> 24));
+      _base <<= 8;
+    } while ((_length <<= 8) < AC_MinLength);
+  }
+
+  uint32_t _base = 0;
+  uint32_t _length = AC_MaxLength;
+  std::vector<uint8_t> _bytes;
+};
+
+/**
+ * IntegerCompressor of LASzip with 32 bits, as used for the chunk table
+ */
+struct IntegerCompressor
+{
+  constexpr static uint32_t CorrectorBits = 32;
+  constexpr static uint32_t BitsHigh = 8;
+
+  IntegerCompressor(ArithmeticEncoder& encoder, uint32_t contexts)
+    : _encoder(encoder)
+  {
+    _bits_models.reserve(contexts);
+    for (uint32_t context = 0; context < contexts; ++context) {
+      _bits_models.emplace_back(CorrectorBits + 1);
+    }
+    // _corrector_models[0] is unused, k == 0 is encoded with _corrector_bit_model
+    _corrector_models.reserve(CorrectorBits + 1);
+    for (uint32_t k = 0; k <= CorrectorBits; ++k) {
+      _corrector_models.emplace_back(1U << std::min(std::max(k, 1u), BitsHigh));
+    }
+  }
+
+  void compress(int32_t predicted, int32_t real, uint32_t context)
+  {
+    // With 32 bits, the corrector covers the whole range of int32_t and is never folded
+    const auto corrector = static_cast<int32_t>(static_cast<uint32_t>(real) -
+                                                static_cast<uint32_t>(predicted));
+    write_corrector(corrector, _bits_models[context]);
+  }
+
+private:
+  void write_corrector(int32_t corrector, ArithmeticModel& bits_model)
+  {
+    // Find the tightest interval [ - (2^k - 1) ... + (2^k) ] that contains the corrector
+    uint32_t k = 0;
+    auto c1 = (corrector <= 0) ? (0u - static_cast<uint32_t>(corrector))
+                               : (static_cast<uint32_t>(corrector) - 1);
+    while (c1) {
+      c1 >>= 1;
+      ++k;
+    }
+
+    _encoder.encode_symbol(bits_model, k);
+
+    if (!k) {
+      _encoder.encode_bit(_corrector_bit_model, static_cast<uint32_t>(corrector));
+      return;
+    }
+    if (k >= 32)
+      return;
+
+    // Translate the corrector into the k-bit interval [ 0 ... 2^k - 1 ]
+    auto c = static_cast<uint32_t>(corrector);
+    if (corrector < 0) {
+      c += (1U << k) - 1;
+    } else {
+      c -= 1;
+    }
+
+    if (k <= BitsHigh) {
+      _encoder.encode_symbol(_corrector_models[k], c);
+    } else {
+      // Larger correctors are coded in two steps
+      const auto k1 = k - BitsHigh;
+      const auto low_bits = c & ((1U << k1) - 1);
+      _encoder.encode_symbol(_corrector_models[k], c >> k1);
+      _encoder.write_bits(k1, low_bits);
+    }
+  }
+
+  ArithmeticEncoder& _encoder;
+  std::vector<ArithmeticModel> _bits_models;
+  ArithmeticBitModel _corrector_bit_model;
+  std::vector<ArithmeticModel> _corrector_models;
+};
+
+} // namespace
+
+std::vector<uint8_t>
+las::encode_chunk_table(const std::vector<uint32_t>& chunk_byte_sizes,
+                        const std::vector<uint32_t>& chunk_point_counts)
+{
+  assert(chunk_point_counts.empty() || chunk_point_counts.size() == chunk_byte_sizes.size());
+
+  std::vector<uint8_t> chunk_table(2 * sizeof(uint32_t));
+  const uint32_t version = 0;
+  const auto number_of_chunks = static_cast<uint32_t>(chunk_byte_sizes.size());
+  std::memcpy(chunk_table.data(), &version, sizeof(uint32_t));
+  std::memcpy(chunk_table.data() + sizeof(uint32_t), &number_of_chunks, sizeof(uint32_t));
+  if (chunk_byte_sizes.empty())
+    return chunk_table;
+
+  ArithmeticEncoder encoder;
+  {
+    // Each size is predicted from the size of the previous chunk, point counts use context 0 and
+    // sizes in bytes use context 1
+    IntegerCompressor compressor{ encoder, 2 };
+    for (size_t chunk = 0; chunk < chunk_byte_sizes.size(); ++chunk) {
+      if (!chunk_point_counts.empty()) {
+        const auto previous_count = chunk ? chunk_point_counts[chunk - 1] : 0u;
+        compressor.compress(
+          static_cast<int32_t>(previous_count), static_cast<int32_t>(chunk_point_counts[chunk]), 0);
+      }
+      const auto previous_size = chunk ? chunk_byte_sizes[chunk - 1] : 0u;
+      compressor.compress(
+        static_cast<int32_t>(previous_size), static_cast<int32_t>(chunk_byte_sizes[chunk]), 1);
+    }
+  }
+  const auto encoded_sizes = encoder.done();
+  chunk_table.insert(std::end(chunk_table), std::begin(encoded_sizes), std::end(encoded_sizes));
+  return chunk_table;
+}
+
+std::optional<std::pair<uint32_t, std::string_view>>
+las::read_laz_chunks(std::string_view laz_file)
+{
+  // Layout of a LAZ file: Header and VLRs, the offset to the chunk table (int64), the chunks and
+  // then the chunk table
+  uint32_t offset_to_point_data;
+  int64_t chunk_table_offset;
+  if (laz_file.size() < FileHeader::HeaderSize)
+    return std::nullopt;
+  std::memcpy(&offset_to_point_data, laz_file.data() + 96, sizeof(uint32_t));
+  if (laz_file.size() < offset_to_point_data + sizeof(int64_t))
+    return std::nullopt;
+  std::memcpy(&chunk_table_offset, laz_file.data() + offset_to_point_data, sizeof(int64_t));
+
+  const auto chunk_begin = offset_to_point_data + sizeof(int64_t);
+  if (chunk_table_offset < static_cast<int64_t>(chunk_begin) ||
+      static_cast<size_t>(chunk_table_offset) > laz_file.size())
+    return std::nullopt;
+  return std::make_pair(
+    offset_to_point_data,
+    laz_file.substr(chunk_begin, static_cast<size_t>(chunk_table_offset) - chunk_begin));
+}
+
+std::string
+las::compress_laz_chunk(const PointBuffer& points,
+                        size_t begin_index,
+                        size_t end_index,
+                        const PointRecordFields& fields,
+                        const AABB& bounds,
+                        double scale)
+{
+  laszip_POINTER laswriter = nullptr;
+  laszip_create(&laswriter);
+  if (!laswriter)
+    return {};
+
+  BOOST_SCOPE_EXIT(&laswriter) { laszip_destroy(laswriter); }
+  BOOST_SCOPE_EXIT_END
+
+  std::ostringstream stream;
+  if (!setup_laszip_header(
+        laswriter, static_cast<uint32_t>(points.count()), fields, bounds, scale) ||
+      laszip_set_chunk_size(laswriter, LAZChunkSize) ||
+      laszip_open_writer_stream(laswriter, stream, 1, 0)) {
+    std::cerr << "Could not compress LAZ chunk (" << laszip_error_message(laswriter) << ")\n";
+    return {};
+  }
+
+  const auto points_written =
+    write_points_with_laszip(laswriter, points, begin_index, end_index, fields);
+  if (laszip_close_writer(laswriter) || !points_written) {
+    std::cerr << "Could not compress LAZ chunk (" << laszip_error_message(laswriter) << ")\n";
+    return {};
+  }
+
+  return stream.str();
+}
+
+bool
+las::write_laz_file_from_chunks(const std::string& file_path,
+                                const std::vector<std::string>& single_chunk_laz_files)
+{
+  if (single_chunk_laz_files.empty())
+    return false;
+
+  std::vector<std::string_view> chunks;
+  std::vector<uint32_t> chunk_byte_sizes;
+  chunks.reserve(single_chunk_laz_files.size());
+  chunk_byte_sizes.reserve(single_chunk_laz_files.size());
+  for (auto& laz_file : single_chunk_laz_files) {
+    const auto chunk = read_laz_chunks(laz_file);
+    if (!chunk)
+      return false;
+    chunks.push_back(chunk->second);
+    chunk_byte_sizes.push_back(static_cast<uint32_t>(chunk->second.size()));
+  }
+
+  const auto& header_source = single_chunk_laz_files.front();
+  const auto offset_to_point_data = read_laz_chunks(header_source)->first;
+  const auto chunk_table = encode_chunk_table(chunk_byte_sizes);
+
+  const auto total_chunk_bytes =
+    std::accumulate(std::begin(chunk_byte_sizes), std::end(chunk_byte_sizes), size_t{ 0 });
+  const auto chunk_table_offset =
+    static_cast<int64_t>(offset_to_point_data + sizeof(int64_t) + total_chunk_bytes);
+
+  std::string laz_file;
+  laz_file.reserve(static_cast<size_t>(chunk_table_offset) + chunk_table.size());
+  laz_file.append(header_source, 0, offset_to_point_data);
+  laz_file.append(reinterpret_cast<const char*>(&chunk_table_offset), sizeof(int64_t));
+  for (auto chunk : chunks) {
+    laz_file.append(chunk.data(), chunk.size());
+  }
+  laz_file.append(reinterpret_cast<const char*>(chunk_table.data()), chunk_table.size());
+
+  return write_file_async(file_path, laz_file.data(), laz_file.size());
+}
+
+void
+write_laz_file(const std::string& file_path,
+               const PointBuffer& points,
+               const PointAttributes& output_attributes,
+               const AABB& bounds,
+               double scale)
+{
+  if (points.empty())
+    return;
+
+  const auto fields = las::point_record_fields_for_points(*std::begin(points), output_attributes);
+  las::write_laz_file(file_path,
+                      static_cast<uint32_t>(points.count()),
+                      fields,
+                      bounds,
+                      scale,
+                      [&](laszip_POINTER laswriter) {
+                        return las::write_points_with_laszip(
+                          laswriter, points, 0, points.count(), fields);
+                      });
+}
+
+void
+write_laz_file(const std::string& file_path,
+               const PointBuffer& points,
+               const PointAttributes& output_attributes,
+               const AABB& bounds,
+               double scale,
+               tf::Subflow& subflow)
+{
+  if (points.count() < las::MinPointsForChunkedCompression) {
+    write_laz_file(file_path, points, output_attributes, bounds, scale);
+    return;
+  }
+
+  struct ChunkedFile
+  {
+    PointBuffer points;
+    las::PointRecordFields fields;
+    std::vector<std::string> compressed_chunks;
+  };
+
+  // The chunk tasks run after the calling task returns, when 'points' might be reused already
+  const auto file = std::make_shared<ChunkedFile>();
+  file->points = points;
+  file->fields = las::point_record_fields_for_points(*std::begin(points), output_attributes);
+  const auto num_chunks = (points.count() + las::LAZChunkSize - 1) / las::LAZChunkSize;
+  file->compressed_chunks.resize(num_chunks);
+
+  auto stitch_task = subflow.emplace([file, file_path]() {
+    if (!las::write_laz_file_from_chunks(file_path, file->compressed_chunks)) {
+      std::cerr << "Could not write LAS file " << file_path << std::endl;
+    }
+  });
+
+  for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+    subflow
+      .emplace([file, chunk, bounds, scale]() {
+        const auto begin_index = chunk * las::LAZChunkSize;
+        const auto end_index = std::min(begin_index + las::LAZChunkSize, file->points.count());
+        file->compressed_chunks[chunk] = las::compress_laz_chunk(
+          file->points, begin_index, end_index, file->fields, bounds, scale);
+      })
+      .precede(stitch_task);
+  }
+}
@@ -0,0 +1,473 @@
+#pragma once
+
+#include "datastructures/PointBuffer.h"
+#include "io/AsyncFileWriter.h"
+#include "io/io_util.h"
+#include "laszip_api.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gsl/gsl>
+#include <taskflow/taskflow.hpp>
+
+namespace las {
+
+/**
+ * Which fields of the LAS point records are written. Fields that are not written are zero
+ */
+struct PointRecordFields
+{
+  bool rgb = false;
+  bool intensity = false;
+  bool classification = false;
+  bool edge_of_flight_line = false;
+  bool gps_time = false;
+  bool number_of_returns = false;
+  bool return_number = false;
+  bool point_source_id = false;
+  bool scan_angle_rank = false;
+  bool scan_direction_flag = false;
+  bool user_data = false;
+
+  /**
+   * LAS 1.2 point data format (0 to 3) that is required to store these fields
+   */
+  uint8_t point_data_format() const
+  {
+    return static_cast<uint8_t>((gps_time ? 1 : 0) + (rgb ? 2 : 0));
+  }
+  uint16_t point_record_length() const
+  {
+    return static_cast<uint16_t>(20 + (gps_time ? 8 : 0) + (rgb ? 6 : 0));
+  }
+};
+
+/**
+ * Which fields to write for the given points? Only attributes that are part of 'output_attributes'
+ * and that the points have are written. All points are expected to have the same attributes, so
+ * only the first point is checked
+ */
+template<typename PointRef>
+PointRecordFields
+point_record_fields_for_points(const PointRef& first_point,
+                               const PointAttributes& output_attributes)
+{
+  const auto has = [&output_attributes](bool point_has_attribute, PointAttribute attribute) {
+    return point_has_attribute && has_attribute(output_attributes, attribute);
+  };
+
+  PointRecordFields fields;
+  fields.rgb = has(first_point.rgbColor() != nullptr, PointAttribute::RGB);
+  fields.intensity = has(first_point.intensity() != nullptr, PointAttribute::Intensity);
+  fields.classification =
+    has(first_point.classification() != nullptr, PointAttribute::Classification);
+  fields.edge_of_flight_line =
+    has(first_point.edge_of_flight_line() != nullptr, PointAttribute::EdgeOfFlightLine);
+  fields.gps_time = has(first_point.gps_time() != nullptr, PointAttribute::GPSTime);
+  fields.number_of_returns =
+    has(first_point.number_of_returns() != nullptr, PointAttribute::NumberOfReturns);
+  fields.return_number = has(first_point.return_number() != nullptr, PointAttribute::ReturnNumber);
+  fields.point_source_id =
+    has(first_point.point_source_id() != nullptr, PointAttribute::PointSourceID);
+  fields.scan_angle_rank =
+    has(first_point.scan_angle_rank() != nullptr, PointAttribute::ScanAngleRank);
+  fields.scan_direction_flag =
+    has(first_point.scan_direction_flag() != nullptr, PointAttribute::ScanDirectionFlag);
+  fields.user_data = has(first_point.user_data() != nullptr, PointAttribute::UserData);
+  return fields;
+}
+
+/**
+ * Header of a LAS file. Offset and scale are the same for all three axes
+ */
+struct FileHeader
+{
+  constexpr static uint16_t HeaderSize = 227;
+
+  uint32_t num_points;
+  PointRecordFields fields;
+  Vector3<double> offset;
+  double scale;
+  AABB bounds;
+
+  size_t total_byte_length() const
+  {
+    return HeaderSize + static_cast<size_t>(num_points) * fields.point_record_length();
+  }
+};
+
+/**
+ * Returns a buffer for a whole LAS file with the given header, with the LAS 1.2 public header block
+ * already written and all point records set to zero. The buffer is reused between all files that
+ * are written on the calling thread
+ */
+gsl::span<std::byte>
+prepare_file_buffer(const FileHeader& header);
+
+/**
+ * Quantizes the given coordinate the same way as LASzip does
+ */
+inline int32_t
+quantize_coordinate(double value, double offset, double scale)
+{
+  const auto scaled = (value - offset) / scale;
+  return static_cast<int32_t>((scaled >= 0) ? (scaled + 0.5) : (scaled - 0.5));
+}
+
+/**
+ * Writes the value returned by 'get_value' for each point in [begin, end) to 'dst', advancing by
+ * 'stride' bytes after each point
+ */
+template<typename Iter, typename GetValue>
+void
+write_field(Iter begin, Iter end, std::byte* dst, size_t stride, GetValue get_value)
+{
+  for (; begin != end; ++begin, dst += stride) {
+    const auto value = get_value(*begin);
+    std::memcpy(dst, &value, sizeof(value));
+  }
+}
+
+/**
+ * Number of points per chunk of LAZ files, which is the default chunk size of LASzip
+ */
+constexpr uint32_t LAZChunkSize = 50'000;
+
+/**
+ * Returns the last error message of the given LASzip object
+ */
+std::string
+laszip_error_message(laszip_POINTER laszip);
+
+/**
+ * Sets up the header of the given LASzip writer for a file with 'num_points' points. Returns false
+ * on failure
+ */
+bool
+setup_laszip_header(laszip_POINTER laswriter,
+                    uint32_t num_points,
+                    const PointRecordFields& fields,
+                    const AABB& bounds,
+                    double scale);
+
+/**
+ * Writes all points in [begin, end) using the given LASzip writer, which has to be opened already.
+ * Returns false on failure
+ */
+template<typename Iter>
+bool
+write_points_with_laszip(laszip_POINTER laswriter,
+                         Iter begin,
+                         Iter end,
+                         const PointRecordFields& fields)
+{
+  laszip_point* laspoint;
+  if (laszip_get_point_pointer(laswriter, &laspoint))
+    return false;
+
+  for (; begin != end; ++begin) {
+    const auto& point_ref = *begin;
+    const auto pos = point_ref.position();
+    laszip_F64 coordinates[3] = { pos.x, pos.y, pos.z };
+    if (laszip_set_coordinates(laswriter, coordinates))
+      return false;
+
+    if (fields.rgb) {
+      const auto rgb = point_ref.rgbColor();
+      // Shifting by 8 bits to get 16-bit color values. This is per the LAS
+      // specification, which states: "The Red, Green, Blue values should
+      // always be normalized to 16 bit values. For example, when encoding an
+      // 8 bit per channel pixel, multiply each channel value by 256 prior to
+      // storage in these fields. This normalization allows color values from
+      // different camera bit depths to be accurately merged." [LAS
+      // Specification, Version 1.4 - R13, 15 July 2013]
+      // (https://www.asprs.org/wp-content/uploads/2010/12/LAS_1_4_r13.pdf)
+      laspoint->rgb[0] = rgb->x << 8;
+      laspoint->rgb[1] = rgb->y << 8;
+      laspoint->rgb[2] = rgb->z << 8;
+    }
+    if (fields.intensity) {
+      laspoint->intensity = *point_ref.intensity();
+    }
+    if (fields.classification) {
+      laspoint->classification = *point_ref.classification();
+    }
+    if (fields.edge_of_flight_line) {
+      laspoint->edge_of_flight_line = *point_ref.edge_of_flight_line();
+    }
+    if (fields.gps_time) {
+      laspoint->gps_time = *point_ref.gps_time();
+    }
+    if (fields.number_of_returns) {
+      laspoint->number_of_returns = *point_ref.number_of_returns();
+    }
+    if (fields.return_number) {
+      laspoint->return_number = *point_ref.return_number();
+    }
+    if (fields.point_source_id) {
+      laspoint->point_source_ID = *point_ref.point_source_id();
+    }
+    if (fields.scan_angle_rank) {
+      laspoint->scan_angle_rank = *point_ref.scan_angle_rank();
+    }
+    if (fields.scan_direction_flag) {
+      laspoint->scan_direction_flag = *point_ref.scan_direction_flag();
+    }
+    if (fields.user_data) {
+      laspoint->user_data = *point_ref.user_data();
+    }
+
+    if (laszip_write_point(laswriter))
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * Writes the points [begin_index, end_index) of 'points' using the given LASzip writer, which has
+ * to be opened already. Each attribute is read directly from its column in the PointBuffer.
+ * Returns false on failure
+ */
+bool
+write_points_with_laszip(laszip_POINTER laswriter,
+                         const PointBuffer& points,
+                         size_t begin_index,
+                         size_t end_index,
+                         const PointRecordFields& fields);
+
+/**
+ * Writes a LAZ file with 'num_points' points to 'file_path'. The points are written by calling
+ * 'write_points' with the opened LASzip writer, which returns false on failure. Errors are logged
+ */
+void
+write_laz_file(const std::string& file_path,
+               uint32_t num_points,
+               const PointRecordFields& fields,
+               const AABB& bounds,
+               double scale,
+               const std::function<bool(laszip_POINTER)>& write_points);
+
+/**
+ * Returns the offset to the point data of the given LAZ file and the compressed chunks, which are
+ * stored between the offset to the chunk table and the chunk table itself. Returns std::nullopt if
+ * the file is malformed
+ */
+std::optional<std::pair<uint32_t, std::string_view>>
+read_laz_chunks(std::string_view laz_file);
+
+/**
+ * Encodes the chunk table of a LAZ file, given the sizes of all chunks in bytes. LAZ files with a
+ * fixed chunk size only store the sizes in bytes. For LAZ files with variable chunk sizes, the
+ * number of points in each chunk has to be passed in 'chunk_point_counts'
+ */
+std::vector<uint8_t>
+encode_chunk_table(const std::vector<uint32_t>& chunk_byte_sizes,
+                   const std::vector<uint32_t>& chunk_point_counts = {});
+
+/**
+ * LAZ files with at least this many points are compressed as independent chunks in parallel, see
+ * 'write_laz_file' with a tf::Subflow
+ */
+constexpr uint32_t MinPointsForChunkedCompression = 4 * LAZChunkSize;
+
+/**
+ * Compresses the points [begin_index, end_index) of 'points' with LASzip as the only chunk of a LAZ
+ * file and returns that file. The header is set up for all points of 'points', so that the header
+ * of the first chunk is the header of the whole file. Returns an empty string on failure
+ */
+std::string
+compress_laz_chunk(const PointBuffer& points,
+                   size_t begin_index,
+                   size_t end_index,
+                   const PointRecordFields& fields,
+                   const AABB& bounds,
+                   double scale);
+
+/**
+ * Writes a LAZ file from the given LAZ files, which all have to be written by 'compress_laz_chunk'
+ * for consecutive chunks of the same points. The header is taken from the first file, the chunks
+ * are stitched together and a new chunk table is written for them. Returns false on failure
+ */
+bool
+write_laz_file_from_chunks(const std::string& file_path,
+                           const std::vector<std::string>& single_chunk_laz_files);
+
+} // namespace las
+
+/**
+ * Writes the points in [points_begin, points_end) as a LAZ file. Offset and bounds of the file are
+ * taken from 'bounds', the scale is given by 'scale'.
+ *
+ * The file is compressed by a single LASzip writer on the calling thread.
+ *
+ * 'Iter' has to dereference to PointBuffer::PointReference or PointBuffer::PointConstReference
+ */
+template<typename Iter>
+void
+write_laz_file(const std::string& file_path,
+               Iter points_begin,
+               Iter points_end,
+               const PointAttributes& output_attributes,
+               const AABB& bounds,
+               double scale)
+{
+  const auto num_points = static_cast<uint32_t>(std::distance(points_begin, points_end));
+  if (!num_points)
+    return;
+
+  const auto fields = las::point_record_fields_for_points(*points_begin, output_attributes);
+  las::write_laz_file(
+    file_path, num_points, fields, bounds, scale, [&](laszip_POINTER laswriter) {
+      return las::write_points_with_laszip(laswriter, points_begin, points_end, fields);
+    });
+}
+
+/**
+ * Writes all points of 'points' as a LAZ file, see 'write_laz_file' above. The points are read
+ * directly from the columns of the PointBuffer
+ */
+void
+write_laz_file(const std::string& file_path,
+               const PointBuffer& points,
+               const PointAttributes& output_attributes,
+               const AABB& bounds,
+               double scale);
+
+/**
+ * Writes all points of 'points' as a LAZ file, see 'write_laz_file' above. Files with at least
+ * 'las::MinPointsForChunkedCompression' points are split into chunks of 'las::LAZChunkSize' points,
+ * which are compressed independently as tasks on 'subflow'. A last task stitches the chunks into
+ * the file, which thus is only written once 'subflow' joins. The tasks work on a copy of 'points'.
+ * Smaller files are written right away on the calling thread
+ */
+void
+write_laz_file(const std::string& file_path,
+               const PointBuffer& points,
+               const PointAttributes& output_attributes,
+               const AABB& bounds,
+               double scale,
+               tf::Subflow& subflow);
+
+/**
+ * Writes the points in [points_begin, points_end) as an uncompressed LAS 1.2 file. Instead of
+ * setting each point through the LASzip API, the header and all point records are written field by
+ * field into a single buffer for the whole file, which is then written to disk with a single write.
+ * Offset and bounds of the file are taken from 'bounds', the scale is given by 'scale'.
+ *
+ * 'Iter' has to dereference to PointBuffer::PointReference or PointBuffer::PointConstReference
+ */
+template<typename Iter>
+void
+write_las_file(const std::string& file_path,
+               Iter points_begin,
+               Iter points_end,
+               const PointAttributes& output_attributes,
+               const AABB& bounds,
+               double scale)
+{
+  const auto num_points = static_cast<uint32_t>(std::distance(points_begin, points_end));
+  if (!num_points)
+    return;
+
+  las::FileHeader header;
+  header.num_points = num_points;
+  header.fields = las::point_record_fields_for_points(*points_begin, output_attributes);
+  header.offset = bounds.min;
+  header.scale = scale;
+  header.bounds = bounds;
+
+  const auto file_buffer = las::prepare_file_buffer(header);
+  const auto records = file_buffer.data() + las::FileHeader::HeaderSize;
+  const size_t stride = header.fields.point_record_length();
+  const auto& fields = header.fields;
+
+  // Positions are quantized in a tight loop per axis instead of per point, which the compiler
+  // can vectorize for contiguous point ranges
+  las::write_field(points_begin, points_end, records, stride, [&header](const auto& point) {
+    return las::quantize_coordinate(point.position().x, header.offset.x, header.scale);
+  });
+  las::write_field(points_begin, points_end, records + 4, stride, [&header](const auto& point) {
+    return las::quantize_coordinate(point.position().y, header.offset.y, header.scale);
+  });
+  las::write_field(points_begin, points_end, records + 8, stride, [&header](const auto& point) {
+    return las::quantize_coordinate(point.position().z, header.offset.z, header.scale);
+  });
+
+  if (fields.intensity) {
+    las::write_field(points_begin, points_end, records + 12, stride, [](const auto& point) {
+      return *point.intensity();
+    });
+  }
+
+  // Return number, number of returns, scan direction flag and edge of flight line share a single
+  // byte. Values are truncated to their bit widths, as in LASzip
+  if (fields.return_number || fields.number_of_returns || fields.scan_direction_flag ||
+      fields.edge_of_flight_line) {
+    las::write_field(points_begin, points_end, records + 14, stride, [&fields](const auto& point) {
+      uint8_t flags = 0;
+      if (fields.return_number)
+        flags |= (*point.return_number() & 0b111);
+      if (fields.number_of_returns)
+        flags |= (*point.number_of_returns() & 0b111) << 3;
+      if (fields.scan_direction_flag)
+        flags |= (*point.scan_direction_flag() & 0b1) << 6;
+      if (fields.edge_of_flight_line)
+        flags |= (*point.edge_of_flight_line() & 0b1) << 7;
+      return flags;
+    });
+  }
+
+  if (fields.classification) {
+    // The upper three bits are the synthetic, key-point and withheld flags
+    las::write_field(points_begin, points_end, records + 15, stride, [](const auto& point) {
+      return static_cast<uint8_t>(*point.classification() & 0b11111);
+    });
+  }
+  if (fields.scan_angle_rank) {
+    las::write_field(points_begin, points_end, records + 16, stride, [](const auto& point) {
+      return *point.scan_angle_rank();
+    });
+  }
+  if (fields.user_data) {
+    las::write_field(points_begin, points_end, records + 17, stride, [](const auto& point) {
+      return *point.user_data();
+    });
+  }
+  if (fields.point_source_id) {
+    las::write_field(points_begin, points_end, records + 18, stride, [](const auto& point) {
+      return *point.point_source_id();
+    });
+  }
+  if (fields.gps_time) {
+    las::write_field(points_begin, points_end, records + 20, stride, [](const auto& point) {
+      return *point.gps_time();
+    });
+  }
+  if (fields.rgb) {
+    // See comment in las::write_points_with_laszip for an explanation of the bit-shift
+    const auto rgb_offset = fields.gps_time ? 28 : 20;
+    las::write_field(
+      points_begin, points_end, records + rgb_offset, stride, [](const auto& point) {
+        const auto rgb = point.rgbColor();
+        return Vector3<uint16_t>{ static_cast<uint16_t>(rgb->x << 8),
+                                  static_cast<uint16_t>(rgb->y << 8),
+                                  static_cast<uint16_t>(rgb->z << 8) };
+      });
+  }
+
+  if (!write_file_async(file_path, file_buffer.data(), file_buffer.size())) {
+    std::cerr << "Could not write LAS file \"" << file_path << "\" (" << strerror(errno) << ")"
+              << std::endl;
+  }
+}
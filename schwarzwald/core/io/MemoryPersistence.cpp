@@ -8,24 +8,24 @@ MemoryPersistence::MemoryPersistence(const PointAttributes& input_attributes)
 void
 MemoryPersistence::persist_points(PointBuffer const& points,
                                   const AABB& bounds,
-                                  const std::string& node_name)
+                                  const OctreeNodeIndex64& node_index)
 {
   std::lock_guard<std::mutex> lock{ *_lock };
-  auto& buffer = _points_cache[node_name];
+  auto& buffer = _points_cache[node_index];
   buffer = points;
 }
 
 void
-MemoryPersistence::retrieve_points(const std::string& node_name, PointBuffer& points)
+MemoryPersistence::retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
 {
   std::lock_guard<std::mutex> lock{ *_lock };
-  points = _points_cache[node_name];
+  points = _points_cache[node_index];
   points.apply_schema(_input_attributes);
 }
 
 bool
-MemoryPersistence::node_exists(const std::string& node_name) const
+MemoryPersistence::node_exists(const OctreeNodeIndex64& node_index) const
 {
   std::lock_guard<std::mutex> lock{ *_lock };
-  return _points_cache.find(node_name) != std::end(_points_cache);
+  return _points_cache.find(node_index) != std::end(_points_cache);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "datastructures/MortonIndex.h"
+#include "datastructures/OctreeNodeIndex.h"
 #include "datastructures/PointBuffer.h"
 #include "math/AABB.h"
 #include "pointcloud/PointAttributes.h"
@@ -23,19 +24,21 @@ struct MemoryPersistence
   void persist_points(Iter points_begin,
                       Iter points_end,
                       const AABB& bounds,
-                      const std::string& node_name)
+                      const OctreeNodeIndex64& node_index)
   {
     std::lock_guard<std::mutex> lock{ *_lock };
-    auto& buffer = _points_cache[node_name];
+    auto& buffer = _points_cache[node_index];
     std::for_each(
       points_begin, points_end, [&buffer](const auto& point_ref) { buffer.push_point(point_ref); });
   }
 
-  void persist_points(PointBuffer const& points, const AABB& bounds, const std::string& node_name);
+  void persist_points(PointBuffer const& points,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index);
 
-  void retrieve_points(const std::string& node_name, PointBuffer& points);
+  void retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points);
 
-  bool node_exists(const std::string& node_name) const;
+  bool node_exists(const OctreeNodeIndex64& node_index) const;
 
   inline bool is_lossless() const { return true; }
 
@@ -48,5 +51,5 @@ private:
   // that retrieve_points returns a PointBuffer with the correct schema
 
   std::unique_ptr<std::mutex> _lock;
-  std::unordered_map<std::string, PointBuffer> _points_cache;
+  std::unordered_map<OctreeNodeIndex64, PointBuffer> _points_cache;
 };
\ No newline at end of file
@@ -0,0 +1,300 @@
+#include "io/MeshoptCodec.h"
+
+#include "util/stuff.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+constexpr uint8_t VertexHeader = 0xA0;
+constexpr size_t ByteGroupSize = 16;
+constexpr size_t VertexBlockSizeBytes = 8192;
+constexpr size_t VertexBlockMaxSize = 256;
+constexpr size_t TailMaxSize = 32;
+
+/**
+ * Number of vertices per block, so that all bytes of one block fit into 8KiB
+ */
+size_t
+vertex_block_size(size_t vertex_size)
+{
+  const auto block_size = (VertexBlockSizeBytes / vertex_size) & ~(ByteGroupSize - 1);
+  return std::min(block_size, VertexBlockMaxSize);
+}
+
+size_t
+tail_size(size_t vertex_size)
+{
+  return std::max(vertex_size, TailMaxSize);
+}
+
+uint8_t
+zigzag8(uint8_t value)
+{
+  return static_cast<uint8_t>((static_cast<int8_t>(value) >> 7) ^ (value << 1));
+}
+
+uint8_t
+unzigzag8(uint8_t value)
+{
+  return static_cast<uint8_t>(-(value & 1) ^ (value >> 1));
+}
+
+/**
+ * Size of a group of 16 values with the given number of bits per value. Values that don't fit are
+ * stored as the sentinel value (all bits set), followed by a full byte after the packed values
+ */
+size_t
+encoded_group_size(const uint8_t* group, uint32_t bits)
+{
+  if (bits == 0) {
+    return std::all_of(group, group + ByteGroupSize, [](uint8_t value) { return value == 0; })
+             ? 0
+             : std::numeric_limits<size_t>::max();
+  }
+  if (bits == 8)
+    return ByteGroupSize;
+
+  const auto sentinel = static_cast<uint8_t>((1u << bits) - 1);
+  return ByteGroupSize * bits / 8 +
+         std::count_if(
+           group, group + ByteGroupSize, [sentinel](uint8_t value) { return value >= sentinel; });
+}
+
+uint8_t*
+encode_group(uint8_t* dst, const uint8_t* group, uint32_t bits)
+{
+  if (bits == 0)
+    return dst;
+  if (bits == 8) {
+    std::memcpy(dst, group, ByteGroupSize);
+    return dst + ByteGroupSize;
+  }
+
+  // Packed values first, with the first value in the highest bits of each byte
+  const auto values_per_byte = 8 / bits;
+  const auto sentinel = static_cast<uint8_t>((1u << bits) - 1);
+  for (size_t idx = 0; idx < ByteGroupSize; idx += values_per_byte) {
+    uint8_t byte = 0;
+    for (size_t value_idx = 0; value_idx < values_per_byte; ++value_idx) {
+      byte = static_cast<uint8_t>((byte << bits) | std::min(group[idx + value_idx], sentinel));
+    }
+    *dst++ = byte;
+  }
+
+  for (size_t idx = 0; idx < ByteGroupSize; ++idx) {
+    if (group[idx] >= sentinel) {
+      *dst++ = group[idx];
+    }
+  }
+  return dst;
+}
+
+/**
+ * Encodes 'size' values, which is a multiple of the group size, with a 2-bit header per group
+ * that selects between 0, 2, 4 or 8 bits per value
+ */
+uint8_t*
+encode_bytes(uint8_t* dst, const uint8_t* values, size_t size)
+{
+  constexpr std::array<uint32_t, 4> BitsPerCode = { 0, 2, 4, 8 };
+
+  const auto group_count = size / ByteGroupSize;
+  const auto header = dst;
+  const auto header_size = (group_count + 3) / 4;
+  std::fill(header, header + header_size, uint8_t{ 0 });
+  dst += header_size;
+
+  for (size_t group_idx = 0; group_idx < group_count; ++group_idx) {
+    const auto group = values + group_idx * ByteGroupSize;
+
+    uint8_t best_code = 3;
+    auto best_size = encoded_group_size(group, BitsPerCode[best_code]);
+    for (uint8_t code = 0; code < 3; ++code) {
+      const auto size = encoded_group_size(group, BitsPerCode[code]);
+      if (size < best_size) {
+        best_code = code;
+        best_size = size;
+      }
+    }
+
+    header[group_idx / 4] |= static_cast<uint8_t>(best_code << ((group_idx % 4) * 2));
+    dst = encode_group(dst, group, BitsPerCode[best_code]);
+  }
+  return dst;
+}
+
+const uint8_t*
+decode_bytes(const uint8_t* src, const uint8_t* src_end, uint8_t* values, size_t size)
+{
+  const auto group_count = size / ByteGroupSize;
+  const auto header = src;
+  const auto header_size = (group_count + 3) / 4;
+  if (static_cast<size_t>(src_end - src) < header_size)
+    throw std::runtime_error{ "Truncated vertex buffer" };
+  src += header_size;
+
+  for (size_t group_idx = 0; group_idx < group_count; ++group_idx) {
+    const auto group = values + group_idx * ByteGroupSize;
+    const auto code = (header[group_idx / 4] >> ((group_idx % 4) * 2)) & 3;
+
+    if (code == 0) {
+      std::fill(group, group + ByteGroupSize, uint8_t{ 0 });
+      continue;
+    }
+    if (code == 3) {
+      if (static_cast<size_t>(src_end - src) < ByteGroupSize)
+        throw std::runtime_error{ "Truncated vertex buffer" };
+      std::memcpy(group, src, ByteGroupSize);
+      src += ByteGroupSize;
+      continue;
+    }
+
+    const uint32_t bits = (code == 1) ? 2 : 4;
+    const auto values_per_byte = 8 / bits;
+    const auto sentinel = static_cast<uint8_t>((1u << bits) - 1);
+    const auto packed_size = ByteGroupSize / values_per_byte;
+    if (static_cast<size_t>(src_end - src) < packed_size)
+      throw std::runtime_error{ "Truncated vertex buffer" };
+
+    auto extra = src + packed_size;
+    for (size_t idx = 0; idx < ByteGroupSize; ++idx) {
+      const auto shift = 8 - bits * (idx % values_per_byte + 1);
+      const auto value = static_cast<uint8_t>((src[idx / values_per_byte] >> shift) & sentinel);
+      if (value != sentinel) {
+        group[idx] = value;
+        continue;
+      }
+      if (extra == src_end)
+        throw std::runtime_error{ "Truncated vertex buffer" };
+      group[idx] = *extra++;
+    }
+    src = extra;
+  }
+  return src;
+}
+} // namespace
+
+size_t
+meshopt::max_encoded_vertex_buffer_size(size_t vertex_count, size_t vertex_size)
+{
+  const auto block_size = vertex_block_size(vertex_size);
+  const auto block_count = (vertex_count + block_size - 1) / block_size;
+  const auto block_header_size = (block_size / ByteGroupSize + 3) / 4;
+  return 1 + block_count * vertex_size * (block_header_size + block_size) + tail_size(vertex_size);
+}
+
+std::vector<std::byte>
+meshopt::encode_vertex_buffer(gsl::span<const std::byte> vertices,
+                              size_t vertex_count,
+                              size_t vertex_size)
+{
+  if (vertex_size == 0 || vertex_size > MaxVertexSize || vertex_size % 4 != 0) {
+    throw std::invalid_argument{ concat(
+      "Vertex size must be a multiple of 4 between 4 and ", MaxVertexSize, " (got ", vertex_size, ")") };
+  }
+  if (static_cast<size_t>(vertices.size()) < vertex_count * vertex_size) {
+    throw std::invalid_argument{ "Vertex buffer is smaller than vertex_count * vertex_size" };
+  }
+
+  std::vector<std::byte> encoded(max_encoded_vertex_buffer_size(vertex_count, vertex_size));
+  const auto src = reinterpret_cast<const uint8_t*>(vertices.data());
+  auto dst = reinterpret_cast<uint8_t*>(encoded.data());
+  *dst++ = VertexHeader;
+
+  // The first vertex is the reference for the differences of the first block
+  std::array<uint8_t, MaxVertexSize> first_vertex = {};
+  if (vertex_count) {
+    std::memcpy(first_vertex.data(), src, vertex_size);
+  }
+  auto last_vertex = first_vertex;
+
+  const auto block_size = vertex_block_size(vertex_size);
+  std::array<uint8_t, VertexBlockMaxSize> deltas;
+  for (size_t block_begin = 0; block_begin < vertex_count; block_begin += block_size) {
+    const auto count = std::min(block_size, vertex_count - block_begin);
+    const auto block = src + block_begin * vertex_size;
+
+    // Values after the end of the last block are encoded as zeros
+    deltas.fill(0);
+    for (size_t byte_idx = 0; byte_idx < vertex_size; ++byte_idx) {
+      auto previous = last_vertex[byte_idx];
+      for (size_t vertex_idx = 0; vertex_idx < count; ++vertex_idx) {
+        const auto current = block[vertex_idx * vertex_size + byte_idx];
+        deltas[vertex_idx] = zigzag8(static_cast<uint8_t>(current - previous));
+        previous = current;
+      }
+      dst = encode_bytes(dst, deltas.data(), (count + ByteGroupSize - 1) & ~(ByteGroupSize - 1));
+    }
+
+    std::memcpy(last_vertex.data(), block + (count - 1) * vertex_size, vertex_size);
+  }
+
+  // The tail holds the first vertex, padded to at least 32 bytes
+  const auto padding = tail_size(vertex_size) - vertex_size;
+  std::fill(dst, dst + padding, uint8_t{ 0 });
+  dst += padding;
+  std::memcpy(dst, first_vertex.data(), vertex_size);
+  dst += vertex_size;
+
+  encoded.resize(static_cast<size_t>(dst - reinterpret_cast<uint8_t*>(encoded.data())));
+  return encoded;
+}
+
+void
+meshopt::decode_vertex_buffer(gsl::span<const std::byte> encoded,
+                              size_t vertex_count,
+                              size_t vertex_size,
+                              gsl::span<std::byte> vertices)
+{
+  if (vertex_size == 0 || vertex_size > MaxVertexSize || vertex_size % 4 != 0) {
+    throw std::invalid_argument{ concat(
+      "Vertex size must be a multiple of 4 between 4 and ", MaxVertexSize, " (got ", vertex_size, ")") };
+  }
+  if (static_cast<size_t>(vertices.size()) < vertex_count * vertex_size) {
+    throw std::invalid_argument{ "Vertex buffer is smaller than vertex_count * vertex_size" };
+  }
+
+  const auto src_begin = reinterpret_cast<const uint8_t*>(encoded.data());
+  const auto encoded_size = static_cast<size_t>(encoded.size());
+  if (encoded_size < 1 + tail_size(vertex_size)) {
+    throw std::runtime_error{ "Truncated vertex buffer" };
+  }
+  if (*src_begin != VertexHeader) {
+    throw std::runtime_error{ "Unsupported vertex buffer version" };
+  }
+
+  auto src = src_begin + 1;
+  const auto src_end = src_begin + encoded_size - tail_size(vertex_size);
+
+  std::array<uint8_t, MaxVertexSize> last_vertex;
+  std::memcpy(last_vertex.data(), src_begin + encoded_size - vertex_size, vertex_size);
+
+  const auto dst = reinterpret_cast<uint8_t*>(vertices.data());
+  const auto block_size = vertex_block_size(vertex_size);
+  std::array<uint8_t, VertexBlockMaxSize> deltas;
+  for (size_t block_begin = 0; block_begin < vertex_count; block_begin += block_size) {
+    const auto count = std::min(block_size, vertex_count - block_begin);
+    const auto block = dst + block_begin * vertex_size;
+
+    for (size_t byte_idx = 0; byte_idx < vertex_size; ++byte_idx) {
+      src = decode_bytes(
+        src, src_end, deltas.data(), (count + ByteGroupSize - 1) & ~(ByteGroupSize - 1));
+
+      auto value = last_vertex[byte_idx];
+      for (size_t vertex_idx = 0; vertex_idx < count; ++vertex_idx) {
+        value = static_cast<uint8_t>(value + unzigzag8(deltas[vertex_idx]));
+        block[vertex_idx * vertex_size + byte_idx] = value;
+      }
+    }
+
+    std::memcpy(last_vertex.data(), block + (count - 1) * vertex_size, vertex_size);
+  }
+
+  if (src != src_end) {
+    throw std::runtime_error{ "Vertex buffer has trailing data" };
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <gsl/gsl>
+
+/**
+ * Vertex buffer codec that produces the same bitstream as 'meshopt_encodeVertexBuffer' (version 0)
+ * of meshoptimizer, which is what the 'ATTRIBUTES' mode of the glTF extension
+ * 'EXT_meshopt_compression' stores. See
+ * https://github.com/KhronosGroup/glTF/tree/main/extensions/2.0/Vendor/EXT_meshopt_compression
+ *
+ * Vertices are split into blocks, and every byte of the vertices of a block is stored as the
+ * zigzag-encoded difference to the same byte of the previous vertex. These differences are small
+ * for attributes of neighbouring points, and are packed with 0, 2, 4 or 8 bits per value in groups
+ * of 16
+ */
+namespace meshopt {
+
+/**
+ * Size in bytes of the largest vertex that the codec supports
+ */
+constexpr size_t MaxVertexSize = 256;
+
+/**
+ * Maximum number of bytes that encode_vertex_buffer writes for 'vertex_count' vertices of
+ * 'vertex_size' bytes
+ */
+size_t
+max_encoded_vertex_buffer_size(size_t vertex_count, size_t vertex_size);
+
+/**
+ * Encodes 'vertex_count' vertices of 'vertex_size' bytes each, which are stored tightly packed in
+ * 'vertices'. 'vertex_size' has to be a multiple of 4 and at most MaxVertexSize
+ */
+std::vector<std::byte>
+encode_vertex_buffer(gsl::span<const std::byte> vertices, size_t vertex_count, size_t vertex_size);
+
+/**
+ * Decodes the vertex buffer in 'encoded' into 'vertices', which has to hold 'vertex_count' vertices
+ * of 'vertex_size' bytes. Throws std::runtime_error if 'encoded' is not a valid vertex buffer
+ */
+void
+decode_vertex_buffer(gsl::span<const std::byte> encoded,
+                     size_t vertex_count,
+                     size_t vertex_size,
+                     gsl::span<std::byte> vertices);
+
+} // namespace meshopt
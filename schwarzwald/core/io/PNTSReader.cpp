@@ -1,4 +1,5 @@
 #include "io/PNTSReader.h"
+#include "io/PNTSWriter.h"
 
 #include <cstddef>
 #include <fstream>
@@ -81,16 +82,46 @@ readPNTSFile(const std::string& filepath, const PointAttributes& input_attribute
                           rtcCenterMember[1].GetDouble(),
                           rtcCenterMember[2].GetDouble() };
 
-  const auto& positionMember = featureTableJSONDocument.FindMember("POSITION")->value;
-  const auto positionByteOffset = positionMember.FindMember("byteOffset")->value.GetUint();
-
-  const auto positionsBegin =
-    reinterpret_cast<const Vector3<float>*>(featureTableBinaryBegin + positionByteOffset);
-  const auto positionsEnd = positionsBegin + pointsLength;
   std::vector<Vector3<double>> highpPositions;
   highpPositions.reserve(pointsLength);
-  std::transform(
-    positionsBegin, positionsEnd, std::back_inserter(highpPositions), Vector3<float>::cast<double>);
+  const auto positionMember = featureTableJSONDocument.FindMember("POSITION");
+  if (positionMember != featureTableJSONDocument.MemberEnd()) {
+    const auto positionByteOffset = positionMember->value.FindMember("byteOffset")->value.GetUint();
+    const auto positionsBegin =
+      reinterpret_cast<const Vector3<float>*>(featureTableBinaryBegin + positionByteOffset);
+    const auto positionsEnd = positionsBegin + pointsLength;
+    std::transform(positionsBegin,
+                   positionsEnd,
+                   std::back_inserter(highpPositions),
+                   Vector3<float>::cast<double>);
+  } else {
+    const auto quantizedPositionMember = featureTableJSONDocument.FindMember("POSITION_QUANTIZED");
+    if (quantizedPositionMember == featureTableJSONDocument.MemberEnd()) {
+      std::cerr << "Missing POSITION or POSITION_QUANTIZED in \"" << filepath << "\"" << std::endl;
+      return std::nullopt;
+    }
+
+    const auto readVector = [&featureTableJSONDocument](const char* name) -> Vector3<double> {
+      const auto& member = featureTableJSONDocument.FindMember(name)->value;
+      return { member[0].GetDouble(), member[1].GetDouble(), member[2].GetDouble() };
+    };
+    const auto quantizedVolumeOffset = readVector("QUANTIZED_VOLUME_OFFSET");
+    const auto quantizedVolumeScale = readVector("QUANTIZED_VOLUME_SCALE");
+
+    std::vector<Vector3<uint16_t>> quantizedPositions;
+    extractFeatureArray<Vector3<uint16_t>>(quantizedPositions,
+                                           "POSITION_QUANTIZED",
+                                           featureTableJSONDocument,
+                                           featureTableBinaryBegin,
+                                           pointsLength);
+    std::transform(std::begin(quantizedPositions),
+                   std::end(quantizedPositions),
+                   std::back_inserter(highpPositions),
+                   [&](const Vector3<uint16_t>& quantizedPosition) {
+                     return pnts::dequantize_position(
+                       quantizedPosition, quantizedVolumeOffset, quantizedVolumeScale);
+                   });
+  }
 
   std::vector<Vector3<uint8_t>> colors;
   if (has_attribute(input_attributes, PointAttribute::RGB)) {
@@ -99,9 +130,22 @@ readPNTSFile(const std::string& filepath, const PointAttributes& input_attribute
   }
 
   std::vector<Vector3<float>> normals;
-  // FEATURE Read normals from PNTS file
   if (has_attribute(input_attributes, PointAttribute::Normal)) {
-    throw std::runtime_error{ "Reading normals from .pnts files is not supported" };
+    extractFeatureArray<Vector3<float>>(
+      normals, "NORMAL", featureTableJSONDocument, featureTableBinaryBegin, pointsLength);
+    if (normals.empty()) {
+      std::vector<NORMAL_OCT16P> octEncodedNormals;
+      extractFeatureArray<NORMAL_OCT16P>(octEncodedNormals,
+                                         "NORMAL_OCT16P",
+                                         featureTableJSONDocument,
+                                         featureTableBinaryBegin,
+                                         pointsLength);
+      normals.reserve(octEncodedNormals.size());
+      std::transform(std::begin(octEncodedNormals),
+                     std::end(octEncodedNormals),
+                     std::back_inserter(normals),
+                     pnts::oct_decode_normal);
+    }
   }
 
   std::vector<uint16_t> intensities;
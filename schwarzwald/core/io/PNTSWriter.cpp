@@ -1,6 +1,8 @@
 
 #include "io/PNTSWriter.h"
+#include "io/AsyncFileWriter.h"
 #include "io/PNTSReader.h"
+#include "io/io_util.h"
 #include "rapidjson/prettywriter.h"
 #include "rapidjson/stringbuffer.h"
 #include "util/Transformation.h"
@@ -263,6 +265,235 @@ PNTSWriter::createFeatureTableBlob(const Vector3<double>& localCenter) // create
   return featureTableBlob;
 }
 
+namespace {
+struct ColumnDescription
+{
+  const char* semantic;
+  uint32_t element_size;
+  uint32_t alignment;
+};
+
+static ColumnDescription
+describe_column(pnts::ColumnType column_type)
+{
+  switch (column_type) {
+    case pnts::ColumnType::Position:
+      return { "POSITION", sizeof(Vector3<float>), 4u };
+    case pnts::ColumnType::PositionQuantized:
+      return { "POSITION_QUANTIZED", sizeof(Vector3<uint16_t>), 2u };
+    case pnts::ColumnType::RGB:
+    case pnts::ColumnType::RGBFromIntensityLinear:
+    case pnts::ColumnType::RGBFromIntensityLogarithmic:
+      return { "RGB", sizeof(RGB), 1u };
+    case pnts::ColumnType::Intensity:
+      return { "INTENSITY", sizeof(uint16_t), 2u };
+    case pnts::ColumnType::Classification:
+      return { "CLASSIFICATION", sizeof(uint8_t), 1u };
+    case pnts::ColumnType::Normal:
+      return { "NORMAL", sizeof(Vector3<float>), 4u };
+    case pnts::ColumnType::NormalOct16P:
+      return { "NORMAL_OCT16P", sizeof(NORMAL_OCT16P), 1u };
+    default:
+      throw std::runtime_error{ "Invalid pnts::ColumnType" };
+  }
+}
+} // namespace
+
+pnts::FileLayout
+pnts::compute_file_layout(uint32_t num_points,
+                          const std::vector<ColumnType>& column_types,
+                          const Vector3<double>& rtc_center,
+                          const AABB& quantized_volume)
+{
+  FileLayout layout;
+
+  StringBuffer json_buffer;
+  Writer<StringBuffer> json_writer{ json_buffer };
+
+  // Same JSON header as PNTSWriter: POINTS_LENGTH and RTC_CENTER, followed by the byte offsets of
+  // all columns
+  json_writer.StartObject();
+  json_writer.Key("POINTS_LENGTH");
+  json_writer.Uint(num_points);
+  json_writer.Key("RTC_CENTER");
+  json_writer.StartArray();
+  json_writer.Double(rtc_center.x);
+  json_writer.Double(rtc_center.y);
+  json_writer.Double(rtc_center.z);
+  json_writer.EndArray();
+
+  const auto has_quantized_positions =
+    std::find(std::begin(column_types), std::end(column_types), ColumnType::PositionQuantized) !=
+    std::end(column_types);
+  if (has_quantized_positions) {
+    const auto write_vector = [&json_writer](const char* key, const Vector3<double>& vector) {
+      json_writer.Key(key);
+      json_writer.StartArray();
+      json_writer.Double(vector.x);
+      json_writer.Double(vector.y);
+      json_writer.Double(vector.z);
+      json_writer.EndArray();
+    };
+    write_vector("QUANTIZED_VOLUME_OFFSET", quantized_volume.min);
+    write_vector("QUANTIZED_VOLUME_SCALE", quantized_volume.extent());
+  }
+
+  uint32_t current_offset = 0;
+  layout.columns.reserve(column_types.size());
+  for (auto column_type : column_types) {
+    const auto description = describe_column(column_type);
+    const auto aligned_offset = align(current_offset, description.alignment);
+    layout.columns.push_back({ column_type, aligned_offset });
+
+    json_writer.Key(description.semantic);
+    json_writer.StartObject();
+    json_writer.Key("byteOffset");
+    json_writer.Int(static_cast<int>(aligned_offset));
+    json_writer.EndObject();
+
+    current_offset = aligned_offset + description.element_size * num_points;
+  }
+  json_writer.EndObject();
+
+  // JSON header and binary body both have to be 8-byte aligned, the JSON header is padded with
+  // spaces
+  layout.json.assign(json_buffer.GetString(), json_buffer.GetSize());
+  layout.json.resize(align(layout.json.size(), size_t{ 8 }), ' ');
+  layout.binary_byte_length = align(current_offset, 8u);
+
+  return layout;
+}
+
+gsl::span<std::byte>
+pnts::prepare_file_buffer(const FileLayout& layout)
+{
+  thread_local std::vector<std::byte> file_buffer;
+  file_buffer.resize(layout.total_byte_length());
+
+  const auto write_uint32 = [](std::byte* dst, uint32_t value) {
+    std::memcpy(dst, &value, sizeof(uint32_t));
+    return dst + sizeof(uint32_t);
+  };
+
+  // FEATURE Support batch table
+  const auto batch_table_json_size = 0u;
+  const auto batch_table_binary_size = 0u;
+
+  auto dst = file_buffer.data();
+  std::memcpy(dst, "pnts", 4);
+  dst += 4;
+  dst = write_uint32(dst, 1);
+  dst = write_uint32(dst, static_cast<uint32_t>(layout.total_byte_length()));
+  dst = write_uint32(dst, static_cast<uint32_t>(layout.json.size()));
+  dst = write_uint32(dst, layout.binary_byte_length);
+  dst = write_uint32(dst, batch_table_json_size);
+  dst = write_uint32(dst, batch_table_binary_size);
+
+  std::memcpy(dst, layout.json.data(), layout.json.size());
+
+  // The buffer is reused, so the padding between and after the columns has to be cleared
+  std::fill(file_buffer.data() + layout.binary_body_offset(),
+            file_buffer.data() + file_buffer.size(),
+            std::byte{ 0 });
+
+  return { file_buffer.data(), static_cast<std::ptrdiff_t>(file_buffer.size()) };
+}
+
+void
+pnts::write_file(const std::string& file_path, gsl::span<const std::byte> bytes)
+{
+  if (!write_file_async(file_path, bytes.data(), bytes.size())) {
+    std::cerr << "Could not write .pnts file \"" << file_path << "\" (" << strerror(errno) << ")"
+              << std::endl;
+  }
+}
+
+void
+write_pnts_file(const std::string& file_path,
+                const PointBuffer& points,
+                const PointAttributes& point_attributes,
+                RGBMapping rgb_mapping,
+                const Vector3<double>& rtc_center,
+                PNTSEncoding encoding,
+                const AABB& bounds)
+{
+  const auto num_points = static_cast<uint32_t>(points.count());
+  if (!num_points)
+    return;
+
+  const auto layout = pnts::compute_file_layout(
+    num_points,
+    pnts::column_types_for_points(points.get_point(0), point_attributes, rgb_mapping, encoding),
+    rtc_center,
+    bounds);
+  const auto file_buffer = pnts::prepare_file_buffer(layout);
+  const auto binary_body = file_buffer.data() + layout.binary_body_offset();
+
+  const auto copy_column = [](const auto& values, std::byte* dst) {
+    std::memcpy(dst, values.data(), values.size() * sizeof(values[0]));
+  };
+
+  for (auto& column : layout.columns) {
+    const auto column_begin = binary_body + column.byte_offset;
+    const auto& positions = points.positions();
+    const auto& intensities = points.intensities();
+    switch (column.type) {
+      case pnts::ColumnType::Position:
+        pnts::write_column(std::begin(positions),
+                           std::end(positions),
+                           column_begin,
+                           [](const Vector3<double>& position) -> Vector3<float> {
+                             return { static_cast<float>(position.x),
+                                      static_cast<float>(position.y),
+                                      static_cast<float>(position.z) };
+                           });
+        break;
+      case pnts::ColumnType::PositionQuantized:
+        pnts::write_column(std::begin(positions),
+                           std::end(positions),
+                           column_begin,
+                           [&bounds](const Vector3<double>& position) {
+                             return pnts::quantize_position(position, bounds);
+                           });
+        break;
+      case pnts::ColumnType::RGB:
+        static_assert(sizeof(RGB) == sizeof(Vector3<uint8_t>),
+                      "RGB colors of PointBuffer and .pnts file must have the same layout");
+        copy_column(points.rgbColors(), column_begin);
+        break;
+      case pnts::ColumnType::RGBFromIntensityLinear:
+        pnts::write_column(std::begin(intensities),
+                           std::end(intensities),
+                           column_begin,
+                           &pnts::rgb_from_intensity_linear);
+        break;
+      case pnts::ColumnType::RGBFromIntensityLogarithmic:
+        pnts::write_column(std::begin(intensities),
+                           std::end(intensities),
+                           column_begin,
+                           &pnts::rgb_from_intensity_logarithmic);
+        break;
+      case pnts::ColumnType::Intensity:
+        copy_column(intensities, column_begin);
+        break;
+      case pnts::ColumnType::Classification:
+        copy_column(points.classifications(), column_begin);
+        break;
+      case pnts::ColumnType::Normal:
+        copy_column(points.normals(), column_begin);
+        break;
+      case pnts::ColumnType::NormalOct16P:
+        pnts::write_column(std::begin(points.normals()),
+                           std::end(points.normals()),
+                           column_begin,
+                           &pnts::oct_encode_normal);
+        break;
+    }
+  }
+
+  pnts::write_file(file_path, file_buffer);
+}
+
 void
 transform_pnts_file_coordinates(const std::string& file_path,
                                 Recenter recenter,
@@ -508,18 +739,10 @@ attributes::RGBFromIntensityAttribute::RGBFromIntensityAttribute(MappingType map
 {
   switch (mapping_type) {
     case MappingType::Linear:
-      _mapping_func = [](uint16_t intensity) -> RGB {
-        const auto greyscale = static_cast<uint8_t>(intensity >> 8);
-        return { greyscale, greyscale, greyscale };
-      };
+      _mapping_func = pnts::rgb_from_intensity_linear;
       break;
     case MappingType::Log:
-      _mapping_func = [](uint16_t intensity) -> RGB {
-        const auto intensity_max = std::numeric_limits<uint16_t>::max();
-        const auto greyscale = static_cast<uint8_t>(
-          255 * std::log(static_cast<float>(intensity) + 1) / std::log(intensity_max));
-        return { greyscale, greyscale, greyscale };
-      };
+      _mapping_func = pnts::rgb_from_intensity_logarithmic;
       break;
     default:
       throw std::runtime_error{ "Invalid MappingType" };
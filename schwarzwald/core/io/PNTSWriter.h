@@ -1,9 +1,13 @@
 #pragma once
 
 #include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <optional>
 #include <variant>
 #include <vector>
@@ -291,6 +295,370 @@ private:
   FeatureTableBlob createFeatureTableBlob(const Vector3<double>& localCenter);
 };
 
+/**
+ * How positions and normals are stored in .pnts files
+ */
+enum class PNTSEncoding
+{
+  // POSITION and NORMAL as 32-bit floats
+  Float,
+  // POSITION_QUANTIZED with 16 bits per axis relative to the bounds of the node, and normals as
+  // NORMAL_OCT16P. This roughly halves the size of the files, but is lossy
+  Quantized
+};
+
+namespace pnts {
+
+/**
+ * Per-point data that a column in the binary body of a .pnts feature table is created from
+ */
+enum class ColumnType
+{
+  Position,
+  PositionQuantized,
+  RGB,
+  RGBFromIntensityLinear,
+  RGBFromIntensityLogarithmic,
+  Intensity,
+  Classification,
+  Normal,
+  NormalOct16P
+};
+
+/**
+ * A single column of per-point data in the binary body of a .pnts feature table
+ */
+struct FeatureTableColumn
+{
+  ColumnType type;
+  /**
+   * Offset of this column relative to the start of the binary body
+   */
+  uint32_t byte_offset;
+};
+
+/**
+ * Layout of a complete .pnts file, computed from the number of points and the columns before any
+ * point data is written. 'json' already contains the padding required after the JSON header
+ */
+struct FileLayout
+{
+  constexpr static uint32_t HeaderSize = 28;
+
+  std::vector<FeatureTableColumn> columns;
+  std::string json;
+  uint32_t binary_byte_length;
+
+  size_t total_byte_length() const { return HeaderSize + json.size() + binary_byte_length; }
+  size_t binary_body_offset() const { return HeaderSize + json.size(); }
+};
+
+/**
+ * Computes the layout of a .pnts file. 'quantized_volume' is only used if there is a
+ * PositionQuantized column, in which case it is written as QUANTIZED_VOLUME_OFFSET and
+ * QUANTIZED_VOLUME_SCALE
+ */
+FileLayout
+compute_file_layout(uint32_t num_points,
+                    const std::vector<ColumnType>& column_types,
+                    const Vector3<double>& rtc_center,
+                    const AABB& quantized_volume);
+
+/**
+ * Returns a buffer for a whole .pnts file with the given layout, with the header and JSON header
+ * already written and all padding bytes set. The buffer is reused between all files that are
+ * written on the calling thread
+ */
+gsl::span<std::byte>
+prepare_file_buffer(const FileLayout& layout);
+
+/**
+ * Write the given bytes to the given file with a single write
+ */
+void
+write_file(const std::string& file_path, gsl::span<const std::byte> bytes);
+
+inline RGB
+rgb_from_intensity_linear(uint16_t intensity)
+{
+  const auto greyscale = static_cast<uint8_t>(intensity >> 8);
+  return { greyscale, greyscale, greyscale };
+}
+
+inline RGB
+rgb_from_intensity_logarithmic(uint16_t intensity)
+{
+  const auto intensity_max = std::numeric_limits<uint16_t>::max();
+  const auto greyscale = static_cast<uint8_t>(
+    255 * std::log(static_cast<float>(intensity) + 1) / std::log(intensity_max));
+  return { greyscale, greyscale, greyscale };
+}
+
+/**
+ * Quantizes the given position to 16 bits per axis relative to 'quantized_volume', as required by
+ * the POSITION_QUANTIZED semantic. Positions outside of the volume are clamped to the volume
+ */
+inline Vector3<uint16_t>
+quantize_position(const Vector3<double>& position, const AABB& quantized_volume)
+{
+  const auto quantize = [](double value, double min, double extent) -> uint16_t {
+    if (extent <= 0)
+      return 0;
+    const auto normalized = std::clamp((value - min) / extent, 0.0, 1.0);
+    return static_cast<uint16_t>(std::lround(normalized * std::numeric_limits<uint16_t>::max()));
+  };
+  const auto extent = quantized_volume.extent();
+  return { quantize(position.x, quantized_volume.min.x, extent.x),
+           quantize(position.y, quantized_volume.min.y, extent.y),
+           quantize(position.z, quantized_volume.min.z, extent.z) };
+}
+
+inline Vector3<double>
+dequantize_position(const Vector3<uint16_t>& quantized_position,
+                    const Vector3<double>& quantized_volume_offset,
+                    const Vector3<double>& quantized_volume_scale)
+{
+  const auto dequantize = [](uint16_t value, double offset, double scale) {
+    return offset + (value * scale / std::numeric_limits<uint16_t>::max());
+  };
+  return { dequantize(quantized_position.x, quantized_volume_offset.x, quantized_volume_scale.x),
+           dequantize(quantized_position.y, quantized_volume_offset.y, quantized_volume_scale.y),
+           dequantize(quantized_position.z, quantized_volume_offset.z, quantized_volume_scale.z) };
+}
+
+/**
+ * Encodes the given unit normal with the octahedral encoding with 8 bits per component, as
+ * required by the NORMAL_OCT16P semantic. See 'A Survey of Efficient Representations for
+ * Independent Unit Vectors' (Cigolle et al. 2014)
+ */
+inline NORMAL_OCT16P
+oct_encode_normal(const Vector3<float>& normal)
+{
+  const auto sign_not_zero = [](float value) { return (value < 0.f) ? -1.f : 1.f; };
+  const auto to_snorm8 = [](float value) {
+    return static_cast<uint8_t>(std::lround((std::clamp(value, -1.f, 1.f) * 0.5f + 0.5f) * 255.f));
+  };
+
+  const auto l1_norm = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (l1_norm == 0.f)
+    return { to_snorm8(0.f), to_snorm8(0.f) };
+
+  auto u = normal.x / l1_norm;
+  auto v = normal.y / l1_norm;
+  if (normal.z < 0.f) {
+    const auto old_u = u;
+    u = (1.f - std::abs(v)) * sign_not_zero(u);
+    v = (1.f - std::abs(old_u)) * sign_not_zero(v);
+  }
+  return { to_snorm8(u), to_snorm8(v) };
+}
+
+inline Vector3<float>
+oct_decode_normal(const NORMAL_OCT16P& encoded_normal)
+{
+  const auto sign_not_zero = [](float value) { return (value < 0.f) ? -1.f : 1.f; };
+  const auto from_snorm8 = [](uint8_t value) { return (value / 255.f) * 2.f - 1.f; };
+
+  auto x = from_snorm8(encoded_normal.x);
+  auto y = from_snorm8(encoded_normal.y);
+  const auto z = 1.f - std::abs(x) - std::abs(y);
+  if (z < 0.f) {
+    const auto old_x = x;
+    x = (1.f - std::abs(y)) * sign_not_zero(x);
+    y = (1.f - std::abs(old_x)) * sign_not_zero(y);
+  }
+  const Vector3<float> normal{ x, y, z };
+  return normal / normal.length();
+}
+
+/**
+ * Writes the value returned by 'get_value' for each point in [begin, end) tightly packed to 'dst'
+ */
+template<typename Iter, typename GetValue>
+void
+write_column(Iter begin, Iter end, std::byte* dst, GetValue get_value)
+{
+  for (; begin != end; ++begin) {
+    const auto value = get_value(*begin);
+    std::memcpy(dst, &value, sizeof(value));
+    dst += sizeof(value);
+  }
+}
+
+/**
+ * Which columns to write for the given points? Attributes that the points don't have or that .pnts
+ * files don't support are skipped. All points are expected to have the same attributes, so only
+ * the first point is checked
+ */
+template<typename PointRef>
+std::vector<ColumnType>
+column_types_for_points(const PointRef& first_point,
+                        const PointAttributes& point_attributes,
+                        RGBMapping rgb_mapping,
+                        PNTSEncoding encoding)
+{
+  std::vector<ColumnType> column_types;
+  for (auto attribute : point_attributes) {
+    switch (attribute) {
+      case PointAttribute::Position:
+        column_types.push_back((encoding == PNTSEncoding::Quantized)
+                                 ? ColumnType::PositionQuantized
+                                 : ColumnType::Position);
+        break;
+      case PointAttribute::RGB:
+        switch (rgb_mapping) {
+          case RGBMapping::FromIntensityLinear:
+            if (first_point.intensity())
+              column_types.push_back(ColumnType::RGBFromIntensityLinear);
+            break;
+          case RGBMapping::FromIntensityLogarithmic:
+            if (first_point.intensity())
+              column_types.push_back(ColumnType::RGBFromIntensityLogarithmic);
+            break;
+          default:
+            if (first_point.rgbColor())
+              column_types.push_back(ColumnType::RGB);
+            break;
+        }
+        break;
+      case PointAttribute::Intensity:
+        if (first_point.intensity())
+          column_types.push_back(ColumnType::Intensity);
+        break;
+      case PointAttribute::Classification:
+        if (first_point.classification())
+          column_types.push_back(ColumnType::Classification);
+        break;
+      case PointAttribute::Normal:
+        if (first_point.normal())
+          column_types.push_back((encoding == PNTSEncoding::Quantized) ? ColumnType::NormalOct16P
+                                                                       : ColumnType::Normal);
+        break;
+      default:
+        break;
+    }
+  }
+  return column_types;
+}
+
+} // namespace pnts
+
+/**
+ * Writes the points in [points_begin, points_end) as a .pnts file. With PNTSEncoding::Float, this
+ * produces the same file as PNTSWriter, but without any intermediate copies: The layout of the file
+ * is computed up front, all attribute columns are written straight from the range of points into a
+ * single buffer for the whole file and this buffer is written to disk with a single write. With
+ * PNTSEncoding::Quantized, positions are quantized relative to 'bounds', which should be the bounds
+ * of the node that the points belong to
+ *
+ * 'Iter' has to dereference to PointBuffer::PointReference or PointBuffer::PointConstReference
+ */
+template<typename Iter>
+void
+write_pnts_file(const std::string& file_path,
+                Iter points_begin,
+                Iter points_end,
+                const PointAttributes& point_attributes,
+                RGBMapping rgb_mapping,
+                const Vector3<double>& rtc_center,
+                PNTSEncoding encoding,
+                const AABB& bounds)
+{
+  const auto num_points = static_cast<uint32_t>(std::distance(points_begin, points_end));
+  if (!num_points)
+    return;
+
+  const auto layout = pnts::compute_file_layout(
+    num_points,
+    pnts::column_types_for_points(*points_begin, point_attributes, rgb_mapping, encoding),
+    rtc_center,
+    bounds);
+  const auto file_buffer = pnts::prepare_file_buffer(layout);
+  const auto binary_body = file_buffer.data() + layout.binary_body_offset();
+
+  for (auto& column : layout.columns) {
+    const auto column_begin = binary_body + column.byte_offset;
+    switch (column.type) {
+      case pnts::ColumnType::Position:
+        pnts::write_column(
+          points_begin, points_end, column_begin, [](const auto& point) -> Vector3<float> {
+            const auto& position = point.position();
+            return { static_cast<float>(position.x),
+                     static_cast<float>(position.y),
+                     static_cast<float>(position.z) };
+          });
+        break;
+      case pnts::ColumnType::PositionQuantized:
+        pnts::write_column(points_begin, points_end, column_begin, [&bounds](const auto& point) {
+          return pnts::quantize_position(point.position(), bounds);
+        });
+        break;
+      case pnts::ColumnType::RGB:
+        pnts::write_column(points_begin, points_end, column_begin, [](const auto& point) -> RGB {
+          const auto color = point.rgbColor();
+          assert(color != nullptr);
+          return { color->x, color->y, color->z };
+        });
+        break;
+      case pnts::ColumnType::RGBFromIntensityLinear:
+        pnts::write_column(points_begin, points_end, column_begin, [](const auto& point) {
+          assert(point.intensity() != nullptr);
+          return pnts::rgb_from_intensity_linear(*point.intensity());
+        });
+        break;
+      case pnts::ColumnType::RGBFromIntensityLogarithmic:
+        pnts::write_column(points_begin, points_end, column_begin, [](const auto& point) {
+          assert(point.intensity() != nullptr);
+          return pnts::rgb_from_intensity_logarithmic(*point.intensity());
+        });
+        break;
+      case pnts::ColumnType::Intensity:
+        pnts::write_column(
+          points_begin, points_end, column_begin, [](const auto& point) -> uint16_t {
+            assert(point.intensity() != nullptr);
+            return *point.intensity();
+          });
+        break;
+      case pnts::ColumnType::Classification:
+        pnts::write_column(
+          points_begin, points_end, column_begin, [](const auto& point) -> uint8_t {
+            assert(point.classification() != nullptr);
+            return *point.classification();
+          });
+        break;
+      case pnts::ColumnType::Normal:
+        pnts::write_column(
+          points_begin, points_end, column_begin, [](const auto& point) -> Vector3<float> {
+            assert(point.normal() != nullptr);
+            return *point.normal();
+          });
+        break;
+      case pnts::ColumnType::NormalOct16P:
+        pnts::write_column(points_begin, points_end, column_begin, [](const auto& point) {
+          assert(point.normal() != nullptr);
+          return pnts::oct_encode_normal(*point.normal());
+        });
+        break;
+    }
+  }
+
+  pnts::write_file(file_path, file_buffer);
+}
+
+/**
+ * Same as the iterator overload, but writes every column straight from the attribute columns of
+ * 'points'. Columns that .pnts files store in the same representation as the PointBuffer are
+ * copied with a single memcpy
+ */
+void
+write_pnts_file(const std::string& file_path,
+                const PointBuffer& points,
+                const PointAttributes& point_attributes,
+                RGBMapping rgb_mapping,
+                const Vector3<double>& rtc_center,
+                PNTSEncoding encoding,
+                const AABB& bounds);
+
 /// <summary>
 /// When transforming positions in a .pnts file, should they be recentered with
 /// their origin at the smallest point?
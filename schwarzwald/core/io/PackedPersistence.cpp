@@ -0,0 +1,309 @@
+#include "io/PackedPersistence.h"
+
+#include <algorithm>
+#include <array>
+#include <experimental/filesystem>
+#include <fstream>
+#include <limits>
+
+namespace {
+constexpr uint32_t IndexMagic = 0x49505753; // 'SWPI'
+constexpr uint8_t IndexVersion = 1;
+
+/**
+ * Views the encoded points of a node. The decoding buffers are reused by all nodes that are viewed
+ * from the same thread
+ */
+PointBufferView
+view_node(gsl::span<const std::byte> encoded_points, const OctreeNodeIndex64& node_index)
+{
+  thread_local std::vector<std::byte> decompressed;
+  thread_local std::vector<std::byte> decoded;
+  return BinaryPersistence::view_encoded_points(
+    encoded_points, concat("node ", node_name_from_index(node_index)), decompressed, decoded);
+}
+} // namespace
+
+PointAttributes
+PackedPersistence::supported_output_attributes()
+{
+  return BinaryPersistence::supported_output_attributes();
+}
+
+PackedPersistence::PackedPersistence(const std::string& work_dir,
+                                     const PointAttributes& input_attributes,
+                                     const PointAttributes& output_attributes,
+                                     BinaryCodec codec,
+                                     int codec_level,
+                                     uint64_t max_pack_size)
+  : _work_dir(work_dir)
+  , _encoder(work_dir, input_attributes, output_attributes, codec, codec_level)
+  , _max_pack_size(max_pack_size)
+  , _lock(std::make_unique<std::mutex>())
+  , _has_current_pack(false)
+  , _current_pack(0)
+  , _current_pack_size(0)
+  , _index_modified(false)
+{
+  read_index();
+}
+
+PackedPersistence::~PackedPersistence()
+{
+  // Moved-from instances have no lock and nothing to write
+  if (!_lock || !_index_modified)
+    return;
+
+  try {
+    flush_index();
+  } catch (const std::exception& ex) {
+    std::cerr << "Could not write pack index file " << index_file_path() << " (" << ex.what()
+              << ")" << std::endl;
+  }
+}
+
+void
+PackedPersistence::persist_points(PointBuffer const& points,
+                                  const AABB& bounds,
+                                  const OctreeNodeIndex64& node_index)
+{
+  if (!points.count())
+    throw std::runtime_error{ "No points selected" };
+
+  persist_points(std::begin(points), std::end(points), bounds, node_index);
+}
+
+void
+PackedPersistence::retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
+{
+  const auto encoded_points = read_node(node_index);
+  if (encoded_points.empty())
+    return;
+
+  points = {};
+  points.append_buffer(view_node(encoded_points, node_index));
+}
+
+void
+PackedPersistence::append_points(const OctreeNodeIndex64& node_index, PointBuffer& points) const
+{
+  const auto encoded_points = read_node(node_index);
+  if (encoded_points.empty())
+    return;
+
+  points.append_buffer(view_node(encoded_points, node_index));
+}
+
+bool
+PackedPersistence::node_exists(const OctreeNodeIndex64& node_index) const
+{
+  std::lock_guard<std::mutex> lock{ *_lock };
+  return _index.find(node_index) != std::end(_index);
+}
+
+std::optional<PackedPersistence::NodeLocation>
+PackedPersistence::locate_node(const OctreeNodeIndex64& node_index) const
+{
+  std::lock_guard<std::mutex> lock{ *_lock };
+  const auto iter = _index.find(node_index);
+  if (iter == std::end(_index))
+    return std::nullopt;
+  return std::make_optional(iter->second);
+}
+
+std::string
+PackedPersistence::pack_file_path(uint32_t pack) const
+{
+  return concat(_work_dir, "/points_", pack, ".pack");
+}
+
+std::string
+PackedPersistence::index_file_path() const
+{
+  return concat(_work_dir, "/points.packindex");
+}
+
+void
+PackedPersistence::flush_index()
+{
+  std::lock_guard<std::mutex> lock{ *_lock };
+
+  // Sorted by node, so that the index file does not depend on the order in which nodes were written
+  std::vector<const std::pair<const OctreeNodeIndex64, NodeLocation>*> entries;
+  entries.reserve(_index.size());
+  for (auto& entry : _index) {
+    entries.push_back(&entry);
+  }
+  std::sort(std::begin(entries), std::end(entries), [](const auto* l, const auto* r) {
+    return l->first < r->first;
+  });
+
+  const auto file_path = index_file_path();
+  std::ofstream writer{ file_path, std::ios::out | std::ios::binary | std::ios::trunc };
+  if (!writer.is_open()) {
+    throw std::runtime_error{ concat("Could not open pack index file ", file_path) };
+  }
+
+  const uint32_t pack_count = _has_current_pack ? _current_pack + 1 : _current_pack;
+  const uint64_t node_count = entries.size();
+  write_binary(IndexMagic, writer);
+  write_binary(IndexVersion, writer);
+  const std::array<uint8_t, 3> reserved = {};
+  write_binary(reserved, writer);
+  write_binary(pack_count, writer);
+  write_binary(node_count, writer);
+
+  // Nodes are stored by name in the index file
+  for (auto entry : entries) {
+    const auto node_name = node_name_from_index(entry->first);
+    write_binary(static_cast<uint8_t>(node_name.size()), writer);
+    writer.write(node_name.data(), static_cast<std::streamsize>(node_name.size()));
+    write_binary(entry->second.pack, writer);
+    write_binary(entry->second.offset, writer);
+    write_binary(entry->second.length, writer);
+  }
+
+  if (!writer.good()) {
+    throw std::runtime_error{ concat("Could not write pack index file ", file_path) };
+  }
+  _index_modified = false;
+}
+
+void
+PackedPersistence::append_to_pack(const OctreeNodeIndex64& node_index,
+                                  gsl::span<const std::byte> encoded_points)
+{
+  const auto length = static_cast<uint64_t>(encoded_points.size());
+
+  uint32_t pack;
+  uint64_t offset;
+  {
+    std::lock_guard<std::mutex> lock{ *_lock };
+    auto padding = (NodeAlignment - _current_pack_size % NodeAlignment) % NodeAlignment;
+    if (!_has_current_pack ||
+        (_current_pack_size > 0 && _current_pack_size + padding + length > _max_pack_size)) {
+      open_next_pack();
+      padding = 0;
+    }
+    pack = _current_pack;
+    offset = _current_pack_size + padding;
+    _current_pack_size = offset + length;
+  }
+
+  // Nodes are written at their reserved offsets without holding the lock. The padding in front of a
+  // node is never written, it reads as zeros
+  const auto file_path = pack_file_path(pack);
+  std::fstream writer;
+  writer.rdbuf()->pubsetbuf(nullptr, 0);
+  writer.open(file_path, std::ios::in | std::ios::out | std::ios::binary);
+  writer.seekp(static_cast<std::streamoff>(offset));
+  writer.write(reinterpret_cast<const char*>(encoded_points.data()),
+               static_cast<std::streamsize>(length));
+  if (!writer.good()) {
+    throw std::runtime_error{ concat(
+      "Could not write node ", node_name_from_index(node_index), " to pack file ", file_path) };
+  }
+
+  std::lock_guard<std::mutex> lock{ *_lock };
+  _index[node_index] = { pack, offset, length };
+  _index_modified = true;
+}
+
+gsl::span<const std::byte>
+PackedPersistence::read_node(const OctreeNodeIndex64& node_index) const
+{
+  const auto location = locate_node(node_index);
+  if (!location)
+    return {};
+
+  const auto file_path = pack_file_path(location->pack);
+  std::ifstream reader{ file_path, std::ios::in | std::ios::binary };
+  if (!reader.is_open()) {
+    std::cerr << "Could not read pack file " << file_path << std::endl;
+    return {};
+  }
+
+  thread_local std::vector<std::byte> buffer;
+  buffer.resize(location->length);
+  reader.seekg(static_cast<std::streamoff>(location->offset));
+  reader.read(reinterpret_cast<char*>(buffer.data()),
+              static_cast<std::streamsize>(location->length));
+  if (!reader.good()) {
+    std::cerr << "Could not read node " << node_name_from_index(node_index) << " from pack file "
+              << file_path
+              << std::endl;
+    return {};
+  }
+
+  return { buffer.data(), static_cast<std::ptrdiff_t>(buffer.size()) };
+}
+
+void
+PackedPersistence::open_next_pack()
+{
+  if (_has_current_pack) {
+    ++_current_pack;
+  }
+
+  // Only creates the file, the nodes are written to it by the persisting threads
+  const auto file_path = pack_file_path(_current_pack);
+  std::ofstream creator{ file_path, std::ios::out | std::ios::binary | std::ios::trunc };
+  if (!creator.is_open()) {
+    throw std::runtime_error{ concat("Could not open pack file ", file_path) };
+  }
+  _has_current_pack = true;
+  _current_pack_size = 0;
+}
+
+void
+PackedPersistence::read_index()
+{
+  const auto file_path = index_file_path();
+  if (!std::experimental::filesystem::exists(file_path))
+    return;
+
+  std::ifstream reader{ file_path, std::ios::in | std::ios::binary };
+  if (!reader.is_open()) {
+    throw std::runtime_error{ concat("Could not open pack index file ", file_path) };
+  }
+
+  uint32_t magic;
+  uint8_t version;
+  std::array<uint8_t, 3> reserved;
+  uint32_t pack_count;
+  uint64_t node_count;
+  read_binary(magic, reader);
+  read_binary(version, reader);
+  read_binary(reserved, reader);
+  read_binary(pack_count, reader);
+  read_binary(node_count, reader);
+  if (!reader.good() || magic != IndexMagic) {
+    throw std::runtime_error{ concat("Invalid pack index file ", file_path) };
+  }
+  if (version > IndexVersion) {
+    throw std::runtime_error{ concat(
+      "Unsupported version ", static_cast<int>(version), " of pack index file ", file_path) };
+  }
+
+  std::string node_name;
+  for (uint64_t idx = 0; idx < node_count; ++idx) {
+    uint8_t name_length;
+    read_binary(name_length, reader);
+    node_name.resize(name_length);
+    reader.read(node_name.data(), name_length);
+
+    NodeLocation location;
+    read_binary(location.pack, reader);
+    read_binary(location.offset, reader);
+    read_binary(location.length, reader);
+    const auto node_index =
+      OctreeNodeIndex64::from_string(node_name, MortonIndexNamingConvention::Potree);
+    if (!reader.good() || location.pack >= pack_count || !node_index) {
+      throw std::runtime_error{ concat("Invalid pack index file ", file_path) };
+    }
+    _index[*node_index] = location;
+  }
+
+  // Existing pack files are never appended to, new nodes go into new pack files
+  _current_pack = pack_count;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "io/BinaryPersistence.h"
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+/**
+ * Sink that stores the points of all nodes in a few large pack files instead of one file per node.
+ * Each node is encoded like a file of BinaryPersistence and appended to the current pack file. An
+ * in-memory index maps every node to its pack file, offset and length. The index is written to a
+ * binary index file when the PackedPersistence is destroyed and is read again when a
+ * PackedPersistence is created for the same directory
+ */
+struct PackedPersistence
+{
+  /**
+   * Location of the encoded points of a node
+   */
+  struct NodeLocation
+  {
+    uint32_t pack;
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  constexpr static uint64_t DefaultMaxPackSize = (1ull << 30);
+  // Nodes start at multiples of this offset in the pack files, so that uncompressed nodes can be
+  // viewed in place when a pack file is memory-mapped
+  constexpr static uint64_t NodeAlignment = 8;
+
+  static PointAttributes supported_output_attributes();
+
+  /**
+   * Creates a PackedPersistence that encodes the nodes with the given codec. A new pack file is
+   * started as soon as the current one would exceed 'max_pack_size' bytes. A single node larger
+   * than 'max_pack_size' gets a pack file of its own
+   */
+  PackedPersistence(const std::string& work_dir,
+                    const PointAttributes& input_attributes,
+                    const PointAttributes& output_attributes,
+                    BinaryCodec codec,
+                    int codec_level = 0,
+                    uint64_t max_pack_size = DefaultMaxPackSize);
+  PackedPersistence(const PackedPersistence&) = delete;
+  PackedPersistence(PackedPersistence&&) = default;
+  PackedPersistence& operator=(const PackedPersistence&) = delete;
+  PackedPersistence& operator=(PackedPersistence&&) = default;
+  ~PackedPersistence();
+
+  template<typename Iter>
+  void persist_points(Iter points_begin,
+                      Iter points_end,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index)
+  {
+    const auto encoded_points = _encoder.encode_points(points_begin, points_end);
+    if (encoded_points.empty())
+      return;
+
+    append_to_pack(node_index, encoded_points);
+  }
+
+  void persist_points(PointBuffer const& points,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index);
+
+  void retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points);
+
+  /**
+   * Appends the points of the given node to 'points', without reading them into an intermediate
+   * PointBuffer first
+   */
+  void append_points(const OctreeNodeIndex64& node_index, PointBuffer& points) const;
+
+  bool node_exists(const OctreeNodeIndex64& node_index) const;
+
+  inline bool is_lossless() const { return true; }
+
+  /**
+   * Returns the location of the given node, or std::nullopt if the node does not exist
+   */
+  std::optional<NodeLocation> locate_node(const OctreeNodeIndex64& node_index) const;
+
+  /**
+   * Writes the index of all nodes to the index file. This is called on destruction, but can be
+   * called earlier to make the nodes written so far readable by other processes
+   */
+  void flush_index();
+
+  /**
+   * Path of the pack file with the given number
+   */
+  std::string pack_file_path(uint32_t pack) const;
+
+  /**
+   * Path of the index file
+   */
+  std::string index_file_path() const;
+
+private:
+  /**
+   * Appends the encoded points of a node to the current pack file and adds the node to the index.
+   * Only reserving the space in the pack file happens under the lock, so several threads write
+   * their nodes at the same time. A node that is persisted again is appended again and its index
+   * entry is replaced
+   */
+  void append_to_pack(const OctreeNodeIndex64& node_index,
+                      gsl::span<const std::byte> encoded_points);
+
+  /**
+   * Reads the encoded points of the given node into a buffer that is reused by the next call from
+   * the same thread. Returns an empty span if the node does not exist
+   */
+  gsl::span<const std::byte> read_node(const OctreeNodeIndex64& node_index) const;
+
+  /**
+   * Starts a new, empty pack file. Must be called with the lock held
+   */
+  void open_next_pack();
+
+  void read_index();
+
+  std::string _work_dir;
+  BinaryPersistence _encoder;
+  uint64_t _max_pack_size;
+
+  std::unique_ptr<std::mutex> _lock;
+  bool _has_current_pack;
+  uint32_t _current_pack;
+  uint64_t _current_pack_size;
+  std::unordered_map<OctreeNodeIndex64, NodeLocation> _index;
+  bool _index_modified;
+};
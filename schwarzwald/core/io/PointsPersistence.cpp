@@ -8,6 +8,11 @@ make_persistence(OutputFormat format,
                  const PointAttributes& input_attributes,
                  const PointAttributes& output_attributes,
                  RGBMapping rgb_mapping,
+                 PNTSEncoding pnts_encoding,
+                 TilesetLayout tileset_layout,
+                 GLBCompression glb_compression,
+                 BinaryCodec binz_codec,
+                 int binz_codec_level,
                  float spacing,
                  const AABB& bounds)
 {
@@ -16,15 +21,37 @@ make_persistence(OutputFormat format,
       return PointsPersistence{ BinaryPersistence{
         output_directory, input_attributes, output_attributes, Compressed::No } };
     case OutputFormat::BINZ:
-      return PointsPersistence{ BinaryPersistence{
-        output_directory, input_attributes, output_attributes, Compressed::Yes } };
+      return PointsPersistence{ BinaryPersistence{ output_directory,
+                                                   input_attributes,
+                                                   output_attributes,
+                                                   binz_codec,
+                                                   binz_codec_level } };
+    case OutputFormat::PACKED:
+      return PointsPersistence{ PackedPersistence{ output_directory,
+                                                   input_attributes,
+                                                   output_attributes,
+                                                   binz_codec,
+                                                   binz_codec_level } };
     case OutputFormat::CZM_3DTILES:
       return PointsPersistence{ Cesium3DTilesPersistence{ output_directory,
                                                           input_attributes,
                                                           output_attributes,
                                                           rgb_mapping,
                                                           spacing,
-                                                          bounds.getCenter() } };
+                                                          bounds.getCenter(),
+                                                          pnts_encoding,
+                                                          tileset_layout } };
+    case OutputFormat::CZM_3DTILES_GLB:
+      return PointsPersistence{ Cesium3DTilesPersistence{ output_directory,
+                                                          input_attributes,
+                                                          output_attributes,
+                                                          rgb_mapping,
+                                                          spacing,
+                                                          bounds.getCenter(),
+                                                          pnts_encoding,
+                                                          tileset_layout,
+                                                          TileContentFormat::GLB,
+                                                          glb_compression } };
     case OutputFormat::LAS:
       return PointsPersistence{ LASPersistence{
         output_directory, input_attributes, output_attributes } };
@@ -37,6 +64,15 @@ make_persistence(OutputFormat format,
     case OutputFormat::ENTWINE_LAZ:
       return PointsPersistence{ EntwinePersistence{
         output_directory.string(), input_attributes, output_attributes, EntwineFormat::LAZ } };
+    case OutputFormat::ENTWINE_BIN:
+      return PointsPersistence{ EntwinePersistence{
+        output_directory.string(), input_attributes, output_attributes, EntwineFormat::Binary } };
+    case OutputFormat::COPC:
+      return PointsPersistence{ CopcPersistence{
+        output_directory.string(), input_attributes, output_attributes, bounds, spacing } };
+    case OutputFormat::POTREE2:
+      return PointsPersistence{ Potree2Persistence{
+        output_directory.string(), input_attributes, output_attributes, bounds, spacing } };
     default:
       throw std::invalid_argument{ "Unrecognized output format!" };
   }
@@ -47,14 +83,23 @@ supported_output_attributes_for_format(OutputFormat format)
 {
   switch (format) {
     case OutputFormat::BIN:
+    case OutputFormat::BINZ:
       return BinaryPersistence::supported_output_attributes();
+    case OutputFormat::PACKED:
+      return PackedPersistence::supported_output_attributes();
     case OutputFormat::CZM_3DTILES:
+    case OutputFormat::CZM_3DTILES_GLB:
       return Cesium3DTilesPersistence::supported_output_attributes();
     case OutputFormat::ENTWINE_LAS:
     case OutputFormat::ENTWINE_LAZ:
+    case OutputFormat::ENTWINE_BIN:
     case OutputFormat::LAS:
     case OutputFormat::LAZ:
       return LASPersistence::supported_output_attributes();
+    case OutputFormat::COPC:
+      return CopcPersistence::supported_output_attributes();
+    case OutputFormat::POTREE2:
+      return Potree2Persistence::supported_output_attributes();
     default:
       throw std::runtime_error{
         (boost::format("Invalid OutputFormat: %1%") % static_cast<int>(format)).str()
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <type_traits>
 #include <variant>
 
 #include "BinaryPersistence.h"
 #include "Cesium3DTilesPersistence.h"
+#include "CopcPersistence.h"
 #include "EntwinePersistence.h"
 #include "LASPersistence.h"
 #include "MemoryPersistence.h"
+#include "PackedPersistence.h"
+#include "Potree2Persistence.h"
+#include "TeePersistence.h"
 
 struct PointsPersistence
 {
@@ -24,27 +29,75 @@ struct PointsPersistence
   void persist_points(Iter points_begin,
                       Iter points_end,
                       const AABB& bounds,
-                      const std::string& node_name)
+                      const OctreeNodeIndex64& node_index)
   {
     std::visit(
-      [&](auto& impl) { impl.persist_points(points_begin, points_end, bounds, node_name); }, _impl);
+      [&](auto& impl) { impl.persist_points(points_begin, points_end, bounds, node_index); },
+      _impl);
   }
 
   inline void persist_points(PointBuffer const& points,
                              const AABB& bounds,
-                             const std::string& node_name)
+                             const OctreeNodeIndex64& node_index)
   {
-    std::visit([&](auto& impl) { impl.persist_points(points, bounds, node_name); }, _impl);
+    std::visit([&](auto& impl) { impl.persist_points(points, bounds, node_index); }, _impl);
   }
 
-  inline void retrieve_points(const std::string& node_name, PointBuffer& points)
+  /**
+   * Persists the given points like 'persist_points' above. LASPersistence and EntwinePersistence
+   * compress large LAZ files as chunks on 'subflow', all other sinks persist the points right away
+   */
+  inline void persist_points(PointBuffer const& points,
+                             const AABB& bounds,
+                             const OctreeNodeIndex64& node_index,
+                             tf::Subflow& subflow)
+  {
+    std::visit(
+      [&](auto& impl) {
+        using Impl = std::decay_t<decltype(impl)>;
+        if constexpr (std::is_same_v<Impl, LASPersistence> ||
+                      std::is_same_v<Impl, EntwinePersistence>) {
+          impl.persist_points(points, bounds, node_index, subflow);
+        } else {
+          impl.persist_points(points, bounds, node_index);
+        }
+      },
+      _impl);
+  }
+
+  inline void retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
   {
-    std::visit([&](auto& impl) { impl.retrieve_points(node_name, points); }, _impl);
+    std::visit([&](auto& impl) { impl.retrieve_points(node_index, points); }, _impl);
   }
 
-  inline bool node_exists(const std::string& node_name) const
+  /**
+   * Appends the points of the given node to 'points'. BinaryPersistence and PackedPersistence
+   * append straight from the encoded node, all other sinks retrieve the points into a temporary
+   * PointBuffer first. TeePersistence appends from the sink it retrieves points from
+   */
+  inline void append_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
   {
-    return std::visit([&](auto& impl) { return impl.node_exists(node_name); }, _impl);
+    std::visit(
+      [&](auto& impl) {
+        using Impl = std::decay_t<decltype(impl)>;
+        if constexpr (std::is_same_v<Impl, BinaryPersistence> ||
+                      std::is_same_v<Impl, PackedPersistence> ||
+                      std::is_same_v<Impl, TeePersistence>) {
+          impl.append_points(node_index, points);
+        } else {
+          PointBuffer tmp;
+          impl.retrieve_points(node_index, tmp);
+          if (!tmp.empty()) {
+            points.append_buffer(tmp);
+          }
+        }
+      },
+      _impl);
+  }
+
+  inline bool node_exists(const OctreeNodeIndex64& node_index) const
+  {
+    return std::visit([&](auto& impl) { return impl.node_exists(node_index); }, _impl);
   }
 
   inline bool is_lossless() const
@@ -52,6 +105,30 @@ struct PointsPersistence
     return std::visit([&](auto& impl) { return impl.is_lossless(); }, _impl);
   }
 
+  /**
+   * Signals that no more points will be persisted in the subtree below 'subtree_root', so that
+   * sinks can write their metadata for it right away instead of at the end. Only
+   * Cesium3DTilesPersistence (directly or through a TeePersistence) makes use of this
+   */
+  inline void finalize_subtree(const OctreeNodeIndex64& subtree_root)
+  {
+    std::visit(
+      [&](auto& impl) {
+        using Impl = std::decay_t<decltype(impl)>;
+        if constexpr (std::is_same_v<Impl, Cesium3DTilesPersistence> ||
+                      std::is_same_v<Impl, TeePersistence>) {
+          impl.finalize_subtree(subtree_root);
+        }
+      },
+      _impl);
+  }
+
+  template<typename T>
+  bool holds() const
+  {
+    return std::holds_alternative<T>(_impl);
+  }
+
   template<typename T>
   T& get()
   {
@@ -69,10 +146,37 @@ private:
                Cesium3DTilesPersistence,
                LASPersistence,
                MemoryPersistence,
-               EntwinePersistence>
+               EntwinePersistence,
+               PackedPersistence,
+               CopcPersistence,
+               Potree2Persistence,
+               TeePersistence>
     _impl;
 };
 
+template<typename Iter>
+void
+TeePersistence::persist_points(Iter points_begin,
+                               Iter points_end,
+                               const AABB& bounds,
+                               const OctreeNodeIndex64& node_index)
+{
+  std::vector<std::function<void()>> tasks;
+  tasks.reserve(_sinks.size());
+  for (auto& sink : _sinks) {
+    tasks.push_back([&sink, points_begin, points_end, &bounds, &node_index]() {
+      sink.persist_points(points_begin, points_end, bounds, node_index);
+    });
+  }
+
+  auto& shifted_points = shifted_points_buffer();
+  if (!_shifted_sinks.empty()) {
+    shifted_points.gather(points_begin, points_end);
+  }
+
+  persist_to_all_sinks(std::move(tasks), shifted_points, bounds, node_index);
+}
+
 /**
  * Factory function for creating a PointsPersistence for the given format and
  * parameters
@@ -83,6 +187,11 @@ make_persistence(OutputFormat format,
                  const PointAttributes& input_attributes,
                  const PointAttributes& output_attributes,
                  RGBMapping rgb_mapping,
+                 PNTSEncoding pnts_encoding,
+                 TilesetLayout tileset_layout,
+                 GLBCompression glb_compression,
+                 BinaryCodec binz_codec,
+                 int binz_codec_level,
                  float spacing,
                  const AABB& bounds);
 
@@ -0,0 +1,562 @@
+#include "io/Potree2Persistence.h"
+
+#include "io/LASPersistence.h"
+#include "util/Error.h"
+
+#include <algorithm>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <rapidjson/document.h>
+
+namespace fs = std::experimental::filesystem;
+namespace rj = rapidjson;
+
+namespace {
+/**
+ * All attributes that Potree2Persistence can write, in the order in which they are stored in a
+ * point record. The names follow PotreeConverter, so that Potree recognizes the LAS attributes
+ */
+const std::array<potree2::AttributeColumn, 13> AllColumns = { {
+  { PointAttribute::Position, "position", "int32", 3, 4, 0 },
+  { PointAttribute::RGB, "rgb", "uint16", 3, 2, 0 },
+  { PointAttribute::Intensity, "intensity", "uint16", 1, 2, 0 },
+  { PointAttribute::Classification, "classification", "uint8", 1, 1, 0 },
+  { PointAttribute::ReturnNumber, "return number", "uint8", 1, 1, 0 },
+  { PointAttribute::NumberOfReturns, "number of returns", "uint8", 1, 1, 0 },
+  { PointAttribute::GPSTime, "gps-time", "double", 1, 8, 0 },
+  { PointAttribute::PointSourceID, "point source id", "uint16", 1, 2, 0 },
+  { PointAttribute::ScanAngleRank, "scan angle rank", "int8", 1, 1, 0 },
+  { PointAttribute::UserData, "user data", "uint8", 1, 1, 0 },
+  { PointAttribute::EdgeOfFlightLine, "edge of flight line", "uint8", 1, 1, 0 },
+  { PointAttribute::ScanDirectionFlag, "scan direction flag", "uint8", 1, 1, 0 },
+  { PointAttribute::Normal, "normal", "float", 3, 4, 0 },
+} };
+
+template<typename T, size_t N, typename SetValues>
+void
+decode_column(const std::byte* src, size_t count, uint32_t stride, SetValues set_values)
+{
+  std::array<T, N> values;
+  for (size_t idx = 0; idx < count; ++idx) {
+    std::memcpy(values.data(), src, sizeof(values));
+    set_values(idx, values);
+    src += stride;
+  }
+}
+
+template<typename T>
+void
+append_value(std::vector<std::byte>& dst, const T& value)
+{
+  const auto begin = reinterpret_cast<const std::byte*>(&value);
+  dst.insert(std::end(dst), begin, begin + sizeof(T));
+}
+
+void
+write_at(std::fstream& file, uint64_t offset, const char* data, size_t size)
+{
+  file.seekp(static_cast<std::streamoff>(offset));
+  file.write(data, static_cast<std::streamsize>(size));
+}
+
+rj::Value
+range_to_json(const std::array<double, 3>& values,
+              uint32_t num_elements,
+              rj::Document::AllocatorType& allocator)
+{
+  rj::Value array{ rj::kArrayType };
+  for (uint32_t idx = 0; idx < num_elements; ++idx) {
+    array.PushBack(values[idx], allocator);
+  }
+  return array;
+}
+} // namespace
+
+potree2::PointLayout
+potree2::point_layout_for_attributes(const PointAttributes& attributes)
+{
+  PointLayout layout;
+  layout.record_size = 0;
+  for (auto column : AllColumns) {
+    if (column.attribute != PointAttribute::Position &&
+        !has_attribute(attributes, column.attribute))
+      continue;
+    column.byte_offset = layout.record_size;
+    layout.record_size += column.num_elements * column.element_size;
+    layout.columns.push_back(column);
+  }
+  return layout;
+}
+
+void
+potree2::AttributeRange::update(const AttributeRange& other)
+{
+  for (size_t idx = 0; idx < min.size(); ++idx) {
+    min[idx] = std::min(min[idx], other.min[idx]);
+    max[idx] = std::max(max[idx], other.max[idx]);
+  }
+}
+
+bool
+potree2::decode_points(gsl::span<const std::byte> data,
+                       const PointLayout& layout,
+                       const PositionQuantization& quantization,
+                       const PointAttributes& attributes,
+                       PointBuffer& points)
+{
+  if (!layout.record_size || data.size() % layout.record_size != 0)
+    return false;
+
+  const auto count = static_cast<size_t>(data.size()) / layout.record_size;
+  PointBuffer decoded{ count, attributes };
+  const auto stride = layout.record_size;
+  for (const auto& column : layout.columns) {
+    if (!has_attribute(attributes, column.attribute))
+      continue;
+
+    const auto src = data.data() + column.byte_offset;
+    switch (column.attribute) {
+      case PointAttribute::Position:
+        decode_column<int32_t, 3>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.positions()[idx] = { quantization.offset.x + values[0] * quantization.scale,
+                                       quantization.offset.y + values[1] * quantization.scale,
+                                       quantization.offset.z + values[2] * quantization.scale };
+        });
+        break;
+      case PointAttribute::RGB:
+        decode_column<uint16_t, 3>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.rgbColors()[idx] = { static_cast<uint8_t>(values[0] >> 8),
+                                       static_cast<uint8_t>(values[1] >> 8),
+                                       static_cast<uint8_t>(values[2] >> 8) };
+        });
+        break;
+      case PointAttribute::Intensity:
+        decode_column<uint16_t, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.intensities()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::Classification:
+        decode_column<uint8_t, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.classifications()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::ReturnNumber:
+        decode_column<uint8_t, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.return_numbers()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::NumberOfReturns:
+        decode_column<uint8_t, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.number_of_returns()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::GPSTime:
+        decode_column<double, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.gps_times()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::PointSourceID:
+        decode_column<uint16_t, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.point_source_ids()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::ScanAngleRank:
+        decode_column<int8_t, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.scan_angle_ranks()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::UserData:
+        decode_column<uint8_t, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.user_data()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::EdgeOfFlightLine:
+        decode_column<uint8_t, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.edge_of_flight_lines()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::ScanDirectionFlag:
+        decode_column<uint8_t, 1>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.scan_direction_flags()[idx] = values[0];
+        });
+        break;
+      case PointAttribute::Normal:
+        decode_column<float, 3>(src, count, stride, [&](size_t idx, const auto& values) {
+          decoded.normals()[idx] = { values[0], values[1], values[2] };
+        });
+        break;
+      default:
+        throw std::runtime_error{ "Unhandled PointAttribute in switch statement" };
+    }
+  }
+
+  points = std::move(decoded);
+  return true;
+}
+
+potree2::EncodedHierarchy
+potree2::encode_hierarchy(const std::vector<HierarchyEntry>& entries, uint32_t step_size)
+{
+  if (!step_size) {
+    throw std::invalid_argument{ "Step size of the Potree hierarchy must not be zero" };
+  }
+
+  struct Node
+  {
+    uint32_t point_count = 0;
+    uint64_t byte_offset = 0;
+    uint64_t byte_size = 0;
+    uint8_t child_mask = 0;
+  };
+
+  // The root node always exists, so that an empty octree has a valid hierarchy
+  std::unordered_map<OctreeNodeIndex64, Node> nodes;
+  nodes[OctreeNodeIndex64{}];
+  uint32_t depth = 0;
+  for (const auto& entry : entries) {
+    auto& node = nodes[entry.node_index];
+    node.point_count = entry.point_count;
+    node.byte_offset = entry.byte_offset;
+    node.byte_size = entry.byte_size;
+    depth = std::max(depth, entry.node_index.levels());
+
+    for (auto index = entry.node_index; index.levels() > 0; index = index.parent()) {
+      const auto child_index = index.octant_at_level(index.levels());
+      nodes[index.parent()].child_mask |= static_cast<uint8_t>(1 << child_index);
+    }
+  }
+
+  // Chunks are collected breadth-first, starting at the root node. Within a chunk, the children of
+  // a node follow in the order of their child index, which is the order in which Potree expands the
+  // child masks when it loads a chunk
+  std::vector<OctreeNodeIndex64> chunk_roots = { OctreeNodeIndex64{} };
+  std::vector<std::vector<OctreeNodeIndex64>> chunks;
+  for (size_t chunk_idx = 0; chunk_idx < chunk_roots.size(); ++chunk_idx) {
+    const auto chunk_root_level = chunk_roots[chunk_idx].levels();
+    std::vector<OctreeNodeIndex64> chunk = { chunk_roots[chunk_idx] };
+    for (size_t idx = 0; idx < chunk.size(); ++idx) {
+      const auto index = chunk[idx];
+      const auto child_mask = nodes.at(index).child_mask;
+      if (!child_mask)
+        continue;
+      if (index.levels() - chunk_root_level == step_size) {
+        chunk_roots.push_back(index);
+        continue;
+      }
+      for (uint8_t child_index = 0; child_index < 8; ++child_index) {
+        if (child_mask & (1 << child_index)) {
+          chunk.push_back(index.child(child_index));
+        }
+      }
+    }
+    chunks.push_back(std::move(chunk));
+  }
+
+  std::unordered_map<OctreeNodeIndex64, std::pair<uint64_t, uint64_t>> chunk_ranges;
+  uint64_t chunk_offset = 0;
+  for (size_t chunk_idx = 0; chunk_idx < chunks.size(); ++chunk_idx) {
+    const auto chunk_size = chunks[chunk_idx].size() * HierarchyEntrySize;
+    chunk_ranges[chunk_roots[chunk_idx]] = { chunk_offset, chunk_size };
+    chunk_offset += chunk_size;
+  }
+
+  EncodedHierarchy hierarchy;
+  hierarchy.data.reserve(chunk_offset);
+  hierarchy.first_chunk_size = chunks.front().size() * HierarchyEntrySize;
+  hierarchy.depth = depth;
+  for (size_t chunk_idx = 0; chunk_idx < chunks.size(); ++chunk_idx) {
+    for (const auto& index : chunks[chunk_idx]) {
+      const auto& node = nodes.at(index);
+      const auto is_proxy = (index != chunk_roots[chunk_idx]) && chunk_ranges.count(index);
+      const auto type =
+        is_proxy ? NodeType::Proxy : (node.child_mask ? NodeType::Normal : NodeType::Leaf);
+
+      append_value(hierarchy.data, static_cast<uint8_t>(type));
+      append_value(hierarchy.data, node.child_mask);
+      append_value(hierarchy.data, node.point_count);
+      if (is_proxy) {
+        const auto& chunk_range = chunk_ranges.at(index);
+        append_value(hierarchy.data, chunk_range.first);
+        append_value(hierarchy.data, chunk_range.second);
+      } else {
+        append_value(hierarchy.data, node.byte_offset);
+        append_value(hierarchy.data, node.byte_size);
+      }
+    }
+  }
+
+  return hierarchy;
+}
+
+PointAttributes
+Potree2Persistence::supported_output_attributes()
+{
+  PointAttributes attributes;
+  for (const auto& column : AllColumns) {
+    attributes.insert(column.attribute);
+  }
+  return attributes;
+}
+
+Potree2Persistence::Potree2Persistence(const std::string& work_dir,
+                                       const PointAttributes& input_attributes,
+                                       const PointAttributes& output_attributes,
+                                       const AABB& cubic_bounds,
+                                       float spacing)
+  : _work_dir(work_dir)
+  , _octree_file_path(concat(work_dir, "/octree.bin"))
+  , _input_attributes(input_attributes)
+  , _output_attributes(output_attributes)
+  , _layout(potree2::point_layout_for_attributes(output_attributes))
+  , _cubic_bounds(cubic_bounds)
+  , _spacing(spacing)
+  , _quantization({ cubic_bounds.min, compute_las_scale_from_bounds(cubic_bounds) })
+  , _lock(std::make_unique<std::mutex>())
+  , _next_payload_offset(0)
+  , _ranges(_layout.columns.size())
+  , _finalized(false)
+{
+  if (input_attributes != output_attributes) {
+    throw std::invalid_argument{
+      "Potree2Persistence requires that input and output attributes are equal"
+    };
+  }
+  if (!attributes_are_subset(output_attributes, supported_output_attributes())) {
+    throw std::invalid_argument{ "Output attributes must be a subset of the supported attributes "
+                                 "(Potree2Persistence::supported_output_attributes)" };
+  }
+
+  std::ofstream writer{ _octree_file_path, std::ios::out | std::ios::binary | std::ios::trunc };
+  if (!writer.is_open()) {
+    throw std::runtime_error{ concat("Could not open Potree file ", _octree_file_path) };
+  }
+}
+
+Potree2Persistence::~Potree2Persistence()
+{
+  // Moved-from instances have no lock and nothing to write
+  if (!_lock || _finalized)
+    return;
+
+  try {
+    finalize();
+  } catch (const std::exception& ex) {
+    std::cerr << "Could not finalize Potree output in " << _work_dir << " (" << ex.what() << ")"
+              << std::endl;
+  }
+}
+
+void
+Potree2Persistence::persist_points(PointBuffer const& points,
+                                   const AABB& bounds,
+                                   const OctreeNodeIndex64& node_index)
+{
+  persist_points(std::begin(points), std::end(points), bounds, node_index);
+}
+
+void
+Potree2Persistence::retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
+{
+  NodeLocation location;
+  {
+    std::lock_guard<std::mutex> lock{ *_lock };
+    const auto iter = _nodes.find(node_index);
+    if (iter == std::end(_nodes))
+      return;
+    location = iter->second;
+  }
+
+  std::vector<std::byte> payload(location.byte_size);
+  std::ifstream reader{ _octree_file_path, std::ios::in | std::ios::binary };
+  reader.seekg(static_cast<std::streamoff>(location.byte_offset));
+  reader.read(reinterpret_cast<char*>(payload.data()),
+              static_cast<std::streamsize>(payload.size()));
+  if (!reader.good() ||
+      !potree2::decode_points(payload, _layout, _quantization, _input_attributes, points)) {
+    std::cerr << "Could not read node " << node_name_from_index(node_index) << " from Potree file "
+              << _octree_file_path << std::endl;
+  }
+}
+
+bool
+Potree2Persistence::node_exists(const OctreeNodeIndex64& node_index) const
+{
+  std::lock_guard<std::mutex> lock{ *_lock };
+  return _nodes.find(node_index) != std::end(_nodes);
+}
+
+void
+Potree2Persistence::write_node(const OctreeNodeIndex64& node_index,
+                               const std::vector<std::byte>& payload,
+                               uint32_t point_count,
+                               const std::vector<potree2::AttributeRange>& ranges)
+{
+  uint64_t offset;
+  {
+    std::lock_guard<std::mutex> lock{ *_lock };
+    if (_finalized) {
+      throw std::runtime_error{ concat("Potree output in ", _work_dir, " is already finalized") };
+    }
+    offset = _next_payload_offset;
+    _next_payload_offset += payload.size();
+  }
+
+  // Payloads are written at their reserved offsets without holding the lock
+  std::fstream writer;
+  writer.rdbuf()->pubsetbuf(nullptr, 0);
+  writer.open(_octree_file_path, std::ios::in | std::ios::out | std::ios::binary);
+  write_at(writer, offset, reinterpret_cast<const char*>(payload.data()), payload.size());
+  if (!writer.good()) {
+    throw std::runtime_error{ concat("Could not write node ",
+                                     node_name_from_index(node_index),
+                                     " to Potree file ",
+                                     _octree_file_path) };
+  }
+
+  std::lock_guard<std::mutex> lock{ *_lock };
+  _nodes[node_index] = { offset, payload.size(), point_count };
+  for (size_t idx = 0; idx < ranges.size(); ++idx) {
+    _ranges[idx].update(ranges[idx]);
+  }
+}
+
+void
+Potree2Persistence::finalize()
+{
+  std::lock_guard<std::mutex> lock{ *_lock };
+  if (_finalized)
+    return;
+  _finalized = true;
+
+  std::fstream file{ _octree_file_path, std::ios::in | std::ios::out | std::ios::binary };
+  if (!file.is_open()) {
+    throw std::runtime_error{ concat("Could not open Potree file ", _octree_file_path) };
+  }
+
+  // Payloads are moved to the front in the order in which they were written, which removes the old
+  // payloads of nodes that were persisted more than once
+  std::vector<NodeLocation*> locations;
+  locations.reserve(_nodes.size());
+  for (auto& [index, location] : _nodes) {
+    locations.push_back(&location);
+  }
+  std::sort(std::begin(locations), std::end(locations), [](const auto* l, const auto* r) {
+    return l->byte_offset < r->byte_offset;
+  });
+
+  uint64_t payload_offset = 0;
+  uint64_t total_point_count = 0;
+  std::vector<char> payload_buffer;
+  for (auto location : locations) {
+    if (location->byte_offset != payload_offset) {
+      payload_buffer.resize(location->byte_size);
+      file.seekg(static_cast<std::streamoff>(location->byte_offset));
+      file.read(payload_buffer.data(), static_cast<std::streamsize>(location->byte_size));
+      write_at(file, payload_offset, payload_buffer.data(), payload_buffer.size());
+      location->byte_offset = payload_offset;
+    }
+    payload_offset += location->byte_size;
+    total_point_count += location->point_count;
+  }
+
+  if (!file.good()) {
+    throw std::runtime_error{ concat("Could not write Potree file ", _octree_file_path) };
+  }
+  file.close();
+  fs::resize_file(_octree_file_path, payload_offset);
+
+  std::vector<potree2::HierarchyEntry> entries;
+  entries.reserve(_nodes.size());
+  for (auto& [index, location] : _nodes) {
+    entries.push_back({ index, location.point_count, location.byte_offset, location.byte_size });
+  }
+  const auto hierarchy = potree2::encode_hierarchy(entries, potree2::HierarchyStepSize);
+
+  const auto hierarchy_file_path = concat(_work_dir, "/hierarchy.bin");
+  std::ofstream hierarchy_writer{ hierarchy_file_path,
+                                  std::ios::out | std::ios::binary | std::ios::trunc };
+  hierarchy_writer.write(reinterpret_cast<const char*>(hierarchy.data.data()),
+                         static_cast<std::streamsize>(hierarchy.data.size()));
+  if (!hierarchy_writer.good()) {
+    throw std::runtime_error{ concat("Could not write Potree file ", hierarchy_file_path) };
+  }
+
+  write_metadata(total_point_count, hierarchy);
+}
+
+void
+Potree2Persistence::write_metadata(uint64_t total_point_count,
+                                   const potree2::EncodedHierarchy& hierarchy) const
+{
+  rj::Document document;
+  auto& allocator = document.GetAllocator();
+
+  document.SetObject();
+  document.AddMember("version", "2.0", allocator);
+  document.AddMember("name", "pointcloud", allocator);
+  document.AddMember("description", "", allocator);
+  document.AddMember("points", total_point_count, allocator);
+  document.AddMember("projection", "", allocator);
+
+  rj::Value hierarchy_member{ rj::kObjectType };
+  hierarchy_member.AddMember("firstChunkSize", hierarchy.first_chunk_size, allocator);
+  hierarchy_member.AddMember("stepSize", potree2::HierarchyStepSize, allocator);
+  hierarchy_member.AddMember("depth", hierarchy.depth, allocator);
+  document.AddMember("hierarchy", hierarchy_member, allocator);
+
+  const auto& offset = _quantization.offset;
+  const auto scale = _quantization.scale;
+  document.AddMember(
+    "offset", range_to_json({ offset.x, offset.y, offset.z }, 3, allocator), allocator);
+  document.AddMember("scale", range_to_json({ scale, scale, scale }, 3, allocator), allocator);
+  document.AddMember("spacing", static_cast<double>(_spacing), allocator);
+
+  rj::Value bounding_box_member{ rj::kObjectType };
+  const auto& min = _cubic_bounds.min;
+  const auto& max = _cubic_bounds.max;
+  bounding_box_member.AddMember(
+    "min", range_to_json({ min.x, min.y, min.z }, 3, allocator), allocator);
+  bounding_box_member.AddMember(
+    "max", range_to_json({ max.x, max.y, max.z }, 3, allocator), allocator);
+  document.AddMember("boundingBox", bounding_box_member, allocator);
+
+  document.AddMember("encoding", "DEFAULT", allocator);
+
+  rj::Value attributes_member{ rj::kArrayType };
+  for (size_t idx = 0; idx < _layout.columns.size(); ++idx) {
+    const auto& column = _layout.columns[idx];
+    auto range = _ranges[idx];
+    if (range.min[0] > range.max[0]) {
+      range.min = range.max = { 0, 0, 0 };
+    } else if (column.attribute == PointAttribute::Position) {
+      // The range of the positions is in quantized coordinates
+      for (size_t axis = 0; axis < 3; ++axis) {
+        const std::array<double, 3> offsets = { offset.x, offset.y, offset.z };
+        range.min[axis] = offsets[axis] + range.min[axis] * scale;
+        range.max[axis] = offsets[axis] + range.max[axis] * scale;
+      }
+    }
+
+    rj::Value attribute_member{ rj::kObjectType };
+    attribute_member.AddMember("name", rj::StringRef(column.name), allocator);
+    attribute_member.AddMember("description", "", allocator);
+    attribute_member.AddMember("size", column.num_elements * column.element_size, allocator);
+    attribute_member.AddMember("numElements", column.num_elements, allocator);
+    attribute_member.AddMember("elementSize", column.element_size, allocator);
+    attribute_member.AddMember("type", rj::StringRef(column.type), allocator);
+    attribute_member.AddMember(
+      "min", range_to_json(range.min, column.num_elements, allocator), allocator);
+    attribute_member.AddMember(
+      "max", range_to_json(range.max, column.num_elements, allocator), allocator);
+    attributes_member.PushBack(attribute_member, allocator);
+  }
+  document.AddMember("attributes", attributes_member, allocator);
+
+  try {
+    write_json_to_file(document, concat(_work_dir, "/metadata.json"));
+  } catch (const std::exception& ex) {
+    throw util::chain_error(ex, "Could not write metadata.json file");
+  }
+}
@@ -0,0 +1,365 @@
+#pragma once
+
+#include "datastructures/OctreeNodeIndex.h"
+#include "datastructures/PointBuffer.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+#include "util/stuff.h"
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <gsl/gsl>
+
+/**
+ * Structures of the Potree 2.0 format (https://github.com/potree/PotreeConverter), which stores the
+ * points of all nodes in a single 'octree.bin' file, the hierarchy in a binary 'hierarchy.bin' file
+ * and everything else in 'metadata.json'
+ */
+namespace potree2 {
+
+constexpr size_t HierarchyEntrySize = 22;
+// Every hierarchy chunk contains the nodes of this many levels below its root node
+constexpr uint32_t HierarchyStepSize = 4;
+
+enum class NodeType : uint8_t
+{
+  Normal = 0,
+  Leaf = 1,
+  // Node at the bottom of a hierarchy chunk whose children are in a chunk of their own
+  Proxy = 2
+};
+
+/**
+ * A single attribute in the point records of 'octree.bin'
+ */
+struct AttributeColumn
+{
+  PointAttribute attribute;
+  // Name and type of the attribute as Potree expects them in metadata.json
+  const char* name;
+  const char* type;
+  uint32_t num_elements;
+  uint32_t element_size;
+  /**
+   * Offset of this attribute relative to the start of a point record
+   */
+  uint32_t byte_offset;
+};
+
+/**
+ * Layout of the point records of the DEFAULT encoding, where all attributes of a point are stored
+ * next to each other
+ */
+struct PointLayout
+{
+  std::vector<AttributeColumn> columns;
+  uint32_t record_size;
+};
+
+/**
+ * Computes the point layout for the given attributes. The position always comes first, the other
+ * attributes follow in a fixed order
+ */
+PointLayout
+point_layout_for_attributes(const PointAttributes& attributes);
+
+/**
+ * Range of the values of a single attribute, as it is written to metadata.json. Attributes with
+ * fewer than three elements only use the first elements
+ */
+struct AttributeRange
+{
+  std::array<double, 3> min = { std::numeric_limits<double>::max(),
+                                std::numeric_limits<double>::max(),
+                                std::numeric_limits<double>::max() };
+  std::array<double, 3> max = { std::numeric_limits<double>::lowest(),
+                                std::numeric_limits<double>::lowest(),
+                                std::numeric_limits<double>::lowest() };
+
+  void update(const AttributeRange& other);
+};
+
+/**
+ * Positions are stored as 32-bit integers relative to 'offset'
+ */
+struct PositionQuantization
+{
+  Vector3<double> offset;
+  double scale;
+};
+
+/**
+ * Writes the values returned by 'get_values' for each point in [begin, end) to 'dst', with 'stride'
+ * bytes between consecutive values, and updates 'range' with them
+ */
+template<typename Iter, typename GetValues>
+void
+encode_column(Iter begin,
+              Iter end,
+              std::byte* dst,
+              uint32_t stride,
+              AttributeRange& range,
+              GetValues get_values)
+{
+  for (; begin != end; ++begin) {
+    const auto values = get_values(*begin);
+    std::memcpy(dst, values.data(), sizeof(values));
+    for (size_t idx = 0; idx < values.size(); ++idx) {
+      range.min[idx] = std::min(range.min[idx], static_cast<double>(values[idx]));
+      range.max[idx] = std::max(range.max[idx], static_cast<double>(values[idx]));
+    }
+    dst += stride;
+  }
+}
+
+/**
+ * Encodes the points in [begin, end) as point records with the given layout into 'dst'. The range
+ * of the values of each column is merged into 'ranges', which has one entry per column. The range
+ * of the positions is the range of the quantized values
+ *
+ * 'Iter' has to dereference to PointBuffer::PointReference or PointBuffer::PointConstReference
+ */
+template<typename Iter>
+void
+encode_points(Iter begin,
+              Iter end,
+              const PointLayout& layout,
+              const PositionQuantization& quantization,
+              std::vector<std::byte>& dst,
+              std::vector<AttributeRange>& ranges)
+{
+  const auto num_points = static_cast<size_t>(std::distance(begin, end));
+  dst.resize(num_points * layout.record_size);
+  ranges.resize(layout.columns.size());
+
+  for (size_t column_idx = 0; column_idx < layout.columns.size(); ++column_idx) {
+    const auto& column = layout.columns[column_idx];
+    const auto column_begin = dst.data() + column.byte_offset;
+    const auto stride = layout.record_size;
+    auto& range = ranges[column_idx];
+    switch (column.attribute) {
+      case PointAttribute::Position:
+        encode_column(begin, end, column_begin, stride, range, [&quantization](const auto& point) {
+          const auto relative = (point.position() - quantization.offset) / quantization.scale;
+          return std::array<int32_t, 3>{ static_cast<int32_t>(std::round(relative.x)),
+                                         static_cast<int32_t>(std::round(relative.y)),
+                                         static_cast<int32_t>(std::round(relative.z)) };
+        });
+        break;
+      case PointAttribute::RGB:
+        // See comment in las::write_points_with_laszip for an explanation of the bit-shift
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          const auto color = point.rgbColor();
+          assert(color != nullptr);
+          return std::array<uint16_t, 3>{ static_cast<uint16_t>(color->x << 8),
+                                          static_cast<uint16_t>(color->y << 8),
+                                          static_cast<uint16_t>(color->z << 8) };
+        });
+        break;
+      case PointAttribute::Intensity:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<uint16_t, 1>{ *point.intensity() };
+        });
+        break;
+      case PointAttribute::Classification:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<uint8_t, 1>{ *point.classification() };
+        });
+        break;
+      case PointAttribute::ReturnNumber:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<uint8_t, 1>{ *point.return_number() };
+        });
+        break;
+      case PointAttribute::NumberOfReturns:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<uint8_t, 1>{ *point.number_of_returns() };
+        });
+        break;
+      case PointAttribute::GPSTime:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<double, 1>{ *point.gps_time() };
+        });
+        break;
+      case PointAttribute::PointSourceID:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<uint16_t, 1>{ *point.point_source_id() };
+        });
+        break;
+      case PointAttribute::ScanAngleRank:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<int8_t, 1>{ *point.scan_angle_rank() };
+        });
+        break;
+      case PointAttribute::UserData:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<uint8_t, 1>{ *point.user_data() };
+        });
+        break;
+      case PointAttribute::EdgeOfFlightLine:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<uint8_t, 1>{ *point.edge_of_flight_line() };
+        });
+        break;
+      case PointAttribute::ScanDirectionFlag:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          return std::array<uint8_t, 1>{ *point.scan_direction_flag() };
+        });
+        break;
+      case PointAttribute::Normal:
+        encode_column(begin, end, column_begin, stride, range, [](const auto& point) {
+          const auto normal = point.normal();
+          assert(normal != nullptr);
+          return std::array<float, 3>{ normal->x, normal->y, normal->z };
+        });
+        break;
+      default:
+        throw std::runtime_error{ "Unhandled PointAttribute in switch statement" };
+    }
+  }
+}
+
+/**
+ * Decodes the point records in 'data' into 'points', which get the given attributes. Returns false
+ * if 'data' does not contain a whole number of point records
+ */
+bool
+decode_points(gsl::span<const std::byte> data,
+              const PointLayout& layout,
+              const PositionQuantization& quantization,
+              const PointAttributes& attributes,
+              PointBuffer& points);
+
+/**
+ * Location of the points of a single node in 'octree.bin'
+ */
+struct HierarchyEntry
+{
+  OctreeNodeIndex64 node_index;
+  uint32_t point_count;
+  uint64_t byte_offset;
+  uint64_t byte_size;
+};
+
+struct EncodedHierarchy
+{
+  std::vector<std::byte> data;
+  uint64_t first_chunk_size;
+  // Deepest level of the octree
+  uint32_t depth;
+};
+
+/**
+ * Encodes the hierarchy of all nodes as it is stored in 'hierarchy.bin'. Every chunk holds the
+ * nodes of 'step_size' levels below its root node in breadth-first order, and nodes on the last
+ * level of a chunk that have children are proxies that point to the chunk below them. The chunk of
+ * the root node comes first. Ancestors of the given nodes that are not in 'entries' are added
+ * without points
+ */
+EncodedHierarchy
+encode_hierarchy(const std::vector<HierarchyEntry>& entries, uint32_t step_size);
+
+} // namespace potree2
+
+/**
+ * Sink that writes all nodes in the Potree 2.0 format. The points of each node are encoded on the
+ * calling thread and written concurrently at offsets in 'octree.bin' that are reserved when a node
+ * is persisted. 'hierarchy.bin' is built from the byte ranges of all nodes when the sink is
+ * finalized, which happens on destruction at the latest
+ */
+struct Potree2Persistence
+{
+  static PointAttributes supported_output_attributes();
+
+  /**
+   * Creates a Potree2Persistence that writes to 'work_dir'. 'cubic_bounds' are the bounds of the
+   * root node and 'spacing' is the point spacing at the root node
+   */
+  Potree2Persistence(const std::string& work_dir,
+                     const PointAttributes& input_attributes,
+                     const PointAttributes& output_attributes,
+                     const AABB& cubic_bounds,
+                     float spacing);
+  Potree2Persistence(const Potree2Persistence&) = delete;
+  Potree2Persistence(Potree2Persistence&&) = default;
+  Potree2Persistence& operator=(const Potree2Persistence&) = delete;
+  Potree2Persistence& operator=(Potree2Persistence&&) = default;
+  ~Potree2Persistence();
+
+  template<typename Iter>
+  void persist_points(Iter points_begin,
+                      Iter points_end,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index)
+  {
+    const auto num_points = static_cast<uint32_t>(std::distance(points_begin, points_end));
+    if (!num_points)
+      return;
+
+    std::vector<std::byte> payload;
+    std::vector<potree2::AttributeRange> ranges;
+    potree2::encode_points(points_begin, points_end, _layout, _quantization, payload, ranges);
+    write_node(node_index, payload, num_points, ranges);
+  }
+
+  void persist_points(PointBuffer const& points,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index);
+
+  void retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points);
+
+  bool node_exists(const OctreeNodeIndex64& node_index) const;
+
+  inline bool is_lossless() const { return false; }
+
+  /**
+   * Compacts 'octree.bin' and writes 'hierarchy.bin' and 'metadata.json'. No points can be
+   * persisted afterwards. This is called on destruction if it has not been called before
+   */
+  void finalize();
+
+private:
+  struct NodeLocation
+  {
+    uint64_t byte_offset;
+    uint64_t byte_size;
+    uint32_t point_count;
+  };
+
+  /**
+   * Reserves space for the given payload in 'octree.bin', writes it and adds it to the hierarchy. A
+   * node that is persisted again gets a new payload, the old payload is removed when the sink is
+   * finalized
+   */
+  void write_node(const OctreeNodeIndex64& node_index,
+                  const std::vector<std::byte>& payload,
+                  uint32_t point_count,
+                  const std::vector<potree2::AttributeRange>& ranges);
+
+  void write_metadata(uint64_t total_point_count, const potree2::EncodedHierarchy& hierarchy) const;
+
+  std::string _work_dir;
+  std::string _octree_file_path;
+  PointAttributes _input_attributes;
+  PointAttributes _output_attributes;
+  potree2::PointLayout _layout;
+  AABB _cubic_bounds;
+  float _spacing;
+  potree2::PositionQuantization _quantization;
+
+  std::unique_ptr<std::mutex> _lock;
+  uint64_t _next_payload_offset;
+  std::unordered_map<OctreeNodeIndex64, NodeLocation> _nodes;
+  std::vector<potree2::AttributeRange> _ranges;
+  bool _finalized;
+};
@@ -0,0 +1,247 @@
+#include "io/TeePersistence.h"
+#include "io/PointsPersistence.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <experimental/filesystem>
+#include <limits>
+#include <mutex>
+
+namespace fs = std::experimental::filesystem;
+
+namespace {
+/**
+ * Rank of a lossless sink for retrieving points, lower is faster. Memory needs no I/O at all, BIN
+ * and PACKED can be decoded without a schema conversion
+ */
+size_t
+retrieval_rank(const PointsPersistence& sink)
+{
+  if (sink.holds<MemoryPersistence>())
+    return 0;
+  if (sink.holds<BinaryPersistence>())
+    return 1;
+  if (sink.holds<PackedPersistence>())
+    return 2;
+  return 3;
+}
+
+/**
+ * The tasks for persisting a single node to all sinks. Each task is run by the first thread that
+ * claims it, so the persisting thread runs all tasks that no worker has started yet instead of
+ * waiting for a worker that is busy with another node
+ */
+struct NodeTasks
+{
+  explicit NodeTasks(std::vector<std::function<void()>> node_tasks)
+    : tasks(std::move(node_tasks))
+    , next_task(0)
+    , unfinished_tasks(tasks.size())
+  {}
+
+  /**
+   * Claims and runs the next task. Returns false if all tasks have been claimed already
+   */
+  bool run_next_task()
+  {
+    const auto idx = next_task++;
+    if (idx >= tasks.size())
+      return false;
+
+    std::exception_ptr task_error;
+    try {
+      tasks[idx]();
+    } catch (...) {
+      task_error = std::current_exception();
+    }
+
+    std::lock_guard guard{ lock };
+    if (task_error && !error) {
+      error = task_error;
+    }
+    if (!--unfinished_tasks) {
+      tasks_finished.notify_all();
+    }
+    return true;
+  }
+
+  /**
+   * Waits for all tasks and rethrows the first exception that a task threw
+   */
+  void wait()
+  {
+    std::unique_lock guard{ lock };
+    tasks_finished.wait(guard, [this]() { return !unfinished_tasks; });
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  std::vector<std::function<void()>> tasks;
+  std::atomic<size_t> next_task;
+  std::mutex lock;
+  std::condition_variable tasks_finished;
+  size_t unfinished_tasks;
+  std::exception_ptr error;
+};
+} // namespace
+
+TeePersistence::TeePersistence(std::vector<PointsPersistence> sinks,
+                               std::vector<PointsPersistence> shifted_sinks,
+                               const Vector3<double>& position_offset,
+                               const std::string& cache_directory,
+                               const PointAttributes& input_attributes)
+  : _sinks(std::move(sinks))
+  , _shifted_sinks(std::move(shifted_sinks))
+  , _position_offset(position_offset)
+  , _input_attributes(input_attributes)
+  , _retrieval_sink(std::numeric_limits<size_t>::max())
+{
+  if (_sinks.empty() && _shifted_sinks.empty()) {
+    throw std::invalid_argument{ "TeePersistence requires at least one sink" };
+  }
+
+  // Shifted sinks are never used for retrieving points, their positions would have to be moved
+  // back. 3D Tiles stores 32-bit positions, which is only lossless if the positions have been
+  // truncated to 32-bit before. This is not done if other formats are written as well, as they
+  // would lose the precision of their absolute positions
+  auto best_rank = std::numeric_limits<size_t>::max();
+  for (size_t idx = 0; idx < _sinks.size(); ++idx) {
+    if (!_sinks[idx].is_lossless())
+      continue;
+    if (!_shifted_sinks.empty() && _sinks[idx].holds<Cesium3DTilesPersistence>())
+      continue;
+    const auto rank = retrieval_rank(_sinks[idx]);
+    if (rank < best_rank) {
+      best_rank = rank;
+      _retrieval_sink = idx;
+    }
+  }
+
+  if (_retrieval_sink == std::numeric_limits<size_t>::max()) {
+    _cache_directory = cache_directory;
+    fs::create_directories(_cache_directory);
+    _sinks.emplace_back(
+      BinaryPersistence{ _cache_directory, _input_attributes, _input_attributes, Compressed::No });
+    _retrieval_sink = _sinks.size() - 1;
+  }
+
+  const auto sinks_count = _sinks.size() + _shifted_sinks.size();
+  if (sinks_count > 1) {
+    _task_system = std::make_unique<TaskSystem>();
+    _task_system->run(static_cast<uint32_t>(sinks_count - 1));
+  }
+}
+
+TeePersistence::~TeePersistence()
+{
+  if (_task_system) {
+    _task_system->stop_and_join();
+  }
+
+  if (_sinks.empty() || _cache_directory.empty())
+    return;
+
+  // The cache is always the last sink
+  _sinks.pop_back();
+  std::error_code ec;
+  fs::remove_all(_cache_directory, ec);
+}
+
+void
+TeePersistence::persist_points(PointBuffer const& points,
+                               const AABB& bounds,
+                               const OctreeNodeIndex64& node_index)
+{
+  std::vector<std::function<void()>> tasks;
+  tasks.reserve(_sinks.size());
+  for (auto& sink : _sinks) {
+    tasks.push_back([&sink, &points, &bounds, &node_index]() {
+      sink.persist_points(points, bounds, node_index);
+    });
+  }
+
+  auto& shifted_points = shifted_points_buffer();
+  if (!_shifted_sinks.empty()) {
+    shifted_points = points;
+  }
+
+  persist_to_all_sinks(std::move(tasks), shifted_points, bounds, node_index);
+}
+
+void
+TeePersistence::retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
+{
+  _sinks[_retrieval_sink].retrieve_points(node_index, points);
+}
+
+void
+TeePersistence::append_points(const OctreeNodeIndex64& node_index, PointBuffer& points)
+{
+  _sinks[_retrieval_sink].append_points(node_index, points);
+}
+
+bool
+TeePersistence::node_exists(const OctreeNodeIndex64& node_index) const
+{
+  return _sinks[_retrieval_sink].node_exists(node_index);
+}
+
+bool
+TeePersistence::is_lossless() const
+{
+  // The retrieval sink is either lossless or the cache
+  return true;
+}
+
+void
+TeePersistence::finalize_subtree(const OctreeNodeIndex64& subtree_root)
+{
+  for (auto& sink : _sinks) {
+    sink.finalize_subtree(subtree_root);
+  }
+  for (auto& sink : _shifted_sinks) {
+    sink.finalize_subtree(subtree_root);
+  }
+}
+
+PointBuffer&
+TeePersistence::shifted_points_buffer()
+{
+  thread_local PointBuffer shifted_points;
+  return shifted_points;
+}
+
+void
+TeePersistence::persist_to_all_sinks(std::vector<std::function<void()>> tasks,
+                                     PointBuffer& shifted_points,
+                                     const AABB& bounds,
+                                     const OctreeNodeIndex64& node_index)
+{
+  const AABB shifted_bounds{ bounds.min + _position_offset, bounds.max + _position_offset };
+  if (!_shifted_sinks.empty()) {
+    for (auto& position : shifted_points.positions()) {
+      position += _position_offset;
+    }
+    for (auto& sink : _shifted_sinks) {
+      tasks.push_back([&sink, &shifted_points, &shifted_bounds, &node_index]() {
+        sink.persist_points(shifted_points, shifted_bounds, node_index);
+      });
+    }
+  }
+
+  // The workers and the calling thread claim the tasks, so the calling thread only waits for tasks
+  // that are running already
+  const auto node_tasks = std::make_shared<NodeTasks>(std::move(tasks));
+  if (_task_system) {
+    for (size_t idx = 1; idx < node_tasks->tasks.size(); ++idx) {
+      _task_system->push([node_tasks]() { node_tasks->run_next_task(); });
+    }
+  }
+  while (node_tasks->run_next_task()) {
+  }
+
+  // Other sinks may still reference the points, so an exception is only rethrown once all of them
+  // are done
+  node_tasks->wait();
+}
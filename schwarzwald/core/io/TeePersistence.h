@@ -0,0 +1,100 @@
+#pragma once
+
+#include "datastructures/OctreeNodeIndex.h"
+#include "datastructures/PointBuffer.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+#include "threading/TaskSystem.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct PointsPersistence;
+
+/**
+ * Sink that forwards all points to several other sinks, so that a single tiling pass writes
+ * multiple output formats. Points are persisted to all sinks concurrently, using the persisting
+ * thread and a pool of one worker per additional sink.
+ *
+ * Points are retrieved from the fastest lossless sink that stores the points unmodified. If there
+ * is no such sink (e.g. because all sinks are LAS-based), the points are also written to a hidden
+ * cache of uncompressed BIN files in 'cache_directory', which is removed again when the
+ * TeePersistence is destroyed.
+ *
+ * The 'shifted_sinks' get all positions moved by 'position_offset'. This way 3D Tiles, whose points
+ * are shifted to the center of the point cloud, can be written together with formats that store
+ * absolute positions. With shifted sinks, the positions are not truncated to 32-bit for 3D Tiles,
+ * so 3D Tiles sinks are not used for retrieving points then
+ */
+struct TeePersistence
+{
+  TeePersistence(std::vector<PointsPersistence> sinks,
+                 std::vector<PointsPersistence> shifted_sinks,
+                 const Vector3<double>& position_offset,
+                 const std::string& cache_directory,
+                 const PointAttributes& input_attributes);
+  TeePersistence(const TeePersistence&) = delete;
+  TeePersistence(TeePersistence&&) = default;
+  TeePersistence& operator=(const TeePersistence&) = delete;
+  TeePersistence& operator=(TeePersistence&&) = default;
+  ~TeePersistence();
+
+  /**
+   * Defined in PointsPersistence.h, since it needs the complete PointsPersistence type
+   */
+  template<typename Iter>
+  void persist_points(Iter points_begin,
+                      Iter points_end,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index);
+
+  void persist_points(PointBuffer const& points,
+                      const AABB& bounds,
+                      const OctreeNodeIndex64& node_index);
+
+  void retrieve_points(const OctreeNodeIndex64& node_index, PointBuffer& points);
+
+  void append_points(const OctreeNodeIndex64& node_index, PointBuffer& points);
+
+  bool node_exists(const OctreeNodeIndex64& node_index) const;
+
+  bool is_lossless() const;
+
+  void finalize_subtree(const OctreeNodeIndex64& subtree_root);
+
+  /**
+   * Does this TeePersistence write the hidden BIN cache?
+   */
+  bool uses_cache() const { return !_cache_directory.empty(); }
+
+private:
+  /**
+   * Buffer for the points of the shifted sinks, which is reused for all nodes that the calling
+   * thread persists
+   */
+  static PointBuffer& shifted_points_buffer();
+
+  /**
+   * Moves the points in 'shifted_points' by the position offset, then runs all 'tasks' and the
+   * persisting of 'shifted_points' to the shifted sinks concurrently. The calling thread runs all
+   * tasks that no worker has started yet
+   */
+  void persist_to_all_sinks(std::vector<std::function<void()>> tasks,
+                            PointBuffer& shifted_points,
+                            const AABB& bounds,
+                            const OctreeNodeIndex64& node_index);
+
+  std::vector<PointsPersistence> _sinks;
+  std::vector<PointsPersistence> _shifted_sinks;
+  Vector3<double> _position_offset;
+  std::string _cache_directory;
+  PointAttributes _input_attributes;
+  // Index of the sink in '_sinks' that points are retrieved from
+  size_t _retrieval_sink;
+  // Workers for persisting to several sinks at once, declared last so that they are stopped
+  // before the sinks are destroyed
+  std::unique_ptr<TaskSystem> _task_system;
+};
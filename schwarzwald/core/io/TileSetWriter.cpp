@@ -1,90 +1,82 @@
 #include "io/TileSetWriter.h"
+#include "io/io_util.h"
 #include "util/Definitions.h"
 
-#include <rapidjson/document.h>
-#include <rapidjson/filewritestream.h>
+#include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 #include <types/type_util.h>
 
 #include <experimental/filesystem>
-#include <fstream>
+#include <iostream>
 
 using namespace rapidjson;
 
-template <typename Alloc>
-static Value writeBoundingVolume(const BoundingVolume_t &boundingVolume,
-                                 Alloc &alloc) {
-  Value boundingVolumeObj{kObjectType};
-  Value boundingVolumeArr{kArrayType};
+using TilesetJSONWriter = Writer<StringBuffer>;
 
+static void writeBoundingVolume(const BoundingVolume_t &boundingVolume,
+                                TilesetJSONWriter &writer) {
+  writer.StartObject();
+  std::visit(overloaded{[&](const BoundingRegion &br) { writer.Key("region"); },
+                        [&](const BoundingBox &bb) { writer.Key("box"); }},
+             boundingVolume);
+
+  writer.StartArray();
   const auto boundingVolumeAsArray = boundingVolumeToArray(boundingVolume);
   for (auto entry : boundingVolumeAsArray) {
-    boundingVolumeArr.PushBack(entry, alloc);
+    writer.Double(entry);
   }
-
-  std::visit(overloaded{[&](const BoundingRegion &br) {
-                          boundingVolumeObj.AddMember("region",
-                                                      boundingVolumeArr, alloc);
-                        },
-                        [&](const BoundingBox &bb) {
-                          boundingVolumeObj.AddMember("box", boundingVolumeArr,
-                                                      alloc);
-                        }},
-             boundingVolume);
-
-  return boundingVolumeObj;
+  writer.EndArray();
+  writer.EndObject();
 }
 
 /**
- * Converts the given Tileset into JSON tree structure
+ * Streams the given Tileset as JSON tree structure into 'writer'
  */
-template <typename Alloc>
-static Value write_tileset(const Tileset &tileset, Alloc &alloc,
-                           uint32_t remaining_levels) {
-  Value root{kObjectType};
+static void write_tileset(const Tileset &tileset, TilesetJSONWriter &writer,
+                          uint32_t remaining_levels) {
+  writer.StartObject();
 
-  auto boundingVolumeObj = writeBoundingVolume(tileset.boundingVolume, alloc);
-  root.AddMember("boundingVolume", boundingVolumeObj, alloc);
-  root.AddMember("geometricError", tileset.geometricError, alloc);
-  root.AddMember("refine", "ADD", alloc);
+  writer.Key("boundingVolume");
+  writeBoundingVolume(tileset.boundingVolume, writer);
+  writer.Key("geometricError");
+  writer.Double(tileset.geometricError);
+  writer.Key("refine");
+  writer.String("ADD");
 
-  Value content{kObjectType};
   // optional: add bounding box for that object
 
   // HACK If remaining_levels == 0, we are at the bottom of the tree and have to
   // refer
   // to external tilesets
-  auto content_uri = [&]() {
-    if (remaining_levels == 0) {
-      return Value{tileset.url.c_str(),
-                   static_cast<rapidjson::SizeType>(tileset.url.size())};
-    }
-    return Value{tileset.content_url.c_str(),
-                 static_cast<rapidjson::SizeType>(tileset.content_url.size())};
-  }();
-  content.AddMember("uri", content_uri, alloc);
-  root.AddMember("content", content, alloc);
+  const auto &content_uri =
+      (remaining_levels == 0) ? tileset.url : tileset.content_url;
+  writer.Key("content");
+  writer.StartObject();
+  writer.Key("uri");
+  writer.String(content_uri.c_str(),
+                static_cast<rapidjson::SizeType>(content_uri.size()));
+  writer.EndObject();
 
   // Write children, if there are any. Skip writing children if at max level
-  if (tileset.children.empty() || remaining_levels == 0)
-    return root;
-
-  Value children{kArrayType};
-  for (auto &child : tileset.children) {
-    children.PushBack(write_tileset(child, alloc, remaining_levels - 1), alloc);
+  if (!tileset.children.empty() && remaining_levels != 0) {
+    writer.Key("children");
+    writer.StartArray();
+    for (auto &child : tileset.children) {
+      write_tileset(child, writer, remaining_levels - 1);
+    }
+    writer.EndArray();
   }
-  root.AddMember("children", children, alloc);
 
-  return root;
+  writer.EndObject();
 }
 
 bool writeTilesetJSON(const std::string &filepath, const Tileset &ts,
                       uint32_t max_depth) {
-
-  Document document;
-  document.SetObject();
-
-  auto &alloc = document.GetAllocator();
+  // The JSON is streamed into a buffer without building a document first, so
+  // only the serialized tileset is held in memory
+  StringBuffer buffer;
+  TilesetJSONWriter writer{buffer};
+  writer.StartObject();
 
   // Tileset
   // https://github.com/AnalyticalGraphicsInc/3d-tiles/blob/master/schema/tileset.schema.json
@@ -103,26 +95,27 @@ bool writeTilesetJSON(const std::string &filepath, const Tileset &ts,
   -tilsetVersion
   -gltUpAxis
   */
-  Value assetobj(kObjectType);
-  Value version(ts.version.c_str(), (rapidjson::SizeType)ts.version.size());
-  assetobj.AddMember("version", version,
-                     alloc); // defines the JSON schema for tileset.json and
-                             // the base set of tile formats
+  writer.Key("asset");
+  writer.StartObject();
+  // defines the JSON schema for tileset.json and the base set of tile formats
+  writer.Key("version");
+  writer.String(ts.version.c_str(),
+                static_cast<rapidjson::SizeType>(ts.version.size()));
   if (!ts.tilesetVersion.empty()) {
-    Value v(ts.tilesetVersion.c_str(), (rapidjson::SizeType)ts.version.size());
-    assetobj.AddMember("tilesetVersion", v, alloc);
+    writer.Key("tilesetVersion");
+    writer.String(ts.tilesetVersion.c_str(),
+                  static_cast<rapidjson::SizeType>(ts.tilesetVersion.size()));
   }
-  if (ts.gltfUpAxis == X || ts.gltfUpAxis == Z) // Y is deafult in schema
-  {
-    if (ts.gltfUpAxis == X) {
-      assetobj.AddMember("gltUpAxis", "X", alloc);
-    }
-    if (ts.gltfUpAxis == Z) {
-      assetobj.AddMember("gltUpAxis", "Z", alloc);
-    }
+  // Y is deafult in schema
+  if (ts.gltfUpAxis == X) {
+    writer.Key("gltUpAxis");
+    writer.String("X");
   }
-
-  document.AddMember("asset", assetobj, alloc);
+  if (ts.gltfUpAxis == Z) {
+    writer.Key("gltUpAxis");
+    writer.String("Z");
+  }
+  writer.EndObject();
 
   // properties
   // https://github.com/AnalyticalGraphicsInc/3d-tiles/blob/master/schema/properties.schema.json
@@ -132,13 +125,16 @@ bool writeTilesetJSON(const std::string &filepath, const Tileset &ts,
   -minimum required
   */
   if (ts.height_max != 0 && ts.height_min != 0) {
-    Value propertiesobj(kObjectType);
-    Value heightobj(kObjectType);
-    heightobj.AddMember("minimum", ts.height_min, alloc);
-    heightobj.AddMember("maximum", ts.height_max, alloc);
-    propertiesobj.AddMember("Height", heightobj, alloc);
-
-    document.AddMember("properties", propertiesobj, alloc);
+    writer.Key("properties");
+    writer.StartObject();
+    writer.Key("Height");
+    writer.StartObject();
+    writer.Key("minimum");
+    writer.Double(ts.height_min);
+    writer.Key("maximum");
+    writer.Double(ts.height_max);
+    writer.EndObject();
+    writer.EndObject();
   }
 
   // geometricError
@@ -147,64 +143,20 @@ bool writeTilesetJSON(const std::string &filepath, const Tileset &ts,
   At runtime, the geometric error is used to compute screen space error (SSE),
   i.e., the error measured in pixels. minimum = 0
   */
-  document.AddMember("geometricError", ts.geometricError,
-                     alloc); // error when the entire tileset is not rendered
-
-  auto root_tileset = write_tileset(ts, alloc, max_depth);
-  document.AddMember("root", root_tileset, alloc);
-
-  if (fs::exists(filepath)) {
-    std::error_code removeErrorCode;
-    auto success = fs::remove(filepath, removeErrorCode);
-    if (!success) {
-      std::cerr << "Could not remove file \"" << filepath << "\" ("
-                << removeErrorCode.message() << ")" << std::endl;
-      return false;
-    }
-  }
-
-  /*
-  FILE* filePtr;
-  auto fopenErr = fopen_s(&filePtr, filepath.c_str(), "wb");
-  if (fopenErr) {
-    std::cerr << "Error writing tileset JSON to \"" << filepath << "\" ("
-              << strerror(fopenErr) << ")" << std::endl;
-    return false;
-  }
+  writer.Key("geometricError");
+  // error when the entire tileset is not rendered
+  writer.Double(ts.geometricError);
 
-  char writeBuffer[65536];
-
-  FileWriteStream os(filePtr, writeBuffer, sizeof(writeBuffer));
-  */
+  writer.Key("root");
+  write_tileset(ts, writer, max_depth);
 
-  struct Stream {
-    std::ofstream of;
+  writer.EndObject();
 
-    explicit Stream(const std::string &filepath)
-        : of{filepath, std::ios::binary} {}
-
-    typedef char Ch;
-    void Put(Ch ch) { of.put(ch); }
-    void Flush() {}
-  };
-
-  Stream fs{filepath};
-  if (!fs.of.is_open()) {
+  if (!write_file_unbuffered(filepath, buffer.GetString(), buffer.GetSize())) {
     std::cerr << "Error writing tileset JSON to \"" << filepath << "\""
               << std::endl;
     return false;
   }
 
-  Writer<Stream> writer(fs);
-  document.Accept(writer);
-
-  /*
-  auto fcloseErr = fclose(filePtr);
-  if (fcloseErr) {
-    std::cerr << "Error " << fcloseErr << " while closing file handle for \""
-              << filepath << "\"" << std::endl;
-  }
-  */
-
   return true;
 }
@@ -1,6 +1,7 @@
 #include "process/ConverterProcess.h"
 
 #include "datastructures/DynamicMortonIndex.h"
+#include "datastructures/OctreeNodeIndex.h"
 #include "io/Cesium3DTilesPersistence.h"
 #include "io/PNTSWriter.h"
 #include "io/PointsPersistence.h"
@@ -44,6 +45,8 @@ struct Properties
   float root_spacing;
   bool points_have_offset;
   NodeNameToMortonIndex_t morton_index_parser;
+  // Naming convention of the node files in the source folder
+  MortonIndexNamingConvention naming_convention;
 };
 
 enum class DeleteSource
@@ -92,6 +95,7 @@ parse_properties_json(const std::string& properties_json_path)
   props.morton_index_parser = [](const std::string& name) {
     return DynamicMortonIndex::parse_string(name, MortonIndexNamingConvention::Potree);
   };
+  props.naming_convention = MortonIndexNamingConvention::Potree;
 
   props.points_have_offset = true;
 
@@ -136,6 +140,7 @@ parse_ept_json(const std::string& ept_json_path)
   props.morton_index_parser = [](const std::string& name) {
     return DynamicMortonIndex::parse_string(name, MortonIndexNamingConvention::Entwine);
   };
+  props.naming_convention = MortonIndexNamingConvention::Entwine;
 
   props.points_have_offset = false;
 
@@ -180,6 +185,7 @@ parse_cloud_js(const std::string& cloud_js_path)
   props.morton_index_parser = [](const std::string& name) {
     return DynamicMortonIndex::parse_string(name, MortonIndexNamingConvention::Potree);
   };
+  props.naming_convention = MortonIndexNamingConvention::Potree;
 
   props.points_have_offset = true;
 
@@ -237,7 +243,8 @@ static std::optional<PointsPersistence>
 get_persistence_for_file(const fs::path& file_path,
                          const std::string& source_folder,
                          const PointAttributes& attributes,
-                         float spacing_at_root)
+                         float spacing_at_root,
+                         MortonIndexNamingConvention naming_convention)
 {
   const auto extension = file_path.extension();
 
@@ -253,11 +260,11 @@ get_persistence_for_file(const fs::path& file_path,
   }
   if (extension == ".las") {
     return std::make_optional<PointsPersistence>(
-      LASPersistence{ source_folder, attributes, attributes, Compressed::No });
+      LASPersistence{ source_folder, attributes, attributes, Compressed::No, naming_convention });
   }
   if (extension == ".laz") {
     return std::make_optional<PointsPersistence>(
-      LASPersistence{ source_folder, attributes, attributes, Compressed::Yes });
+      LASPersistence{ source_folder, attributes, attributes, Compressed::Yes, naming_convention });
   }
   if (extension == ".pnts") {
     return std::make_optional<PointsPersistence>(Cesium3DTilesPersistence{
@@ -493,11 +500,12 @@ convert_to_pnts_file(const std::string& source_folder,
                      const std::string& output_folder,
                      const PointAttributes& attributes,
                      float spacing_at_root,
+                     MortonIndexNamingConvention naming_convention,
                      const SRSTransformHelper& transformation,
                      DeleteSource delete_source)
 {
-  auto persistence =
-    get_persistence_for_file(input_file, source_folder, attributes, spacing_at_root);
+  auto persistence = get_persistence_for_file(
+    input_file, source_folder, attributes, spacing_at_root, naming_convention);
   if (!persistence) {
     util::write_log(concat("Could not read source file \"",
                            input_file.filename().string(),
@@ -509,9 +517,15 @@ convert_to_pnts_file(const std::string& source_folder,
   PNTSWriter writer{ out_file_name, attributes, RGBMapping::None };
 
   const auto node_name = input_file.filename().stem().string();
+  const auto node_index = OctreeNodeIndex64::from_string(node_name, naming_convention);
+  if (!node_index) {
+    util::write_log(
+      concat("Could not read source file \"", node_name, "\": ", node_index.error(), "\n"));
+    return;
+  }
 
   PointBuffer source_data;
-  persistence->retrieve_points(node_name, source_data);
+  persistence->retrieve_points(*node_index, source_data);
   transformation.transformPositionsTo(TargetSRS::CesiumWorld,
                                       gsl::make_span(source_data.positions()));
   auto local_offset_to_world = setOriginToSmallestPoint(source_data.positions());
@@ -541,11 +555,12 @@ convert_to_las_file(const std::string& source_folder,
                     const AABB& root_bounds,
                     float spacing_at_root,
                     NodeNameToMortonIndex_t morton_index_parser,
+                    MortonIndexNamingConvention naming_convention,
                     Compressed compressed,
                     DeleteSource delete_source)
 {
-  auto persistence =
-    get_persistence_for_file(input_file, source_folder, attributes, spacing_at_root);
+  auto persistence = get_persistence_for_file(
+    input_file, source_folder, attributes, spacing_at_root, naming_convention);
   if (!persistence) {
     util::write_log(concat("Could not read source file \"",
                            input_file.filename().string(),
@@ -553,19 +568,26 @@ convert_to_las_file(const std::string& source_folder,
     return;
   }
 
-  LASPersistence las_persistence{ output_folder, attributes, attributes, compressed };
+  LASPersistence las_persistence{
+    output_folder, attributes, attributes, compressed, naming_convention
+  };
 
   const auto node_name = input_file.filename().stem().string();
+  const auto node_index = OctreeNodeIndex64::from_string(node_name, naming_convention);
+  if (!node_index) {
+    std::cerr << node_index.error() << std::endl;
+    return;
+  }
 
   morton_index_parser(node_name)
     .map([&](const auto& node_morton_index) {
       const auto node_bounds = get_bounds_from_morton_index(node_morton_index, root_bounds);
 
       PointBuffer source_data;
-      persistence->retrieve_points(node_name, source_data);
+      persistence->retrieve_points(*node_index, source_data);
 
       las_persistence.persist_points(
-        std::begin(source_data), std::end(source_data), node_bounds, node_name);
+        std::begin(source_data), std::end(source_data), node_bounds, *node_index);
 
       if (delete_source == DeleteSource::Yes) {
         std::error_code ec;
@@ -624,6 +646,7 @@ convert_to_3dtiles_impl(const ConverterArguments& args,
                            args.output_folder,
                            args.output_attributes,
                            properties.root_spacing,
+                           properties.naming_convention,
                            *transformation,
                            (args.delete_source_files) ? DeleteSource::Yes : DeleteSource::No);
 
@@ -684,6 +707,7 @@ convert_to_las_impl(const ConverterArguments& args,
                           properties.root_bounds,
                           properties.root_spacing,
                           properties.morton_index_parser,
+                          properties.naming_convention,
                           compressed,
                           (args.delete_source_files) ? DeleteSource::Yes : DeleteSource::No);
 
@@ -186,16 +186,17 @@ Tiler::Tiler(DatasetMetadata dataset_metadata,
     (meta_parameters.shift_points_to_origin ? _dataset_metadata.total_bounds_cubic_at_origin()
                                             : _dataset_metadata.total_bounds_cubic());
 
-  switch (meta_parameters.tiling_strategy) {
-    case TilingStrategy::Accurate:
-      _tiling_algorithm = std::make_unique<TilingAlgorithmV1>(
-        _sampling_strategy, _progress_reporter, _persistence, _meta_parameters);
-      break;
-    case TilingStrategy::Fast:
-      _tiling_algorithm = std::make_unique<TilingAlgorithmV3>(
-        _sampling_strategy, _progress_reporter, _persistence, _meta_parameters, _output_directory);
-      break;
-  }
+  TilingContext tiling_context{ _bounds, _meta_parameters.spacing_at_root };
+
+  // The type of the sampling strategy is resolved once here, the tiling algorithm then samples
+  // every node through direct calls
+  _tiling_algorithm = make_tiling_algorithm(meta_parameters.tiling_strategy,
+                                            _sampling_strategy,
+                                            _progress_reporter,
+                                            _persistence,
+                                            _meta_parameters,
+                                            std::move(tiling_context),
+                                            _output_directory);
 }
 
 Tiler::~Tiler() {}
@@ -257,13 +258,16 @@ Tiler::run()
 
     if (!first_run) {
       build_execution_graph_for_indexing(
-        index_taskflow, index_concurrency, index_throughput_sampler);
+        index_taskflow, index_concurrency, index_throughput_sampler, last_run);
     } else {
       first_run = false;
     }
 
     auto batch_finished = scheduler->execute_tiling_iteration(read_taskflow, index_taskflow);
     batch_finished.wait();
+    // Sampling in the next batch uses the statistics of all previous batches, which do not depend
+    // on the order in which the nodes of a batch were processed
+    update_measured_statistics(_sampling_strategy);
 
     if (global_config().is_journaling_enabled) {
       journal_taskflow(read_taskflow, "read_taskflow");
@@ -499,7 +503,8 @@ Tiler::max_read_parallelism() const
 void
 Tiler::build_execution_graph_for_indexing(tf::Taskflow& tf,
                                           uint32_t num_indexing_threads,
-                                          ThroughputSampler& throughput_sampler)
+                                          ThroughputSampler& throughput_sampler,
+                                          bool is_last_batch)
 {
   util::Range<PointBuffer::PointIterator> produced_points_range{
     std::begin(_points_cache_for_consumers),
@@ -507,7 +512,7 @@ Tiler::build_execution_graph_for_indexing(tf::Taskflow& tf,
   };
 
   auto [indexing_first_task, indexing_last_task] = _tiling_algorithm->build_execution_graph(
-    produced_points_range, _bounds, num_indexing_threads, tf);
+    produced_points_range, _bounds, num_indexing_threads, tf, is_last_batch);
 
   // The actual indexing is bounded by first waiting for the _producers
   // Semaphore, and at the end incrementing the _consumers Semaphore
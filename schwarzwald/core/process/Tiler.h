@@ -22,7 +22,7 @@
 #include <taskflow/taskflow.hpp>
 
 struct ProgressReporter;
-struct TilingAlgorithmBase;
+struct TilingAlgorithm;
 struct ThroughputSampler;
 
 /**
@@ -72,6 +72,11 @@ struct TilerMetaParameters
   bool create_journal;
   TilingStrategy tiling_strategy;
   std::variant<FixedThreadCount, AdaptiveThreadCount> thread_count;
+  /**
+   * Persist the points of each node in progressive order instead of Morton order, so that every
+   * prefix of the points of a node is a uniform subsample of the node
+   */
+  bool progressive_point_ordering;
 };
 
 /**
@@ -111,7 +116,8 @@ private:
 
   void build_execution_graph_for_indexing(tf::Taskflow& tf,
                                           uint32_t num_indexing_threads,
-                                          ThroughputSampler& throughput_sampler);
+                                          ThroughputSampler& throughput_sampler,
+                                          bool is_last_batch);
 
   void create_read_commands();
   void adjust_read_thread_count(size_t num_read_threads);
@@ -138,7 +144,7 @@ private:
   std::deque<ReadCommand> _remaining_read_commands;
   std::vector<ReadCommand> _next_read_commands_per_thread;
 
-  std::unique_ptr<TilingAlgorithmBase> _tiling_algorithm;
+  std::unique_ptr<TilingAlgorithm> _tiling_algorithm;
 
   Semaphore _producers, _consumers;
 
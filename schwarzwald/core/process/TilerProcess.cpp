@@ -9,8 +9,10 @@
 #include <rapidjson/writer.h>
 
 #include "Tiler.h"
+#include "io/AsyncFileWriter.h"
 #include "io/BinaryPersistence.h"
 #include "io/Cesium3DTilesPersistence.h"
+#include "io/DirectoryRemoval.h"
 #include "io/EntwinePersistence.h"
 #include "io/LASFile.h"
 #include "io/LASPersistence.h"
@@ -25,9 +27,12 @@
 #include <debug/ThroughputCounter.h>
 #include <terminal/stdout_helper.h>
 
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/format.hpp>
 #include <chrono>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <map>
 #include <math.h>
@@ -41,32 +46,166 @@ namespace rj = rapidjson;
 
 constexpr auto PROCESS_COUNT = 1'000'000;
 
-/// <summary>
-/// Verify that output directory is valid
-/// </summary>
+/**
+ * Is the given output format one of the 3D Tiles formats?
+ */
+static bool
+is_3d_tiles_format(OutputFormat output_format)
+{
+  return output_format == OutputFormat::CZM_3DTILES ||
+         output_format == OutputFormat::CZM_3DTILES_GLB;
+}
+
+/**
+ * Is the given output format one of the Entwine formats?
+ */
+static bool
+is_entwine_format(OutputFormat output_format)
+{
+  return output_format == OutputFormat::ENTWINE_LAS || output_format == OutputFormat::ENTWINE_LAZ ||
+         output_format == OutputFormat::ENTWINE_BIN;
+}
+
+/**
+ * Name of the hidden directory within the output directory that caches the points of all nodes when
+ * writing multiple formats that are all lossy
+ */
+constexpr auto TEE_CACHE_DIRECTORY = ".tee_cache";
+
+// Threads that remove the output of a previous run before tiling. Removing files is mostly waiting
+// for the filesystem, so this may exceed the number of cores
+constexpr unsigned OUTPUT_REMOVAL_THREADS = 16;
+// Threads that remove the output of a previous run while tiling, few enough to leave the cores and
+// the disk to tiling
+constexpr unsigned BACKGROUND_OUTPUT_REMOVAL_THREADS = 2;
+
+/**
+ * Is the journal written to a directory within the given output directory? A journal elsewhere is
+ * never touched when removing the files of a previous run
+ */
+static bool
+is_journal_within(const fs::path& output_directory)
+{
+  if (!global_config().is_journaling_enabled)
+    return false;
+  std::error_code error;
+  return fs::equivalent(global_config().journal_directory.parent_path(), output_directory, error) &&
+         !error;
+}
+
+/**
+ * Removes the files of a previous run from the output directory. If the journal directory is within
+ * the output directory, only its contents are removed, so that we can run the tool multiple times
+ * with the same output directory without leaving garbage
+ */
 static void
-prepare_output_directory(const std::string& output_directory)
+clear_output_directory(const fs::path& output_directory)
 {
-  if (fs::exists(output_directory)) {
-    // TODO We could add a progress bar here!
-    util::write_log("Output directory not empty, removing existing files\n");
-    for (auto& entry : fs::directory_iterator{ output_directory }) {
-      // A bit hacky, but we have to make sure that we don't delete the journal output folder
-      if (global_config().is_journaling_enabled && entry == global_config().journal_directory) {
-        // Remove only the contents of the journal output folder, so that we can run the tool
-        // multiple times with the same output folder and don't get leave garbage
-        for (auto& journal_entry : fs::directory_iterator{ entry }) {
-          fs::remove_all(journal_entry);
-        }
-        continue;
-      }
+  const auto journal_within_output = is_journal_within(output_directory);
+  const auto journal_directory = output_directory / global_config().journal_directory.filename();
+  const auto is_journal_directory = [&](const fs::path& entry) {
+    return journal_within_output && entry == journal_directory;
+  };
+
+  auto failed_removals =
+    remove_directory_contents(output_directory, OUTPUT_REMOVAL_THREADS, is_journal_directory);
+  if (journal_within_output && fs::exists(journal_directory)) {
+    failed_removals += remove_directory_contents(journal_directory, OUTPUT_REMOVAL_THREADS);
+  }
+
+  if (failed_removals) {
+    util::write_log(
+      concat("warning: ", failed_removals, " existing files could not be removed\n"));
+  }
+}
+
+/**
+ * Renames the output directory of a previous run to a hidden sibling and creates a new, empty
+ * output directory in its place. The renamed directory is then removed in the background, together
+ * with renamed directories that runs which were aborted before finishing the removal left behind.
+ * A journal directory within the output directory is moved and removed along with it. Returns the
+ * number of files that could not be removed, or an invalid future if the output directory could not
+ * be renamed
+ */
+static std::future<size_t>
+remove_output_directory_in_background(const fs::path& output_directory)
+{
+  // Renaming the target of a symbolic link would leave the link dangling, and the link itself has
+  // to stay where it is
+  if (fs::is_symlink(output_directory))
+    return {};
+
+  std::error_code error;
+  const auto canonical_output_directory = fs::canonical(output_directory, error);
+  if (error || !canonical_output_directory.has_filename())
+    return {};
+  // Renaming the working directory would leave this process within the renamed directory
+  if (fs::equivalent(canonical_output_directory, fs::current_path(), error) || error)
+    return {};
+
+  const auto parent_directory = canonical_output_directory.parent_path();
+  const auto stale_prefix = concat(".", canonical_output_directory.filename().string(), ".stale-");
+  const auto stale_directory =
+    parent_directory /
+    concat(stale_prefix, std::chrono::system_clock::now().time_since_epoch().count());
+  fs::rename(canonical_output_directory, stale_directory, error);
+  if (error)
+    return {};
+  fs::create_directories(output_directory);
+
+  std::vector<fs::path> stale_directories;
+  fs::directory_iterator iter{ parent_directory, error };
+  for (; !error && iter != fs::directory_iterator{}; iter.increment(error)) {
+    if (boost::algorithm::starts_with(iter->path().filename().string(), stale_prefix) &&
+        fs::is_directory(iter->symlink_status())) {
+      stale_directories.push_back(iter->path());
+    }
+  }
+  if (error || stale_directories.empty()) {
+    stale_directories = { stale_directory };
+  }
 
-      fs::remove_all(entry);
+  return std::async(std::launch::async, [stale_directories = std::move(stale_directories)]() {
+    size_t failed_removals = 0;
+    for (const auto& directory : stale_directories) {
+      failed_removals += remove_directory(directory, BACKGROUND_OUTPUT_REMOVAL_THREADS);
     }
-  } else {
+    return failed_removals;
+  });
+}
+
+/**
+ * Makes sure that the output directory exists and contains no files of a previous run. If
+ * 'remove_in_background' is set, the existing output directory is removed in the background and
+ * the returned future becomes ready once it is gone, otherwise the future is invalid
+ */
+static std::future<size_t>
+prepare_output_directory(const fs::path& output_directory, bool remove_in_background)
+{
+  if (!fs::exists(output_directory)) {
     util::write_log("Output directory does not exist, creating it\n");
     fs::create_directories(output_directory);
+    return {};
+  }
+
+  if (remove_in_background) {
+    const auto journal_within_output = is_journal_within(output_directory);
+    auto removal = remove_output_directory_in_background(output_directory);
+    if (removal.valid()) {
+      util::write_log("Output directory not empty, removing existing files in the background\n");
+      // A journal directory within the output directory was moved aside with the old output
+      if (journal_within_output) {
+        fs::create_directories(global_config().journal_directory);
+      }
+      return removal;
+    }
+    util::write_log("warning: Could not move the existing output directory aside, removing "
+                    "existing files before tiling\n");
   }
+
+  util::write_log("Output directory not empty, removing existing files\n");
+  clear_output_directory(output_directory);
+  return {};
 }
 
 static void
@@ -234,7 +373,33 @@ TilerProcess::prepare()
   const auto attributesDescription = print_attributes(_output_attributes);
   util::write_log(concat("Writing the following point attributes: ", attributesDescription, "\n"));
 
-  prepare_output_directory(_args.output_directory);
+  _previous_output_removal =
+    prepare_output_directory(_args.output_directory, _args.background_cleanup);
+}
+
+std::vector<OutputFormat>
+TilerProcess::all_output_formats() const
+{
+  std::vector<OutputFormat> output_formats = { _args.output_format };
+  output_formats.insert(std::end(output_formats),
+                        std::begin(_args.additional_output_formats),
+                        std::end(_args.additional_output_formats));
+  return output_formats;
+}
+
+fs::path
+TilerProcess::output_directory_for_format(OutputFormat format) const
+{
+  if (_args.additional_output_formats.empty())
+    return _args.output_directory;
+  return _args.output_directory / util::to_string(format);
+}
+
+PointAttributes
+TilerProcess::output_attributes_for_format(OutputFormat format) const
+{
+  // Only 3D Tiles supports RGB mapping, all other formats write the attributes of the input files
+  return is_3d_tiles_format(format) ? _output_attributes : _input_attributes;
 }
 
 void
@@ -281,9 +446,10 @@ source.string() % err.what())
   // Output attributes are dependent on the attributes that the desired output
   // format supports, and on whether or not one of the input attributes should
   // be converted to RGB
+  const auto output_formats = all_output_formats();
   auto output_attributes = _input_attributes;
   // TODO 3D Tiles is the only format supporting RGB remapping at the moment
-  if (_args.output_format == OutputFormat::CZM_3DTILES) {
+  if (std::any_of(std::begin(output_formats), std::end(output_formats), is_3d_tiles_format)) {
     switch (_args.rgb_mapping) {
       case RGBMapping::FromIntensityLinear:
       case RGBMapping::FromIntensityLogarithmic:
@@ -294,8 +460,21 @@ source.string() % err.what())
     }
   }
 
-  const auto supported_output_attributes =
-    supported_output_attributes_for_format(_args.output_format);
+  // When writing multiple formats, only the attributes that all formats support are written
+  auto supported_output_attributes = supported_output_attributes_for_format(output_formats.front());
+  std::vector<std::string> format_names;
+  for (auto output_format : output_formats) {
+    const auto supported_by_format = supported_output_attributes_for_format(output_format);
+    for (auto it = std::begin(supported_output_attributes);
+         it != std::end(supported_output_attributes);) {
+      if (supported_by_format.find(*it) == std::end(supported_by_format)) {
+        it = supported_output_attributes.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    format_names.push_back(util::to_string(output_format));
+  }
   PointAttributes supported_attributes, unsupported_attributes;
   std::for_each(std::begin(output_attributes),
                 std::end(output_attributes),
@@ -311,7 +490,7 @@ source.string() % err.what())
                 });
 
   if (!unsupported_attributes.empty()) {
-    const auto format_name = util::to_string(_args.output_format);
+    const auto format_name = boost::algorithm::join(format_names, ",");
     util::write_log((boost::format("warning: Not all point attributes in the input files are "
                                    "supported when using output "
                                    "format %1%. Input files have attributes %2%, %3% only "
@@ -460,13 +639,15 @@ TilerProcess::make_sampling_strategy() const
   if (_args.sampling_strategy == "MIN_DISTANCE")
     return PoissonDiskSampling{ _args.max_points_per_node };
   if (_args.sampling_strategy == "MIN_DISTANCE_FAST")
-    return AdaptivePoissonDiskSampling{ _args.max_points_per_node, [](int32_t node_level) -> float {
-                                         if (node_level < 0)
-                                           return 0.25f;
-                                         if (node_level < 1)
-                                           return 0.5f;
-                                         return 1.f;
-                                       } };
+    return AdaptivePoissonDiskSampling{ _args.max_points_per_node,
+                                        [](int32_t node_level) -> float {
+                                          if (node_level < 0)
+                                            return 0.25f;
+                                          if (node_level < 1)
+                                            return 0.5f;
+                                          return 1.f;
+                                        },
+                                        _args.adaptive_sampling_budget };
   throw std::invalid_argument{
     (boost::format("Unrecognized sampling strategy %1%") % _args.sampling_strategy).str()
   };
@@ -492,12 +673,34 @@ TilerProcess::make_tiler(bool shift_points_to_center,
   tiler_meta_parameters.shift_points_to_origin = shift_points_to_center;
   tiler_meta_parameters.thread_count = thread_count;
 
+  // Progressive ordering only pays off for formats that viewers stream point by point. It does no
+  // harm to the other formats, so it is used if any of the output formats benefits from it
+  const auto output_formats = all_output_formats();
+  const auto output_format_supports_progressive_ordering = std::any_of(
+    std::begin(output_formats), std::end(output_formats), [](OutputFormat output_format) {
+      return is_3d_tiles_format(output_format) || output_format == OutputFormat::BIN ||
+             output_format == OutputFormat::BINZ || output_format == OutputFormat::PACKED;
+    });
+  if (_args.progressive_point_ordering && !output_format_supports_progressive_ordering) {
+    util::write_log("warning: Progressive point ordering is only supported for 3DTILES and BIN "
+                    "output, points are written in Morton order instead\n");
+  }
+  tiler_meta_parameters.progressive_point_ordering =
+    _args.progressive_point_ordering && output_format_supports_progressive_ordering;
+
+  // Truncating positions to 32-bit would also cost the precision of the other output formats, so it
+  // is only done if 3D Tiles is the only output format
+  const auto truncate_positions_to_32_bit =
+    shift_points_to_center &&
+    std::all_of(std::begin(output_formats), std::end(output_formats), is_3d_tiles_format);
+
   MultiReaderPointSource point_source{ _args.sources, _args.errors_to_ignore };
   point_source.add_transformation(
     [this,
      srs_transform,
      cubic_bounds = dataset_metadata.total_bounds_cubic(),
-     shift_points_to_center](util::Range<PointBuffer::PointIterator> points) {
+     shift_points_to_center,
+     truncate_positions_to_32_bit](util::Range<PointBuffer::PointIterator> points) {
       srs_transform->transformPointsTo(TargetSRS::CesiumWorld, points);
 
       // 3D Tiles is not strictly lossless as it stores 32-bit floating point
@@ -509,9 +712,11 @@ TilerProcess::make_tiler(bool shift_points_to_center,
         for (auto point_ref : points) {
           auto& position = point_ref.position();
           position -= cubic_bounds.getCenter();
-          position.x = static_cast<float>(position.x);
-          position.y = static_cast<float>(position.y);
-          position.z = static_cast<float>(position.z);
+          if (truncate_positions_to_32_bit) {
+            position.x = static_cast<float>(position.x);
+            position.y = static_cast<float>(position.y);
+            position.z = static_cast<float>(position.z);
+          }
         }
       }
     });
@@ -560,14 +765,85 @@ TilerProcess::run()
   progress_reporter.register_progress_counter<size_t>(progress::LOADING, total_points_count);
   progress_reporter.register_progress_counter<size_t>(progress::INDEXING, total_points_count);
 
-  auto persistence = make_persistence(_args.output_format,
-                                      _args.output_directory,
-                                      _input_attributes,
-                                      _output_attributes,
-                                      _args.rgb_mapping,
-                                      _args.spacing,
-                                      dataset_metadata.total_bounds_cubic());
-  const auto shift_points_to_center = (_args.output_format == OutputFormat::CZM_3DTILES);
+  const auto output_formats = all_output_formats();
+  const auto writes_3d_tiles =
+    std::any_of(std::begin(output_formats), std::end(output_formats), is_3d_tiles_format);
+  const auto writes_3d_tiles_glb =
+    std::find(std::begin(output_formats), std::end(output_formats),
+              OutputFormat::CZM_3DTILES_GLB) != std::end(output_formats);
+
+  if (_args.quantize_pnts && !writes_3d_tiles) {
+    util::write_log("warning: Quantized positions and normals are only supported for 3DTILES "
+                    "and 3DTILES_GLB output, the option is ignored\n");
+  }
+  if (_args.implicit_tiling && !writes_3d_tiles) {
+    util::write_log("warning: Implicit tiling is only supported for 3DTILES and 3DTILES_GLB "
+                    "output, the option is ignored\n");
+  }
+  if (_args.meshopt_compression && !writes_3d_tiles_glb) {
+    util::write_log("warning: Meshopt compression is only supported for 3DTILES_GLB output, the "
+                    "option is ignored\n");
+  }
+
+  // 3D Tiles stores 32-bit positions, so all points are shifted to the center of the point cloud
+  const auto shift_points_to_center = writes_3d_tiles;
+  const auto make_persistence_for_format = [&](OutputFormat format) {
+    const auto output_directory = output_directory_for_format(format);
+    fs::create_directories(output_directory);
+    return make_persistence(format,
+                            output_directory,
+                            _input_attributes,
+                            output_attributes_for_format(format),
+                            _args.rgb_mapping,
+                            _args.quantize_pnts ? PNTSEncoding::Quantized : PNTSEncoding::Float,
+                            _args.implicit_tiling ? TilesetLayout::Implicit
+                                                  : TilesetLayout::Explicit,
+                            _args.meshopt_compression ? GLBCompression::Meshopt
+                                                      : GLBCompression::None,
+                            _args.binz_codec,
+                            _args.binz_codec_level,
+                            _args.spacing,
+                            cubic_bounds);
+  };
+
+  // Declared before the persistence, so that files which the persistence writes when it is
+  // destroyed are still written in the background and waited for
+  std::optional<AsyncFileWriter> file_writer;
+  if (_args.async_file_writes) {
+    file_writer.emplace();
+    set_async_file_writer(&*file_writer);
+    util::write_log(concat("Writing node files asynchronously using ",
+                           (file_writer->backend() == AsyncFileWriter::Backend::IOUring)
+                             ? "io_uring"
+                             : "a thread pool",
+                           "\n"));
+  }
+
+  auto persistence = [&]() {
+    if (output_formats.size() == 1) {
+      return make_persistence_for_format(_args.output_format);
+    }
+
+    // All formats are written from a single tiling pass. Formats other than 3D Tiles get their
+    // points moved back from the center of the point cloud
+    std::vector<PointsPersistence> sinks, shifted_sinks;
+    std::vector<std::string> format_names;
+    for (auto format : output_formats) {
+      auto& target_sinks =
+        (shift_points_to_center && !is_3d_tiles_format(format)) ? shifted_sinks : sinks;
+      target_sinks.push_back(make_persistence_for_format(format));
+      format_names.push_back(util::to_string(format));
+    }
+    util::write_log(concat("Writing output formats ",
+                           boost::algorithm::join(format_names, ", "),
+                           " in a single pass\n"));
+    return PointsPersistence{ TeePersistence{
+      std::move(sinks),
+      std::move(shifted_sinks),
+      shift_points_to_center ? cubic_bounds.getCenter() : Vector3<double>{ 0, 0, 0 },
+      (_args.output_directory / TEE_CACHE_DIRECTORY).string(),
+      _input_attributes } };
+  }();
 
 const auto max_depth =
     (_args.max_depth <= 0)
@@ -576,6 +852,10 @@ const auto max_depth =
                                                 // results in only root level being created...
 
   util::write_log(concat("Using ", _args.sampling_strategy, " sampling\n"));
+  if (_args.sampling_strategy == "MIN_DISTANCE_FAST" && _args.adaptive_sampling_budget > 0.f) {
+    util::write_log(
+      concat("Adaptive sampling budget: ", _args.adaptive_sampling_budget, " points per sample\n"));
+  }
   auto sampling_strategy = make_sampling_strategy();
 
   auto tiler = make_tiler(shift_points_to_center,
@@ -596,6 +876,11 @@ const auto max_depth =
   const auto indexing_start = std::chrono::high_resolution_clock::now();
 
   const auto num_processed_points = tiler.run();
+  if (file_writer) {
+    if (const auto failed_writes = file_writer->wait_for_all()) {
+      util::write_log(concat("warning: ", failed_writes, " node files could not be written\n"));
+    }
+  }
 
   const auto indexing_end = std::chrono::high_resolution_clock::now();
   const auto indexing_duration =
@@ -608,20 +893,43 @@ const auto max_depth =
 
   write_properties_json(_args.output_directory, cubic_bounds, _args.spacing, stats);
 
-  if (_args.output_format == OutputFormat::ENTWINE_LAS ||
-      _args.output_format == OutputFormat::ENTWINE_LAZ) {
+  for (auto output_format : output_formats) {
+    if (!is_entwine_format(output_format))
+      continue;
+
     EptJson ept_json;
     ept_json.bounds = cubic_bounds;
     ept_json.conforming_bounds = cubic_bounds;
-    ept_json.data_type =
-      (_args.output_format == OutputFormat::ENTWINE_LAZ) ? EntwineFormat::LAZ : EntwineFormat::LAS;
+    switch (output_format) {
+      case OutputFormat::ENTWINE_LAZ:
+        ept_json.data_type = EntwineFormat::LAZ;
+        break;
+      case OutputFormat::ENTWINE_BIN:
+        ept_json.data_type = EntwineFormat::Binary;
+        break;
+      default:
+        ept_json.data_type = EntwineFormat::LAS;
+        break;
+    }
     ept_json.hierarchy_type = "json";
     ept_json.points = num_processed_points;
-    ept_json.schema = point_attributes_to_ept_schema(_output_attributes);
+    ept_json.schema = point_attributes_to_ept_schema(output_attributes_for_format(output_format),
+                                                     ept_json.data_type);
     ept_json.span = _args.spacing;
     // ept_json.srs = ...;
     ept_json.version = "1.0.0";
-    write_ept_json(_args.output_directory / "ept.json", ept_json);
+    write_ept_json(output_directory_for_format(output_format) / "ept.json", ept_json);
+  }
+
+  if (_previous_output_removal.valid()) {
+    if (_previous_output_removal.wait_for(std::chrono::seconds{ 0 }) !=
+        std::future_status::ready) {
+      util::write_log("Waiting for the removal of the previous output\n");
+    }
+    if (const auto failed_removals = _previous_output_removal.get()) {
+      util::write_log(concat(
+        "warning: ", failed_removals, " files of the previous output could not be removed\n"));
+    }
   }
 
   const auto total_indexed_count = progress_reporter.get_progress<size_t>(progress::INDEXING);
@@ -11,6 +11,7 @@
 
 #include <cstdint>
 #include <experimental/filesystem>
+#include <future>
 #include <optional>
 #include <string>
 #include <vector>
@@ -31,12 +32,28 @@ struct TilerProcess
     size_t internal_cache_size;
     size_t max_batch_read_size;
     OutputFormat output_format;
+    // Formats that are written in the same run as 'output_format'. If there are any, every format
+    // is written to a subdirectory of 'output_directory' that is named after the format
+    std::vector<OutputFormat> additional_output_formats;
     RGBMapping rgb_mapping;
+    bool quantize_pnts;
+    bool implicit_tiling;
+    bool meshopt_compression;
+    BinaryCodec binz_codec;
+    int binz_codec_level;
     std::string sampling_strategy;
+    float adaptive_sampling_budget;
+    bool progressive_point_ordering;
     std::string executable_path;
     std::optional<std::string> source_projection;
     std::optional<unit::byte> cache_size;
     bool use_compression;
+    // Write node files in the background (through io_uring on Linux) instead of from the tiling
+    // threads
+    bool async_file_writes;
+    // Move the output of a previous run aside and remove it while tiling, instead of removing it
+    // before tiling starts
+    bool background_cleanup;
     uint32_t max_memory_usage_MiB;
     util::IgnoreErrors errors_to_ignore;
     TilingStrategy tiling_strategy;
@@ -66,7 +83,13 @@ private:
   UIState _ui_state;
   TerminalUI _ui;
 
+  // Removal of the output of a previous run in the background. Invalid if there is none
+  std::future<size_t> _previous_output_removal;
+
   void prepare();
+  std::vector<OutputFormat> all_output_formats() const;
+  fs::path output_directory_for_format(OutputFormat format) const;
+  PointAttributes output_attributes_for_format(OutputFormat format) const;
   void cleanUp();
   DatasetMetadata calculate_dataset_metadata(const SRSTransformHelper* transform);
   std::variant<FixedThreadCount, AdaptiveThreadCount> calculate_actual_thread_counts(
@@ -3,20 +3,27 @@
 #include "OctreeAlgorithms.h"
 #include "datastructures/DynamicMortonIndex.h"
 #include "datastructures/MortonIndex.h"
+#include "datastructures/OctreeNodeIndex.h"
 #include "math/AABB.h"
+#include "tiling/TilingContext.h"
 
+#include <memory>
 #include <unordered_map>
 
 namespace octree {
 
 struct NodeStructure
 {
-  std::string name;
+  OctreeNodeIndex64 index;
   MortonIndex64 morton_index;
   AABB bounds;
   int32_t level;
   float max_spacing;
   uint32_t max_depth;
+  // Lookup tables of a node that became a new root node because its points were too deep for the
+  // MortonIndex. Built once when the new root is created and shared by all nodes below it. Not set
+  // for the root node of the tiling run, whose TilingContext is owned by the tiling algorithm
+  std::shared_ptr<const TilingContext> tiling_context;
 };
 
 using NodeData = std::vector<IndexedPoint64>;
@@ -13,6 +13,10 @@
 #include <unordered_set>
 #include <vector>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 /**
  * A reference to a cached point in a PointBuffer, together with the points
  * octree index
@@ -235,8 +239,7 @@ filter_points_for_octree_node(
   Iter points_end,
   MortonIndex<MaxLevels> node_key,
   int32_t node_level,
-  const AABB& root_bounds,
-  float spacing_at_root,
+  const TilingContext& tiling_context,
   SamplingBehaviour sampling_behaviour,
   SamplingStrategy& sampling_strategy)
 {
@@ -246,8 +249,7 @@ filter_points_for_octree_node(
                        points_end,
                        node_key,
                        node_level,
-                       root_bounds,
-                       spacing_at_root,
+                       tiling_context,
                        sampling_behaviour);
 }
 
@@ -285,4 +287,100 @@ partition_points_into_child_octants(Iter begin,
   }
 
   return partitions;
-}
\ No newline at end of file
+}
+
+namespace detail {
+/**
+ * Returns the index of the most significant set bit of 'value', which must not be zero
+ */
+inline uint32_t
+highest_set_bit(unsigned long long value)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return static_cast<uint32_t>(index);
+#else
+  return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+/**
+ * Returns the first level at which the two given Morton indices have different octants, or
+ * 'MaxLevels' if both indices are equal
+ */
+template<unsigned int MaxLevels>
+uint32_t
+first_differing_level(const MortonIndex<MaxLevels>& l, const MortonIndex<MaxLevels>& r)
+{
+  const auto difference = l.get() ^ r.get();
+  if (!difference)
+    return MaxLevels;
+
+  uint32_t highest_differing_bit;
+  if constexpr (sizeof(difference) <= sizeof(unsigned long long)) {
+    highest_differing_bit = highest_set_bit(static_cast<unsigned long long>(difference));
+  } else {
+    const auto high_bits = static_cast<unsigned long long>(difference >> 64);
+    const auto low_bits = static_cast<unsigned long long>(difference);
+    highest_differing_bit =
+      high_bits ? 64 + highest_set_bit(high_bits) : highest_set_bit(low_bits);
+  }
+
+  // The octant of level 0 is stored in the most significant bits
+  return MaxLevels - 1 - highest_differing_bit / 3;
+}
+} // namespace detail
+
+/**
+ * Copies a range of indexed points that is sorted in ascending order by MortonIndex to 'out' in
+ * progressive order, i.e. so that every prefix of the output is a spatially uniform subsample of
+ * all points. Each point is assigned the coarsest level at which it is the first point of its cell
+ * in Morton order, which is the first level at which its MortonIndex differs from its predecessor.
+ * Points are then ordered by this level, which is stable, so the first N points contain exactly one
+ * point for each occupied cell down to some level, and points of the same level remain in Morton
+ * order. Viewers can thus stop reading the points of a node early and still get a coarser version
+ * of the node instead of a partial one.
+ *
+ * This takes linear time (a counting sort over the levels) and requires 'out' to be a random access
+ * iterator with room for all points in the input range. Returns the end of the output range
+ *
+ * 'Iter' has to dereference to IndexedPoint<N> for arbitrary N
+ */
+template<typename Iter, typename OutIter>
+OutIter
+order_points_progressively(Iter begin, Iter end, OutIter out)
+{
+  if (begin == end)
+    return out;
+
+  using MortonIndex_t = std::decay_t<decltype(begin->morton_index)>;
+  constexpr auto MaxLevels = MortonIndex_t::MaxLevels;
+
+  const auto for_each_level = [begin, end](auto func) {
+    // The first point is the first point of its cell at all levels
+    auto previous_key = begin->morton_index;
+    func(*begin, 0u);
+    for (auto iter = std::next(begin); iter != end; ++iter) {
+      func(*iter, detail::first_differing_level(previous_key, iter->morton_index));
+      previous_key = iter->morton_index;
+    }
+  };
+
+  // Levels range from 0 to 'MaxLevels' (duplicate points), so we need 'MaxLevels + 1' buckets
+  std::array<size_t, MaxLevels + 1> bucket_offsets{};
+  for_each_level([&bucket_offsets](const auto&, uint32_t level) { ++bucket_offsets[level]; });
+
+  size_t offset = 0;
+  for (auto& bucket_offset : bucket_offsets) {
+    const auto bucket_size = bucket_offset;
+    bucket_offset = offset;
+    offset += bucket_size;
+  }
+
+  for_each_level([&bucket_offsets, out](const auto& indexed_point, uint32_t level) {
+    out[static_cast<std::ptrdiff_t>(bucket_offsets[level]++)] = indexed_point;
+  });
+
+  return out + static_cast<std::ptrdiff_t>(offset);
+}
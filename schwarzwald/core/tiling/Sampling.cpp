@@ -1,7 +1,4 @@
 #include "tiling/Sampling.h"
-#include "tiling/Node.h"
-
-#include <types/type_util.h>
 
 RandomSortedGridSampling::RandomSortedGridSampling(size_t max_points_per_node)
   : _max_points_per_node(max_points_per_node)
@@ -15,27 +12,114 @@ PoissonDiskSampling::PoissonDiskSampling(size_t max_points_per_node)
   : _max_points_per_node(max_points_per_node)
 {}
 
+/**
+ * Minimum number of candidate points that have to be sampled on a level before the measured
+ * statistics of this level are used to adjust its density
+ */
+constexpr static uint64_t MIN_CANDIDATES_FOR_MEASURED_DENSITY = 100'000;
+/**
+ * Lower bound for the density of a level, i.e. at least every 256th point is analyzed
+ */
+constexpr static float MIN_MEASURED_DENSITY = 1.f / 256.f;
+
+AdaptivePoissonDiskSampling::LevelStatistics::LevelStatistics()
+{
+  for (size_t level = 0; level < MaxLevels; ++level) {
+    recorded_candidate_points[level] = 0;
+    recorded_selected_points[level] = 0;
+  }
+  measured_candidate_points.fill(0);
+  measured_selected_points.fill(0);
+}
+
 AdaptivePoissonDiskSampling::AdaptivePoissonDiskSampling(
   size_t max_points_per_node,
-  std::function<float(int32_t)> density_per_level)
+  std::function<float(int32_t)> density_per_level,
+  float analysis_budget)
   : _max_points_per_node(max_points_per_node)
   , _density_per_level(density_per_level)
+  , _analysis_budget(analysis_budget)
+  , _level_statistics(std::make_shared<LevelStatistics>())
 {}
 
+/**
+ * Index into the LevelStatistics arrays for the given node level. The root node has level -1, very
+ * deep levels all share the last entry
+ */
+static size_t
+level_statistics_index(int32_t node_level)
+{
+  return std::min(static_cast<size_t>(std::max(node_level + 1, 0)),
+                  AdaptivePoissonDiskSampling::LevelStatistics::MaxLevels - 1);
+}
+
+float
+AdaptivePoissonDiskSampling::density_for_level(int32_t node_level) const
+{
+  const auto fixed_density = _density_per_level(node_level);
+  if (_analysis_budget <= 0.f)
+    return fixed_density;
+
+  const auto level_idx = level_statistics_index(node_level);
+  const auto candidate_points = _level_statistics->measured_candidate_points[level_idx];
+  const auto selected_points = _level_statistics->measured_selected_points[level_idx];
+  if (candidate_points < MIN_CANDIDATES_FOR_MEASURED_DENSITY || !selected_points)
+    return fixed_density;
+
+  const auto candidates_per_selected_point =
+    static_cast<double>(candidate_points) / static_cast<double>(selected_points);
+  if (candidates_per_selected_point <= _analysis_budget)
+    return fixed_density;
+
+  const auto measured_density =
+    static_cast<float>(_analysis_budget / candidates_per_selected_point);
+  return std::max(MIN_MEASURED_DENSITY, std::min(fixed_density, measured_density));
+}
+
+void
+AdaptivePoissonDiskSampling::record_level_statistics(int32_t node_level,
+                                                     size_t candidate_points,
+                                                     size_t selected_points)
+{
+  if (_analysis_budget <= 0.f)
+    return;
+
+  const auto level_idx = level_statistics_index(node_level);
+  _level_statistics->recorded_candidate_points[level_idx].fetch_add(candidate_points,
+                                                                    std::memory_order_relaxed);
+  _level_statistics->recorded_selected_points[level_idx].fetch_add(selected_points,
+                                                                   std::memory_order_relaxed);
+}
+
+void
+AdaptivePoissonDiskSampling::update_measured_statistics()
+{
+  // The sums of all recorded counters do not depend on the order in which they were recorded
+  for (size_t level = 0; level < LevelStatistics::MaxLevels; ++level) {
+    _level_statistics->measured_candidate_points[level] =
+      _level_statistics->recorded_candidate_points[level].load(std::memory_order_relaxed);
+    _level_statistics->measured_selected_points[level] =
+      _level_statistics->recorded_selected_points[level].load(std::memory_order_relaxed);
+  }
+}
+
+void
+update_measured_statistics(SamplingStrategy& sampling_strategy)
+{
+  if (auto adaptive_sampling = std::get_if<AdaptivePoissonDiskSampling>(&sampling_strategy)) {
+    adaptive_sampling->update_measured_statistics();
+  }
+}
+
 int32_t
 required_morton_index_depth(const SamplingStrategy& sampling_strategy,
                             int32_t node_level,
-                            const octree::NodeStructure& root_node)
+                            const TilingContext& tiling_context)
 {
   return std::visit(
-    overloaded{
-      [node_level, &root_node](const RandomSortedGridSampling&) -> int32_t {
-        return octree::get_node_level_to_sample_from(node_level, root_node);
-      },
-      [node_level, &root_node](const GridCenterSampling&) -> int32_t {
-        return octree::get_node_level_to_sample_from(node_level, root_node);
-      },
-      [node_level](const PoissonDiskSampling&) -> int32_t { return node_level; },
-      [node_level](const AdaptivePoissonDiskSampling&) -> int32_t { return node_level; } },
+    [node_level, &tiling_context](const auto& strategy) -> int32_t {
+      return required_morton_index_depth<std::decay_t<decltype(strategy)>>(node_level,
+                                                                           tiling_context);
+    },
     sampling_strategy);
-}
\ No newline at end of file
+}
@@ -4,14 +4,16 @@
 #include "datastructures/MortonIndex.h"
 #include "datastructures/SparseGrid.h"
 #include "math/AABB.h"
+#include "tiling/TilingContext.h"
 
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <random>
 #include <unordered_set>
 #include <variant>
-
-namespace octree {
-struct NodeStructure;
-}
+#include <vector>
 
 /**
  * Different behaviours for the SamplingStrategies based on the number of points
@@ -36,112 +38,64 @@ enum class SamplingBehaviour
  */
 struct RandomSortedGridSampling
 {
+  /**
+   * Sampling happens on the grid of Morton indices at the candidate level of a node
+   */
+  constexpr static bool SamplesOnMortonGrid = true;
+
   explicit RandomSortedGridSampling(size_t max_points_per_node);
 
-  template<typename Iter, unsigned int MaxLevels>
-  Iter sample_points(
+  template<typename Iter, typename SelectedOutIter, typename RejectedOutIter, unsigned int MaxLevels>
+  std::pair<SelectedOutIter, RejectedOutIter> sample_points_into(
     Iter begin,
     Iter end,
+    SelectedOutIter selected_out,
+    RejectedOutIter rejected_out,
     MortonIndex<MaxLevels> node_key,
     int32_t node_level,
-    const AABB& root_bounds,
-    float spacing_at_root,
+    const TilingContext& tiling_context,
     SamplingBehaviour sampling_behaviour = SamplingBehaviour::TakeAllWhenCountBelowMaxPoints)
   {
     if (sampling_behaviour == SamplingBehaviour::TakeAllWhenCountBelowMaxPoints) {
       const auto num_points_to_process = static_cast<size_t>(std::distance(begin, end));
       if (num_points_to_process <= _max_points_per_node) {
-        return end;
+        return { std::move(begin, end, selected_out), rejected_out };
       }
     }
 
-    const auto spacing_at_this_node = spacing_at_root / std::pow(2, node_level + 1);
     // candidate_level_in_octree is the last level in the octree at which the
-    // node sidelength is >= spacing we use floor() here because this guarantees
-    // that we always get a node with sidelength
-    // >= spacing. Sadly this means that there might be edge cases where the
-    // spacing is just a bit too large to fit into a node (e.g. sidelength = 2,
-    // spacing = 2.1) If we don't want that, we could use round() which resolves
-    // these cases while at the same time dropping the guarantee for >= spacing.
-    // Also, round(log(...)) might not split fair. If there are sidelengths 4
-    // and 2, we would expect that spacing >= 3 rounds to node with sidelength
-    // 4, while < 3 rounds to 2. However, log_2(4/2.9)~=0.464, which will still
-    // round to the larger node
-    const auto candidate_level_in_octree =
-      std::max(-1,
-               (int)std::floor(std::log2f(root_bounds.extent().x / spacing_at_this_node)) -
-                 1); // the root node (whole octree) is level '-1', so level
-                     // 0 has a sidelength of half the max octree, hence we
-                     // have to subtract one here
-    auto partition_point = begin;
-
-    const auto stable_partition_at_level = [&](int level) {
-      // TODO stable_partition looks at all elements, but since the elements are
-      // sorted, once we found the first point in a grid cell, we can skip to
-      // the next grid cell. We know the index of the next grid cell (just
-      // increment the level of the current cell by one)
-      // std::unordered_set<uint64_t> taken_indices;
-      // partition_point =
-      //   std::stable_partition(begin, end, [this, &taken_indices, level](const
-      //   auto& indexed_point) {
-      //     if (taken_indices.size() >= _max_points_per_node)
-      //       return false;
-
-      //     const auto significant_bits =
-      //     indexed_point.morton_index.truncate_to_level(level); if
-      //     (taken_indices.find(significant_bits.get()) != taken_indices.end())
-      //       return false;
-
-      //     taken_indices.insert(significant_bits.get());
-      //     return true;
-      //   });
-
-      size_t num_taken_indices = 0;
-      partition_point = stable_partition_with_jumps(
-        begin, end, [this, &num_taken_indices, level](const auto curBegin, const auto end) {
-          // Take the first point, then look for the next point that falls
-          // into a different cell up to the current level
-          const auto taken_iter = curBegin;
-          ++num_taken_indices;
-          // if (num_taken_indices == _max_points_per_node) {
-          //   return std::make_pair(taken_iter, end);
-          // }
-
-          const auto taken_cell_idx = taken_iter->morton_index.truncate_to_level(level);
-          // const auto next_iter =
-          //   std::find_if(taken_iter + 1, end, [taken_cell_idx, level](const
-          //   auto& other_point) {
-          //     return
-          //     other_point.morton_index.truncate_to_level(level).get() >
-          //            taken_cell_idx.get();
-          //   });
-          const auto next_iter = std::partition_point(
-            taken_iter + 1, end, [taken_cell_idx, level](const auto& other_point) {
-              return other_point.morton_index.truncate_to_level(level).get() <=
-                     taken_cell_idx.get();
-            });
-
-          return std::make_pair(taken_iter, next_iter);
-        });
-    };
+    // node sidelength is >= spacing. Sadly this means that there might be edge
+    // cases where the spacing is just a bit too large to fit into a node (e.g.
+    // sidelength = 2, spacing = 2.1)
+    const auto candidate_level_in_octree = tiling_context.candidate_level(node_level);
 
-    // Dirty, but we need a special function to partition at root (level -1) if
+    // Dirty, but we need a special case for sampling at root (level -1) if
     // this situation ever occurs. We just take the first point and are done
     // with it
-    const auto partition_at_root = [&]() {
-      if (begin == end)
-        return;
-
-      ++partition_point;
-    };
-
     if (candidate_level_in_octree == -1) {
-      partition_at_root();
-    } else {
-      stable_partition_at_level(candidate_level_in_octree);
+      if (begin == end)
+        return { selected_out, rejected_out };
+      selected_out = std::move(begin, begin + 1, selected_out);
+      rejected_out = std::move(begin + 1, end, rejected_out);
+      return { selected_out, rejected_out };
     }
 
-    return partition_point;
+    const auto level = candidate_level_in_octree;
+    return partition_copy_with_jumps(
+      begin, end, selected_out, rejected_out, [level](const auto cur_begin, const auto cur_end) {
+        // Take the first point, then look for the next point that falls
+        // into a different cell up to the current level. Since the points
+        // are sorted, we can skip over the whole cell with a binary search
+        const auto taken_iter = cur_begin;
+        const auto taken_cell_idx = taken_iter->morton_index.truncate_to_level(level);
+        const auto next_iter = std::partition_point(
+          taken_iter + 1, cur_end, [taken_cell_idx, level](const auto& other_point) {
+            return other_point.morton_index.truncate_to_level(level).get() <=
+                   taken_cell_idx.get();
+          });
+
+        return std::make_pair(taken_iter, next_iter);
+      });
   }
 
 private:
@@ -154,43 +108,50 @@ private:
  */
 struct GridCenterSampling
 {
+  /**
+   * Sampling happens on the grid of Morton indices at the candidate level of a node
+   */
+  constexpr static bool SamplesOnMortonGrid = true;
+
   explicit GridCenterSampling(size_t max_points_per_node);
 
-  template<typename Iter, unsigned int MaxLevels>
-  Iter sample_points(
+  template<typename Iter, typename SelectedOutIter, typename RejectedOutIter, unsigned int MaxLevels>
+  std::pair<SelectedOutIter, RejectedOutIter> sample_points_into(
     Iter begin,
     Iter end,
+    SelectedOutIter selected_out,
+    RejectedOutIter rejected_out,
     MortonIndex<MaxLevels> node_key,
     int32_t node_level,
-    const AABB& root_bounds,
-    float spacing_at_root,
+    const TilingContext& tiling_context,
     SamplingBehaviour sampling_behaviour = SamplingBehaviour::TakeAllWhenCountBelowMaxPoints)
   {
     if (sampling_behaviour == SamplingBehaviour::TakeAllWhenCountBelowMaxPoints) {
       const auto num_points_to_process = static_cast<size_t>(std::distance(begin, end));
       if (num_points_to_process <= _max_points_per_node) {
-        return end;
+        return { std::move(begin, end, selected_out), rejected_out };
       }
     }
 
-    const auto spacing_at_this_node = spacing_at_root / std::pow(2, node_level + 1);
-    const auto candidate_level_in_octree =
-      std::max(-1, (int)std::floor(std::log2f(root_bounds.extent().x / spacing_at_this_node)) - 1);
-    auto partition_point = begin;
+    const auto candidate_level_in_octree = tiling_context.candidate_level(node_level);
 
     if (candidate_level_in_octree == -1) {
-      return ++partition_point;
+      if (begin == end)
+        return { selected_out, rejected_out };
+      selected_out = std::move(begin, begin + 1, selected_out);
+      rejected_out = std::move(begin + 1, end, rejected_out);
+      return { selected_out, rejected_out };
     }
-    size_t num_selected_points = 0;
 
     // TODO Can we write this method in a way that it prevents the out-of-bounds
     // errors?
 
-    return stable_partition_with_jumps(
+    return partition_copy_with_jumps(
       begin,
       end,
-      [this, candidate_level_in_octree, &num_selected_points, &root_bounds](const auto cur_begin,
-                                                                            const auto cur_end) {
+      selected_out,
+      rejected_out,
+      [candidate_level_in_octree, &tiling_context](const auto cur_begin, const auto cur_end) {
         /*
         HACK truncate_to_level shifts down but it should just mask away the
         lower levels. This causes bugs because the new key starts at
@@ -218,8 +179,8 @@ struct GridCenterSampling
           });
 
         // Find the point closest to the center of the current cell bounds
-        const auto current_cell_bounds = get_bounds_from_morton_index(
-          cur_begin->morton_index, root_bounds, candidate_level_in_octree + 1);
+        const auto current_cell_bounds =
+          tiling_context.node_bounds(cur_begin->morton_index, candidate_level_in_octree);
         const auto current_cell_center = current_cell_bounds.getCenter();
 
         const auto min_point = std::min_element(
@@ -231,11 +192,6 @@ struct GridCenterSampling
             return l_dist_to_center < r_dist_to_center;
           });
 
-        // ++num_selected_points;
-        // if (num_selected_points == _max_points_per_node) {
-        //   return std::make_pair(min_point, cur_end);
-        // }
-
         return std::make_pair(min_point, points_in_same_cell_end);
       });
   }
@@ -249,42 +205,41 @@ private:
  */
 struct PoissonDiskSampling
 {
+  /**
+   * Sampling uses its own grid instead of the Morton indices, so the Morton indices of the node
+   * level suffice
+   */
+  constexpr static bool SamplesOnMortonGrid = false;
+
   explicit PoissonDiskSampling(size_t max_points_per_node);
 
-  template<typename Iter, unsigned int MaxLevels>
-  Iter sample_points(
+  template<typename Iter, typename SelectedOutIter, typename RejectedOutIter, unsigned int MaxLevels>
+  std::pair<SelectedOutIter, RejectedOutIter> sample_points_into(
     Iter begin,
     Iter end,
+    SelectedOutIter selected_out,
+    RejectedOutIter rejected_out,
     MortonIndex<MaxLevels> node_key,
     int32_t node_level,
-    const AABB& root_bounds,
-    float spacing_at_root,
+    const TilingContext& tiling_context,
     SamplingBehaviour sampling_behaviour = SamplingBehaviour::TakeAllWhenCountBelowMaxPoints)
   {
     if (sampling_behaviour == SamplingBehaviour::TakeAllWhenCountBelowMaxPoints) {
       const auto num_points_to_process = static_cast<size_t>(std::distance(begin, end));
       if (num_points_to_process <= _max_points_per_node) {
-        return end;
+        return { std::move(begin, end, selected_out), rejected_out };
       }
     }
 
-    const auto bounds_at_this_node =
-      get_bounds_from_morton_index(node_key, root_bounds, node_level + 1);
-    const auto spacing_at_this_node = spacing_at_root / std::pow(2, node_level + 1);
+    const auto bounds_at_this_node = tiling_context.node_bounds(node_key, node_level);
+    const auto spacing_at_this_node = tiling_context.spacing_at_level(node_level);
     SparseGrid sparse_grid{ bounds_at_this_node, static_cast<float>(spacing_at_this_node) };
-    size_t num_points_taken = 0;
-
-    return std::stable_partition(
-      begin, end, [this, &num_points_taken, &sparse_grid](const auto& point) {
-        // if (num_points_taken == _max_points_per_node)
-        //   return false;
-
-        const auto accepted = sparse_grid.add(point.point_reference.position());
-        if (!accepted)
-          return false;
 
-        ++num_points_taken;
-        return true;
+    return partition_copy_with_jumps(
+      begin, end, selected_out, rejected_out, [&sparse_grid](const auto cur, const auto) {
+        const auto next = cur + 1;
+        const auto accepted = sparse_grid.add(cur->point_reference.position());
+        return accepted ? std::make_pair(cur, next) : std::make_pair(next, next);
       });
   }
 
@@ -295,62 +250,139 @@ private:
 
 /**
  * Poisson disk sampling, but it can skip points entirely depending on a density
- * function based on the level of the sampled node
+ * function based on the level of the sampled node.
+ *
+ * If an analysis budget is given, the density of each level is additionally
+ * driven by measurements: For each level, the number of candidate points (the
+ * points that were analyzed) and the number of selected points are recorded.
+ * Once the ratio of candidates to selected points on a level exceeds the
+ * budget, points on this level are skipped so that on average only
+ * 'analysis_budget' points are analyzed per selected point. Dense levels thus
+ * trade quality for speed, approaching RANDOM_GRID sampling for small budgets
  */
 struct AdaptivePoissonDiskSampling
 {
+  /**
+   * Per-level counters of candidate and selected points. These are shared between all copies of
+   * the sampling strategy. The recorded counters are updated concurrently from all tiling threads,
+   * while the density is computed from the measured counters, a snapshot that only changes between
+   * batches. All nodes of a batch thus use the same density, independent of the order in which the
+   * nodes are sampled
+   */
+  struct LevelStatistics
+  {
+    constexpr static size_t MaxLevels = 64;
+
+    std::array<std::atomic<uint64_t>, MaxLevels> recorded_candidate_points;
+    std::array<std::atomic<uint64_t>, MaxLevels> recorded_selected_points;
+    std::array<uint64_t, MaxLevels> measured_candidate_points;
+    std::array<uint64_t, MaxLevels> measured_selected_points;
+
+    LevelStatistics();
+  };
+
+  /**
+   * Sampling uses its own grid instead of the Morton indices, so the Morton indices of the node
+   * level suffice
+   */
+  constexpr static bool SamplesOnMortonGrid = false;
+
   AdaptivePoissonDiskSampling(size_t max_points_per_node,
-                              std::function<float(int32_t)> density_per_level);
+                              std::function<float(int32_t)> density_per_level,
+                              float analysis_budget = 0.f);
+
+  /**
+   * Returns the density (i.e. ratio of points that get analyzed) for the given node level, based
+   * on the density function and - if an analysis budget is set - the measured statistics of
+   * this level
+   */
+  float density_for_level(int32_t node_level) const;
+
+  /**
+   * Record that 'candidate_points' were analyzed on the given node level, of which
+   * 'selected_points' were selected
+   */
+  void record_level_statistics(int32_t node_level,
+                               size_t candidate_points,
+                               size_t selected_points);
+
+  /**
+   * Makes all statistics recorded so far visible to 'density_for_level'. Must not be called while
+   * points are sampled, e.g. only between two batches of the tiling
+   */
+  void update_measured_statistics();
 
-  template<typename Iter, unsigned int MaxLevels>
-  Iter sample_points(
+  template<typename Iter, typename SelectedOutIter, typename RejectedOutIter, unsigned int MaxLevels>
+  std::pair<SelectedOutIter, RejectedOutIter> sample_points_into(
     Iter begin,
     Iter end,
+    SelectedOutIter selected_out,
+    RejectedOutIter rejected_out,
     MortonIndex<MaxLevels> node_key,
     int32_t node_level,
-    const AABB& root_bounds,
-    float spacing_at_root,
+    const TilingContext& tiling_context,
     SamplingBehaviour sampling_behaviour = SamplingBehaviour::TakeAllWhenCountBelowMaxPoints)
   {
     if (sampling_behaviour == SamplingBehaviour::TakeAllWhenCountBelowMaxPoints) {
       const auto num_points_to_process = static_cast<size_t>(std::distance(begin, end));
       if (num_points_to_process <= _max_points_per_node) {
-        return end;
+        return { std::move(begin, end, selected_out), rejected_out };
       }
     }
 
-    const auto spacing_at_this_node = spacing_at_root / std::pow(2, node_level + 1);
-    const auto candidate_level_in_octree =
-      std::max(-1, (int)std::floor(std::log2f(root_bounds.extent().x / spacing_at_this_node)) - 1);
-    auto partition_point = begin;
+    const auto candidate_level_in_octree = tiling_context.candidate_level(node_level);
 
     if (candidate_level_in_octree == -1) {
-      return ++partition_point;
+      if (begin == end)
+        return { selected_out, rejected_out };
+      selected_out = std::move(begin, begin + 1, selected_out);
+      rejected_out = std::move(begin + 1, end, rejected_out);
+      return { selected_out, rejected_out };
     }
 
-    const auto bounds_at_this_node =
-      get_bounds_from_morton_index(node_key, root_bounds, node_level + 1);
+    const auto bounds_at_this_node = tiling_context.node_bounds(node_key, node_level);
+    const auto spacing_at_this_node = tiling_context.spacing_at_level(node_level);
     SparseGrid sparse_grid{ bounds_at_this_node, static_cast<float>(spacing_at_this_node) };
 
     // Density determines the ratio of points that will be analyzed, e.g. a
     // density of 0.1 means 10% of all points get analyzed, or in other words 9
     // out of 10 points are ignored
-    const auto nth_point = static_cast<uint32_t>(std::round(1 / _density_per_level(node_level)));
+    const auto nth_point = static_cast<uint32_t>(std::round(1 / density_for_level(node_level)));
     uint32_t point_counter = nth_point - 1; // Guarantees that at least one point is analyzed
+    size_t num_analyzed_points = 0;
+    size_t num_selected_points = 0;
 
-    return std::stable_partition(
-      begin, end, [this, &point_counter, nth_point, &sparse_grid](const auto& point) {
+    const auto selected_and_rejected_end = partition_copy_with_jumps(
+      begin,
+      end,
+      selected_out,
+      rejected_out,
+      [&point_counter, &num_analyzed_points, &num_selected_points, nth_point, &sparse_grid](
+        const auto cur, const auto) {
+        const auto next = cur + 1;
         if (++point_counter == nth_point) {
           point_counter = 0;
-          return sparse_grid.add(point.point_reference.position());
+          ++num_analyzed_points;
+          if (sparse_grid.add(cur->point_reference.position())) {
+            ++num_selected_points;
+            return std::make_pair(cur, next);
+          }
         }
-        return false;
+        return std::make_pair(next, next);
       });
+
+    // Points that were skipped because of the density are no candidates, otherwise the measured
+    // ratio would shrink along with the density
+    record_level_statistics(node_level, num_analyzed_points, num_selected_points);
+
+    return selected_and_rejected_end;
   }
 
 private:
   size_t _max_points_per_node;
   std::function<float(int32_t)> _density_per_level;
+  float _analysis_budget;
+  std::shared_ptr<LevelStatistics> _level_statistics;
 };
 
 /**
@@ -363,38 +395,40 @@ struct ZOrderNextSampling
     : _max_points_per_node(max_points_per_node)
   {}
 
-  template<typename Iter, unsigned int MaxLevels>
-  Iter sample_points(
+  template<typename Iter, typename SelectedOutIter, typename RejectedOutIter, unsigned int MaxLevels>
+  std::pair<SelectedOutIter, RejectedOutIter> sample_points_into(
     Iter begin,
     Iter end,
+    SelectedOutIter selected_out,
+    RejectedOutIter rejected_out,
     MortonIndex<MaxLevels> node_key,
     int32_t node_level,
-    const AABB& root_bounds,
-    float spacing_at_root,
+    const TilingContext& tiling_context,
     SamplingBehaviour sampling_behaviour = SamplingBehaviour::TakeAllWhenCountBelowMaxPoints)
   {
     if (sampling_behaviour == SamplingBehaviour::TakeAllWhenCountBelowMaxPoints) {
       const auto num_points_to_process = static_cast<size_t>(std::distance(begin, end));
       if (num_points_to_process <= _max_points_per_node) {
-        return end;
+        return { std::move(begin, end, selected_out), rejected_out };
       }
     }
 
-    const auto spacing_at_this_node = spacing_at_root / std::pow(2, node_level + 1);
-    const auto sqr_spacing = spacing_at_this_node * spacing_at_this_node;
+    const auto sqr_spacing = tiling_context.squared_spacing_at_level(node_level);
 
     // auto last_taken_point_iter = begin;
 
-    return stable_partition_with_jumps(begin, end, [&](const auto cur_begin, const auto cur_end) {
-      // Take the current point, search for next point that is outside of
-      // min distance
-      const auto current_position = cur_begin->point_reference.position();
-      const auto next_begin = std::find_if(cur_begin + 1, cur_end, [&](const auto& other) {
-        return other.point_reference.position().squaredDistanceTo(current_position) >= sqr_spacing;
-      });
+    return partition_copy_with_jumps(
+      begin, end, selected_out, rejected_out, [&](const auto cur_begin, const auto cur_end) {
+        // Take the current point, search for next point that is outside of
+        // min distance
+        const auto current_position = cur_begin->point_reference.position();
+        const auto next_begin = std::find_if(cur_begin + 1, cur_end, [&](const auto& other) {
+          return other.point_reference.position().squaredDistanceTo(current_position) >=
+                 sqr_spacing;
+        });
 
-      return std::make_pair(cur_begin, next_begin);
-    });
+        return std::make_pair(cur_begin, next_begin);
+      });
   }
 
 private:
@@ -429,29 +463,121 @@ make_sampling_strategy_from_name(const std::string& name, Args&&... args)
   throw std::runtime_error{ "Unrecognized sampling strategy name \"" + name + "\"" };
 }
 
+/**
+ * Updates the statistics that the given sampling strategy measured during the last batch, if it
+ * measures any. Must not be called while points are sampled
+ */
+void
+update_measured_statistics(SamplingStrategy& sampling_strategy);
+
+/**
+ * Sample points for the given node from a range of points using the given
+ * sampling strategy. This is done in a single pass over [begin, end) without
+ * any allocations: All sampled points are moved to 'selected_out' and all
+ * remaining points are moved to 'rejected_out', both in the order in which
+ * they appear in the input range (i.e. sorted by their Morton index if the
+ * input is sorted). 'selected_out' must have room for all points in the input
+ * range, for example through a preallocated scratch buffer. 'rejected_out'
+ * may point to 'begin', in which case the remaining points are compacted in
+ * place at the front of the input range.
+ *
+ * Returns the end iterators of both output ranges
+ */
+template<typename Iter, typename SelectedOutIter, typename RejectedOutIter, unsigned int MaxLevels>
+std::pair<SelectedOutIter, RejectedOutIter>
+sample_points_into(SamplingStrategy& sampling_strategy,
+                   Iter begin,
+                   Iter end,
+                   SelectedOutIter selected_out,
+                   RejectedOutIter rejected_out,
+                   MortonIndex<MaxLevels> node_key,
+                   int32_t node_level,
+                   const TilingContext& tiling_context,
+                   SamplingBehaviour sampling_behaviour)
+{
+  return std::visit(
+    [&](auto& strategy) {
+      return strategy.sample_points_into(begin,
+                                         end,
+                                         selected_out,
+                                         rejected_out,
+                                         node_key,
+                                         node_level,
+                                         tiling_context,
+                                         sampling_behaviour);
+    },
+    sampling_strategy);
+}
+
+/**
+ * Same as 'sample_points_into' on the SamplingStrategy variant, but for a sampling strategy whose
+ * type is known at compile time. This is a direct call, which code that resolved the type of the
+ * sampling strategy once (e.g. the tiling algorithms) uses on its per-node path
+ */
+template<typename Strategy,
+         typename Iter,
+         typename SelectedOutIter,
+         typename RejectedOutIter,
+         unsigned int MaxLevels>
+std::pair<SelectedOutIter, RejectedOutIter>
+sample_points_into(Strategy& sampling_strategy,
+                   Iter begin,
+                   Iter end,
+                   SelectedOutIter selected_out,
+                   RejectedOutIter rejected_out,
+                   MortonIndex<MaxLevels> node_key,
+                   int32_t node_level,
+                   const TilingContext& tiling_context,
+                   SamplingBehaviour sampling_behaviour)
+{
+  return sampling_strategy.sample_points_into(begin,
+                                              end,
+                                              selected_out,
+                                              rejected_out,
+                                              node_key,
+                                              node_level,
+                                              tiling_context,
+                                              sampling_behaviour);
+}
+
 /**
  * Sample points for the given node from a range of points using the given
  * sampling strategy. Returns a partition point in the range of points where
  * [begin, partition_point) contains all sampled points and [partition_point,
- * end) all remaining points. Partitioning is stable
+ * end) all remaining points. Partitioning is stable.
+ *
+ * This requires a temporary buffer for the sampled points, prefer
+ * 'sample_points_into' with a reusable scratch buffer in hot code paths
  */
-template<typename Iter, unsigned int MaxLevels>
+template<typename Strategy, typename Iter, unsigned int MaxLevels>
 Iter
-sample_points(SamplingStrategy& sampling_strategy,
+sample_points(Strategy& sampling_strategy,
               Iter begin,
               Iter end,
               MortonIndex<MaxLevels> node_key,
               int32_t node_level,
-              const AABB& root_bounds,
-              float spacing_at_root,
+              const TilingContext& tiling_context,
               SamplingBehaviour sampling_behaviour)
 {
-  return std::visit(
-    [&](auto& strategy) {
-      return strategy.sample_points(
-        begin, end, node_key, node_level, root_bounds, spacing_at_root, sampling_behaviour);
-    },
-    sampling_strategy);
+  using Value_t = typename std::iterator_traits<Iter>::value_type;
+  std::vector<Value_t> selected_points;
+  selected_points.reserve(static_cast<size_t>(std::distance(begin, end)));
+
+  const auto rejected_end = sample_points_into(sampling_strategy,
+                                               begin,
+                                               end,
+                                               std::back_inserter(selected_points),
+                                               begin,
+                                               node_key,
+                                               node_level,
+                                               tiling_context,
+                                               sampling_behaviour)
+                              .second;
+
+  // Remaining points are at the front of the range, move them to the back and the selected points
+  // in front of them
+  std::move_backward(begin, rejected_end, end);
+  return std::move(std::begin(selected_points), std::end(selected_points), begin);
 }
 
 /**
@@ -467,4 +593,18 @@ sample_points(SamplingStrategy& sampling_strategy,
 int32_t
 required_morton_index_depth(const SamplingStrategy& sampling_strategy,
                             int32_t node_level,
-                            const octree::NodeStructure& root_node);
\ No newline at end of file
+                            const TilingContext& tiling_context);
+
+/**
+ * Required depth of Morton indices for a sampling strategy whose type is known at compile time
+ */
+template<typename Strategy>
+int32_t
+required_morton_index_depth(int32_t node_level, const TilingContext& tiling_context)
+{
+  if constexpr (Strategy::SamplesOnMortonGrid) {
+    return tiling_context.candidate_level(node_level);
+  } else {
+    return node_level;
+  }
+}
\ No newline at end of file
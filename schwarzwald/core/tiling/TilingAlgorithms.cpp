@@ -45,16 +45,18 @@ journal_start_nodes(std::string start_nodes_as_graphviz)
 #pragma region helper_functions
 /**
  * Reads the cached points for the given node from disk and returns them as
- * IndexedPoints
+ * IndexedPoints. 'persisted_in_morton_order' states whether the points of
+ * each node were persisted sorted by their MortonIndex
  */
 static std::vector<IndexedPoint<MAX_OCTREE_LEVELS>>
 read_pnts_from_disk(const octree::NodeStructure& node,
                     const AABB& octree_bounds,
                     PointsCache& points_cache,
-                    PointsPersistence& persistence)
+                    PointsPersistence& persistence,
+                    bool persisted_in_morton_order)
 {
   PointBuffer tmp_points;
-  persistence.retrieve_points(node.name, tmp_points);
+  persistence.retrieve_points(node.index, tmp_points);
   if (!tmp_points.count())
     return {};
 
@@ -95,14 +97,30 @@ read_pnts_from_disk(const octree::NodeStructure& node,
     });
 
   // If the Persistence is lossy, we have to sort, as FP inaccuracies might disturb the order
-  // of points
-  if (!persistence.is_lossless()) {
+  // of points. The same goes for points that were persisted in progressive order
+  if (!persistence.is_lossless() || !persisted_in_morton_order) {
     std::sort(std::begin(indexed_points), std::end(indexed_points));
   }
 
   return indexed_points;
 }
 
+/**
+ * Returns a scratch buffer for sampled points that can hold at least 'count'
+ * points. The buffer is reused between all nodes that are processed on the
+ * calling thread, so sampling does not allocate once the buffer has grown to
+ * the size of the largest node seen by this thread
+ */
+static std::vector<IndexedPoint64>&
+sampling_scratch_buffer(size_t count)
+{
+  thread_local std::vector<IndexedPoint64> scratch_buffer;
+  if (scratch_buffer.size() < count) {
+    scratch_buffer.resize(count);
+  }
+  return scratch_buffer;
+}
+
 /**
  * Takes a sorted range of IndexedPoints and splits it up into up to eight
  * ranges, one for each child node. This method then returns the appropriate
@@ -131,7 +149,7 @@ split_range_into_child_nodes(std::vector<IndexedPoint64>::iterator points_begin,
     child_node.bounds = get_octant_bounds(octant, node.bounds);
     child_node.level = child_level;
     child_node.max_spacing /= 2;
-    child_node.name = concat(node.name, static_cast<char>('0' + octant));
+    child_node.index = node.index.child(octant);
 
     // for (auto& point : child_range) {
     //   if (!child_node.bounds.isInside(point.point_reference.position())) {
@@ -177,26 +195,85 @@ dump_tree_to_graphviz(const Tree& tree, const std::string& path, GetTotalPoints
 
 #pragma region TilingAlgorithmBase
 
-TilingAlgorithmBase::TilingAlgorithmBase(SamplingStrategy& sampling_strategy,
-                                         ProgressReporter* progress_reporter,
-                                         PointsPersistence& persistence,
-                                         TilerMetaParameters meta_parameters)
+template<typename Strategy>
+TilingAlgorithmBase<Strategy>::TilingAlgorithmBase(Strategy& sampling_strategy,
+                                                   ProgressReporter* progress_reporter,
+                                                   PointsPersistence& persistence,
+                                                   TilerMetaParameters meta_parameters,
+                                                   TilingContext tiling_context)
   : _sampling_strategy(sampling_strategy)
   , _progress_reporter(progress_reporter)
   , _persistence(persistence)
   , _meta_parameters(meta_parameters)
+  , _tiling_context(std::move(tiling_context))
 {}
 
-TilingAlgorithmBase::~TilingAlgorithmBase() {}
+TilingAlgorithm::~TilingAlgorithm() {}
+
+/**
+ * Gathers the points in [begin, end) column by column into a PointBuffer and persists it, so that
+ * all sinks encode contiguous attribute columns instead of reading each point through its
+ * PointReference. The PointBuffer is reused between all nodes that are persisted on the calling
+ * thread. With a 'subflow', sinks can persist large nodes as tasks on it
+ */
+static void
+persist_gathered_points(PointsPersistence& persistence,
+                        octree::NodeData::const_iterator begin,
+                        octree::NodeData::const_iterator end,
+                        const AABB& bounds,
+                        const OctreeNodeIndex64& node_index,
+                        tf::Subflow* subflow)
+{
+  const auto points_begin = member_iterator(begin, &IndexedPoint64::point_reference);
+  const auto points_end = member_iterator(end, &IndexedPoint64::point_reference);
+  // Sinks differ in how they treat empty nodes, which the PointBuffer overloads don't all mirror
+  if (begin == end) {
+    persistence.persist_points(points_begin, points_end, bounds, node_index);
+    return;
+  }
+
+  thread_local PointBuffer node_points;
+  node_points.gather(points_begin, points_end);
+  if (subflow) {
+    persistence.persist_points(node_points, bounds, node_index, *subflow);
+  } else {
+    persistence.persist_points(node_points, bounds, node_index);
+  }
+}
+
+template<typename Strategy>
+void
+TilingAlgorithmBase<Strategy>::persist_node_points(octree::NodeData::const_iterator begin,
+                                                   octree::NodeData::const_iterator end,
+                                                   octree::NodeData::iterator ordering_buffer,
+                                                   const AABB& bounds,
+                                                   const OctreeNodeIndex64& node_index,
+                                                   tf::Subflow* subflow)
+{
+  if (!_meta_parameters.progressive_point_ordering) {
+    persist_gathered_points(_persistence, begin, end, bounds, node_index, subflow);
+    return;
+  }
+
+  const auto ordered_points_end = order_points_progressively(begin, end, ordering_buffer);
+  persist_gathered_points(_persistence,
+                          octree::NodeData::const_iterator{ ordering_buffer },
+                          octree::NodeData::const_iterator{ ordered_points_end },
+                          bounds,
+                          node_index,
+                          subflow);
+}
 
 /**
  * Tile the given node as a terminal node, i.e. take up to 'max_points_per_node'
  * points and persist them without any sampling
  */
+template<typename Strategy>
 void
-TilingAlgorithmBase::tile_terminal_node(octree::NodeData const& all_points,
-                                        octree::NodeStructure const& node,
-                                        size_t previously_taken_points_count)
+TilingAlgorithmBase<Strategy>::tile_terminal_node(octree::NodeData& all_points,
+                                                  octree::NodeStructure const& node,
+                                                  size_t previously_taken_points_count,
+                                                  tf::Subflow& subflow)
 {
   // const auto points_to_take = std::min(all_points.size(), _meta_parameters.max_points_per_node);
   // if (points_to_take < all_points.size()) {
@@ -211,15 +288,28 @@ TilingAlgorithmBase::tile_terminal_node(octree::NodeData const& all_points,
 
   if (all_points.size() > _meta_parameters.max_points_per_node) {
     util::write_log((boost::format("Taking %1% points at terminal node %2% without sampling") %
-                     all_points.size() % node.name)
+                     all_points.size() % node_name_from_index(node.index))
                       .str());
   }
 
-  _persistence.persist_points(
-    member_iterator(std::begin(all_points), &IndexedPoint64::point_reference),
-    member_iterator(std::end(all_points), &IndexedPoint64::point_reference),
-    node.bounds,
-    node.name);
+  if (_meta_parameters.progressive_point_ordering) {
+    // Points of terminal nodes are not sorted, progressive ordering requires them to be. The
+    // points belong to this node only, so they can be sorted in place
+    std::sort(std::begin(all_points), std::end(all_points));
+    persist_node_points(std::begin(all_points),
+                        std::end(all_points),
+                        std::begin(sampling_scratch_buffer(all_points.size())),
+                        node.bounds,
+                        node.index,
+                        &subflow);
+  } else {
+    persist_gathered_points(_persistence,
+                            std::begin(all_points),
+                            std::end(all_points),
+                            node.bounds,
+                            node.index,
+                            &subflow);
+  }
 
   if (_progress_reporter)
     _progress_reporter->increment_progress(progress::INDEXING,
@@ -230,11 +320,14 @@ TilingAlgorithmBase::tile_terminal_node(octree::NodeData const& all_points,
  * Tile the given node as an interior node, i.e. by using the given
  * SamplingStrategy
  */
+template<typename Strategy>
 std::vector<NodeTilingData>
-TilingAlgorithmBase::tile_internal_node(octree::NodeData& all_points,
-                                        octree::NodeStructure const& node,
-                                        octree::NodeStructure const& root_node,
-                                        size_t previously_taken_points_count)
+TilingAlgorithmBase<Strategy>::tile_internal_node(octree::NodeData& all_points,
+                                                  octree::NodeStructure const& node,
+                                                  octree::NodeStructure const& root_node,
+                                                  TilingContext const& tiling_context,
+                                                  size_t previously_taken_points_count,
+                                                  tf::Subflow& subflow)
 {
   /**
    * When we first hit a node with a range of points, we can take all points if their count is
@@ -251,25 +344,34 @@ TilingAlgorithmBase::tile_internal_node(octree::NodeData& all_points,
                                     ? SamplingBehaviour::AlwaysAdhereToMinSpacing
                                     : SamplingBehaviour::TakeAllWhenCountBelowMaxPoints;
 
-  const auto partition_point = filter_points_for_octree_node(std::begin(all_points),
-                                                             std::end(all_points),
-                                                             node.morton_index,
-                                                             node.level,
-                                                             root_node.bounds,
-                                                             root_node.max_spacing,
-                                                             sampling_behaviour,
-                                                             _sampling_strategy);
+  // Sampled points go into the scratch buffer, all remaining points are compacted at the front of
+  // 'all_points'. Both ranges stay sorted, so the remaining points can be split up into the child
+  // nodes directly
+  auto& selected_points = sampling_scratch_buffer(all_points.size());
+  const auto [selected_points_end, remaining_points_end] =
+    sample_points_into(_sampling_strategy,
+                       std::begin(all_points),
+                       std::end(all_points),
+                       std::begin(selected_points),
+                       std::begin(all_points),
+                       node.morton_index,
+                       node.level,
+                       tiling_context,
+                       sampling_behaviour);
 
   const auto points_taken =
-    static_cast<size_t>(std::distance(std::begin(all_points), partition_point));
+    static_cast<size_t>(std::distance(std::begin(selected_points), selected_points_end));
+  const auto total_points = points_taken + static_cast<size_t>(std::distance(
+                                             std::begin(all_points), remaining_points_end));
 
   if (node.level >= 16) {
-    const auto taken_percentage = points_taken / static_cast<double>(all_points.size());
+    const auto taken_percentage = points_taken / static_cast<double>(total_points);
     if (taken_percentage < 0.01) {
-      util::write_log(concat("Discovered potentially broken node ", node.name));
+      const auto node_name = node_name_from_index(node.index);
+      util::write_log(concat("Discovered potentially broken node ", node_name));
       // Dump points to text file for debugging
       const auto dump_file_path =
-        global_config().root_directory / concat("broken_", node.name + ".txt");
+        global_config().root_directory / concat("broken_", node_name, ".txt");
       std::ofstream fs{ dump_file_path };
       if (!fs.is_open()) {
         throw std::runtime_error{
@@ -281,26 +383,31 @@ TilingAlgorithmBase::tile_internal_node(octree::NodeData& all_points,
 
       fs << "Bounds:       " << node.bounds << "\n";
       fs << "Points taken: " << points_taken << "\n";
-      fs << "Total points: " << all_points.size() << "\n";
+      fs << "Total points: " << total_points << "\n";
       fs << "\n";
 
-      for (auto iter = std::begin(all_points); iter != std::end(all_points); ++iter) {
-        const std::string tick_mark = (iter < partition_point) ? "[x]" : "[ ]";
-        fs << tick_mark << " ";
+      const auto dump_points = [&fs](auto begin, auto end, const std::string& tick_mark) {
+        for (auto iter = begin; iter != end; ++iter) {
+          const auto& position = iter->point_reference.position();
+          const auto& morton_idx = iter->morton_index;
 
-        const auto& position = iter->point_reference.position();
-        const auto& morton_idx = iter->morton_index;
+          fs << tick_mark << " " << position << " [" << to_string(morton_idx) << "]\n";
+        }
+      };
 
-        fs << position << " [" << to_string(morton_idx) << "]\n";
-      }
+      dump_points(std::begin(selected_points), selected_points_end, "[x]");
+      dump_points(std::begin(all_points), remaining_points_end, "[ ]");
     }
   }
 
-  _persistence.persist_points(
-    member_iterator(std::begin(all_points), &IndexedPoint64::point_reference),
-    member_iterator(partition_point, &IndexedPoint64::point_reference),
-    node.bounds,
-    node.name);
+  // All points after the remaining points have been moved to the scratch buffer, which leaves
+  // exactly enough room for reordering the selected points
+  persist_node_points(std::begin(selected_points),
+                      selected_points_end,
+                      remaining_points_end,
+                      node.bounds,
+                      node.index,
+                      &subflow);
 
   if (_progress_reporter) {
     // To correctly increment progress, we have to know how many points were
@@ -311,20 +418,22 @@ TilingAlgorithmBase::tile_internal_node(octree::NodeData& all_points,
     _progress_reporter->increment_progress(progress::INDEXING, newly_taken_points);
   }
 
-  return split_range_into_child_nodes(partition_point, std::end(all_points), node, root_node);
+  return split_range_into_child_nodes(std::begin(all_points), remaining_points_end, node, root_node);
 }
 
+template<typename Strategy>
 std::vector<NodeTilingData>
-TilingAlgorithmBase::tile_node(octree::NodeData&& node_data,
-                               const octree::NodeStructure& node_structure,
-                               const octree::NodeStructure& root_node_structure,
-                               tf::Subflow& subflow)
+TilingAlgorithmBase<Strategy>::tile_node(octree::NodeData&& node_data,
+                                         const octree::NodeStructure& node_structure,
+                                         const octree::NodeStructure& root_node_structure,
+                                         tf::Subflow& subflow)
 {
-  const auto current_node_name = concat(
-    root_node_structure.name, to_string(node_structure.morton_index, node_structure.level + 1));
-
   auto cached_points =
-    read_pnts_from_disk(node_structure, root_node_structure.bounds, _points_cache, _persistence);
+    read_pnts_from_disk(node_structure,
+                        root_node_structure.bounds,
+                        _points_cache,
+                        _persistence,
+                        !_meta_parameters.progressive_point_ordering);
 
   // const auto node_morton_index_str = node_structure.name.substr(1);
   // for (auto& point : cached_points) {
@@ -370,8 +479,13 @@ TilingAlgorithmBase::tile_node(octree::NodeData&& node_data,
 
   const auto cached_points_count = cached_points.size();
 
+  // Nodes below a node that was too deep for the MortonIndex have this node as their root node,
+  // which carries its own TilingContext
+  const auto& tiling_context =
+    root_node_structure.tiling_context ? *root_node_structure.tiling_context : _tiling_context;
+
   const auto node_level_to_sample_from =
-    required_morton_index_depth(_sampling_strategy, node_structure.level, root_node_structure);
+    required_morton_index_depth<Strategy>(node_structure.level, tiling_context);
   const auto requires_deeper_morton_indices = node_level_to_sample_from > node_structure.level;
 
   // Check whether this node is an interior node, terminal node, or a node that
@@ -383,30 +497,33 @@ TilingAlgorithmBase::tile_node(octree::NodeData&& node_data,
 
   if (!requires_deeper_morton_indices) {
     if (node_level_to_sample_from >= max_level) {
-      const auto all_points_for_this_node =
+      auto all_points_for_this_node =
         octree::merge_node_data_unsorted(std::move(node_data), std::move(cached_points));
-      tile_terminal_node(all_points_for_this_node, node_structure, cached_points_count);
+      tile_terminal_node(all_points_for_this_node, node_structure, cached_points_count, subflow);
       return {};
     }
 
     auto all_points_for_this_node =
       octree::merge_node_data_sorted(std::move(node_data), std::move(cached_points));
-    return tile_internal_node(
-      all_points_for_this_node, node_structure, root_node_structure, cached_points_count);
+    return tile_internal_node(all_points_for_this_node,
+                              node_structure,
+                              root_node_structure,
+                              tiling_context,
+                              cached_points_count,
+                              subflow);
   } else {
     if (node_structure.level >= max_level) {
-      const auto all_points_for_this_node =
+      auto all_points_for_this_node =
         octree::merge_node_data_unsorted(std::move(node_data), std::move(cached_points));
-      tile_terminal_node(all_points_for_this_node, node_structure, cached_points_count);
+      tile_terminal_node(all_points_for_this_node, node_structure, cached_points_count, subflow);
       return {};
     }
 
     if (node_level_to_sample_from >= static_cast<int32_t>(MAX_OCTREE_LEVELS - 1)) {
 
       if (global_config().is_journaling_enabled) {
-        journal_string((boost::format("Recalculating Morton indices for deep node %1%%2%") %
-                        root_node_structure.name % node_structure.name)
-                         .str());
+        journal_string(concat("Recalculating Morton indices for deep node ",
+                              node_name_from_index(node_structure.index)));
       }
 
       // If we are so deep that we exceed the capacity of the MortonIndex, we
@@ -423,6 +540,8 @@ TilingAlgorithmBase::tile_node(octree::NodeData&& node_data,
       // Set this node as the new root node
       auto new_root_node = node_structure;
       new_root_node.max_depth = node_structure.max_depth - node_structure.level;
+      new_root_node.tiling_context =
+        std::make_shared<const TilingContext>(new_root_node.bounds, new_root_node.max_spacing);
 
       // Compute new indices based upon this node as root node
       for (auto& indexed_point : all_points_for_this_node) {
@@ -433,14 +552,22 @@ TilingAlgorithmBase::tile_node(octree::NodeData&& node_data,
       // Make sure everything is sorted again
       std::sort(all_points_for_this_node.begin(), all_points_for_this_node.end());
 
-      return tile_internal_node(
-        all_points_for_this_node, node_structure, new_root_node, cached_points_count);
+      return tile_internal_node(all_points_for_this_node,
+                                node_structure,
+                                new_root_node,
+                                *new_root_node.tiling_context,
+                                cached_points_count,
+                                subflow);
     }
 
     auto all_points_for_this_node =
       octree::merge_node_data_sorted(std::move(node_data), std::move(cached_points));
-    return tile_internal_node(
-      all_points_for_this_node, node_structure, root_node_structure, cached_points_count);
+    return tile_internal_node(all_points_for_this_node,
+                              node_structure,
+                              root_node_structure,
+                              tiling_context,
+                              cached_points_count,
+                              subflow);
   }
 }
 
@@ -449,11 +576,12 @@ TilingAlgorithmBase::tile_node(octree::NodeData&& node_data,
  * node and creates the execution graph for processing the child nodes of this
  * node
  */
+template<typename Strategy>
 void
-TilingAlgorithmBase::do_tiling_for_node(octree::NodeData&& node_data,
-                                        const octree::NodeStructure& node_structure,
-                                        const octree::NodeStructure& root_node_structure,
-                                        tf::Subflow& subflow)
+TilingAlgorithmBase<Strategy>::do_tiling_for_node(octree::NodeData&& node_data,
+                                                  const octree::NodeStructure& node_structure,
+                                                  const octree::NodeStructure& root_node_structure,
+                                                  tf::Subflow& subflow)
 {
   auto child_nodes = tile_node(std::move(node_data), node_structure, root_node_structure, subflow);
 
@@ -480,7 +608,7 @@ TilingAlgorithmBase::do_tiling_for_node(octree::NodeData&& node_data,
   // Create async tasks for tiling child nodes that have many points
   std::for_each(
     std::begin(child_nodes), iter_to_first_sync_node, [this, &subflow](NodeTilingData& child_node) {
-      const auto child_node_name = child_node.node.name;
+      const auto child_node_name = node_name_from_index(child_node.node.index);
       const auto child_points_count = child_node.points.size();
       const auto child_task_name =
         (boost::format("%1% [%2%]") % child_node_name % child_points_count).str();
@@ -504,18 +632,26 @@ TilingAlgorithmBase::do_tiling_for_node(octree::NodeData&& node_data,
 
 #pragma region TilingAlgorithmV1
 
-TilingAlgorithmV1::TilingAlgorithmV1(SamplingStrategy& sampling_strategy,
-                                     ProgressReporter* progress_reporter,
-                                     PointsPersistence& persistence,
-                                     TilerMetaParameters meta_parameters)
-  : TilingAlgorithmBase(sampling_strategy, progress_reporter, persistence, meta_parameters)
+template<typename Strategy>
+TilingAlgorithmV1<Strategy>::TilingAlgorithmV1(Strategy& sampling_strategy,
+                                               ProgressReporter* progress_reporter,
+                                               PointsPersistence& persistence,
+                                               TilerMetaParameters meta_parameters,
+                                               TilingContext tiling_context)
+  : TilingAlgorithmBase<Strategy>(sampling_strategy,
+                        progress_reporter,
+                        persistence,
+                        meta_parameters,
+                        std::move(tiling_context))
 {}
 
+template<typename Strategy>
 std::pair<tf::Task, tf::Task>
-TilingAlgorithmV1::build_execution_graph(util::Range<PointBuffer::PointIterator> points,
-                                         const AABB& bounds,
-                                         uint32_t num_indexing_threads,
-                                         tf::Taskflow& tf)
+TilingAlgorithmV1<Strategy>::build_execution_graph(util::Range<PointBuffer::PointIterator> points,
+                                                   const AABB& bounds,
+                                                   uint32_t num_indexing_threads,
+                                                   tf::Taskflow& tf,
+                                                   bool is_last_batch)
 {
   _root_node_points.clear();
   _root_node_points.resize(points.size());
@@ -542,14 +678,14 @@ TilingAlgorithmV1::build_execution_graph(util::Range<PointBuffer::PointIterator>
   root_node.max_depth = _meta_parameters.max_depth;
   root_node.max_spacing = _meta_parameters.spacing_at_root;
   root_node.morton_index = {};
-  root_node.name = "r";
+  root_node.index = {};
 
   auto process_task =
     tf.emplace([this, root_node](tf::Subflow& subflow) mutable {
         do_tiling_for_node(std::move(_root_node_points), root_node, root_node, subflow);
         _root_node_points = {};
       })
-      .name(concat(root_node.name, " [", _root_node_points.size(), "]"));
+      .name(concat(node_name_from_index(root_node.index), " [", _root_node_points.size(), "]"));
 
   indexing_tasks.second.precede(sort_task);
   sort_task.precede(process_task);
@@ -561,18 +697,26 @@ TilingAlgorithmV1::build_execution_graph(util::Range<PointBuffer::PointIterator>
 
 #pragma region TilingAlgorithmV2
 
-TilingAlgorithmV2::TilingAlgorithmV2(SamplingStrategy& sampling_strategy,
-                                     ProgressReporter* progress_reporter,
-                                     PointsPersistence& persistence,
-                                     TilerMetaParameters meta_parameters)
-  : TilingAlgorithmBase(sampling_strategy, progress_reporter, persistence, meta_parameters)
+template<typename Strategy>
+TilingAlgorithmV2<Strategy>::TilingAlgorithmV2(Strategy& sampling_strategy,
+                                               ProgressReporter* progress_reporter,
+                                               PointsPersistence& persistence,
+                                               TilerMetaParameters meta_parameters,
+                                               TilingContext tiling_context)
+  : TilingAlgorithmBase<Strategy>(sampling_strategy,
+                        progress_reporter,
+                        persistence,
+                        meta_parameters,
+                        std::move(tiling_context))
 {}
 
+template<typename Strategy>
 std::pair<tf::Task, tf::Task>
-TilingAlgorithmV2::build_execution_graph(util::Range<PointBuffer::PointIterator> points,
-                                         const AABB& bounds,
-                                         uint32_t num_indexing_threads,
-                                         tf::Taskflow& tf)
+TilingAlgorithmV2<Strategy>::build_execution_graph(util::Range<PointBuffer::PointIterator> points,
+                                                   const AABB& bounds,
+                                                   uint32_t num_indexing_threads,
+                                                   tf::Taskflow& tf,
+                                                   bool is_last_batch)
 {
   /**
    * #### Revised algorithm for better concurrency ####
@@ -661,10 +805,11 @@ TilingAlgorithmV2::build_execution_graph(util::Range<PointBuffer::PointIterator>
   return { scatter_task.begin_task, transpose_task };
 }
 
+template<typename Strategy>
 void
-TilingAlgorithmV2::index_and_sort_points(util::Range<PointsIter> points,
-                                         util::Range<IndexedPointsIter> indexed_points,
-                                         const AABB& bounds) const
+TilingAlgorithmV2<Strategy>::index_and_sort_points(util::Range<PointsIter> points,
+                                                   util::Range<IndexedPointsIter> indexed_points,
+                                                   const AABB& bounds) const
 {
   assert(points.size() == indexed_points.size());
 
@@ -708,8 +853,9 @@ TilingAlgorithmV2::index_and_sort_points(util::Range<PointsIter> points,
  *  |-------------|  |--------|  |---|  |-------------|  |-------------|
  *      node 00        node 01  node 03     node 1            node 3
  */
-Octree<util::Range<TilingAlgorithmV2::IndexedPointsIter>>
-TilingAlgorithmV2::split_indexed_points_into_subranges(
+template<typename Strategy>
+Octree<util::Range<typename TilingAlgorithmV2<Strategy>::IndexedPointsIter>>
+TilingAlgorithmV2<Strategy>::split_indexed_points_into_subranges(
   util::Range<IndexedPointsIter> indexed_points,
   size_t min_number_of_ranges) const
 {
@@ -785,12 +931,13 @@ TilingAlgorithmV2::split_indexed_points_into_subranges(
   return point_ranges;
 }
 
-Octree<std::vector<util::Range<TilingAlgorithmV2::IndexedPointsIter>>>
-TilingAlgorithmV2::merge_selected_start_nodes(
+template<typename Strategy>
+Octree<std::vector<util::Range<typename TilingAlgorithmV2<Strategy>::IndexedPointsIter>>>
+TilingAlgorithmV2<Strategy>::merge_selected_start_nodes(
   const std::vector<Octree<util::Range<IndexedPointsIter>>>& selected_nodes,
   size_t min_number_of_ranges)
 {
-  using Octree_t = Octree<std::vector<util::Range<TilingAlgorithmV2::IndexedPointsIter>>>;
+  using Octree_t = Octree<std::vector<util::Range<IndexedPointsIter>>>;
   // Merge all trees into one tree
 
   auto merged_tree = std::accumulate(
@@ -907,7 +1054,7 @@ TilingAlgorithmV2::merge_selected_start_nodes(
       const Octree_t::MutableNode& leaf_parent,
       std::unordered_map<OctreeNodeIndex64, Octree_t::MutableNode>& penultimate_nodes) -> size_t {
     size_t merged_nodes = 0;
-    std::vector<util::Range<TilingAlgorithmV2::IndexedPointsIter>> merged_ranges;
+    std::vector<util::Range<IndexedPointsIter>> merged_ranges;
     for (auto leaf : leaf_parent.children()) {
       if (leaf->empty())
         continue;
@@ -969,8 +1116,9 @@ TilingAlgorithmV2::merge_selected_start_nodes(
   return merged_tree;
 }
 
+template<typename Strategy>
 NodeTilingData
-TilingAlgorithmV2::prepare_range_for_tiling(
+TilingAlgorithmV2<Strategy>::prepare_range_for_tiling(
   const std::vector<util::Range<IndexedPointsIter>>& start_node_data,
   OctreeNodeIndex64 node_index,
   const AABB& bounds)
@@ -995,7 +1143,7 @@ TilingAlgorithmV2::prepare_range_for_tiling(
   root_node.max_depth = _meta_parameters.max_depth;
   root_node.max_spacing = _meta_parameters.spacing_at_root;
   root_node.morton_index = {};
-  root_node.name = "r";
+  root_node.index = {};
 
   octree::NodeStructure this_node;
   this_node.bounds = get_bounds_from_node_index(node_index, bounds);
@@ -1003,14 +1151,15 @@ TilingAlgorithmV2::prepare_range_for_tiling(
   this_node.max_depth = root_node.max_depth;
   this_node.max_spacing = root_node.max_spacing / std::pow(2, node_index.levels());
   this_node.morton_index = node_index.to_static_morton_index();
-  this_node.name = std::string{ "r" } + OctreeNodeIndex64::to_string(node_index);
+  this_node.index = node_index;
 
   return { std::move(merged_data), this_node, root_node };
 }
 
+template<typename Strategy>
 void
-TilingAlgorithmV2::reconstruct_single_node(const OctreeNodeIndex64& node_index,
-                                           const AABB& root_bounds)
+TilingAlgorithmV2<Strategy>::reconstruct_single_node(const OctreeNodeIndex64& node_index,
+                                                     const AABB& root_bounds)
 {
 
   // TODO If this node already exists (from a previous iteration), we will lose
@@ -1021,16 +1170,7 @@ TilingAlgorithmV2::reconstruct_single_node(const OctreeNodeIndex64& node_index,
   // 1) Read data of direct child nodes
   PointBuffer data;
   for (uint8_t octant = 0; octant < 8; ++octant) {
-    const auto child_index = node_index.child(octant);
-    const auto node_name = concat("r", OctreeNodeIndex64::to_string(child_index));
-
-    PointBuffer tmp;
-    _persistence.retrieve_points(node_name, tmp);
-
-    if (tmp.empty())
-      continue;
-
-    data.append_buffer(tmp);
+    _persistence.append_points(node_index.child(octant), data);
   }
 
   // 2) Calculate morton indices for child data
@@ -1042,6 +1182,11 @@ TilingAlgorithmV2::reconstruct_single_node(const OctreeNodeIndex64& node_index,
                                   root_bounds,
                                   OutlierPointsBehaviour::ClampToBounds);
 
+  // Child nodes that were persisted in progressive order are not sorted by their MortonIndex
+  if (_meta_parameters.progressive_point_ordering) {
+    std::sort(std::begin(indexed_points), std::end(indexed_points));
+  }
+
   // 3) Data is sorted, so we can sample directly
   const auto morton_index_for_node = node_index.to_static_morton_index();
   const auto selected_points_end = sample_points(_sampling_strategy,
@@ -1049,26 +1194,26 @@ TilingAlgorithmV2::reconstruct_single_node(const OctreeNodeIndex64& node_index,
                                                  std::end(indexed_points),
                                                  morton_index_for_node,
                                                  static_cast<int32_t>(node_index.levels()) - 1,
-                                                 root_bounds,
-                                                 _meta_parameters.spacing_at_root,
+                                                 _tiling_context,
                                                  SamplingBehaviour::AlwaysAdhereToMinSpacing);
 
   // 3) Write to disk
   const auto node_bounds = get_bounds_from_node_index(node_index, root_bounds);
-  const auto node_name = concat("r", OctreeNodeIndex64::to_string(node_index));
 
   // TOOD For 3D Tiles, reconstructed nodes should have their children be
   // 'REPLACE' instead of 'ADD'
 
-  _persistence.persist_points(
-    member_iterator(std::begin(indexed_points), &IndexedPoint64::point_reference),
-    member_iterator(selected_points_end, &IndexedPoint64::point_reference),
-    node_bounds,
-    node_name);
+  persist_node_points(std::begin(indexed_points),
+                      selected_points_end,
+                      std::begin(sampling_scratch_buffer(indexed_points.size())),
+                      node_bounds,
+                      node_index,
+                      nullptr);
 }
 
+template<typename Strategy>
 void
-TilingAlgorithmV2::reconstruct_left_out_nodes(
+TilingAlgorithmV2<Strategy>::reconstruct_left_out_nodes(
   const std::unordered_set<OctreeNodeIndex64>& left_out_nodes,
   const AABB& root_bounds)
 {
@@ -1085,20 +1230,28 @@ TilingAlgorithmV2::reconstruct_left_out_nodes(
 #pragma endregion
 
 #pragma region TilingAlgorithmV3
-TilingAlgorithmV3::TilingAlgorithmV3(SamplingStrategy& sampling_strategy,
-                                     ProgressReporter* progress_reporter,
-                                     PointsPersistence& persistence,
-                                     TilerMetaParameters meta_parameters,
-                                     const fs::path& output_dir)
-  : TilingAlgorithmBase(sampling_strategy, progress_reporter, persistence, meta_parameters)
+template<typename Strategy>
+TilingAlgorithmV3<Strategy>::TilingAlgorithmV3(Strategy& sampling_strategy,
+                                               ProgressReporter* progress_reporter,
+                                               PointsPersistence& persistence,
+                                               TilerMetaParameters meta_parameters,
+                                               TilingContext tiling_context,
+                                               const fs::path& output_dir)
+  : TilingAlgorithmBase<Strategy>(sampling_strategy,
+                        progress_reporter,
+                        persistence,
+                        meta_parameters,
+                        std::move(tiling_context))
   , _output_dir(output_dir)
 {}
 
+template<typename Strategy>
 std::pair<tf::Task, tf::Task>
-TilingAlgorithmV3::build_execution_graph(util::Range<PointBuffer::PointIterator> points,
-                                         const AABB& bounds,
-                                         uint32_t num_indexing_threads,
-                                         tf::Taskflow& tf)
+TilingAlgorithmV3<Strategy>::build_execution_graph(util::Range<PointBuffer::PointIterator> points,
+                                                   const AABB& bounds,
+                                                   uint32_t num_indexing_threads,
+                                                   tf::Taskflow& tf,
+                                                   bool is_last_batch)
 {
   /**
    * #### Revised algorithm for better concurrency ####
@@ -1117,14 +1270,17 @@ TilingAlgorithmV3::build_execution_graph(util::Range<PointBuffer::PointIterator>
   _indexed_points_ranges.resize(num_indexing_threads);
 
   if (!_level_of_start_nodes.has_value()) {
-    return build_execution_graph_for_first_iteration(points, bounds, num_indexing_threads, tf);
+    return build_execution_graph_for_first_iteration(
+      points, bounds, num_indexing_threads, tf, is_last_batch);
   } else {
-    return build_execution_graph_for_later_iterations(points, bounds, num_indexing_threads, tf);
+    return build_execution_graph_for_later_iterations(
+      points, bounds, num_indexing_threads, tf, is_last_batch);
   }
 }
 
+template<typename Strategy>
 void
-TilingAlgorithmV3::finalize(const AABB& bounds)
+TilingAlgorithmV3<Strategy>::finalize(const AABB& bounds)
 {
   if (!_level_of_start_nodes.has_value()) {
     // build_execution_graph_for_first_iteration was never run, i.e. we never
@@ -1134,12 +1290,14 @@ TilingAlgorithmV3::finalize(const AABB& bounds)
   reconstruct_left_out_nodes(bounds);
 }
 
+template<typename Strategy>
 std::pair<tf::Task, tf::Task>
-TilingAlgorithmV3::build_execution_graph_for_first_iteration(
+TilingAlgorithmV3<Strategy>::build_execution_graph_for_first_iteration(
   util::Range<PointBuffer::PointIterator> points,
   const AABB& bounds,
   uint32_t num_indexing_threads,
-  tf::Taskflow& tf)
+  tf::Taskflow& tf,
+  bool is_last_batch)
 {
   // After indexing the points, we sort them all together, estimate the start
   // node level and then generate the start nodes
@@ -1168,7 +1326,7 @@ TilingAlgorithmV3::build_execution_graph_for_first_iteration(
     "index_points");
 
   auto sort_estimate_get_start_node =
-    tf.emplace([this, bounds, num_indexing_threads](tf::Subflow& subflow) {
+    tf.emplace([this, bounds, num_indexing_threads, is_last_batch](tf::Subflow& subflow) {
         util::Range<IndexedPointsIter> indexed_points{ std::begin(_root_node_points),
                                                        std::end(_root_node_points) };
         indexed_points.sort();
@@ -1199,8 +1357,10 @@ TilingAlgorithmV3::build_execution_graph_for_first_iteration(
                                         OctreeNodeIndex64::to_string(node.index()) % node->size())
                                          .str();
 
+          _tiled_start_nodes.insert(node.index());
+
           subflow
-            .emplace([this, bounds, index = node.index(), _data = std::move(*node)](
+            .emplace([this, bounds, is_last_batch, index = node.index(), _data = std::move(*node)](
                        tf::Subflow& subsubflow) {
               octree::NodeStructure root_node;
               root_node.bounds = bounds;
@@ -1208,7 +1368,7 @@ TilingAlgorithmV3::build_execution_graph_for_first_iteration(
               root_node.max_depth = _meta_parameters.max_depth;
               root_node.max_spacing = _meta_parameters.spacing_at_root;
               root_node.morton_index = {};
-              root_node.name = "r";
+              root_node.index = {};
 
               octree::NodeStructure this_node;
               this_node.bounds = get_bounds_from_node_index(index, bounds);
@@ -1216,10 +1376,11 @@ TilingAlgorithmV3::build_execution_graph_for_first_iteration(
               this_node.max_depth = root_node.max_depth;
               this_node.max_spacing = root_node.max_spacing / std::pow(2, index.levels());
               this_node.morton_index = index.to_static_morton_index();
-              this_node.name = std::string{ "r" } + OctreeNodeIndex64::to_string(index);
+              this_node.index = index;
 
-              do_tiling_for_node(
-                { std::begin(_data), std::end(_data) }, this_node, root_node, subsubflow);
+              tile_start_node({ { std::begin(_data), std::end(_data) }, this_node, root_node },
+                              is_last_batch,
+                              subsubflow);
             })
             .name(child_task_name);
         }
@@ -1233,12 +1394,14 @@ TilingAlgorithmV3::build_execution_graph_for_first_iteration(
   return { index_task.begin_task, sort_estimate_get_start_node };
 }
 
+template<typename Strategy>
 std::pair<tf::Task, tf::Task>
-TilingAlgorithmV3::build_execution_graph_for_later_iterations(
+TilingAlgorithmV3<Strategy>::build_execution_graph_for_later_iterations(
   util::Range<PointBuffer::PointIterator> points,
   const AABB& bounds,
   uint32_t num_indexing_threads,
-  tf::Taskflow& tf)
+  tf::Taskflow& tf,
+  bool is_last_batch)
 {
   const auto chunk_size = _root_node_points.size() / num_indexing_threads;
 
@@ -1264,7 +1427,7 @@ TilingAlgorithmV3::build_execution_graph_for_later_iterations(
     "index_then_sort_then_split_ranges");
 
   auto transpose_task =
-    tf.emplace([this, bounds](tf::Subflow& subflow) {
+    tf.emplace([this, bounds, is_last_batch](tf::Subflow& subflow) {
         auto ranges_per_node = merge_selected_start_nodes(_indexed_points_ranges);
 
         if (global_config().is_journaling_enabled) {
@@ -1282,6 +1445,7 @@ TilingAlgorithmV3::build_execution_graph_for_later_iterations(
 
         // ranges_per_node is an Octree where some of the nodes contain the
         // starting data for tiling
+        std::unordered_set<OctreeNodeIndex64> start_nodes_in_batch;
 
         for (auto node : ranges_per_node.traverse_level_order()) {
           if (node->empty())
@@ -1295,18 +1459,30 @@ TilingAlgorithmV3::build_execution_graph_for_later_iterations(
             (boost::format("r%1% [%2%]") % OctreeNodeIndex64::to_string(node.index()) % num_points)
               .str();
 
+          start_nodes_in_batch.insert(node.index());
+
           subflow
-            .emplace([this, bounds, index = node.index(), _data = std::move(*node)](
+            .emplace([this, bounds, is_last_batch, index = node.index(), _data = std::move(*node)](
                        tf::Subflow& subsubflow) {
-              auto process_data = prepare_range_for_tiling(_data, index, bounds);
-
-              do_tiling_for_node(std::move(process_data.points),
-                                 process_data.node,
-                                 process_data.root_node,
-                                 subsubflow);
+              tile_start_node(
+                prepare_range_for_tiling(_data, index, bounds), is_last_batch, subsubflow);
             })
             .name(child_task_name);
         }
+
+        if (!is_last_batch) {
+          _tiled_start_nodes.insert(std::begin(start_nodes_in_batch),
+                                    std::end(start_nodes_in_batch));
+          return;
+        }
+
+        // Start nodes without points in the last batch were final as soon as the batch started
+        for (const auto& start_node : _tiled_start_nodes) {
+          if (start_nodes_in_batch.count(start_node))
+            continue;
+          subflow.emplace([this, start_node]() { _persistence.finalize_subtree(start_node); })
+            .name(concat("finalize ", node_name_from_index(start_node)));
+        }
       })
       .name("merge_ranges_for_start_nodes");
 
@@ -1317,10 +1493,37 @@ TilingAlgorithmV3::build_execution_graph_for_later_iterations(
   return { scatter_task.begin_task, transpose_task };
 }
 
+template<typename Strategy>
 void
-TilingAlgorithmV3::index_and_sort_points(util::Range<PointsIter> points,
-                                         util::Range<IndexedPointsIter> indexed_points,
-                                         const AABB& bounds) const
+TilingAlgorithmV3<Strategy>::tile_start_node(NodeTilingData&& start_node,
+                                             bool is_last_batch,
+                                             tf::Subflow& subflow)
+{
+  if (!is_last_batch) {
+    do_tiling_for_node(
+      std::move(start_node.points), start_node.node, start_node.root_node, subflow);
+    return;
+  }
+
+  // The subflow of the tiling task only joins once all nodes of the subtree are tiled
+  const auto start_node_index = start_node.node.index;
+  auto tiling_task = subflow.emplace(
+    [this, _start_node = std::move(start_node)](tf::Subflow& tiling_subflow) mutable {
+      do_tiling_for_node(std::move(_start_node.points),
+                         _start_node.node,
+                         _start_node.root_node,
+                         tiling_subflow);
+    });
+  auto finalize_task = subflow.emplace(
+    [this, start_node_index]() { _persistence.finalize_subtree(start_node_index); });
+  tiling_task.precede(finalize_task);
+}
+
+template<typename Strategy>
+void
+TilingAlgorithmV3<Strategy>::index_and_sort_points(util::Range<PointsIter> points,
+                                                   util::Range<IndexedPointsIter> indexed_points,
+                                                   const AABB& bounds) const
 {
   assert(points.size() == indexed_points.size());
 
@@ -1333,8 +1536,9 @@ TilingAlgorithmV3::index_and_sort_points(util::Range<PointsIter> points,
   indexed_points.sort();
 }
 
+template<typename Strategy>
 size_t
-TilingAlgorithmV3::estimate_start_node_level_in_octree(
+TilingAlgorithmV3<Strategy>::estimate_start_node_level_in_octree(
   util::Range<IndexedPointsIter> indexed_points,
   size_t concurrency) const
 {
@@ -1393,8 +1597,9 @@ TilingAlgorithmV3::estimate_start_node_level_in_octree(
   return MAX_LEVEL;
 }
 
-Octree<util::Range<TilingAlgorithmV3::IndexedPointsIter>>
-TilingAlgorithmV3::split_indexed_points_into_subranges(
+template<typename Strategy>
+Octree<util::Range<typename TilingAlgorithmV3<Strategy>::IndexedPointsIter>>
+TilingAlgorithmV3<Strategy>::split_indexed_points_into_subranges(
   util::Range<IndexedPointsIter> indexed_points,
   size_t level_of_subranges_in_octree) const
 {
@@ -1436,8 +1641,9 @@ TilingAlgorithmV3::split_indexed_points_into_subranges(
   return point_ranges;
 }
 
-Octree<std::vector<util::Range<TilingAlgorithmV3::IndexedPointsIter>>>
-TilingAlgorithmV3::merge_selected_start_nodes(
+template<typename Strategy>
+Octree<std::vector<util::Range<typename TilingAlgorithmV3<Strategy>::IndexedPointsIter>>>
+TilingAlgorithmV3<Strategy>::merge_selected_start_nodes(
   const std::vector<Octree<util::Range<IndexedPointsIter>>>& selected_nodes)
 {
   // Since all Octrees have nodes with non-empty ranges at the same level, this
@@ -1475,8 +1681,9 @@ TilingAlgorithmV3::merge_selected_start_nodes(
     });
 }
 
+template<typename Strategy>
 NodeTilingData
-TilingAlgorithmV3::prepare_range_for_tiling(
+TilingAlgorithmV3<Strategy>::prepare_range_for_tiling(
   const std::vector<util::Range<IndexedPointsIter>>& start_node_data,
   OctreeNodeIndex64 node_index,
   const AABB& bounds)
@@ -1501,7 +1708,7 @@ TilingAlgorithmV3::prepare_range_for_tiling(
   root_node.max_depth = _meta_parameters.max_depth;
   root_node.max_spacing = _meta_parameters.spacing_at_root;
   root_node.morton_index = {};
-  root_node.name = "r";
+  root_node.index = {};
 
   octree::NodeStructure this_node;
   this_node.bounds = get_bounds_from_node_index(node_index, bounds);
@@ -1509,26 +1716,19 @@ TilingAlgorithmV3::prepare_range_for_tiling(
   this_node.max_depth = root_node.max_depth;
   this_node.max_spacing = root_node.max_spacing / std::pow(2, node_index.levels());
   this_node.morton_index = node_index.to_static_morton_index();
-  this_node.name = std::string{ "r" } + OctreeNodeIndex64::to_string(node_index);
+  this_node.index = node_index;
 
   return { std::move(merged_data), this_node, root_node };
 }
 
+template<typename Strategy>
 void
-TilingAlgorithmV3::reconstruct_single_node(const OctreeNodeIndex64& node, const AABB& root_bounds)
+TilingAlgorithmV3<Strategy>::reconstruct_single_node(const OctreeNodeIndex64& node,
+                                                     const AABB& root_bounds)
 {
   PointBuffer data;
   for (uint8_t octant = 0; octant < 8; ++octant) {
-    const auto child_index = node.child(octant);
-    const auto node_name = concat("r", OctreeNodeIndex64::to_string(child_index));
-
-    PointBuffer tmp;
-    _persistence.retrieve_points(node_name, tmp);
-
-    if (tmp.empty())
-      continue;
-
-    data.append_buffer(tmp);
+    _persistence.append_points(node.child(octant), data);
   }
 
   // 2) Calculate morton indices for child data
@@ -1540,38 +1740,47 @@ TilingAlgorithmV3::reconstruct_single_node(const OctreeNodeIndex64& node, const
                                   root_bounds,
                                   OutlierPointsBehaviour::ClampToBounds);
 
-  // 3) Data is sorted, so we can sample directly
+  // Child nodes that were persisted in progressive order are not sorted by their MortonIndex
+  if (_meta_parameters.progressive_point_ordering) {
+    std::sort(std::begin(indexed_points), std::end(indexed_points));
+  }
+
+  // 3) Data is sorted, so we can sample directly. We only need the sampled points, the remaining
+  // points are already stored in the child nodes, so they are just compacted in place
   const auto morton_index_for_node = node.to_static_morton_index();
-  const auto selected_points_end = sample_points(_sampling_strategy,
-                                                 std::begin(indexed_points),
-                                                 std::end(indexed_points),
-                                                 morton_index_for_node,
-                                                 static_cast<int32_t>(node.levels()) - 1,
-                                                 root_bounds,
-                                                 _meta_parameters.spacing_at_root,
-                                                 SamplingBehaviour::AlwaysAdhereToMinSpacing);
+  auto& selected_points = sampling_scratch_buffer(indexed_points.size());
+  const auto [selected_points_end, remaining_points_end] =
+    sample_points_into(_sampling_strategy,
+                       std::begin(indexed_points),
+                       std::end(indexed_points),
+                       std::begin(selected_points),
+                       std::begin(indexed_points),
+                       morton_index_for_node,
+                       static_cast<int32_t>(node.levels()) - 1,
+                       _tiling_context,
+                       SamplingBehaviour::AlwaysAdhereToMinSpacing);
 
   // 4) Write to disk
   const auto node_bounds = get_bounds_from_node_index(node, root_bounds);
-  const auto node_name = concat("r", OctreeNodeIndex64::to_string(node));
 
-  _persistence.persist_points(
-    member_iterator(std::begin(indexed_points), &IndexedPoint64::point_reference),
-    member_iterator(selected_points_end, &IndexedPoint64::point_reference),
-    node_bounds,
-    node_name);
+  persist_node_points(std::begin(selected_points),
+                      selected_points_end,
+                      remaining_points_end,
+                      node_bounds,
+                      node,
+                      nullptr);
 }
 
+template<typename Strategy>
 void
-TilingAlgorithmV3::reconstruct_left_out_nodes(const AABB& root_bounds)
+TilingAlgorithmV3<Strategy>::reconstruct_left_out_nodes(const AABB& root_bounds)
 {
   if (*_level_of_start_nodes == 0) {
     return;
   }
 
   const auto node_exists = [this](const OctreeNodeIndex64& node_index) {
-    const auto node_name = concat("r", OctreeNodeIndex64::to_string(node_index));
-    return _persistence.node_exists(node_name);
+    return _persistence.node_exists(node_index);
   };
 
   // Collect all nodes that we left out and have to reconstruct. These are the
@@ -1625,4 +1834,43 @@ TilingAlgorithmV3::reconstruct_left_out_nodes(const AABB& root_bounds)
     journal_string((boost::format("Reconstructing nodes: %1% s") % delta_t_seconds).str());
   }
 }
-#pragma endregion
\ No newline at end of file
+#pragma endregion
+
+std::unique_ptr<TilingAlgorithm>
+make_tiling_algorithm(TilingStrategy tiling_strategy,
+                      SamplingStrategy& sampling_strategy,
+                      ProgressReporter* progress_reporter,
+                      PointsPersistence& persistence,
+                      TilerMetaParameters meta_parameters,
+                      TilingContext tiling_context,
+                      const fs::path& output_dir)
+{
+  return std::visit(
+    [&](auto& strategy) -> std::unique_ptr<TilingAlgorithm> {
+      using Strategy = std::decay_t<decltype(strategy)>;
+      switch (tiling_strategy) {
+        case TilingStrategy::Accurate:
+          return std::make_unique<TilingAlgorithmV1<Strategy>>(strategy,
+                                                               progress_reporter,
+                                                               persistence,
+                                                               meta_parameters,
+                                                               std::move(tiling_context));
+        case TilingStrategy::Fast:
+          return std::make_unique<TilingAlgorithmV3<Strategy>>(strategy,
+                                                               progress_reporter,
+                                                               persistence,
+                                                               meta_parameters,
+                                                               std::move(tiling_context),
+                                                               output_dir);
+      }
+      throw std::invalid_argument{ "Unknown tiling strategy" };
+    },
+    sampling_strategy);
+}
+
+// TilingAlgorithmV2 is not selectable through 'make_tiling_algorithm', it is instantiated here so
+// that it keeps compiling
+template struct TilingAlgorithmV2<RandomSortedGridSampling>;
+template struct TilingAlgorithmV2<GridCenterSampling>;
+template struct TilingAlgorithmV2<PoissonDiskSampling>;
+template struct TilingAlgorithmV2<AdaptivePoissonDiskSampling>;
\ No newline at end of file
@@ -6,11 +6,13 @@
 #include "process/Tiler.h"
 #include "tiling/Node.h"
 #include "tiling/Sampling.h"
+#include "tiling/TilingContext.h"
 
 #include <containers/Range.h>
 
 #include <memory>
 #include <taskflow/taskflow.hpp>
+#include <unordered_set>
 #include <vector>
 
 struct ProgressReporter;
@@ -65,51 +67,82 @@ struct NodeTilingData
 };
 
 /**
- * Base class for different tiling algorithms
+ * Interface of all tiling algorithms
  */
-struct TilingAlgorithmBase
+struct TilingAlgorithm
 {
-  TilingAlgorithmBase(SamplingStrategy& sampling_strategy,
-                      ProgressReporter* progress_reporter,
-                      PointsPersistence& persistence,
-                      TilerMetaParameters meta_parameters);
-  virtual ~TilingAlgorithmBase();
+  virtual ~TilingAlgorithm();
   /**
    * Build an execution graph for tiling the given range of points. Returns the start and end tasks
-   * of the execution graph
+   * of the execution graph. 'is_last_batch' is set for the last range of points of the tiling run
    */
   virtual std::pair<tf::Task, tf::Task> build_execution_graph(
     util::Range<PointBuffer::PointIterator> points,
     const AABB& bounds,
     uint32_t num_indexing_threads,
-    tf::Taskflow& tf) = 0;
+    tf::Taskflow& tf,
+    bool is_last_batch) = 0;
 
   /**
    * Finalize the computation after all points have been indexed
    */
   virtual void finalize(const AABB& bounds) {}
+};
+
+/**
+ * Base class for different tiling algorithms. All tiling algorithms are templated on the concrete
+ * type of the sampling strategy, which is resolved once when the algorithm is created (see
+ * 'make_tiling_algorithm'). Sampling on the per-node path is thus a direct call that can be inlined
+ */
+template<typename Strategy>
+struct TilingAlgorithmBase : TilingAlgorithm
+{
+  TilingAlgorithmBase(Strategy& sampling_strategy,
+                      ProgressReporter* progress_reporter,
+                      PointsPersistence& persistence,
+                      TilerMetaParameters meta_parameters,
+                      TilingContext tiling_context);
 
 protected:
   std::vector<NodeTilingData> tile_node(octree::NodeData&& node_data,
                                         const octree::NodeStructure& node_structure,
                                         const octree::NodeStructure& root_node_structure,
                                         tf::Subflow& subflow);
-  void tile_terminal_node(octree::NodeData const& all_points,
+  void tile_terminal_node(octree::NodeData& all_points,
                           octree::NodeStructure const& node,
-                          size_t previously_taken_points);
+                          size_t previously_taken_points,
+                          tf::Subflow& subflow);
   std::vector<NodeTilingData> tile_internal_node(octree::NodeData& all_points,
                                                  octree::NodeStructure const& node,
                                                  octree::NodeStructure const& root_node,
-                                                 size_t previously_taken_points);
+                                                 TilingContext const& tiling_context,
+                                                 size_t previously_taken_points,
+                                                 tf::Subflow& subflow);
+  /**
+   * Persist the given points for the given node. The points have to be sorted by their MortonIndex
+   * if progressive point ordering is enabled, in which case they are reordered into
+   * 'ordering_buffer' before persisting. 'ordering_buffer' must have room for all points and must
+   * not overlap [begin, end). With a 'subflow', sinks can persist large nodes as tasks on it
+   */
+  void persist_node_points(octree::NodeData::const_iterator begin,
+                           octree::NodeData::const_iterator end,
+                           octree::NodeData::iterator ordering_buffer,
+                           const AABB& bounds,
+                           const OctreeNodeIndex64& node_index,
+                           tf::Subflow* subflow);
   void do_tiling_for_node(octree::NodeData&& node_data,
                           const octree::NodeStructure& node_structure,
                           const octree::NodeStructure& root_node_structure,
                           tf::Subflow& subflow);
 
-  SamplingStrategy& _sampling_strategy;
+  Strategy& _sampling_strategy;
   ProgressReporter* _progress_reporter;
   PointsPersistence& _persistence;
   TilerMetaParameters _meta_parameters;
+  /**
+   * Per-level lookup tables for the root node of this tiling run
+   */
+  TilingContext _tiling_context;
 
   octree::NodeData _root_node_points;
   PointsCache _points_cache;
@@ -123,18 +156,28 @@ protected:
  * -  Sequential sorting
  * -  Processing from the root node
  */
-struct TilingAlgorithmV1 : TilingAlgorithmBase
+template<typename Strategy>
+struct TilingAlgorithmV1 : TilingAlgorithmBase<Strategy>
 {
-  TilingAlgorithmV1(SamplingStrategy& sampling_strategy,
+  TilingAlgorithmV1(Strategy& sampling_strategy,
                     ProgressReporter* progress_reporter,
                     PointsPersistence& persistence,
-                    TilerMetaParameters meta_parameters);
+                    TilerMetaParameters meta_parameters,
+                    TilingContext tiling_context);
 
   std::pair<tf::Task, tf::Task> build_execution_graph(
     util::Range<PointBuffer::PointIterator> points,
     const AABB& bounds,
     uint32_t num_indexing_threads,
-    tf::Taskflow& tf) override;
+    tf::Taskflow& tf,
+    bool is_last_batch) override;
+
+private:
+  using Base = TilingAlgorithmBase<Strategy>;
+  using Base::_meta_parameters;
+  using Base::_points_cache;
+  using Base::_root_node_points;
+  using Base::do_tiling_for_node;
 };
 
 /**
@@ -147,20 +190,33 @@ struct TilingAlgorithmV1 : TilingAlgorithmBase
  *
  * In general, a lot of parallel map/reduce operations
  */
-struct TilingAlgorithmV2 : TilingAlgorithmBase
+template<typename Strategy>
+struct TilingAlgorithmV2 : TilingAlgorithmBase<Strategy>
 {
-  TilingAlgorithmV2(SamplingStrategy& sampling_strategy,
+  TilingAlgorithmV2(Strategy& sampling_strategy,
                     ProgressReporter* progress_reporter,
                     PointsPersistence& persistence,
-                    TilerMetaParameters meta_parameters);
+                    TilerMetaParameters meta_parameters,
+                    TilingContext tiling_context);
 
   std::pair<tf::Task, tf::Task> build_execution_graph(
     util::Range<PointBuffer::PointIterator> points,
     const AABB& bounds,
     uint32_t num_indexing_threads,
-    tf::Taskflow& tf) override;
+    tf::Taskflow& tf,
+    bool is_last_batch) override;
 
 private:
+  using Base = TilingAlgorithmBase<Strategy>;
+  using Base::_meta_parameters;
+  using Base::_persistence;
+  using Base::_points_cache;
+  using Base::_root_node_points;
+  using Base::_sampling_strategy;
+  using Base::_tiling_context;
+  using Base::do_tiling_for_node;
+  using Base::persist_node_points;
+
   using IndexedPoints = std::vector<IndexedPoint64>;
   using IndexedPointsIter = typename IndexedPoints::iterator;
   using PointsIter = typename PointBuffer::PointIterator;
@@ -208,23 +264,36 @@ private:
   std::vector<Octree<util::Range<IndexedPointsIter>>> _indexed_points_ranges;
 };
 
-struct TilingAlgorithmV3 : TilingAlgorithmBase
+template<typename Strategy>
+struct TilingAlgorithmV3 : TilingAlgorithmBase<Strategy>
 {
-  TilingAlgorithmV3(SamplingStrategy& sampling_strategy,
+  TilingAlgorithmV3(Strategy& sampling_strategy,
                     ProgressReporter* progress_reporter,
                     PointsPersistence& persistence,
                     TilerMetaParameters meta_parameters,
+                    TilingContext tiling_context,
                     const fs::path& output_dir);
 
   std::pair<tf::Task, tf::Task> build_execution_graph(
     util::Range<PointBuffer::PointIterator> points,
     const AABB& bounds,
     uint32_t num_indexing_threads,
-    tf::Taskflow& tf) override;
+    tf::Taskflow& tf,
+    bool is_last_batch) override;
 
   void finalize(const AABB& bounds) override;
 
 private:
+  using Base = TilingAlgorithmBase<Strategy>;
+  using Base::_meta_parameters;
+  using Base::_persistence;
+  using Base::_points_cache;
+  using Base::_root_node_points;
+  using Base::_sampling_strategy;
+  using Base::_tiling_context;
+  using Base::do_tiling_for_node;
+  using Base::persist_node_points;
+
   using IndexedPoints = std::vector<IndexedPoint64>;
   using IndexedPointsIter = typename IndexedPoints::iterator;
   using PointsIter = typename PointBuffer::PointIterator;
@@ -233,12 +302,14 @@ private:
     util::Range<PointBuffer::PointIterator> points,
     const AABB& bounds,
     uint32_t num_indexing_threads,
-    tf::Taskflow& tf);
+    tf::Taskflow& tf,
+    bool is_last_batch);
   std::pair<tf::Task, tf::Task> build_execution_graph_for_later_iterations(
     util::Range<PointBuffer::PointIterator> points,
     const AABB& bounds,
     uint32_t num_indexing_threads,
-    tf::Taskflow& tf);
+    tf::Taskflow& tf,
+    bool is_last_batch);
 
   /**
    * Takes a range of points from a PointBuffer, calculates the Morton indices
@@ -282,6 +353,13 @@ private:
     OctreeNodeIndex64 node_index,
     const AABB& bounds);
 
+  /**
+   * Tiles the subtree below the given start node within 'subflow'. In the last batch, no more
+   * points are added to the subtree once it is tiled, so the persistence is told to finalize the
+   * subtree right away instead of at the end of the tiling run
+   */
+  void tile_start_node(NodeTilingData&& start_node, bool is_last_batch, tf::Subflow& subflow);
+
   /**
    * Reconstruct the nodes that we left out initially
    */
@@ -295,4 +373,19 @@ private:
 
   std::vector<Octree<util::Range<IndexedPointsIter>>> _indexed_points_ranges;
   std::optional<size_t> _level_of_start_nodes;
-};
\ No newline at end of file
+  // All start nodes that received points in any batch so far
+  std::unordered_set<OctreeNodeIndex64> _tiled_start_nodes;
+};
+
+/**
+ * Creates the tiling algorithm for the given strategy. The sampling strategy is visited once here
+ * and has to outlive the algorithm
+ */
+std::unique_ptr<TilingAlgorithm>
+make_tiling_algorithm(TilingStrategy tiling_strategy,
+                      SamplingStrategy& sampling_strategy,
+                      ProgressReporter* progress_reporter,
+                      PointsPersistence& persistence,
+                      TilerMetaParameters meta_parameters,
+                      TilingContext tiling_context,
+                      const fs::path& output_dir);
@@ -0,0 +1,42 @@
+#include "tiling/TilingContext.h"
+
+#include <cmath>
+
+TilingContext::TilingContext(const AABB& root_bounds, float spacing_at_root)
+  : _root_bounds(root_bounds)
+  , _spacing_at_root(spacing_at_root)
+{
+  for (int32_t node_level = -1; node_level < MaxTabulatedLevels - 1; ++node_level) {
+    const auto idx = table_index(node_level);
+    const auto spacing = compute_spacing(node_level);
+    _spacing_per_level[idx] = spacing;
+    _squared_spacing_per_level[idx] = spacing * spacing;
+    _candidate_level_per_level[idx] = compute_candidate_level(node_level);
+    _node_extent_per_level[idx] = compute_node_extent(node_level);
+  }
+}
+
+double
+TilingContext::compute_spacing(int32_t node_level) const
+{
+  // Spacing halves with each level. Since the root node is level -1, spacing at level 0 is half
+  // the spacing at root
+  return _spacing_at_root / std::pow(2, node_level + 1);
+}
+
+int32_t
+TilingContext::compute_candidate_level(int32_t node_level) const
+{
+  // We use floor() here because this guarantees that we always get a node with sidelength
+  // >= spacing. The root node (whole octree) is level '-1', so level 0 has a sidelength of half
+  // the max octree, hence we have to subtract one here
+  return std::max(
+    -1,
+    (int)std::floor(std::log2f(_root_bounds.extent().x / compute_spacing(node_level))) - 1);
+}
+
+Vector3<double>
+TilingContext::compute_node_extent(int32_t node_level) const
+{
+  return _root_bounds.extent() / std::pow(2, node_level + 1);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "datastructures/MortonIndex.h"
+#include "math/AABB.h"
+#include "math/Vector3.h"
+
+#include <array>
+#include <stdint.h>
+
+/**
+ * Lookup tables for all values of the octree that only depend on the level of a node, such as the
+ * spacing of a node or the level of the grid cells used for sampling. A TilingContext is built once
+ * for the root node of a tiling run and then shared by all nodes, so that the per-node path of the
+ * tiling algorithms and the sampling strategies does not have to recompute these values.
+ *
+ * All accessors take the level of a node, where the root node has level -1. Levels that are deeper
+ * than the tables fall back to computing the values directly
+ */
+struct TilingContext
+{
+  constexpr static int32_t MaxTabulatedLevels = 64;
+
+  TilingContext(const AABB& root_bounds, float spacing_at_root);
+
+  const AABB& root_bounds() const { return _root_bounds; }
+  float spacing_at_root() const { return _spacing_at_root; }
+
+  /**
+   * Minimum distance between points of a node at the given level
+   */
+  double spacing_at_level(int32_t node_level) const
+  {
+    return is_tabulated(node_level) ? _spacing_per_level[table_index(node_level)]
+                                    : compute_spacing(node_level);
+  }
+
+  double squared_spacing_at_level(int32_t node_level) const
+  {
+    if (!is_tabulated(node_level)) {
+      const auto spacing = compute_spacing(node_level);
+      return spacing * spacing;
+    }
+    return _squared_spacing_per_level[table_index(node_level)];
+  }
+
+  /**
+   * The last level in the octree at which the node sidelength is >= the spacing of a node at the
+   * given level. Sampling strategies that work on a grid use cells of this level. Is -1 if even the
+   * root node is smaller than the spacing
+   */
+  int32_t candidate_level(int32_t node_level) const
+  {
+    return is_tabulated(node_level) ? _candidate_level_per_level[table_index(node_level)]
+                                    : compute_candidate_level(node_level);
+  }
+
+  /**
+   * Side lengths of a node at the given level
+   */
+  Vector3<double> node_extent_at_level(int32_t node_level) const
+  {
+    return is_tabulated(node_level) ? _node_extent_per_level[table_index(node_level)]
+                                    : compute_node_extent(node_level);
+  }
+
+  /**
+   * Bounds of the node with the given key at the given level
+   */
+  template<unsigned int MaxLevels>
+  AABB node_bounds(const MortonIndex<MaxLevels>& node_key, int32_t node_level) const
+  {
+    if (node_level < 0)
+      return _root_bounds;
+
+    const auto levels = std::min(static_cast<uint32_t>(node_level + 1), MaxLevels);
+    uint64_t x = 0, y = 0, z = 0;
+    for (uint32_t level = 0; level < levels; ++level) {
+      const auto octant = node_key.get_octant_at_level(level);
+      x = (x << 1) | ((octant >> 2) & 1);
+      y = (y << 1) | ((octant >> 1) & 1);
+      z = (z << 1) | (octant & 1);
+    }
+
+    const auto extent = node_extent_at_level(static_cast<int32_t>(levels) - 1);
+    const Vector3<double> min{ _root_bounds.min.x + x * extent.x,
+                               _root_bounds.min.y + y * extent.y,
+                               _root_bounds.min.z + z * extent.z };
+    return { min, min + extent };
+  }
+
+private:
+  static bool is_tabulated(int32_t node_level)
+  {
+    return node_level >= -1 && node_level < MaxTabulatedLevels - 1;
+  }
+  static size_t table_index(int32_t node_level) { return static_cast<size_t>(node_level + 1); }
+
+  double compute_spacing(int32_t node_level) const;
+  int32_t compute_candidate_level(int32_t node_level) const;
+  Vector3<double> compute_node_extent(int32_t node_level) const;
+
+  AABB _root_bounds;
+  float _spacing_at_root;
+
+  std::array<double, MaxTabulatedLevels> _spacing_per_level;
+  std::array<double, MaxTabulatedLevels> _squared_spacing_per_level;
+  std::array<int32_t, MaxTabulatedLevels> _candidate_level_per_level;
+  std::array<Vector3<double>, MaxTabulatedLevels> _node_extent_per_level;
+};
@@ -3,6 +3,7 @@
 #include "algorithms/Enums.h"
 #include "algorithms/Pairs.h"
 
+#include <cstdint>
 #include <experimental/filesystem>
 #include <string>
 #include <unordered_set>
@@ -20,8 +21,12 @@ enum class OutputFormat
   BIN,
   // Custom binary format (compressed)
   BINZ,
+  // Custom binary format (compressed), with all nodes stored in a few large pack files
+  PACKED,
   // Cesium 3D Tiles format (https://github.com/CesiumGS/3d-tiles)
   CZM_3DTILES,
+  // Cesium 3D Tiles 1.1 format with glTF binary (.glb) point tiles instead of .pnts files
+  CZM_3DTILES_GLB,
   // LAS format
   LAS,
   // Compressed LAS format (LAZ)
@@ -29,7 +34,13 @@ enum class OutputFormat
   // Entwine format using LAS as file type
   ENTWINE_LAS,
   // Entwine format using LAZ as file type
-  ENTWINE_LAZ
+  ENTWINE_LAZ,
+  // Entwine format using uncompressed binary point records as file type
+  ENTWINE_BIN,
+  // Cloud Optimized Point Cloud, a single LAZ 1.4 file with one chunk per node (https://copc.io)
+  COPC,
+  // Potree 2.0 format with all nodes in a single octree.bin file and a binary hierarchy
+  POTREE2
 };
 
 namespace util {
@@ -39,11 +50,16 @@ static const std::unordered_set<std::pair<OutputFormat, std::string>,
   OUTPUT_FORMAT_TO_STRING_MAPPING = {
     { OutputFormat::BIN, "BIN" },
     { OutputFormat::BINZ, "BINZ" },
+    { OutputFormat::PACKED, "PACKED" },
     { OutputFormat::CZM_3DTILES, "3DTILES" },
+    { OutputFormat::CZM_3DTILES_GLB, "3DTILES_GLB" },
     { OutputFormat::LAS, "LAS" },
     { OutputFormat::LAZ, "LAZ" },
     { OutputFormat::ENTWINE_LAS, "ENTWINE_LAS" },
     { OutputFormat::ENTWINE_LAZ, "ENTWINE_LAZ" },
+    { OutputFormat::ENTWINE_BIN, "ENTWINE_BIN" },
+    { OutputFormat::COPC, "COPC" },
+    { OutputFormat::POTREE2, "POTREE2" },
   };
 }
 
@@ -75,6 +91,35 @@ enum class Compressed
   Yes
 };
 
+/**
+ * Codecs for the custom binary format. The codec is stored in the header of each file, so files can
+ * be read back independent of the codec that a BinaryPersistence is configured with. The numeric
+ * values are part of the file format and must not change
+ */
+enum class BinaryCodec : uint8_t
+{
+  // Uncompressed
+  None = 0,
+  // zlib/deflate, as used by the legacy BINZ format
+  Deflate = 1,
+  // LZ4, very fast compression and decompression at a moderate compression ratio
+  LZ4 = 2,
+  // Zstandard, better compression ratio than LZ4 with a selectable level
+  Zstd = 3
+};
+
+/**
+ * How the point data of the custom binary format is laid out before it is compressed. Like the
+ * codec, the encoding is stored in the header of each file
+ */
+enum class BinaryEncoding : uint8_t
+{
+  // Attribute columns as they are stored in memory
+  Plain = 0,
+  // Attribute columns are transformed so that they compress better, see bin::ColumnFilter
+  Filtered = 1
+};
+
 namespace progress {
 const static std::string LOADING{ "loading" };
 const static std::string INDEXING{ "indexing" };
@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <chrono>
 #include <exception>
 #include <experimental/filesystem>
@@ -183,6 +184,7 @@ parseArguments(int argc, char** argv)
   std::vector<std::string> source_files;
   std::string cache_size_string;
   std::string rgb_mapping_string;
+  std::string binz_codec_string;
   bool create_journal;
 
   bpo::options_description options("Options");
@@ -224,17 +226,78 @@ parseArguments(int argc, char** argv)
     "output-format",
     bpo::value<std::string>()->default_value("3DTILES"),
     "Output format for the conversion. Accepted values are: 3DTILES (Cesium 3D "
-    "Tiles format), "
+    "Tiles format), 3DTILES_GLB (Cesium 3D Tiles 1.1 format with glTF binary point tiles, see "
+    "--meshopt), "
     "ENTWINE_LAS (Entwine format using LAS files, compatible with Potree), "
     "ENTWINE_LAZ (Entwine "
-    "format using LAZ files, compatible with Potree), BIN (custom binary "
-    "format, uncompressed), BINZ (custom binary format, compressed)")(
+    "format using LAZ files, compatible with Potree), ENTWINE_BIN (Entwine format using "
+    "uncompressed binary files, readable by PDAL), BIN (custom binary "
+    "format, uncompressed), BINZ (custom binary format, compressed with --binz-codec), PACKED "
+    "(custom binary format, compressed with --binz-codec and stored in a few large pack files "
+    "with an index file instead of one file per node), COPC (Cloud Optimized Point Cloud, a "
+    "single LAZ file named pointcloud.copc.laz that stores every node as a chunk of its own), "
+    "POTREE2 (Potree 2.0 format, with all nodes in octree.bin and the hierarchy in hierarchy.bin). "
+    "Multiple formats can be separated by commas (e.g. 3DTILES,ENTWINE_LAZ) to write all of them "
+    "in a single run, each into a subdirectory of the output directory named after the format")(
     "sampling",
     bpo::value<std::string>(&tiler_args.sampling_strategy)->default_value("MIN_DISTANCE"),
     "Sampling strategy to use. Possible values are RANDOM_GRID, GRID_CENTER, "
-    "MIN_DISTANCE. The quality of the resulting point cloud can be adjusted "
+    "MIN_DISTANCE, MIN_DISTANCE_FAST. The quality of the resulting point cloud can be adjusted "
     "with this parameter, with RANDOM_GRID corresponding to the lowest "
     "quality and MIN_DISTANCE to the highest quality.")(
+    "adaptive-sampling-budget",
+    bpo::value<float>(&tiler_args.adaptive_sampling_budget)->default_value(0.f),
+    "Only used with MIN_DISTANCE_FAST sampling. Maximum number of points that are analyzed on "
+    "average per selected point on each level of the octree. Levels where the measured ratio of "
+    "points to selected points exceeds this budget are subsampled before the minimum distance "
+    "test. Smaller values are faster but result in lower quality, approaching RANDOM_GRID. A "
+    "value of 0 disables the budget and uses a fixed density per level.")(
+    "progressive-ordering",
+    bpo::bool_switch(&tiler_args.progressive_point_ordering)->default_value(false),
+    "Write the points of each node in progressive order instead of Morton order, so that every "
+    "prefix of the points of a node is a uniform subsample of the whole node. Viewers can then "
+    "render partially loaded nodes. Only supported when output-format is 3DTILES, BIN, BINZ or "
+    "PACKED")(
+    "quantize-pnts",
+    bpo::bool_switch(&tiler_args.quantize_pnts)->default_value(false),
+    "Write positions as 16-bit integers relative to the bounds of each node (POSITION_QUANTIZED) "
+    "and normals as NORMAL_OCT16P in the .pnts files. This roughly halves the size of the files "
+    "at the cost of precision. With 3DTILES_GLB, positions and normals are quantized the same way "
+    "using KHR_mesh_quantization. Only supported when output-format is 3DTILES or 3DTILES_GLB")(
+    "implicit-tiling",
+    bpo::bool_switch(&tiler_args.implicit_tiling)->default_value(false),
+    "Write a 3D Tiles 1.1 implicit tileset: a single tileset.json with an implicit octree and "
+    ".subtree files with the availability of the tiles, instead of a tree of JSON files. Tiles are "
+    "named {level}-{x}-{y}-{z}.pnts (or .glb). Only supported when output-format is 3DTILES or "
+    "3DTILES_GLB")(
+    "meshopt",
+    bpo::bool_switch(&tiler_args.meshopt_compression)->default_value(false),
+    "Compress the attributes of the .glb tiles losslessly with the meshopt vertex codec "
+    "(EXT_meshopt_compression), which clients decode very fast. Only supported when "
+    "output-format is 3DTILES_GLB")(
+    "async-writes",
+    bpo::bool_switch(&tiler_args.async_file_writes)->default_value(false),
+    "Write the node files in the background instead of from the tiling threads. On Linux kernels "
+    "that support it, the files are opened, written and closed in batches through io_uring, "
+    "otherwise a small pool of threads writes them. Helps when writing many small files, e.g. to "
+    "network filesystems")(
+    "background-cleanup",
+    bpo::bool_switch(&tiler_args.background_cleanup)->default_value(false),
+    "Instead of removing the files of a previous run from the output directory before tiling, "
+    "rename the output directory to a hidden sibling and remove that while tiling. Startup then "
+    "takes the same time regardless of the size of the previous output. Falls back to removing "
+    "the files before tiling if the output directory can't be renamed, e.g. if it is the working "
+    "directory")(
+    "binz-codec",
+    bpo::value<std::string>(&binz_codec_string)->default_value("LZ4"),
+    "Codec used for compressing the files when output-format is BINZ or PACKED. Accepted values are: LZ4 "
+    "(fastest), ZSTD (better compression ratio, see --binz-codec-level), DEFLATE (zlib). Files "
+    "store their codec, so they can be read regardless of this setting")(
+    "binz-codec-level",
+    bpo::value<int>(&tiler_args.binz_codec_level)->default_value(0),
+    "Compression level for --binz-codec. 0 selects a fast default level. For ZSTD and DEFLATE, "
+    "higher levels compress better but slower. For LZ4, this is the acceleration factor, so higher "
+    "values are faster but compress less")(
     "calculate-rgb-from",
     bpo::value<std::string>(&rgb_mapping_string),
     "Calculate RGB values from one of the other point attributes. Accepted "
@@ -382,23 +445,48 @@ parseArguments(int argc, char** argv)
       tiler_args.diagonal_fraction = 250;
     }
 
-    tiler_args.output_format = [&]() {
+    const auto output_formats = [&]() {
       const std::unordered_map<std::string, OutputFormat> supported_output_formats = {
         { "3DTILES", OutputFormat::CZM_3DTILES },
+        { "3DTILES_GLB", OutputFormat::CZM_3DTILES_GLB },
         { "BIN", OutputFormat::BIN },
+        { "BINZ", OutputFormat::BINZ },
+        { "PACKED", OutputFormat::PACKED },
         { "LAS", OutputFormat::LAS },
         { "LAZ", OutputFormat::LAZ },
         { "ENTWINE_LAS", OutputFormat::ENTWINE_LAS },
-        { "ENTWINE_LAZ", OutputFormat::ENTWINE_LAZ }
+        { "ENTWINE_LAZ", OutputFormat::ENTWINE_LAZ },
+        { "ENTWINE_BIN", OutputFormat::ENTWINE_BIN },
+        { "COPC", OutputFormat::COPC },
+        { "POTREE2", OutputFormat::POTREE2 }
       };
-      const auto& output_format_arg = tiler_variables["output-format"].as<std::string>();
-      const auto matching_output_format = supported_output_formats.find(output_format_arg);
-      if (matching_output_format == supported_output_formats.end()) {
-        std::cout << "Output format \"" << output_format_arg << "\" not recognized!" << std::endl;
-        std::exit(EXIT_FAILURE);
+      // Multiple formats are separated by commas and written in a single run
+      std::vector<std::string> output_format_args;
+      boost::split(output_format_args,
+                   tiler_variables["output-format"].as<std::string>(),
+                   boost::is_any_of(","));
+      std::vector<OutputFormat> output_formats;
+      for (const auto& output_format_arg : output_format_args) {
+        const auto matching_output_format = supported_output_formats.find(output_format_arg);
+        if (matching_output_format == supported_output_formats.end()) {
+          std::cout << "Output format \"" << output_format_arg << "\" not recognized!"
+                    << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+        if (std::find(std::begin(output_formats),
+                      std::end(output_formats),
+                      matching_output_format->second) != std::end(output_formats)) {
+          std::cout << "Output format \"" << output_format_arg << "\" specified more than once!"
+                    << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+        output_formats.push_back(matching_output_format->second);
       }
-      return matching_output_format->second;
+      return output_formats;
     }();
+    tiler_args.output_format = output_formats.front();
+    tiler_args.additional_output_formats.assign(std::begin(output_formats) + 1,
+                                                std::end(output_formats));
 
     if (tiler_variables.count("calculate-rgb-from")) {
       tiler_args.rgb_mapping = [&]() {
@@ -417,6 +505,21 @@ parseArguments(int argc, char** argv)
       }();
     }
 
+    tiler_args.binz_codec = [&]() {
+      const std::unordered_map<std::string, BinaryCodec> supported_binz_codecs = {
+        { "DEFLATE", BinaryCodec::Deflate },
+        { "LZ4", BinaryCodec::LZ4 },
+        { "ZSTD", BinaryCodec::Zstd }
+      };
+      const auto matching_binz_codec_iter = supported_binz_codecs.find(binz_codec_string);
+      if (matching_binz_codec_iter == std::end(supported_binz_codecs)) {
+        std::cout << "Parameter \"" << binz_codec_string
+                  << "\" for option --binz-codec not recognized!" << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+      return matching_binz_codec_iter->second;
+    }();
+
     if (tiler_variables.count("cache-size")) {
       parse_memory_size(cache_size_string)
         .map([&tiler_args](unit::byte cache_size) { tiler_args.cache_size = cache_size; })
@@ -79,6 +79,50 @@ TEST_CASE("stable_partition_with_jumps is stable on odd count input",
   REQUIRE(std::is_sorted(pivot, std::end(numbers)));
 }
 
+TEST_CASE("partition_copy_with_jumps is stable and compacts in place",
+          "[partition_copy_with_jumps]")
+{
+  constexpr size_t Count = 1025;
+  auto numbers = generate_random_numbers(Count, 0, 999);
+
+  std::sort(std::begin(numbers), std::end(numbers));
+
+  const auto predicate = [](int number) { return (number % 7) == 0; };
+  const auto matches_count = std::count_if(std::begin(numbers), std::end(numbers), predicate);
+
+  std::vector<int> expected_selected, expected_rejected;
+  std::partition_copy(std::begin(numbers),
+                      std::end(numbers),
+                      std::back_inserter(expected_selected),
+                      std::back_inserter(expected_rejected),
+                      predicate);
+
+  // Selected numbers go into a preallocated scratch buffer, rejected numbers are compacted at the
+  // front of the input range
+  std::vector<int> scratch(Count);
+  const auto [selected_end, rejected_end] = partition_copy_with_jumps(
+    std::begin(numbers),
+    std::end(numbers),
+    std::begin(scratch),
+    std::begin(numbers),
+    [&](auto current, auto end) {
+      if (!predicate(*current)) {
+        const auto match = std::find_if(current + 1, end, predicate);
+        if (match == end)
+          return std::make_pair(end, end);
+        return std::make_pair(match, match + 1);
+      }
+      return std::make_pair(current, current + 1);
+    });
+
+  REQUIRE(std::distance(std::begin(scratch), selected_end) == matches_count);
+  REQUIRE(std::distance(std::begin(numbers), rejected_end) ==
+          static_cast<ptrdiff_t>(Count - matches_count));
+
+  REQUIRE(std::equal(std::begin(scratch), selected_end, std::begin(expected_selected)));
+  REQUIRE(std::equal(std::begin(numbers), rejected_end, std::begin(expected_rejected)));
+}
+
 SCENARIO("Algorithm - merge - single range", "[Algorithm]")
 {
   using Range_t = util::Range<std::vector<int>::iterator>;
@@ -0,0 +1,122 @@
+#include "catch.hpp"
+
+#include "io/AsyncFileWriter.h"
+
+#include <experimental/filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::experimental::filesystem;
+
+static std::string
+read_file(const std::string& file_path)
+{
+  std::ifstream fs{ file_path, std::ios::in | std::ios::binary };
+  return { std::istreambuf_iterator<char>{ fs }, std::istreambuf_iterator<char>{} };
+}
+
+static std::string
+file_contents(size_t file_index, size_t size)
+{
+  std::string contents(size, '\0');
+  for (size_t idx = 0; idx < size; ++idx) {
+    contents[idx] = static_cast<char>((file_index * 31 + idx) % 251);
+  }
+  return contents;
+}
+
+static void
+write_files_with_backend(AsyncFileWriter::Backend backend)
+{
+  const std::string work_dir = "./_async_file_writer_test_";
+  fs::remove_all(work_dir);
+  fs::create_directories(work_dir);
+
+  constexpr size_t NumFiles = 300;
+  const auto file_path = [&work_dir](size_t file_index) {
+    return work_dir + "/" + std::to_string(file_index) + ".bin";
+  };
+  const auto file_size = [](size_t file_index) { return (file_index * 977) % 20000; };
+
+  {
+    // The small limit makes writers wait for each other, a single larger file is still written
+    AsyncFileWriter writer{ 64 * 1024, backend };
+    if (backend == AsyncFileWriter::Backend::ThreadPool) {
+      REQUIRE(writer.backend() == AsyncFileWriter::Backend::ThreadPool);
+    }
+
+    for (size_t idx = 0; idx < NumFiles; ++idx) {
+      const auto contents = file_contents(idx, file_size(idx));
+      writer.write_file(file_path(idx), contents.data(), contents.size());
+    }
+    const auto large_contents = file_contents(NumFiles, 200 * 1024);
+    writer.write_file(file_path(NumFiles), large_contents.data(), large_contents.size());
+
+    // Files are replaced by later writes
+    const auto replaced_contents = file_contents(42, 123);
+    writer.write_file(file_path(0), replaced_contents.data(), replaced_contents.size());
+    writer.wait_for_file(file_path(0));
+    REQUIRE(read_file(file_path(0)) == replaced_contents);
+
+    REQUIRE(writer.wait_for_all() == 0);
+    for (size_t idx = 1; idx < NumFiles; ++idx) {
+      REQUIRE(read_file(file_path(idx)) == file_contents(idx, file_size(idx)));
+    }
+    REQUIRE(read_file(file_path(NumFiles)) == large_contents);
+
+    // Writes to the same file happen in the order in which they were queued, so the last one wins
+    constexpr size_t NumRewrites = 100;
+    const auto rewrite_size = [](size_t rewrite_index) { return 1000 + rewrite_index * 37; };
+    for (size_t idx = 0; idx < NumRewrites; ++idx) {
+      const auto contents = file_contents(idx, rewrite_size(idx));
+      writer.write_file(file_path(1), contents.data(), contents.size());
+    }
+    REQUIRE(writer.wait_for_all() == 0);
+    REQUIRE(read_file(file_path(1)) ==
+            file_contents(NumRewrites - 1, rewrite_size(NumRewrites - 1)));
+
+    writer.write_file(work_dir + "/missing_dir/file.bin", large_contents.data(), 16);
+    REQUIRE(writer.wait_for_all() == 1);
+  }
+
+  fs::remove_all(work_dir);
+}
+
+TEST_CASE("AsyncFileWriter writes all files with io_uring", "[AsyncFileWriter]")
+{
+  // Falls back to the thread pool where io_uring is not available
+  write_files_with_backend(AsyncFileWriter::Backend::IOUring);
+}
+
+TEST_CASE("AsyncFileWriter writes all files with a thread pool", "[AsyncFileWriter]")
+{
+  write_files_with_backend(AsyncFileWriter::Backend::ThreadPool);
+}
+
+TEST_CASE("write_file_async writes through the current AsyncFileWriter", "[AsyncFileWriter]")
+{
+  const std::string work_dir = "./_async_file_writer_global_test_";
+  fs::remove_all(work_dir);
+  fs::create_directories(work_dir);
+  const std::string contents = "schwarzwald";
+
+  // Without an AsyncFileWriter, files are written right away
+  REQUIRE(write_file_async(work_dir + "/sync.txt", contents.data(), contents.size()));
+  REQUIRE(read_file(work_dir + "/sync.txt") == contents);
+  REQUIRE(!write_file_async(work_dir + "/missing_dir/sync.txt", contents.data(), contents.size()));
+
+  {
+    AsyncFileWriter writer;
+    set_async_file_writer(&writer);
+    REQUIRE(write_file_async(work_dir + "/async.txt", contents.data(), contents.size()));
+    wait_for_file_write(work_dir + "/async.txt");
+    REQUIRE(read_file(work_dir + "/async.txt") == contents);
+  }
+
+  // The destroyed writer is not used anymore
+  REQUIRE(!write_file_async(work_dir + "/missing_dir/sync.txt", contents.data(), contents.size()));
+
+  fs::remove_all(work_dir);
+}
@@ -1,13 +1,19 @@
 #include "catch.hpp"
 
+#include "io/AsyncFileWriter.h"
 #include "io/BinaryPersistence.h"
 #include "math/AABB.h"
 #include "pointcloud/PointAttributes.h"
 #include "tiling/OctreeAlgorithms.h"
 
+#include <fstream>
 #include <random>
 #include <string>
 
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace bio = boost::iostreams;
 using namespace std::string_literals;
 
 static PointBuffer
@@ -85,15 +91,16 @@ TEST_CASE("BinaryPersistence for points is lossless")
     const auto points_begin = std::begin(octant_range);
     const auto points_end = std::end(octant_range);
 
-    const auto node_name = "_persistence_test_"s;
+    const OctreeNodeIndex64 node_index{ 7, 0, 1 };
+    const auto node_name = node_name_from_index(node_index);
     const auto node_bounds = get_bounds_from_morton_index(points_begin->morton_index, bounds, 0);
 
     auto point_references = point_references_from_indexed_points(points_begin, points_end);
     persistence.persist_points(
-      std::begin(point_references), std::end(point_references), node_bounds, node_name);
+      std::begin(point_references), std::end(point_references), node_bounds, node_index);
 
     PointBuffer retrieved_points;
-    persistence.retrieve_points(node_name, retrieved_points);
+    persistence.retrieve_points(node_index, retrieved_points);
 
     // Delete temporary file of LASPersistence so that we don't leave any
     // garbage when running this test!
@@ -102,4 +109,409 @@ TEST_CASE("BinaryPersistence for points is lossless")
 
     compare_points(point_references, retrieved_points);
   }
-}
\ No newline at end of file
+}
+
+static PointBuffer
+generate_random_points_with_attributes(size_t count, const AABB& bounds)
+{
+  std::mt19937 mt{ static_cast<unsigned int>(time(nullptr)) };
+  std::uniform_real_distribution<double> x_dist{ bounds.min.x, bounds.max.x };
+  std::uniform_real_distribution<double> y_dist{ bounds.min.y, bounds.max.y };
+  std::uniform_real_distribution<double> z_dist{ bounds.min.z, bounds.max.z };
+  std::uniform_int_distribution<int> byte_dist{ 0, 255 };
+  std::uniform_int_distribution<int> intensity_dist{ 0, 65535 };
+
+  std::vector<Vector3<double>> positions;
+  std::vector<Vector3<uint8_t>> colors;
+  std::vector<Vector3<float>> normals;
+  std::vector<uint16_t> intensities;
+  std::vector<uint8_t> classifications;
+  std::vector<uint8_t> edge_of_flight_lines;
+  std::vector<double> gps_times;
+  std::vector<uint8_t> number_of_returns;
+  std::vector<uint8_t> return_numbers;
+  std::vector<uint16_t> point_source_ids;
+  std::vector<uint8_t> scan_direction_flags;
+  std::vector<int8_t> scan_angle_ranks;
+  std::vector<uint8_t> user_data;
+  for (size_t idx = 0; idx < count; ++idx) {
+    positions.push_back({ x_dist(mt), y_dist(mt), z_dist(mt) });
+    colors.push_back({ static_cast<uint8_t>(byte_dist(mt)),
+                       static_cast<uint8_t>(byte_dist(mt)),
+                       static_cast<uint8_t>(byte_dist(mt)) });
+    normals.push_back({ 0.f, static_cast<float>(byte_dist(mt)) / 255.f, 1.f });
+    intensities.push_back(static_cast<uint16_t>(intensity_dist(mt)));
+    classifications.push_back(static_cast<uint8_t>(byte_dist(mt) % 32));
+    edge_of_flight_lines.push_back(static_cast<uint8_t>(idx % 1000 == 0));
+    gps_times.push_back(1e8 + idx * 1e-5 - byte_dist(mt) * 1e-6);
+    number_of_returns.push_back(static_cast<uint8_t>(1 + byte_dist(mt) % 3));
+    return_numbers.push_back(static_cast<uint8_t>(1 + (idx / 7) % 3));
+    point_source_ids.push_back(static_cast<uint16_t>(idx / 300));
+    scan_direction_flags.push_back(static_cast<uint8_t>((idx / 500) % 2));
+    scan_angle_ranks.push_back(static_cast<int8_t>(byte_dist(mt) - 128));
+    user_data.push_back(0);
+  }
+
+  return { count,
+           std::move(positions),
+           std::move(colors),
+           std::move(normals),
+           std::move(intensities),
+           std::move(classifications),
+           std::move(edge_of_flight_lines),
+           std::move(gps_times),
+           std::move(number_of_returns),
+           std::move(return_numbers),
+           std::move(point_source_ids),
+           std::move(scan_direction_flags),
+           std::move(scan_angle_ranks),
+           std::move(user_data) };
+}
+
+static void
+require_equal_points(const PointBuffer& expected, const PointBuffer& actual)
+{
+  REQUIRE(expected.count() == actual.count());
+  REQUIRE(expected.positions() == actual.positions());
+  REQUIRE(expected.rgbColors() == actual.rgbColors());
+  REQUIRE(expected.normals() == actual.normals());
+  REQUIRE(expected.intensities() == actual.intensities());
+  REQUIRE(expected.classifications() == actual.classifications());
+  REQUIRE(expected.edge_of_flight_lines() == actual.edge_of_flight_lines());
+  REQUIRE(expected.gps_times() == actual.gps_times());
+  REQUIRE(expected.number_of_returns() == actual.number_of_returns());
+  REQUIRE(expected.return_numbers() == actual.return_numbers());
+  REQUIRE(expected.point_source_ids() == actual.point_source_ids());
+  REQUIRE(expected.scan_direction_flags() == actual.scan_direction_flags());
+  REQUIRE(expected.scan_angle_ranks() == actual.scan_angle_ranks());
+  REQUIRE(expected.user_data() == actual.user_data());
+}
+
+static PointAttributes
+all_binary_attributes()
+{
+  return BinaryPersistence::supported_output_attributes();
+}
+
+static PointAttributes
+position_and_intensity_attributes()
+{
+  PointAttributes attributes;
+  attributes.insert(PointAttribute::Position);
+  attributes.insert(PointAttribute::Intensity);
+  return attributes;
+}
+
+/**
+ * Writes the given points in the legacy layout of binary files, which has no header
+ */
+template<typename Stream>
+static void
+write_legacy_points(const PointBuffer& points, Stream& stream)
+{
+  write_binary(BinaryPersistence::INTENSITY_BIT, stream);
+  write_binary(static_cast<uint64_t>(points.count()), stream);
+  for (auto& position : points.positions()) {
+    write_binary(position, stream);
+  }
+  for (auto intensity : points.intensities()) {
+    write_binary(intensity, stream);
+  }
+}
+
+TEST_CASE("BinaryPersistence round-trips points with every codec")
+{
+  const auto root_folder = "."s;
+  const auto attributes = all_binary_attributes();
+
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  const auto points = generate_random_points_with_attributes(10'000, bounds);
+
+  const OctreeNodeIndex64 node_index{ 7, 0, 2 };
+  const auto node_name = node_name_from_index(node_index);
+  for (auto codec :
+       { BinaryCodec::None, BinaryCodec::Deflate, BinaryCodec::LZ4, BinaryCodec::Zstd }) {
+    for (auto encoding : { BinaryEncoding::Plain, BinaryEncoding::Filtered }) {
+      for (auto level : { 0, 3 }) {
+        BinaryPersistence persistence{
+          root_folder, attributes, attributes, codec, level, encoding
+        };
+        persistence.persist_points(points, bounds, node_index);
+
+        PointBuffer retrieved_points;
+        persistence.retrieve_points(node_index, retrieved_points);
+
+        fs::remove(
+          concat(root_folder, "/", node_name, codec == BinaryCodec::None ? ".bin" : ".binz"));
+
+        require_equal_points(points, retrieved_points);
+      }
+    }
+  }
+}
+
+TEST_CASE("BinaryPersistence reads back files that are written asynchronously")
+{
+  const auto root_folder = "."s;
+  const auto attributes = all_binary_attributes();
+
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  const auto points = generate_random_points_with_attributes(10'000, bounds);
+
+  AsyncFileWriter file_writer;
+  set_async_file_writer(&file_writer);
+  BinaryPersistence persistence{ root_folder, attributes, attributes, BinaryCodec::LZ4 };
+
+  // Every node is read back right after it was queued, so reading has to wait for the write
+  std::vector<OctreeNodeIndex64> node_indices;
+  for (uint8_t octant = 0; octant < 8; ++octant) {
+    node_indices.push_back(OctreeNodeIndex64{ octant, 3 });
+    persistence.persist_points(points, bounds, node_indices.back());
+    REQUIRE(persistence.node_exists(node_indices.back()));
+
+    PointBuffer retrieved_points;
+    persistence.retrieve_points(node_indices.back(), retrieved_points);
+    require_equal_points(points, retrieved_points);
+  }
+
+  REQUIRE(file_writer.wait_for_all() == 0);
+  set_async_file_writer(nullptr);
+
+  for (const auto& node_index : node_indices) {
+    fs::remove(concat(root_folder, "/", node_name_from_index(node_index), ".binz"));
+  }
+}
+
+TEST_CASE("PointBuffer::gather copies the referenced points column by column")
+{
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  const auto first_points = generate_random_points_with_attributes(100, bounds);
+  const auto second_points = generate_random_points_with_attributes(50, bounds);
+
+  // Runs of points from two different PointBuffers
+  std::vector<PointBuffer::PointConstReference> point_references;
+  for (size_t idx = 0; idx < 100; idx += 3) {
+    point_references.push_back(first_points.get_point(99 - idx));
+    if (idx % 2) {
+      point_references.push_back(second_points.get_point(idx / 2));
+    }
+  }
+  const PointBuffer expected_points{ gsl::make_span(point_references) };
+
+  PointBuffer gathered_points{ 1000, all_binary_attributes() };
+  gathered_points.gather(std::begin(point_references), std::end(point_references));
+  require_equal_points(expected_points, gathered_points);
+
+  // Attributes that the PointBuffer of a later point doesn't have get default values
+  const auto positions_only = generate_random_points(1, bounds);
+  point_references.push_back(positions_only.get_point(0));
+  gathered_points.gather(std::begin(point_references), std::end(point_references));
+  REQUIRE(gathered_points.count() == point_references.size());
+  REQUIRE(gathered_points.positions().back() == positions_only.positions().front());
+  REQUIRE(gathered_points.intensities().back() == 0);
+  REQUIRE(gathered_points.gps_times().back() == 0);
+
+  gathered_points.gather(std::begin(point_references), std::begin(point_references));
+  REQUIRE(gathered_points.empty());
+}
+
+TEST_CASE("BinaryPersistence encodes a PointBuffer like a range of points")
+{
+  const auto attributes = all_binary_attributes();
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  const auto points = generate_random_points_with_attributes(1000, bounds);
+
+  BinaryPersistence persistence{
+    ".", attributes, attributes, BinaryCodec::LZ4, 0, BinaryEncoding::Filtered
+  };
+  // The encoded points are only valid until the next call
+  const auto encoded_range = persistence.encode_points(std::begin(points), std::end(points));
+  const std::vector<std::byte> expected{ std::begin(encoded_range), std::end(encoded_range) };
+  const auto encoded_buffer = persistence.encode_points(points);
+  const std::vector<std::byte> actual{ std::begin(encoded_buffer), std::end(encoded_buffer) };
+  REQUIRE(actual == expected);
+}
+
+TEST_CASE("Filtered BinaryPersistence files are smaller for sorted points")
+{
+  const auto root_folder = "."s;
+  const auto attributes = all_binary_attributes();
+
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  auto points = generate_random_points_with_attributes(10'000, bounds);
+  std::sort(std::begin(points.positions()),
+            std::end(points.positions()),
+            [](const auto& l, const auto& r) { return l.x < r.x; });
+  std::sort(std::begin(points.classifications()), std::end(points.classifications()));
+
+  const auto file_size_with_encoding = [&](BinaryEncoding encoding) {
+    BinaryPersistence persistence{
+      root_folder, attributes, attributes, BinaryCodec::LZ4, 0, encoding
+    };
+    const OctreeNodeIndex64 node_index{ 7, 0, 3 };
+    const auto node_name = node_name_from_index(node_index);
+    persistence.persist_points(points, bounds, node_index);
+
+    PointBuffer retrieved_points;
+    persistence.retrieve_points(node_index, retrieved_points);
+    require_equal_points(points, retrieved_points);
+
+    const auto file_path = concat(root_folder, "/", node_name, ".binz");
+    const auto file_size = fs::file_size(file_path);
+    fs::remove(file_path);
+    return file_size;
+  };
+
+  REQUIRE(file_size_with_encoding(BinaryEncoding::Filtered) <
+          file_size_with_encoding(BinaryEncoding::Plain));
+}
+
+TEST_CASE("BinaryPersistence detects the codec of a file from its header")
+{
+  const auto root_folder = "."s;
+  const auto attributes = all_binary_attributes();
+
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  const auto points = generate_random_points_with_attributes(1000, bounds);
+
+  BinaryPersistence zstd_persistence{ root_folder, attributes, attributes, BinaryCodec::Zstd, 5 };
+  BinaryPersistence lz4_persistence{ root_folder, attributes, attributes, Compressed::Yes };
+
+  const OctreeNodeIndex64 node_index{ 7, 0, 4 };
+  const auto node_name = node_name_from_index(node_index);
+  zstd_persistence.persist_points(points, bounds, node_index);
+
+  PointBuffer retrieved_points;
+  lz4_persistence.retrieve_points(node_index, retrieved_points);
+
+  fs::remove(concat(root_folder, "/", node_name, ".binz"));
+
+  require_equal_points(points, retrieved_points);
+}
+
+TEST_CASE("BinaryPersistence reads files without a header")
+{
+  const auto root_folder = "."s;
+  const auto attributes = position_and_intensity_attributes();
+
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  auto points = generate_random_points(100, bounds);
+  points.intensities().resize(points.count(), 42);
+
+  const OctreeNodeIndex64 node_index{ 7, 0, 5 };
+  const auto node_name = node_name_from_index(node_index);
+  const auto file_path = concat(root_folder, "/", node_name, ".bin");
+  {
+    std::ofstream fs{ file_path, std::ios::out | std::ios::binary };
+    write_legacy_points(points, fs);
+  }
+
+  BinaryPersistence persistence{ root_folder, attributes, attributes, Compressed::No };
+  PointBuffer retrieved_points;
+  persistence.retrieve_points(node_index, retrieved_points);
+
+  fs::remove(file_path);
+
+  REQUIRE(points.positions() == retrieved_points.positions());
+  REQUIRE(points.intensities() == retrieved_points.intensities());
+}
+
+TEST_CASE("BinaryPersistence reads zlib compressed files without a header")
+{
+  const auto root_folder = "."s;
+  const auto attributes = position_and_intensity_attributes();
+
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  auto points = generate_random_points(100, bounds);
+  points.intensities().resize(points.count(), 42);
+
+  const OctreeNodeIndex64 node_index{ 7, 0, 5 };
+  const auto node_name = node_name_from_index(node_index);
+  const auto file_path = concat(root_folder, "/", node_name, ".binz");
+  {
+    // Legacy .binz files are the legacy layout compressed with zlib as a whole
+    std::ofstream fs{ file_path, std::ios::out | std::ios::binary };
+    bio::filtering_ostream stream;
+    stream.push(bio::zlib_compressor{});
+    stream.push(fs);
+    write_legacy_points(points, stream);
+  }
+
+  BinaryPersistence persistence{ root_folder, attributes, attributes, Compressed::Yes };
+  PointBuffer retrieved_points;
+  persistence.retrieve_points(node_index, retrieved_points);
+
+  fs::remove(file_path);
+
+  REQUIRE(points.positions() == retrieved_points.positions());
+  REQUIRE(points.intensities() == retrieved_points.intensities());
+}
+
+TEST_CASE("BinaryPersistence maps uncompressed files without copying")
+{
+  const auto root_folder = "."s;
+  const auto attributes = all_binary_attributes();
+
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  const auto points = generate_random_points_with_attributes(1001, bounds);
+
+  BinaryPersistence persistence{ root_folder, attributes, attributes, Compressed::No };
+  const OctreeNodeIndex64 node_index{ 7, 0, 6 };
+  const auto node_name = node_name_from_index(node_index);
+  persistence.persist_points(points, bounds, node_index);
+
+  {
+    auto mapped_points = persistence.map_points(node_index);
+    REQUIRE(mapped_points);
+
+    const auto file_begin = reinterpret_cast<const std::byte*>(mapped_points->file.data());
+    const auto file_end = file_begin + mapped_points->file.size();
+    const auto is_in_file = [&](const auto& column) {
+      const auto column_begin = reinterpret_cast<const std::byte*>(column.data());
+      return column_begin >= file_begin && column_begin < file_end &&
+             (reinterpret_cast<uintptr_t>(column_begin) % alignof(decltype(column[0]))) == 0;
+    };
+    REQUIRE(is_in_file(mapped_points->points.positions));
+    REQUIRE(is_in_file(mapped_points->points.gps_times));
+    REQUIRE(is_in_file(mapped_points->points.intensities));
+
+    PointBuffer mapped_copy;
+    mapped_copy.append_buffer(mapped_points->points);
+    require_equal_points(points, mapped_copy);
+  }
+
+  PointBuffer appended_points{ points };
+  persistence.append_points(node_index, appended_points);
+
+  fs::remove(concat(root_folder, "/", node_name, ".bin"));
+
+  REQUIRE(appended_points.count() == 2 * points.count());
+  auto expected_points{ points };
+  expected_points.append_buffer(points);
+  require_equal_points(expected_points, appended_points);
+}
+
+TEST_CASE("BinaryPersistence maps compressed files")
+{
+  const auto root_folder = "."s;
+  const auto attributes = all_binary_attributes();
+
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+  const auto points = generate_random_points_with_attributes(1001, bounds);
+
+  BinaryPersistence persistence{ root_folder, attributes, attributes, Compressed::Yes };
+  const OctreeNodeIndex64 node_index{ 7, 0, 7 };
+  const auto node_name = node_name_from_index(node_index);
+  persistence.persist_points(points, bounds, node_index);
+
+  auto mapped_points = persistence.map_points(node_index);
+  REQUIRE(mapped_points);
+  PointBuffer mapped_copy;
+  mapped_copy.append_buffer(mapped_points->points);
+
+  REQUIRE_FALSE(persistence.map_points(node_index.child(0)));
+
+  fs::remove(concat(root_folder, "/", node_name, ".binz"));
+
+  require_equal_points(points, mapped_copy);
+}
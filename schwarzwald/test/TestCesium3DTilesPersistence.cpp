@@ -0,0 +1,121 @@
+#include "catch.hpp"
+
+#include "io/Cesium3DTilesPersistence.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+#include "tiling/OctreeAlgorithms.h"
+
+#include <experimental/filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <rapidjson/document.h>
+
+namespace fs = std::experimental::filesystem;
+
+static rapidjson::Document
+read_json(const std::string& file_path)
+{
+  std::ifstream fs{ file_path };
+  const std::string json{ std::istreambuf_iterator<char>{ fs }, std::istreambuf_iterator<char>{} };
+  rapidjson::Document document;
+  document.Parse(json.c_str());
+  return document;
+}
+
+TEST_CASE("Cesium3DTilesPersistence writes the tilesets of finalized subtrees right away")
+{
+  const std::string work_dir = "./_cesium_persistence_subtree_test_";
+  fs::remove_all(work_dir);
+  fs::create_directories(work_dir);
+
+  const PointAttributes attributes = { PointAttribute::Position };
+  const AABB root_bounds{ { 0, 0, 0 }, { 8, 8, 8 } };
+  const PointBuffer points{ 1, std::vector<Vector3<double>>{ { 1, 1, 1 } } };
+
+  {
+    Cesium3DTilesPersistence persistence{
+      work_dir, attributes, attributes, RGBMapping::None, 1.f, { 0, 0, 0 }
+    };
+
+    // Two subtrees with one node on each level from 1 to 4, JSON files start at level 3
+    for (uint8_t octant : { 0, 1 }) {
+      OctreeNodeIndex64 node_index{ octant };
+      while (node_index.levels() <= 4) {
+        persistence.persist_points(
+          points, get_bounds_from_node_index(node_index, root_bounds), node_index);
+        node_index = node_index.child(2);
+      }
+    }
+
+    persistence.finalize_subtree(OctreeNodeIndex64{ 0 });
+    REQUIRE(fs::exists(work_dir + "/r022.json"));
+    REQUIRE(!fs::exists(work_dir + "/r122.json"));
+    REQUIRE(!fs::exists(work_dir + "/r.json"));
+
+    const auto subtree_tileset = read_json(work_dir + "/r022.json");
+    REQUIRE(!subtree_tileset.HasParseError());
+    REQUIRE(std::string{ subtree_tileset["root"]["content"]["uri"].GetString() } == "r022.pnts");
+    REQUIRE(subtree_tileset["root"]["children"].Size() == 1);
+
+    persistence.persist_points(points, root_bounds, OctreeNodeIndex64{});
+  }
+
+  REQUIRE(fs::exists(work_dir + "/r122.json"));
+
+  // The finalized subtree is referenced as an external tileset and is not written again
+  const auto root_tileset = read_json(work_dir + "/r.json");
+  REQUIRE(!root_tileset.HasParseError());
+  const auto& r0 = root_tileset["root"]["children"][0];
+  REQUIRE(std::string{ r0["content"]["uri"].GetString() } == "r0.pnts");
+  const auto& r02 = r0["children"][0];
+  REQUIRE(std::string{ r02["children"][0]["content"]["uri"].GetString() } == "r022.json");
+
+  const auto subtree_tileset = read_json(work_dir + "/r022.json");
+  REQUIRE(subtree_tileset["root"]["children"].Size() == 1);
+
+  fs::remove_all(work_dir);
+}
+
+TEST_CASE("Cesium3DTilesPersistence writes the availability of implicit tilesets")
+{
+  const std::string work_dir = "./_cesium_persistence_implicit_test_";
+  fs::remove_all(work_dir);
+  fs::create_directories(work_dir);
+
+  const PointAttributes attributes = { PointAttribute::Position };
+  const AABB root_bounds{ { 0, 0, 0 }, { 8, 8, 8 } };
+  const PointBuffer points{ 1, std::vector<Vector3<double>>{ { 1, 1, 1 } } };
+
+  {
+    Cesium3DTilesPersistence persistence{ work_dir,
+                                          attributes,
+                                          attributes,
+                                          RGBMapping::None,
+                                          1.f,
+                                          { 0, 0, 0 },
+                                          PNTSEncoding::Float,
+                                          TilesetLayout::Implicit };
+
+    // A chain of nodes from level 1 to 5, so the deepest node lies in a second subtree
+    OctreeNodeIndex64 node_index{ 7 };
+    while (node_index.levels() <= 5) {
+      persistence.persist_points(
+        points, get_bounds_from_node_index(node_index, root_bounds), node_index);
+      node_index = node_index.child(0);
+    }
+    REQUIRE(fs::exists(work_dir + "/1-1-1-1.pnts"));
+  }
+
+  const auto tileset = read_json(work_dir + "/tileset.json");
+  REQUIRE(!tileset.HasParseError());
+  const auto& implicit_tiling = tileset["root"]["implicitTiling"];
+  REQUIRE(implicit_tiling["subtreeLevels"].GetUint() == Cesium3DTilesPersistence::SubtreeLevels);
+  // The root is available as the ancestor of the written nodes
+  REQUIRE(implicit_tiling["availableLevels"].GetUint() == 6);
+  REQUIRE(fs::exists(work_dir + "/0-0-0-0.subtree"));
+  REQUIRE(fs::exists(work_dir + "/4-8-8-8.subtree"));
+
+  fs::remove_all(work_dir);
+}
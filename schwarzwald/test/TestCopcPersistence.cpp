@@ -0,0 +1,225 @@
+#include "catch.hpp"
+
+#include "io/CopcPersistence.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+static PointBuffer
+generate_random_points(size_t count, const AABB& bounds, unsigned int seed)
+{
+  std::mt19937 mt{ seed };
+  std::uniform_real_distribution<double> x_dist{ bounds.min.x, bounds.max.x };
+  std::uniform_real_distribution<double> y_dist{ bounds.min.y, bounds.max.y };
+  std::uniform_real_distribution<double> z_dist{ bounds.min.z, bounds.max.z };
+  std::uniform_int_distribution<int> intensity_dist{ 0, 65535 };
+
+  std::vector<Vector3<double>> positions;
+  std::vector<Vector3<uint8_t>> colors;
+  std::vector<uint16_t> intensities;
+  std::vector<uint8_t> classifications;
+  for (size_t idx = 0; idx < count; ++idx) {
+    positions.push_back({ x_dist(mt), y_dist(mt), z_dist(mt) });
+    colors.push_back({ static_cast<uint8_t>(idx), 0, 255 });
+    intensities.push_back(static_cast<uint16_t>(intensity_dist(mt)));
+    classifications.push_back(static_cast<uint8_t>(idx % 64));
+  }
+
+  return { count,         std::move(positions),   std::move(colors),
+           {},            std::move(intensities), std::move(classifications) };
+}
+
+template<typename T>
+static T
+read_at(const std::string& data, size_t offset)
+{
+  T value;
+  std::memcpy(&value, data.data() + offset, sizeof(T));
+  return value;
+}
+
+static copc::HierarchyEntry
+read_hierarchy_entry(const std::vector<std::byte>& data, size_t index)
+{
+  copc::HierarchyEntry entry;
+  const auto src = data.data() + index * copc::HierarchyEntrySize;
+  std::memcpy(&entry.key.d, src, sizeof(int32_t));
+  std::memcpy(&entry.key.x, src + 4, sizeof(int32_t));
+  std::memcpy(&entry.key.y, src + 8, sizeof(int32_t));
+  std::memcpy(&entry.key.z, src + 12, sizeof(int32_t));
+  std::memcpy(&entry.offset, src + 16, sizeof(uint64_t));
+  std::memcpy(&entry.byte_size, src + 24, sizeof(int32_t));
+  std::memcpy(&entry.point_count, src + 28, sizeof(int32_t));
+  return entry;
+}
+
+TEST_CASE("COPC voxel keys match Entwine node names")
+{
+  const auto voxel_key_from_entwine_name = [](const std::string& entwine_name) {
+    const auto node_index =
+      OctreeNodeIndex64::from_string(entwine_name, MortonIndexNamingConvention::Entwine);
+    REQUIRE(node_index);
+    return copc::voxel_key_from_node_index(*node_index);
+  };
+
+  REQUIRE(voxel_key_from_entwine_name("0-0-0-0") == copc::VoxelKey{ 0, 0, 0, 0 });
+
+  const auto node = voxel_key_from_entwine_name("3-1-2-7");
+  REQUIRE(node == copc::VoxelKey{ 3, 1, 2, 7 });
+  REQUIRE(node.ancestor_at_depth(1) == copc::VoxelKey{ 1, 0, 0, 1 });
+  REQUIRE(node.ancestor_at_depth(0) == copc::VoxelKey{ 0, 0, 0, 0 });
+
+  REQUIRE(copc::voxel_key_from_node_index({}) == copc::VoxelKey{ 0, 0, 0, 0 });
+  REQUIRE(copc::voxel_key_from_node_index({ 0, 7 }) == copc::VoxelKey{ 2, 1, 1, 1 });
+  const OctreeNodeIndex64 node_index{ 4, 2, 1 };
+  REQUIRE(copc::voxel_key_from_node_index(node_index) ==
+          voxel_key_from_entwine_name(
+            OctreeNodeIndex64::to_string(node_index, MortonIndexNamingConvention::Entwine)));
+}
+
+TEST_CASE("COPC hierarchy is split into pages")
+{
+  // A chain of nodes from the root down to depth 7, so the nodes at depth 5 to 7 go into a
+  // second page
+  std::vector<copc::HierarchyEntry> entries;
+  for (int32_t depth = 0; depth < 8; ++depth) {
+    entries.push_back({ { depth, 0, 0, 0 },
+                        static_cast<uint64_t>(1000 + depth * 100),
+                        100,
+                        static_cast<int32_t>(10 + depth) });
+  }
+  // Nodes are passed in any order
+  std::swap(entries.front(), entries.back());
+
+  const uint64_t payload_offset = 4096;
+  const auto hierarchy = copc::encode_hierarchy(entries, payload_offset);
+
+  REQUIRE(hierarchy.root_page_size == 6 * copc::HierarchyEntrySize);
+  REQUIRE(hierarchy.data.size() == 9 * copc::HierarchyEntrySize);
+
+  for (int32_t depth = 0; depth < 5; ++depth) {
+    const auto entry = read_hierarchy_entry(hierarchy.data, static_cast<size_t>(depth));
+    REQUIRE(entry.key == copc::VoxelKey{ depth, 0, 0, 0 });
+    REQUIRE(entry.offset == static_cast<uint64_t>(1000 + depth * 100));
+    REQUIRE(entry.byte_size == 100);
+    REQUIRE(entry.point_count == 10 + depth);
+  }
+
+  const auto page_reference = read_hierarchy_entry(hierarchy.data, 5);
+  REQUIRE(page_reference.key == copc::VoxelKey{ 5, 0, 0, 0 });
+  REQUIRE(page_reference.point_count == -1);
+  REQUIRE(page_reference.offset == payload_offset + hierarchy.root_page_size);
+  REQUIRE(page_reference.byte_size == 3 * copc::HierarchyEntrySize);
+
+  for (int32_t depth = 5; depth < 8; ++depth) {
+    const auto entry = read_hierarchy_entry(hierarchy.data, static_cast<size_t>(depth + 1));
+    REQUIRE(entry.key == copc::VoxelKey{ depth, 0, 0, 0 });
+    REQUIRE(entry.point_count == 10 + depth);
+  }
+
+  REQUIRE(copc::encode_hierarchy({}, payload_offset).data.empty());
+}
+
+TEST_CASE("CopcPersistence writes all nodes into a single COPC file")
+{
+  const std::string work_dir = "./_copc_persistence_test_";
+  fs::remove_all(work_dir);
+  fs::create_directories(work_dir);
+
+  const PointAttributes attributes = { PointAttribute::Position,
+                                       PointAttribute::RGB,
+                                       PointAttribute::Intensity,
+                                       PointAttribute::Classification };
+  AABB bounds{ { 0, 0, 0 }, { 16, 16, 16 } };
+
+  const std::vector<OctreeNodeIndex64> node_indices = { {}, { 0 }, { 7 }, { 0, 7 }, { 7, 0 } };
+  std::vector<PointBuffer> nodes;
+  for (unsigned int idx = 0; idx < node_indices.size(); ++idx) {
+    nodes.push_back(generate_random_points(1000 + idx * 123, bounds, idx));
+  }
+
+  std::string file_path;
+  uint64_t total_point_count = 0;
+  {
+    CopcPersistence persistence{ work_dir, attributes, attributes, bounds, 0.5f };
+    file_path = persistence.file_path();
+
+    // Persisting a node again replaces its chunk
+    persistence.persist_points(nodes[1], bounds, node_indices[0]);
+    for (size_t idx = 0; idx < nodes.size(); ++idx) {
+      persistence.persist_points(nodes[idx], bounds, node_indices[idx]);
+      total_point_count += nodes[idx].count();
+    }
+
+    REQUIRE(!persistence.node_exists({ 1 }));
+    for (size_t idx = 0; idx < nodes.size(); ++idx) {
+      REQUIRE(persistence.node_exists(node_indices[idx]));
+
+      PointBuffer retrieved_points;
+      persistence.retrieve_points(node_indices[idx], retrieved_points);
+      REQUIRE(retrieved_points.count() == nodes[idx].count());
+      for (size_t point_idx = 0; point_idx < nodes[idx].count(); ++point_idx) {
+        const auto& expected = nodes[idx].positions()[point_idx];
+        const auto& actual = retrieved_points.positions()[point_idx];
+        REQUIRE(std::abs(expected.x - actual.x) <= 0.001);
+        REQUIRE(std::abs(expected.y - actual.y) <= 0.001);
+        REQUIRE(std::abs(expected.z - actual.z) <= 0.001);
+      }
+      REQUIRE(retrieved_points.rgbColors() == nodes[idx].rgbColors());
+      REQUIRE(retrieved_points.intensities() == nodes[idx].intensities());
+      REQUIRE(retrieved_points.classifications() == nodes[idx].classifications());
+    }
+
+    persistence.finalize();
+    REQUIRE_THROWS(persistence.persist_points(nodes[0], bounds, OctreeNodeIndex64{ 1 }));
+  }
+
+  std::ifstream reader{ file_path, std::ios::in | std::ios::binary };
+  const std::string file{ std::istreambuf_iterator<char>{ reader },
+                          std::istreambuf_iterator<char>{} };
+
+  REQUIRE(file.compare(0, 4, "LASF") == 0);
+  REQUIRE(read_at<uint8_t>(file, 24) == 1);
+  REQUIRE(read_at<uint8_t>(file, 25) == 4);
+  REQUIRE(read_at<uint16_t>(file, 94) == copc::HeaderSize);
+  REQUIRE(read_at<uint32_t>(file, 100) == 2);
+  REQUIRE(read_at<uint8_t>(file, 104) == 7);
+  REQUIRE(read_at<uint64_t>(file, 247) == total_point_count);
+
+  // The COPC info VLR is the first VLR
+  REQUIRE(file.compare(copc::HeaderSize + 2, 4, "copc") == 0);
+  REQUIRE(read_at<uint16_t>(file, copc::HeaderSize + 18) == 1);
+  const auto info = copc::HeaderSize + copc::VLRHeaderSize;
+  REQUIRE(read_at<double>(file, info) == 8.0);
+  REQUIRE(read_at<double>(file, info + 24) == 8.0);
+  REQUIRE(read_at<double>(file, info + 32) == 0.5);
+
+  // The root hierarchy page is the payload of the only EVLR and holds all nodes
+  const auto evlr_offset = read_at<uint64_t>(file, 235);
+  REQUIRE(read_at<uint32_t>(file, 243) == 1);
+  REQUIRE(file.compare(evlr_offset + 2, 4, "copc") == 0);
+  REQUIRE(read_at<uint16_t>(file, evlr_offset + 18) == 1000);
+  const auto root_page_offset = read_at<uint64_t>(file, info + 40);
+  const auto root_page_size = read_at<uint64_t>(file, info + 48);
+  REQUIRE(root_page_offset == evlr_offset + copc::EVLRHeaderSize);
+  REQUIRE(root_page_size == nodes.size() * copc::HierarchyEntrySize);
+  REQUIRE(root_page_offset + root_page_size == file.size());
+
+  // Chunks are stored back to back after the offset to the chunk table
+  const auto point_data_offset = read_at<uint32_t>(file, 96);
+  uint64_t chunk_bytes = 0;
+  for (size_t idx = 0; idx < nodes.size(); ++idx) {
+    const auto entry_offset = root_page_offset + idx * copc::HierarchyEntrySize;
+    REQUIRE(read_at<int32_t>(file, entry_offset + 28) > 0);
+    chunk_bytes += static_cast<uint64_t>(read_at<int32_t>(file, entry_offset + 24));
+  }
+  REQUIRE(static_cast<uint64_t>(read_at<int64_t>(file, point_data_offset)) ==
+          point_data_offset + sizeof(int64_t) + chunk_bytes);
+
+  fs::remove_all(work_dir);
+}
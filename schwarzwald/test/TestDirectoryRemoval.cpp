@@ -0,0 +1,67 @@
+#include "catch.hpp"
+
+#include "io/DirectoryRemoval.h"
+
+#include <experimental/filesystem>
+#include <fstream>
+#include <string>
+
+namespace fs = std::experimental::filesystem;
+
+static void
+create_files(const fs::path& directory, size_t count)
+{
+  fs::create_directories(directory);
+  for (size_t idx = 0; idx < count; ++idx) {
+    std::ofstream{ directory / std::to_string(idx) } << idx;
+  }
+}
+
+static size_t
+count_entries(const fs::path& directory)
+{
+  return static_cast<size_t>(std::distance(fs::recursive_directory_iterator{ directory },
+                                           fs::recursive_directory_iterator{}));
+}
+
+TEST_CASE("remove_directory_contents removes all entries except skipped ones", "[DirectoryRemoval]")
+{
+  const fs::path root = "./_directory_removal_test_";
+  const fs::path outside = "./_directory_removal_test_outside_";
+  fs::remove_all(root);
+  fs::remove_all(outside);
+
+  // More files than fit into a single batch, so that several threads unlink files of one directory
+  create_files(root, 3000);
+  create_files(root / "a" / "b" / "c", 10);
+  create_files(root / "a" / "d", 1500);
+  create_files(root / "keep", 5);
+  create_files(outside, 3);
+  fs::create_directory_symlink(fs::absolute(outside), root / "a" / "link");
+
+  const auto failed_removals = remove_directory_contents(
+    root, 4, [&root](const fs::path& entry) { return entry == root / "keep"; });
+  REQUIRE(failed_removals == 0);
+
+  REQUIRE(fs::exists(root));
+  REQUIRE(count_entries(root) == 6);
+  REQUIRE(count_entries(root / "keep") == 5);
+  // Symbolic links are removed without removing their target
+  REQUIRE(count_entries(outside) == 3);
+
+  REQUIRE(remove_directory(root, 1) == 0);
+  REQUIRE(!fs::exists(root));
+
+  fs::remove_all(outside);
+}
+
+TEST_CASE("remove_directory_contents of an empty directory", "[DirectoryRemoval]")
+{
+  const fs::path root = "./_directory_removal_test_empty_";
+  fs::create_directories(root);
+
+  REQUIRE(remove_directory_contents(root, 4) == 0);
+  REQUIRE(fs::exists(root));
+  REQUIRE(remove_directory(root, 4) == 0);
+  REQUIRE(!fs::exists(root));
+}
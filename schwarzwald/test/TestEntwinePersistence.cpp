@@ -0,0 +1,157 @@
+#include "catch.hpp"
+
+#include "io/EntwinePersistence.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+
+#include <experimental/filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include <rapidjson/document.h>
+
+namespace fs = std::experimental::filesystem;
+
+static PointBuffer
+generate_random_points(size_t count, unsigned int seed)
+{
+  std::mt19937 mt{ seed };
+  std::uniform_real_distribution<double> position_dist{ -1000, 1000 };
+  std::uniform_int_distribution<int> intensity_dist{ 0, 65535 };
+
+  std::vector<Vector3<double>> positions;
+  std::vector<Vector3<uint8_t>> colors;
+  std::vector<uint16_t> intensities;
+  std::vector<uint8_t> classifications;
+  std::vector<double> gps_times;
+  for (size_t idx = 0; idx < count; ++idx) {
+    positions.push_back({ position_dist(mt), position_dist(mt), position_dist(mt) });
+    colors.push_back({ static_cast<uint8_t>(idx), 0, 255 });
+    intensities.push_back(static_cast<uint16_t>(intensity_dist(mt)));
+    classifications.push_back(static_cast<uint8_t>(idx % 64));
+    gps_times.push_back(1000.0 + idx * 0.25);
+  }
+
+  return { count,         std::move(positions),   std::move(colors),
+           {},            std::move(intensities), std::move(classifications),
+           {},            std::move(gps_times) };
+}
+
+static rapidjson::Document
+read_json_file(const std::string& file_path)
+{
+  std::ifstream reader{ file_path };
+  const std::string contents{ std::istreambuf_iterator<char>{ reader },
+                              std::istreambuf_iterator<char>{} };
+  rapidjson::Document document;
+  document.Parse(contents.c_str());
+  REQUIRE(!document.HasParseError());
+  return document;
+}
+
+TEST_CASE("EPT schema and binary layout have the same order")
+{
+  const PointAttributes attributes = { PointAttribute::RGB,
+                                       PointAttribute::GPSTime,
+                                       PointAttribute::Position,
+                                       PointAttribute::Intensity };
+
+  const auto schema = point_attributes_to_ept_schema(attributes, EntwineFormat::Binary);
+  const std::vector<std::string> expected_names = { "X",       "Y",   "Z",     "Intensity",
+                                                    "GpsTime", "Red", "Green", "Blue" };
+  REQUIRE(schema.size() == expected_names.size());
+  for (size_t idx = 0; idx < schema.size(); ++idx) {
+    REQUIRE(schema[idx].name == expected_names[idx]);
+  }
+  REQUIRE(schema[0].size == 8);
+  REQUIRE(schema[0].type == "float");
+  REQUIRE(!schema[0].scale);
+
+  const auto layout = ept::binary_layout_for_attributes(attributes);
+  REQUIRE(layout.record_size == 3 * 8 + 2 + 8 + 3 * 2);
+  REQUIRE(layout.columns.size() == 4);
+  REQUIRE(layout.columns[0].attribute == PointAttribute::Position);
+  REQUIRE(layout.columns[1].attribute == PointAttribute::Intensity);
+  REQUIRE(layout.columns[1].byte_offset == 24);
+  REQUIRE(layout.columns[2].attribute == PointAttribute::GPSTime);
+  REQUIRE(layout.columns[2].byte_offset == 26);
+  REQUIRE(layout.columns[3].attribute == PointAttribute::RGB);
+  REQUIRE(layout.columns[3].byte_offset == 34);
+}
+
+TEST_CASE("EntwinePersistence writes binary node files and hierarchy pages")
+{
+  const std::string work_dir = "./_entwine_persistence_test_";
+  fs::remove_all(work_dir);
+
+  const PointAttributes attributes = { PointAttribute::Position,
+                                       PointAttribute::RGB,
+                                       PointAttribute::Intensity,
+                                       PointAttribute::Classification,
+                                       PointAttribute::GPSTime };
+  const AABB bounds{ { -1000, -1000, -1000 }, { 1000, 1000, 1000 } };
+
+  // The last node is below the first hierarchy page
+  const std::vector<OctreeNodeIndex64> node_indices = {
+    {}, { 0 }, { 7 }, { 0, 7 }, { 0, 0, 0, 0, 0, 0 }
+  };
+  std::vector<PointBuffer> nodes;
+  for (unsigned int idx = 0; idx < node_indices.size(); ++idx) {
+    nodes.push_back(generate_random_points(100 + idx * 17, idx));
+  }
+
+  {
+    EntwinePersistence persistence{ work_dir, attributes, attributes, EntwineFormat::Binary };
+    REQUIRE(persistence.is_lossless());
+
+    for (size_t idx = 0; idx < nodes.size(); ++idx) {
+      persistence.persist_points(nodes[idx], bounds, node_indices[idx]);
+    }
+
+    REQUIRE(!persistence.node_exists({ 1 }));
+    for (size_t idx = 0; idx < nodes.size(); ++idx) {
+      REQUIRE(persistence.node_exists(node_indices[idx]));
+
+      PointBuffer retrieved_points;
+      persistence.retrieve_points(node_indices[idx], retrieved_points);
+      REQUIRE(retrieved_points.count() == nodes[idx].count());
+      REQUIRE(retrieved_points.positions() == nodes[idx].positions());
+      REQUIRE(retrieved_points.rgbColors() == nodes[idx].rgbColors());
+      REQUIRE(retrieved_points.intensities() == nodes[idx].intensities());
+      REQUIRE(retrieved_points.classifications() == nodes[idx].classifications());
+      REQUIRE(retrieved_points.gps_times() == nodes[idx].gps_times());
+    }
+  }
+
+  const auto layout = ept::binary_layout_for_attributes(attributes);
+  REQUIRE(fs::file_size(work_dir + "/ept-data/1-0-0-0.bin") ==
+          nodes[1].count() * layout.record_size);
+
+  const auto root_page = read_json_file(work_dir + "/ept-hierarchy/0-0-0-0.json");
+  REQUIRE(root_page["0-0-0-0"].GetInt64() == static_cast<int64_t>(nodes[0].count()));
+  REQUIRE(root_page["1-0-0-0"].GetInt64() == static_cast<int64_t>(nodes[1].count()));
+  REQUIRE(root_page["1-1-1-1"].GetInt64() == static_cast<int64_t>(nodes[2].count()));
+  // The page of the node at depth 5 is referenced with a count of -1
+  REQUIRE(root_page["5-0-0-0"].GetInt64() == -1);
+  REQUIRE(!root_page.HasMember("6-0-0-0"));
+
+  const auto child_page = read_json_file(work_dir + "/ept-hierarchy/5-0-0-0.json");
+  REQUIRE(child_page["6-0-0-0"].GetInt64() == static_cast<int64_t>(nodes[4].count()));
+
+  EptJson ept_json;
+  ept_json.bounds = bounds;
+  ept_json.conforming_bounds = bounds;
+  ept_json.data_type = EntwineFormat::Binary;
+  ept_json.hierarchy_type = "json";
+  ept_json.points = 0;
+  ept_json.schema = point_attributes_to_ept_schema(attributes, EntwineFormat::Binary);
+  ept_json.span = 128;
+  ept_json.version = "1.0.0";
+  write_ept_json(work_dir + "/ept.json", ept_json);
+  const auto ept = read_json_file(work_dir + "/ept.json");
+  REQUIRE(std::string{ ept["dataType"].GetString() } == "binary");
+
+  fs::remove_all(work_dir);
+}
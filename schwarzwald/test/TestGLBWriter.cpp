@@ -0,0 +1,248 @@
+#include "catch.hpp"
+
+#include "io/GLBReader.h"
+#include "io/GLBWriter.h"
+#include "io/MeshoptCodec.h"
+#include "pointcloud/PointAttributes.h"
+
+#include <cstring>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include <rapidjson/document.h>
+
+namespace fs = std::experimental::filesystem;
+
+static Vector3<float>
+random_normal(std::mt19937& mt)
+{
+  std::uniform_real_distribution<float> dist{ -1, 1 };
+  Vector3<float> normal;
+  do {
+    normal = { dist(mt), dist(mt), dist(mt) };
+  } while (normal.length() < 0.01f);
+  return normal / normal.length();
+}
+
+static PointBuffer
+generate_random_points(size_t count, unsigned int seed)
+{
+  std::mt19937 mt{ seed };
+  std::uniform_real_distribution<double> position_dist{ -100, 100 };
+  std::uniform_int_distribution<int> color_dist{ 0, 255 };
+  std::uniform_int_distribution<int> intensity_dist{ 0, 65535 };
+
+  std::vector<Vector3<double>> positions;
+  std::vector<Vector3<uint8_t>> colors;
+  std::vector<Vector3<float>> normals;
+  std::vector<uint16_t> intensities;
+  std::vector<uint8_t> classifications;
+  for (size_t idx = 0; idx < count; ++idx) {
+    // Positions in .glb files are 32-bit floats
+    positions.push_back({ static_cast<float>(position_dist(mt)),
+                          static_cast<float>(position_dist(mt)),
+                          static_cast<float>(position_dist(mt)) });
+    colors.push_back({ static_cast<uint8_t>(color_dist(mt)),
+                       static_cast<uint8_t>(color_dist(mt)),
+                       static_cast<uint8_t>(color_dist(mt)) });
+    normals.push_back(random_normal(mt));
+    intensities.push_back(static_cast<uint16_t>(intensity_dist(mt)));
+    classifications.push_back(static_cast<uint8_t>(idx % 32));
+  }
+
+  return { count,
+           std::move(positions),
+           std::move(colors),
+           std::move(normals),
+           std::move(intensities),
+           std::move(classifications) };
+}
+
+static std::vector<std::byte>
+read_file(const std::string& path)
+{
+  std::ifstream stream{ path, std::ios::in | std::ios::binary };
+  std::vector<char> data{ std::istreambuf_iterator<char>{ stream },
+                          std::istreambuf_iterator<char>{} };
+  const auto begin = reinterpret_cast<const std::byte*>(data.data());
+  return { begin, begin + data.size() };
+}
+
+static rapidjson::Document
+parse_glb_json(const std::vector<std::byte>& glb)
+{
+  uint32_t json_length;
+  std::memcpy(&json_length, glb.data() + 12, sizeof(uint32_t));
+  const std::string json_chunk{ reinterpret_cast<const char*>(glb.data()) + 20, json_length };
+  rapidjson::Document json;
+  json.Parse(json_chunk.c_str());
+  REQUIRE(!json.HasParseError());
+  return json;
+}
+
+TEST_CASE("Meshopt vertex codec matches the reference bitstream")
+{
+  // A single vertex has no differences, so all byte groups are zero and encoded in the header
+  // only. The tail holds the first vertex, padded to 32 bytes
+  const std::vector<std::byte> vertex = {
+    std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 }, std::byte{ 4 }
+  };
+  const auto encoded = meshopt::encode_vertex_buffer(vertex, 1, 4);
+  REQUIRE(encoded.size() == 1 + 4 + 32);
+  REQUIRE(encoded[0] == std::byte{ 0xA0 });
+  for (size_t idx = 1; idx < 1 + 4 + 28; ++idx) {
+    REQUIRE(encoded[idx] == std::byte{ 0 });
+  }
+  REQUIRE(std::equal(std::begin(vertex), std::end(vertex), std::end(encoded) - 4));
+
+  // Deltas of +1 are zigzag-encoded as 2, which fits into 2 bits per value
+  std::vector<std::byte> ramp(16 * 4);
+  for (size_t idx = 0; idx < 16; ++idx) {
+    ramp[idx * 4] = static_cast<std::byte>(idx);
+  }
+  const auto encoded_ramp = meshopt::encode_vertex_buffer(ramp, 16, 4);
+  REQUIRE(encoded_ramp[1] == std::byte{ 0b01 });
+  // The first delta is 0, all others are 2
+  REQUIRE(encoded_ramp[2] == std::byte{ 0b00101010 });
+  REQUIRE(encoded_ramp[3] == std::byte{ 0b10101010 });
+  REQUIRE(encoded_ramp.size() == 1 + (1 + 4) + 3 * 1 + 32);
+}
+
+TEST_CASE("Meshopt vertex codec round trip")
+{
+  std::mt19937 mt{ 1234 };
+  for (auto vertex_size : { 4, 8, 12, 16, 28, 64 }) {
+    // More vertices than fit into a single block, and a partial last block
+    for (auto vertex_count : { 0, 1, 15, 17, 300, 1000 }) {
+      std::vector<std::byte> vertices(vertex_count * vertex_size);
+      std::uniform_int_distribution<int> noise{ 0, 255 };
+      for (size_t idx = 0; idx < vertices.size(); ++idx) {
+        // Mix of smooth and noisy bytes, so that all group encodings are used
+        const auto byte_idx = idx % vertex_size;
+        const auto value = (byte_idx % 4 == 0) ? noise(mt) : static_cast<int>(idx / vertex_size);
+        vertices[idx] = static_cast<std::byte>(value >> (byte_idx % 3));
+      }
+
+      const auto encoded = meshopt::encode_vertex_buffer(vertices, vertex_count, vertex_size);
+      REQUIRE(encoded.size() <=
+              meshopt::max_encoded_vertex_buffer_size(vertex_count, vertex_size));
+
+      std::vector<std::byte> decoded(vertices.size());
+      meshopt::decode_vertex_buffer(encoded, vertex_count, vertex_size, decoded);
+      REQUIRE(decoded == vertices);
+    }
+  }
+
+  REQUIRE_THROWS(meshopt::encode_vertex_buffer({}, 0, 6));
+
+  std::vector<std::byte> vertices(100 * 8, std::byte{ 7 });
+  auto encoded = meshopt::encode_vertex_buffer(vertices, 100, 8);
+  encoded.pop_back();
+  REQUIRE_THROWS(meshopt::decode_vertex_buffer(encoded, 100, 8, vertices));
+}
+
+TEST_CASE("write_glb_file writes glTF point tiles")
+{
+  const std::string file_path = "./_glb_writer_test_.glb";
+  const PointAttributes attributes = { PointAttribute::Position,
+                                       PointAttribute::RGB,
+                                       PointAttribute::Normal,
+                                       PointAttribute::Intensity,
+                                       PointAttribute::Classification };
+  const AABB bounds{ { -100, -100, -100 }, { 100, 100, 100 } };
+  const Vector3<double> rtc_center{ 4000000.0, 500000.0, 4500000.0 };
+  const auto points = generate_random_points(1000, 42);
+
+  for (auto compression : { GLBCompression::None, GLBCompression::Meshopt }) {
+    write_glb_file(file_path,
+                   std::begin(points),
+                   std::end(points),
+                   attributes,
+                   RGBMapping::None,
+                   rtc_center,
+                   PNTSEncoding::Float,
+                   compression,
+                   bounds);
+
+    const auto glb = read_file(file_path);
+    uint32_t magic, length;
+    std::memcpy(&magic, glb.data(), sizeof(uint32_t));
+    std::memcpy(&length, glb.data() + 8, sizeof(uint32_t));
+    REQUIRE(std::memcmp(&magic, "glTF", 4) == 0);
+    REQUIRE(length == glb.size());
+    REQUIRE(length % 4 == 0);
+
+    const auto json = parse_glb_json(glb);
+    const auto& primitive = json["meshes"][0]["primitives"][0];
+    REQUIRE(primitive["mode"].GetUint() == 0);
+    REQUIRE(primitive["attributes"].HasMember("POSITION"));
+    REQUIRE(primitive["attributes"].HasMember("COLOR_0"));
+    REQUIRE(primitive["attributes"].HasMember("NORMAL"));
+    REQUIRE(primitive["attributes"].HasMember("_INTENSITY"));
+    REQUIRE(primitive["attributes"].HasMember("_CLASSIFICATION"));
+    const auto& position_accessor = json["accessors"][primitive["attributes"]["POSITION"].GetUint()];
+    REQUIRE(position_accessor.HasMember("min"));
+    REQUIRE(position_accessor.HasMember("max"));
+    const auto& buffer_views = json["bufferViews"];
+    for (rapidjson::SizeType idx = 0; idx < buffer_views.Size(); ++idx) {
+      REQUIRE(buffer_views[idx]["byteStride"].GetUint() % 4 == 0);
+    }
+    REQUIRE(json.HasMember("extensionsRequired") == (compression == GLBCompression::Meshopt));
+
+    const auto glb_file = read_glb_file(file_path, attributes);
+    REQUIRE(glb_file);
+    REQUIRE(glb_file->rtc_center == rtc_center);
+    REQUIRE(glb_file->points.count() == points.count());
+    REQUIRE(glb_file->points.positions() == points.positions());
+    REQUIRE(glb_file->points.rgbColors() == points.rgbColors());
+    REQUIRE(glb_file->points.normals() == points.normals());
+    REQUIRE(glb_file->points.intensities() == points.intensities());
+    REQUIRE(glb_file->points.classifications() == points.classifications());
+  }
+
+  fs::remove(file_path);
+}
+
+TEST_CASE("write_glb_file quantizes positions and normals with KHR_mesh_quantization")
+{
+  const std::string file_path = "./_glb_writer_quantized_test_.glb";
+  const PointAttributes attributes = { PointAttribute::Position, PointAttribute::Normal };
+  const AABB bounds{ { -100, -100, -100 }, { 100, 100, 100 } };
+  const auto points = generate_random_points(1000, 43);
+
+  write_glb_file(file_path,
+                 std::begin(points),
+                 std::end(points),
+                 attributes,
+                 RGBMapping::None,
+                 { 0, 0, 0 },
+                 PNTSEncoding::Quantized,
+                 GLBCompression::Meshopt,
+                 bounds);
+
+  const auto json = parse_glb_json(read_file(file_path));
+  const auto& extensions = json["extensionsRequired"];
+  REQUIRE(extensions.Size() == 2);
+  REQUIRE(std::string{ extensions[0].GetString() } == "KHR_mesh_quantization");
+  REQUIRE(json["nodes"][1].HasMember("scale"));
+
+  const auto glb_file = read_glb_file(file_path, attributes);
+  REQUIRE(glb_file);
+  REQUIRE(glb_file->points.count() == points.count());
+  const auto max_position_error = bounds.extent().x / 65535;
+  for (size_t idx = 0; idx < points.count(); ++idx) {
+    const auto& expected = points.positions()[idx];
+    const auto& actual = glb_file->points.positions()[idx];
+    REQUIRE(std::abs(expected.x - actual.x) <= max_position_error);
+    REQUIRE(std::abs(expected.y - actual.y) <= max_position_error);
+    REQUIRE(std::abs(expected.z - actual.z) <= max_position_error);
+
+    const auto normal_difference = points.normals()[idx] - glb_file->points.normals()[idx];
+    REQUIRE(normal_difference.length() < 0.02f);
+  }
+
+  fs::remove(file_path);
+}
@@ -0,0 +1,153 @@
+#include "catch.hpp"
+
+#include "io/ImplicitTiling.h"
+
+#include <cstring>
+#include <string>
+
+#include <rapidjson/document.h>
+
+using namespace implicit_tiling;
+
+TEST_CASE("Tile keys are computed from Potree node names")
+{
+  REQUIRE(*tile_key_from_node_name("r") == TileKey{ 0, 0, 0, 0 });
+  // Octants have x in the highest and z in the lowest bit
+  REQUIRE(*tile_key_from_node_name("r4") == TileKey{ 1, 1, 0, 0 });
+  REQUIRE(*tile_key_from_node_name("r2") == TileKey{ 1, 0, 1, 0 });
+  REQUIRE(*tile_key_from_node_name("r1") == TileKey{ 1, 0, 0, 1 });
+  REQUIRE(*tile_key_from_node_name("r73") == TileKey{ 2, 2, 3, 3 });
+  REQUIRE(tile_key_from_node_name("r73")->ancestor_at_level(1) == TileKey{ 1, 1, 1, 1 });
+
+  REQUIRE(!tile_key_from_node_name(""));
+  REQUIRE(!tile_key_from_node_name("r8"));
+  REQUIRE(!tile_key_from_node_name("0-0-0-0"));
+
+  REQUIRE(tile_key_from_node_index({}) == TileKey{ 0, 0, 0, 0 });
+  REQUIRE(tile_key_from_node_index({ 7, 3 }) == *tile_key_from_node_name("r73"));
+
+  REQUIRE(expand_uri_template("{level}-{x}-{y}-{z}.pnts", { 3, 1, 2, 7 }) == "3-1-2-7.pnts");
+  REQUIRE(expand_uri_template("subtrees/{level}/{x}.{y}.{z}", { 0, 0, 0, 0 }) ==
+          "subtrees/0/0.0.0");
+}
+
+TEST_CASE("TileAvailability marks tiles and their ancestors as available")
+{
+  TileAvailability availability{ 2 };
+  REQUIRE(availability.empty());
+  REQUIRE(availability.tiles_per_subtree() == 9);
+  REQUIRE(availability.child_subtrees_per_subtree() == 64);
+
+  // 'r73' is on level 2, which is the root of the subtree below the root subtree
+  availability.set_content_available(*tile_key_from_node_name("r73"));
+  REQUIRE(availability.available_levels() == 3);
+  REQUIRE(availability.is_content_available({ 2, 2, 3, 3 }));
+  REQUIRE(availability.is_available({ 2, 2, 3, 3 }));
+  REQUIRE(availability.is_available({ 1, 1, 1, 1 }));
+  REQUIRE(availability.is_available({ 0, 0, 0, 0 }));
+  REQUIRE(!availability.is_content_available({ 1, 1, 1, 1 }));
+  REQUIRE(!availability.is_content_available({ 0, 0, 0, 0 }));
+  REQUIRE(!availability.is_available({ 1, 0, 0, 0 }));
+
+  availability.set_content_available(*tile_key_from_node_name("r"));
+  REQUIRE(availability.is_content_available({ 0, 0, 0, 0 }));
+
+  const auto subtree_roots = availability.subtree_roots();
+  REQUIRE(subtree_roots.size() == 2);
+
+  const auto& root_subtree = availability.subtree_availability({ 0, 0, 0, 0 });
+  // Bit 0 is the root tile, bits 1 to 8 are the tiles on level 1 in Morton order
+  REQUIRE(root_subtree.tiles[0] == 0b1);
+  REQUIRE(root_subtree.tiles[1] == 0b1);
+  REQUIRE(root_subtree.contents[0] == 0b1);
+  REQUIRE(root_subtree.contents[1] == 0);
+  // The child subtree (2, 2, 3, 3) has Morton index 0b111110 = 62
+  for (size_t byte = 0; byte < root_subtree.child_subtrees.size(); ++byte) {
+    REQUIRE(root_subtree.child_subtrees[byte] == ((byte == 7) ? 0b01000000 : 0));
+  }
+
+  const auto& child_subtree = availability.subtree_availability({ 2, 2, 3, 3 });
+  REQUIRE(child_subtree.tiles[0] == 0b1);
+  REQUIRE(child_subtree.contents[0] == 0b1);
+
+  REQUIRE_THROWS(availability.subtree_availability({ 2, 0, 0, 0 }));
+  REQUIRE_THROWS(TileAvailability{ 0 });
+}
+
+TEST_CASE("Subtrees are encoded in the binary subtree format")
+{
+  TileAvailability availability{ 2 };
+  availability.set_content_available(*tile_key_from_node_name("r"));
+  availability.set_content_available(*tile_key_from_node_name("r7"));
+  availability.set_content_available(*tile_key_from_node_name("r70"));
+
+  const auto subtree = encode_subtree(availability.subtree_availability({ 0, 0, 0, 0 }),
+                                      availability.tiles_per_subtree(),
+                                      availability.child_subtrees_per_subtree());
+
+  uint32_t magic, version;
+  uint64_t json_length, binary_length;
+  std::memcpy(&magic, subtree.data(), sizeof(uint32_t));
+  std::memcpy(&version, subtree.data() + 4, sizeof(uint32_t));
+  std::memcpy(&json_length, subtree.data() + 8, sizeof(uint64_t));
+  std::memcpy(&binary_length, subtree.data() + 16, sizeof(uint64_t));
+  REQUIRE(std::memcmp(&magic, "subt", 4) == 0);
+  REQUIRE(version == 1);
+  REQUIRE(json_length % 8 == 0);
+  REQUIRE(binary_length % 8 == 0);
+  REQUIRE(subtree.size() == 24 + json_length + binary_length);
+
+  const std::string json_chunk{ reinterpret_cast<const char*>(subtree.data()) + 24, json_length };
+  rapidjson::Document json;
+  json.Parse(json_chunk.c_str());
+  REQUIRE(!json.HasParseError());
+
+  // Tiles and contents are available on both levels, but not for all tiles
+  REQUIRE(json["tileAvailability"]["bitstream"].GetUint() == 0);
+  REQUIRE(json["tileAvailability"]["availableCount"].GetUint() == 2);
+  REQUIRE(json["contentAvailability"][0]["bitstream"].GetUint() == 1);
+  REQUIRE(json["contentAvailability"][0]["availableCount"].GetUint() == 2);
+  // 'r70' is the only tile on level 2, so only one child subtree is available
+  REQUIRE(json["childSubtreeAvailability"]["bitstream"].GetUint() == 2);
+  REQUIRE(json["childSubtreeAvailability"]["availableCount"].GetUint() == 1);
+
+  REQUIRE(binary_length == 24);
+  REQUIRE(json["buffers"][0]["byteLength"].GetUint64() == binary_length);
+  const auto& tile_view = json["bufferViews"][0];
+  REQUIRE(tile_view["byteOffset"].GetUint64() == 0);
+  REQUIRE(tile_view["byteLength"].GetUint64() == 2);
+  const auto& content_view = json["bufferViews"][1];
+  REQUIRE(content_view["byteOffset"].GetUint64() == 8);
+  const auto& child_subtree_view = json["bufferViews"][2];
+  REQUIRE(child_subtree_view["byteOffset"].GetUint64() == 16);
+  REQUIRE(child_subtree_view["byteLength"].GetUint64() == 8);
+
+  const auto binary = subtree.data() + 24 + json_length;
+  // The root tile is bit 0 and 'r7' is the last tile on level 1, which is bit 8
+  REQUIRE(std::to_integer<int>(binary[0]) == 0b1);
+  REQUIRE(std::to_integer<int>(binary[1]) == 0b1);
+}
+
+TEST_CASE("Subtrees with all tiles available store constants")
+{
+  TileAvailability availability{ 1 };
+  availability.set_content_available({ 0, 0, 0, 0 });
+
+  const auto subtree = encode_subtree(availability.subtree_availability({ 0, 0, 0, 0 }),
+                                      availability.tiles_per_subtree(),
+                                      availability.child_subtrees_per_subtree());
+
+  uint64_t json_length, binary_length;
+  std::memcpy(&json_length, subtree.data() + 8, sizeof(uint64_t));
+  std::memcpy(&binary_length, subtree.data() + 16, sizeof(uint64_t));
+  REQUIRE(binary_length == 0);
+
+  const std::string json_chunk{ reinterpret_cast<const char*>(subtree.data()) + 24, json_length };
+  rapidjson::Document json;
+  json.Parse(json_chunk.c_str());
+  REQUIRE(!json.HasParseError());
+  REQUIRE(json["tileAvailability"]["constant"].GetUint() == 1);
+  REQUIRE(json["contentAvailability"][0]["constant"].GetUint() == 1);
+  REQUIRE(json["childSubtreeAvailability"]["constant"].GetUint() == 0);
+  REQUIRE(!json.HasMember("buffers"));
+}
@@ -232,9 +232,10 @@ SCENARIO("LASFile in read-mode")
   attributes.insert(PointAttribute::ScanDirectionFlag);
   attributes.insert(PointAttribute::UserData);
 
-  fs::path file_path = "./tmp_testlasfile.las";
+  const OctreeNodeIndex64 node_index{ 7, 4, 1 };
+  fs::path file_path = concat("./", node_name_from_index(node_index), ".las");
   LASPersistence las_persistence{ ".", attributes, attributes };
-  las_persistence.persist_points(expected_points, bounds, "tmp_testlasfile");
+  las_persistence.persist_points(expected_points, bounds, node_index);
 
   BOOST_SCOPE_EXIT(&file_path) { fs::remove(file_path); }
   BOOST_SCOPE_EXIT_END
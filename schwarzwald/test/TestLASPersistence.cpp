@@ -102,15 +102,16 @@ TEST_CASE("LASPersistence store and retrieve to LAS does not modify points")
     const auto points_begin = std::begin(octant_range);
     const auto points_end = std::end(octant_range);
 
-    const auto node_name = "_persistence_test_"s;
+    const OctreeNodeIndex64 node_index{ 7, 2, 1 };
+    const auto node_name = node_name_from_index(node_index);
     const auto node_bounds = get_bounds_from_morton_index(points_begin->morton_index, bounds, 0);
 
     auto point_references = point_references_from_indexed_points(points_begin, points_end);
     persistence.persist_points(
-      std::begin(point_references), std::end(point_references), node_bounds, node_name);
+      std::begin(point_references), std::end(point_references), node_bounds, node_index);
 
     PointBuffer retrieved_points;
-    persistence.retrieve_points(node_name, retrieved_points);
+    persistence.retrieve_points(node_index, retrieved_points);
 
     // Delete temporary file of LASPersistence so that we don't leave any
     // garbage when running this test!
@@ -119,4 +120,111 @@ TEST_CASE("LASPersistence store and retrieve to LAS does not modify points")
 
     compare_points(point_references, retrieved_points);
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Uncompressed LAS files contain the same points as LAZ files written with LASzip")
+{
+  const auto root_folder = "."s;
+  // LAS files don't store normals
+  auto attributes = LASPersistence::supported_output_attributes();
+  attributes.erase(PointAttribute::Normal);
+  LASPersistence las_persistence{ root_folder, attributes, attributes, Compressed::No };
+  LASPersistence laz_persistence{ root_folder, attributes, attributes, Compressed::Yes };
+
+  const AABB bounds{ { -10, -10, -10 }, { 10, 10, 10 } };
+  static constexpr size_t PointsCount = 1021;
+  auto points = generate_random_points(PointsCount, bounds);
+
+  std::mt19937 mt;
+  std::uniform_int_distribution<int> byte_dist{ 0, 255 };
+  std::uniform_int_distribution<int> short_dist{ 0, 65535 };
+  std::uniform_int_distribution<int> return_dist{ 1, 7 };
+  std::uniform_int_distribution<int> flag_dist{ 0, 1 };
+  for (size_t idx = 0; idx < PointsCount; ++idx) {
+    points.rgbColors().push_back({ static_cast<uint8_t>(byte_dist(mt)),
+                                   static_cast<uint8_t>(byte_dist(mt)),
+                                   static_cast<uint8_t>(byte_dist(mt)) });
+    points.intensities().push_back(static_cast<uint16_t>(short_dist(mt)));
+    points.classifications().push_back(static_cast<uint8_t>(byte_dist(mt) & 0b11111));
+    points.edge_of_flight_lines().push_back(static_cast<uint8_t>(flag_dist(mt)));
+    points.gps_times().push_back(idx * 0.25);
+    points.number_of_returns().push_back(static_cast<uint8_t>(return_dist(mt)));
+    points.return_numbers().push_back(static_cast<uint8_t>(return_dist(mt)));
+    points.point_source_ids().push_back(static_cast<uint16_t>(short_dist(mt)));
+    points.scan_angle_ranks().push_back(static_cast<int8_t>(byte_dist(mt) - 128));
+    points.scan_direction_flags().push_back(static_cast<uint8_t>(flag_dist(mt)));
+    points.user_data().push_back(static_cast<uint8_t>(byte_dist(mt)));
+  }
+
+  const OctreeNodeIndex64 node_index{ 7, 2, 2 };
+  const auto node_name = node_name_from_index(node_index);
+  las_persistence.persist_points(points, bounds, node_index);
+
+  tf::Taskflow taskflow;
+  taskflow.emplace([&](tf::Subflow& subflow) {
+    laz_persistence.persist_points(points, bounds, node_index, subflow);
+  });
+  tf::Executor executor;
+  executor.run(taskflow).wait();
+
+  PointBuffer las_points, laz_points;
+  las_persistence.retrieve_points(node_index, las_points);
+  laz_persistence.retrieve_points(node_index, laz_points);
+
+  fs::remove(concat(root_folder, "/", node_name, ".las"));
+  fs::remove(concat(root_folder, "/", node_name, ".laz"));
+
+  REQUIRE(las_points.count() == PointsCount);
+  REQUIRE(las_points.positions() == laz_points.positions());
+  REQUIRE(las_points.rgbColors() == laz_points.rgbColors());
+  REQUIRE(las_points.intensities() == laz_points.intensities());
+  REQUIRE(las_points.classifications() == laz_points.classifications());
+  REQUIRE(las_points.edge_of_flight_lines() == laz_points.edge_of_flight_lines());
+  REQUIRE(las_points.gps_times() == laz_points.gps_times());
+  REQUIRE(las_points.number_of_returns() == laz_points.number_of_returns());
+  REQUIRE(las_points.return_numbers() == laz_points.return_numbers());
+  REQUIRE(las_points.point_source_ids() == laz_points.point_source_ids());
+  REQUIRE(las_points.scan_angle_ranks() == laz_points.scan_angle_ranks());
+  REQUIRE(las_points.scan_direction_flags() == laz_points.scan_direction_flags());
+  REQUIRE(las_points.user_data() == laz_points.user_data());
+}
+
+TEST_CASE("LAZ files that are compressed in parallel chunks contain all points")
+{
+  const auto root_folder = "."s;
+  PointAttributes attributes;
+  attributes.insert(PointAttribute::Position);
+  attributes.insert(PointAttribute::Intensity);
+  LASPersistence las_persistence{ root_folder, attributes, attributes, Compressed::No };
+  LASPersistence laz_persistence{ root_folder, attributes, attributes, Compressed::Yes };
+
+  const AABB bounds{ { 0, 0, 0 }, { 100, 100, 100 } };
+  // Enough points for chunked compression, with a partially filled last chunk
+  const size_t points_count = las::MinPointsForChunkedCompression + 1234;
+  auto points = generate_random_points(points_count, bounds);
+  for (size_t idx = 0; idx < points_count; ++idx) {
+    points.intensities().push_back(static_cast<uint16_t>(idx));
+  }
+
+  const OctreeNodeIndex64 node_index{ 7, 2, 3 };
+  const auto node_name = node_name_from_index(node_index);
+  las_persistence.persist_points(points, bounds, node_index);
+
+  tf::Taskflow taskflow;
+  taskflow.emplace([&](tf::Subflow& subflow) {
+    laz_persistence.persist_points(points, bounds, node_index, subflow);
+  });
+  tf::Executor executor;
+  executor.run(taskflow).wait();
+
+  PointBuffer las_points, laz_points;
+  las_persistence.retrieve_points(node_index, las_points);
+  laz_persistence.retrieve_points(node_index, laz_points);
+
+  fs::remove(concat(root_folder, "/", node_name, ".las"));
+  fs::remove(concat(root_folder, "/", node_name, ".laz"));
+
+  REQUIRE(laz_points.count() == points_count);
+  REQUIRE(las_points.positions() == laz_points.positions());
+  REQUIRE(las_points.intensities() == laz_points.intensities());
+}
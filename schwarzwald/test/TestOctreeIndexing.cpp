@@ -195,13 +195,13 @@ TEST_CASE("Octree point filtering works correctly", "[filter_points_for_octree_n
   });
 
   MortonIndex<Levels> root_key;
+  const TilingContext tiling_context{ bounds, SideLength };
   const auto partition_point_at_l0 =
     filter_points_for_octree_node(points_and_keys.begin(),
                                   points_and_keys.end(),
                                   root_key,
                                   0,
-                                  bounds,
-                                  SideLength,
+                                  tiling_context,
                                   SamplingBehaviour::TakeAllWhenCountBelowMaxPoints,
                                   sampling_strategy);
 
@@ -271,13 +271,13 @@ TEST_CASE("Octree point filtering is stable", "[filter_points_for_octree_node]")
   });
 
   MortonIndex<Levels> root_key;
+  const TilingContext tiling_context{ bounds, SideLength };
   const auto partition_point_at_l0 =
     filter_points_for_octree_node(points_and_keys.begin(),
                                   points_and_keys.end(),
                                   root_key,
                                   0,
-                                  bounds,
-                                  SideLength,
+                                  tiling_context,
                                   SamplingBehaviour::TakeAllWhenCountBelowMaxPoints,
                                   sampling_strategy);
 
@@ -299,6 +299,89 @@ TEST_CASE("Octree point filtering is stable", "[filter_points_for_octree_node]")
   REQUIRE(non_taken_points_are_sorted);
 }
 
+TEST_CASE("Adaptive sampling density follows the analysis budget",
+          "[AdaptivePoissonDiskSampling]")
+{
+  constexpr size_t MaxPointsPerNode = 16;
+  constexpr float AnalysisBudget = 8.f;
+  const auto fixed_density = [](int32_t) { return 1.f; };
+
+  AdaptivePoissonDiskSampling without_budget{ MaxPointsPerNode, fixed_density };
+  AdaptivePoissonDiskSampling with_budget{ MaxPointsPerNode, fixed_density, AnalysisBudget };
+
+  // Level 2 is dense: 100 candidates per selected point. Level 3 is within budget
+  without_budget.record_level_statistics(2, 1'000'000, 10'000);
+  with_budget.record_level_statistics(2, 1'000'000, 10'000);
+  with_budget.record_level_statistics(3, 1'000'000, 500'000);
+
+  // Recorded statistics only take effect once they are measured, e.g. between two batches
+  REQUIRE(with_budget.density_for_level(2) == 1.f);
+  without_budget.update_measured_statistics();
+  with_budget.update_measured_statistics();
+
+  REQUIRE(without_budget.density_for_level(2) == 1.f);
+  REQUIRE(with_budget.density_for_level(2) == Approx(AnalysisBudget / 100.f));
+  REQUIRE(with_budget.density_for_level(3) == 1.f);
+  // No measurements yet, so the fixed density is used
+  REQUIRE(with_budget.density_for_level(4) == 1.f);
+}
+
+TEST_CASE("Adaptive sampling density settles on a dense level", "[AdaptivePoissonDiskSampling]")
+{
+  constexpr uint32_t Levels = 10;
+  constexpr size_t NumPoints = 200'000;
+  constexpr double SideLength = 64;
+  constexpr float AnalysisBudget = 4.f;
+  constexpr size_t NumBatches = 12;
+
+  std::mt19937 rnd{ 1234 };
+  std::uniform_real_distribution<double> dist{ 0, SideLength };
+  std::vector<V3> positions;
+  positions.reserve(NumPoints);
+  std::generate_n(std::back_inserter(positions), NumPoints, [&]() {
+    return V3{ dist(rnd), dist(rnd), dist(rnd) };
+  });
+
+  const AABB bounds{ V3{ 0, 0, 0 }, V3{ SideLength, SideLength, SideLength } };
+  PointBuffer points{ positions.size(), std::move(positions) };
+  std::vector<MortonIndex<Levels>> octree_indices(points.count());
+  calculate_morton_indices_for_points<Levels>(
+    points.positions().begin(), points.positions().end(), octree_indices.begin(), bounds);
+  std::vector<IndexedPoint<Levels>> indexed_points;
+  indexed_points.reserve(points.count());
+  for (size_t idx = 0; idx < points.count(); ++idx) {
+    indexed_points.push_back(IndexedPoint<Levels>{ *(points.begin() + idx), octree_indices[idx] });
+  }
+  std::sort(indexed_points.begin(), indexed_points.end(), [](const auto& l, const auto& r) {
+    return l.morton_index.get() < r.morton_index.get();
+  });
+
+  const TilingContext tiling_context{ bounds, 4.f };
+  AdaptivePoissonDiskSampling sampling{ 16, [](int32_t) { return 1.f; }, AnalysisBudget };
+
+  // Every batch samples a node of the same dense level
+  std::vector<float> densities;
+  for (size_t batch = 0; batch < NumBatches; ++batch) {
+    std::vector<IndexedPoint<Levels>> selected, rejected;
+    sampling.sample_points_into(indexed_points.begin(),
+                                indexed_points.end(),
+                                std::back_inserter(selected),
+                                std::back_inserter(rejected),
+                                MortonIndex<Levels>{},
+                                -1,
+                                tiling_context);
+    sampling.update_measured_statistics();
+    densities.push_back(sampling.density_for_level(-1));
+  }
+
+  // Skipping points fills the grid less, so the density must not shrink from batch to batch
+  REQUIRE(densities.front() < 1.f);
+  for (auto density : densities) {
+    REQUIRE(density >= densities.front());
+  }
+  REQUIRE(densities.back() == Approx(densities[NumBatches - 2]).epsilon(0.02));
+}
+
 TEST_CASE("Partitioning points at root level into child octants works correctly",
           "[partition_points_into_child_octants]")
 {
@@ -526,6 +609,186 @@ TEST_CASE("get_bounds_from_morton_index with multiple levels works",
   REQUIRE(expected_bounds == actual_bounds);
 }
 
+TEST_CASE("TilingContext matches per-node computations", "[TilingContext]")
+{
+  MortonIndex64 key;
+  key.set_octant_at_level(0, uint8_t(1));
+  key.set_octant_at_level(1, uint8_t(4));
+  key.set_octant_at_level(2, uint8_t(5));
+
+  AABB bounds{ { 0, 0, 0 }, { 8, 8, 8 } };
+  constexpr float SpacingAtRoot = 3.f;
+  const TilingContext tiling_context{ bounds, SpacingAtRoot };
+
+  REQUIRE(tiling_context.node_bounds(key, 2) == get_bounds_from_morton_index(key, bounds, 3));
+  REQUIRE(tiling_context.node_bounds(key, -1) == bounds);
+
+  for (int32_t node_level = -1; node_level < 30; ++node_level) {
+    const auto spacing = SpacingAtRoot / std::pow(2, node_level + 1);
+    const auto candidate_level =
+      std::max(-1, (int)std::floor(std::log2f(bounds.extent().x / spacing)) - 1);
+
+    REQUIRE(tiling_context.spacing_at_level(node_level) == spacing);
+    REQUIRE(tiling_context.squared_spacing_at_level(node_level) == spacing * spacing);
+    REQUIRE(tiling_context.candidate_level(node_level) == candidate_level);
+  }
+
+  // Levels beyond the tables are computed on the fly
+  const auto deep_level = TilingContext::MaxTabulatedLevels + 10;
+  REQUIRE(tiling_context.spacing_at_level(deep_level) ==
+          SpacingAtRoot / std::pow(2, deep_level + 1));
+}
+
+TEST_CASE("Sampling with a concrete strategy type samples the same points as the SamplingStrategy",
+          "[sample_points_into]")
+{
+  constexpr size_t NumPoints = 4096;
+  constexpr size_t MaxPointsPerNode = 16;
+
+  AABB bounds{ V3{ 0, 0, 0 }, V3{ 1024, 1024, 1024 } };
+  const TilingContext tiling_context{ bounds, 128.f };
+
+  std::mt19937 rnd{ 42 };
+  std::uniform_real_distribution<double> dist{ 0, 1024 };
+  std::vector<V3> rnd_points;
+  rnd_points.reserve(NumPoints);
+  std::generate_n(std::back_inserter(rnd_points), NumPoints, [&]() {
+    return V3{ dist(rnd), dist(rnd), dist(rnd) };
+  });
+  PointBuffer points{ rnd_points.size(), rnd_points };
+
+  std::vector<IndexedPoint64> indexed_points;
+  index_points<MortonIndex64::MaxLevels>(std::begin(points),
+                                         std::end(points),
+                                         std::back_inserter(indexed_points),
+                                         bounds,
+                                         OutlierPointsBehaviour::ClampToBounds);
+  std::sort(std::begin(indexed_points), std::end(indexed_points));
+
+  std::vector<SamplingStrategy> sampling_strategies{
+    RandomSortedGridSampling{ MaxPointsPerNode },
+    GridCenterSampling{ MaxPointsPerNode },
+    PoissonDiskSampling{ MaxPointsPerNode }
+  };
+  for (auto& sampling_strategy : sampling_strategies) {
+    // Resolved once, the same way as the tiling algorithms resolve their sampling strategy
+    auto actual_points = indexed_points;
+    std::vector<IndexedPoint64> actual_selected(NumPoints);
+    const auto [actual_selected_end, actual_remaining_end] = std::visit(
+      [&](auto& concrete_strategy) {
+        using Strategy = std::decay_t<decltype(concrete_strategy)>;
+        for (int32_t node_level = -1; node_level < 4; ++node_level) {
+          REQUIRE(required_morton_index_depth<Strategy>(node_level, tiling_context) ==
+                  required_morton_index_depth(sampling_strategy, node_level, tiling_context));
+        }
+
+        return sample_points_into(concrete_strategy,
+                                  std::begin(actual_points),
+                                  std::end(actual_points),
+                                  std::begin(actual_selected),
+                                  std::begin(actual_points),
+                                  MortonIndex64{},
+                                  -1,
+                                  tiling_context,
+                                  SamplingBehaviour::AlwaysAdhereToMinSpacing);
+      },
+      sampling_strategy);
+
+    auto expected_points = indexed_points;
+    std::vector<IndexedPoint64> expected_selected(NumPoints);
+    const auto [expected_selected_end, expected_remaining_end] =
+      sample_points_into(sampling_strategy,
+                         std::begin(expected_points),
+                         std::end(expected_points),
+                         std::begin(expected_selected),
+                         std::begin(expected_points),
+                         MortonIndex64{},
+                         -1,
+                         tiling_context,
+                         SamplingBehaviour::AlwaysAdhereToMinSpacing);
+
+    const auto same_point = [](const IndexedPoint64& l, const IndexedPoint64& r) {
+      return l.point_reference.position() == r.point_reference.position() &&
+             l.morton_index == r.morton_index;
+    };
+    REQUIRE(std::distance(std::begin(actual_selected), actual_selected_end) ==
+            std::distance(std::begin(expected_selected), expected_selected_end));
+    REQUIRE(std::equal(std::begin(actual_selected),
+                       actual_selected_end,
+                       std::begin(expected_selected),
+                       same_point));
+    REQUIRE(std::distance(std::begin(actual_points), actual_remaining_end) ==
+            std::distance(std::begin(expected_points), expected_remaining_end));
+    REQUIRE(std::equal(
+      std::begin(actual_points), actual_remaining_end, std::begin(expected_points), same_point));
+  }
+}
+
+TEST_CASE("Progressive point order covers all cells of each level first",
+          "[order_points_progressively]")
+{
+  constexpr size_t NumPoints = 4096;
+
+  AABB bounds{ V3{ 0, 0, 0 }, V3{ 1024, 1024, 1024 } };
+
+  std::mt19937 rnd{ 42 };
+  std::uniform_real_distribution<double> dist{ 0, 1024 };
+  std::vector<V3> rnd_points;
+  rnd_points.reserve(NumPoints);
+  std::generate_n(std::back_inserter(rnd_points), NumPoints, [&]() {
+    return V3{ dist(rnd), dist(rnd), dist(rnd) };
+  });
+  // Duplicate points end up at the very back
+  rnd_points.push_back(rnd_points.front());
+  PointBuffer points{ rnd_points.size(), rnd_points };
+
+  std::vector<IndexedPoint64> indexed_points;
+  index_points<MortonIndex64::MaxLevels>(std::begin(points),
+                                         std::end(points),
+                                         std::back_inserter(indexed_points),
+                                         bounds,
+                                         OutlierPointsBehaviour::ClampToBounds);
+  std::sort(std::begin(indexed_points), std::end(indexed_points));
+
+  std::vector<IndexedPoint64> ordered_points(indexed_points.size());
+  const auto ordered_points_end = order_points_progressively(
+    std::begin(indexed_points), std::end(indexed_points), std::begin(ordered_points));
+  REQUIRE(ordered_points_end == std::end(ordered_points));
+
+  // Ordering is a permutation of the input
+  auto sorted_ordered_points = ordered_points;
+  std::sort(std::begin(sorted_ordered_points), std::end(sorted_ordered_points));
+  REQUIRE(std::equal(std::begin(sorted_ordered_points),
+                     std::end(sorted_ordered_points),
+                     std::begin(indexed_points),
+                     [](const IndexedPoint64& l, const IndexedPoint64& r) {
+                       return l.morton_index == r.morton_index;
+                     }));
+
+  const auto duplicate_key = ordered_points.back().morton_index;
+  REQUIRE(std::count_if(std::begin(indexed_points),
+                        std::end(indexed_points),
+                        [duplicate_key](const IndexedPoint64& point) {
+                          return point.morton_index == duplicate_key;
+                        }) == 2);
+
+  for (uint32_t level = 0; level < 4; ++level) {
+    const auto cells_at_level = [level](auto begin, auto end) {
+      std::unordered_set<uint64_t> cells;
+      std::for_each(begin, end, [&](const IndexedPoint64& point) {
+        cells.insert(point.morton_index.truncate_to_level(level).get());
+      });
+      return cells.size();
+    };
+
+    // The first N points cover all N occupied cells of this level
+    const auto occupied_cells =
+      cells_at_level(std::begin(indexed_points), std::end(indexed_points));
+    const auto prefix_end = std::begin(ordered_points) + static_cast<std::ptrdiff_t>(occupied_cells);
+    REQUIRE(cells_at_level(std::begin(ordered_points), prefix_end) == occupied_cells);
+  }
+}
+
 TEST_CASE("smart octree key calculation works")
 {
   constexpr uint32_t Levels = 20;
@@ -455,4 +455,23 @@ SCENARIO("OctreeNodeIndex - String conversions", "[OctreeNodeIndex]")
 
     THEN("The conversion fails") { REQUIRE(!index.has_value()); }
   }
+
+  WHEN("A string in Potree format is converted to an OctreeNodeIndex")
+  {
+    const auto index =
+      OctreeNodeIndex64::from_string("r0712", MortonIndexNamingConvention::Potree);
+
+    THEN("The leading 'r' is the root node")
+    {
+      REQUIRE(index.has_value());
+      REQUIRE((*index) == OctreeNodeIndex64{ 0, 7, 1, 2 });
+      REQUIRE(node_name_from_index(*index) == "r0712");
+      REQUIRE(node_name_from_index(OctreeNodeIndex64{}) == "r");
+    }
+
+    THEN("Strings without the leading 'r' are rejected")
+    {
+      REQUIRE(!OctreeNodeIndex64::from_string("0712", MortonIndexNamingConvention::Potree));
+    }
+  }
 }
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "catch.hpp"
+
+#include "io/PNTSReader.h"
+#include "io/PNTSWriter.h"
+#include "pointcloud/PointAttributes.h"
+
+#include <experimental/filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+namespace fs = std::experimental::filesystem;
+
+static Vector3<float>
+random_normal(std::mt19937& mt)
+{
+  std::uniform_real_distribution<float> dist{ -1, 1 };
+  Vector3<float> normal;
+  do {
+    normal = { dist(mt), dist(mt), dist(mt) };
+  } while (normal.length() < 0.01f);
+  return normal / normal.length();
+}
+
+static PointBuffer
+generate_random_points(size_t count)
+{
+  std::mt19937 mt{ static_cast<unsigned int>(time(nullptr)) };
+  std::uniform_real_distribution<double> position_dist{ -100, 100 };
+  std::uniform_int_distribution<int> color_dist{ 0, 255 };
+  std::uniform_int_distribution<int> intensity_dist{ 0, 65535 };
+
+  std::vector<Vector3<double>> positions;
+  std::vector<Vector3<uint8_t>> colors;
+  std::vector<Vector3<float>> normals;
+  std::vector<uint16_t> intensities;
+  for (size_t idx = 0; idx < count; ++idx) {
+    // Positions in .pnts files are 32-bit floats
+    positions.push_back({ static_cast<float>(position_dist(mt)),
+                          static_cast<float>(position_dist(mt)),
+                          static_cast<float>(position_dist(mt)) });
+    colors.push_back({ static_cast<uint8_t>(color_dist(mt)),
+                       static_cast<uint8_t>(color_dist(mt)),
+                       static_cast<uint8_t>(color_dist(mt)) });
+    normals.push_back(random_normal(mt));
+    intensities.push_back(static_cast<uint16_t>(intensity_dist(mt)));
+  }
+
+  return {
+    count, std::move(positions), std::move(colors), std::move(normals), std::move(intensities)
+  };
+}
+
+static std::vector<char>
+read_file(const std::string& path)
+{
+  std::ifstream stream{ path, std::ios::in | std::ios::binary };
+  return { std::istreambuf_iterator<char>{ stream }, std::istreambuf_iterator<char>{} };
+}
+
+TEST_CASE("write_pnts_file writes the same file as PNTSWriter", "[PNTSWriter]")
+{
+  PointAttributes attributes;
+  attributes.insert(PointAttribute::Position);
+  attributes.insert(PointAttribute::RGB);
+  attributes.insert(PointAttribute::Intensity);
+
+  const Vector3<double> rtc_center{ 1024.5, -32.25, 7 };
+  const auto points = generate_random_points(1021);
+
+  const std::string expected_file = "expected.pnts";
+  const std::string actual_file = "actual.pnts";
+
+  for (auto rgb_mapping : { RGBMapping::None, RGBMapping::FromIntensityLogarithmic }) {
+    {
+      PNTSWriter writer{ expected_file, attributes, rgb_mapping };
+      writer.write_points(points);
+      writer.flush(rtc_center);
+    }
+    write_pnts_file(actual_file,
+                    std::begin(points),
+                    std::end(points),
+                    attributes,
+                    rgb_mapping,
+                    rtc_center,
+                    PNTSEncoding::Float,
+                    {});
+
+    REQUIRE(read_file(actual_file) == read_file(expected_file));
+
+    write_pnts_file(
+      actual_file, points, attributes, rgb_mapping, rtc_center, PNTSEncoding::Float, {});
+    REQUIRE(read_file(actual_file) == read_file(expected_file));
+
+    const auto pnts_file = readPNTSFile(actual_file, attributes);
+    REQUIRE(pnts_file);
+    REQUIRE(pnts_file->rtc_center == rtc_center);
+    REQUIRE(pnts_file->points.count() == points.count());
+    REQUIRE(pnts_file->points.positions() == points.positions());
+  }
+
+  fs::remove(expected_file);
+  fs::remove(actual_file);
+}
+
+TEST_CASE("Quantized .pnts files can be read back", "[PNTSWriter]")
+{
+  PointAttributes attributes;
+  attributes.insert(PointAttribute::Position);
+  attributes.insert(PointAttribute::Intensity);
+  attributes.insert(PointAttribute::Normal);
+
+  const AABB bounds{ { -100, -100, -100 }, { 100, 100, 100 } };
+  const auto points = generate_random_points(1021);
+  const std::string file = "quantized.pnts";
+
+  for (auto encoding : { PNTSEncoding::Float, PNTSEncoding::Quantized }) {
+    write_pnts_file(file,
+                    std::begin(points),
+                    std::end(points),
+                    attributes,
+                    RGBMapping::None,
+                    {},
+                    encoding,
+                    bounds);
+
+    const auto pnts_file = readPNTSFile(file, attributes);
+    REQUIRE(pnts_file);
+    REQUIRE(pnts_file->points.count() == points.count());
+    REQUIRE(pnts_file->points.intensities() == points.intensities());
+
+    // Writing the columns of the PointBuffer directly produces the same file
+    const auto expected_contents = read_file(file);
+    write_pnts_file(file, points, attributes, RGBMapping::None, {}, encoding, bounds);
+    REQUIRE(read_file(file) == expected_contents);
+
+    // Quantization error is at most half a quantization step per axis, the octahedral encoding of
+    // normals with 8 bits per component is accurate to within a few degrees
+    const auto max_position_error =
+      (encoding == PNTSEncoding::Quantized) ? (bounds.extent().x / 65535) : 0.0;
+    const auto max_normal_error = (encoding == PNTSEncoding::Quantized) ? 0.02f : 0.f;
+    for (size_t idx = 0; idx < points.count(); ++idx) {
+      const auto& expected_position = points.positions()[idx];
+      const auto& actual_position = pnts_file->points.positions()[idx];
+      REQUIRE(std::abs(expected_position.x - actual_position.x) <= max_position_error);
+      REQUIRE(std::abs(expected_position.y - actual_position.y) <= max_position_error);
+      REQUIRE(std::abs(expected_position.z - actual_position.z) <= max_position_error);
+
+      const auto& expected_normal = points.normals()[idx];
+      const auto& actual_normal = pnts_file->points.normals()[idx];
+      REQUIRE(expected_normal.distanceTo(actual_normal) <= max_normal_error);
+    }
+  }
+
+  fs::remove(file);
+}
@@ -0,0 +1,235 @@
+#include "catch.hpp"
+
+#include "io/PackedPersistence.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace std::string_literals;
+
+static PointBuffer
+generate_random_points(size_t count, const AABB& bounds, unsigned int seed)
+{
+  std::mt19937 mt{ seed };
+  std::uniform_real_distribution<double> x_dist{ bounds.min.x, bounds.max.x };
+  std::uniform_real_distribution<double> y_dist{ bounds.min.y, bounds.max.y };
+  std::uniform_real_distribution<double> z_dist{ bounds.min.z, bounds.max.z };
+  std::uniform_int_distribution<int> intensity_dist{ 0, 65535 };
+
+  std::vector<Vector3<double>> positions;
+  std::vector<Vector3<uint8_t>> colors;
+  std::vector<Vector3<float>> normals;
+  std::vector<uint16_t> intensities;
+  for (size_t idx = 0; idx < count; ++idx) {
+    positions.push_back({ x_dist(mt), y_dist(mt), z_dist(mt) });
+    colors.push_back({ static_cast<uint8_t>(idx), 0, 255 });
+    normals.push_back({ 0.f, 0.f, 1.f });
+    intensities.push_back(static_cast<uint16_t>(intensity_dist(mt)));
+  }
+
+  return { count,
+           std::move(positions),
+           std::move(colors),
+           std::move(normals),
+           std::move(intensities) };
+}
+
+static PointAttributes
+packed_test_attributes()
+{
+  return { PointAttribute::Position,
+           PointAttribute::RGB,
+           PointAttribute::Normal,
+           PointAttribute::Intensity };
+}
+
+static void
+require_equal_points(const PointBuffer& expected, const PointBuffer& actual)
+{
+  REQUIRE(expected.count() == actual.count());
+  REQUIRE(expected.positions() == actual.positions());
+  REQUIRE(expected.rgbColors() == actual.rgbColors());
+  REQUIRE(expected.normals() == actual.normals());
+  REQUIRE(expected.intensities() == actual.intensities());
+}
+
+/**
+ * Index of a distinct node on the third level of the octree for each 'idx' < 512
+ */
+static OctreeNodeIndex64
+test_node_index(size_t idx)
+{
+  return { static_cast<uint8_t>((idx / 64) % 8),
+           static_cast<uint8_t>((idx / 8) % 8),
+           static_cast<uint8_t>(idx % 8) };
+}
+
+/**
+ * Creates an empty directory for a test and removes it again when the test is done
+ */
+struct TemporaryDirectory
+{
+  explicit TemporaryDirectory(const std::string& path)
+    : path(path)
+  {
+    fs::remove_all(path);
+    fs::create_directories(path);
+  }
+  ~TemporaryDirectory() { fs::remove_all(path); }
+
+  std::string path;
+};
+
+TEST_CASE("PackedPersistence stores all nodes in a single pack file")
+{
+  const auto attributes = packed_test_attributes();
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+
+  std::vector<PointBuffer> nodes;
+  for (unsigned int idx = 0; idx < 16; ++idx) {
+    nodes.push_back(generate_random_points(100 + idx * 37, bounds, idx));
+  }
+
+  for (auto codec : { BinaryCodec::None, BinaryCodec::LZ4, BinaryCodec::Zstd }) {
+    TemporaryDirectory directory{ "./_packed_persistence_test_" };
+    PackedPersistence persistence{ directory.path, attributes, attributes, codec };
+    for (size_t idx = 0; idx < nodes.size(); ++idx) {
+      persistence.persist_points(nodes[idx], bounds, test_node_index(idx));
+    }
+
+    REQUIRE(!persistence.node_exists(test_node_index(16)));
+    for (size_t idx = 0; idx < nodes.size(); ++idx) {
+      const auto node_index = test_node_index(idx);
+      REQUIRE(persistence.node_exists(node_index));
+
+      const auto location = persistence.locate_node(node_index);
+      REQUIRE(location);
+      REQUIRE(location->pack == 0);
+      REQUIRE(location->offset % PackedPersistence::NodeAlignment == 0);
+
+      PointBuffer retrieved_points;
+      persistence.retrieve_points(node_index, retrieved_points);
+      require_equal_points(nodes[idx], retrieved_points);
+    }
+
+    PointBuffer appended_points;
+    persistence.append_points(test_node_index(0), appended_points);
+    persistence.append_points(test_node_index(1), appended_points);
+    REQUIRE(appended_points.count() == nodes[0].count() + nodes[1].count());
+
+    REQUIRE(fs::exists(persistence.pack_file_path(0)));
+    REQUIRE(!fs::exists(persistence.pack_file_path(1)));
+    REQUIRE(!fs::exists(concat(directory.path, "/r000.bin")));
+  }
+}
+
+TEST_CASE("PackedPersistence starts a new pack file when the current one is full")
+{
+  TemporaryDirectory directory{ "./_packed_persistence_rollover_test_" };
+  const auto attributes = packed_test_attributes();
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+
+  const auto points = generate_random_points(1000, bounds, 42);
+  PackedPersistence persistence{
+    directory.path, attributes, attributes, BinaryCodec::None, 0, 64 * 1024
+  };
+  for (size_t idx = 0; idx < 10; ++idx) {
+    persistence.persist_points(points, bounds, test_node_index(idx));
+  }
+
+  // Each node is larger than half of a pack file, so every node gets its own pack
+  for (uint32_t idx = 0; idx < 10; ++idx) {
+    const auto location = persistence.locate_node(test_node_index(idx));
+    REQUIRE(location);
+    REQUIRE(location->pack == idx);
+    REQUIRE(location->offset == 0);
+    REQUIRE(fs::exists(persistence.pack_file_path(idx)));
+
+    PointBuffer retrieved_points;
+    persistence.retrieve_points(test_node_index(idx), retrieved_points);
+    require_equal_points(points, retrieved_points);
+  }
+}
+
+TEST_CASE("PackedPersistence reads the index of an existing directory")
+{
+  TemporaryDirectory directory{ "./_packed_persistence_index_test_" };
+  const auto attributes = packed_test_attributes();
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+
+  const auto first_points = generate_random_points(500, bounds, 1);
+  const auto second_points = generate_random_points(700, bounds, 2);
+
+  {
+    PackedPersistence persistence{ directory.path, attributes, attributes, BinaryCodec::LZ4 };
+    persistence.persist_points(first_points, bounds, OctreeNodeIndex64{});
+    persistence.persist_points(second_points, bounds, OctreeNodeIndex64{ 0 });
+    // Persisting a node again replaces it
+    persistence.persist_points(second_points, bounds, OctreeNodeIndex64{});
+  }
+
+  REQUIRE(fs::exists(concat(directory.path, "/points.packindex")));
+
+  {
+    PackedPersistence persistence{ directory.path, attributes, attributes, BinaryCodec::LZ4 };
+    REQUIRE(persistence.node_exists(OctreeNodeIndex64{}));
+    REQUIRE(persistence.node_exists(OctreeNodeIndex64{ 0 }));
+    REQUIRE(!persistence.node_exists(OctreeNodeIndex64{ 1 }));
+
+    PointBuffer retrieved_points;
+    persistence.retrieve_points(OctreeNodeIndex64{}, retrieved_points);
+    require_equal_points(second_points, retrieved_points);
+
+    // New nodes never overwrite the existing pack files
+    persistence.persist_points(first_points, bounds, OctreeNodeIndex64{ 1 });
+    REQUIRE(persistence.locate_node(OctreeNodeIndex64{ 1 })->pack == 1);
+  }
+
+  PackedPersistence persistence{ directory.path, attributes, attributes, BinaryCodec::LZ4 };
+  PointBuffer retrieved_points;
+  persistence.retrieve_points(OctreeNodeIndex64{ 1 }, retrieved_points);
+  require_equal_points(first_points, retrieved_points);
+  persistence.retrieve_points(OctreeNodeIndex64{ 0 }, retrieved_points);
+  require_equal_points(second_points, retrieved_points);
+}
+
+TEST_CASE("PackedPersistence can be written from multiple threads")
+{
+  TemporaryDirectory directory{ "./_packed_persistence_threads_test_" };
+  const auto attributes = packed_test_attributes();
+  AABB bounds{ { 0, 0, 0 }, { 1, 1, 1 } };
+
+  constexpr size_t ThreadCount = 8;
+  constexpr size_t NodesPerThread = 32;
+
+  std::vector<PointBuffer> nodes;
+  for (unsigned int idx = 0; idx < ThreadCount; ++idx) {
+    nodes.push_back(generate_random_points(200 + idx, bounds, idx));
+  }
+
+  PackedPersistence persistence{ directory.path, attributes, attributes, BinaryCodec::LZ4 };
+  std::vector<std::thread> threads;
+  for (size_t thread_idx = 0; thread_idx < ThreadCount; ++thread_idx) {
+    threads.emplace_back([&, thread_idx]() {
+      for (size_t node_idx = 0; node_idx < NodesPerThread; ++node_idx) {
+        persistence.persist_points(
+          nodes[thread_idx], bounds, test_node_index(thread_idx * NodesPerThread + node_idx));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t thread_idx = 0; thread_idx < ThreadCount; ++thread_idx) {
+    for (size_t node_idx = 0; node_idx < NodesPerThread; ++node_idx) {
+      PointBuffer retrieved_points;
+      persistence.retrieve_points(test_node_index(thread_idx * NodesPerThread + node_idx),
+                                  retrieved_points);
+      require_equal_points(nodes[thread_idx], retrieved_points);
+    }
+  }
+}
@@ -0,0 +1,237 @@
+#include "catch.hpp"
+
+#include "io/Potree2Persistence.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+
+#include <cstring>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include <rapidjson/document.h>
+
+namespace fs = std::experimental::filesystem;
+
+static PointBuffer
+generate_random_points(size_t count, const AABB& bounds, unsigned int seed)
+{
+  std::mt19937 mt{ seed };
+  std::uniform_real_distribution<double> x_dist{ bounds.min.x, bounds.max.x };
+  std::uniform_real_distribution<double> y_dist{ bounds.min.y, bounds.max.y };
+  std::uniform_real_distribution<double> z_dist{ bounds.min.z, bounds.max.z };
+  std::uniform_int_distribution<int> intensity_dist{ 0, 65535 };
+
+  std::vector<Vector3<double>> positions;
+  std::vector<Vector3<uint8_t>> colors;
+  std::vector<uint16_t> intensities;
+  std::vector<uint8_t> classifications;
+  std::vector<double> gps_times;
+  for (size_t idx = 0; idx < count; ++idx) {
+    positions.push_back({ x_dist(mt), y_dist(mt), z_dist(mt) });
+    colors.push_back({ static_cast<uint8_t>(idx), 0, 255 });
+    intensities.push_back(static_cast<uint16_t>(intensity_dist(mt)));
+    classifications.push_back(static_cast<uint8_t>(idx % 64));
+    gps_times.push_back(1000.0 + idx * 0.25);
+  }
+
+  return { count,         std::move(positions),   std::move(colors),
+           {},            std::move(intensities), std::move(classifications),
+           {},            std::move(gps_times) };
+}
+
+struct RawHierarchyEntry
+{
+  potree2::NodeType type;
+  uint8_t child_mask;
+  uint32_t point_count;
+  uint64_t byte_offset;
+  uint64_t byte_size;
+};
+
+static RawHierarchyEntry
+read_hierarchy_entry(const std::vector<std::byte>& data, size_t index)
+{
+  RawHierarchyEntry entry;
+  const auto src = data.data() + index * potree2::HierarchyEntrySize;
+  std::memcpy(&entry.type, src, sizeof(uint8_t));
+  std::memcpy(&entry.child_mask, src + 1, sizeof(uint8_t));
+  std::memcpy(&entry.point_count, src + 2, sizeof(uint32_t));
+  std::memcpy(&entry.byte_offset, src + 6, sizeof(uint64_t));
+  std::memcpy(&entry.byte_size, src + 14, sizeof(uint64_t));
+  return entry;
+}
+
+static OctreeNodeIndex64
+index_from_name(const std::string& node_name)
+{
+  return OctreeNodeIndex64::from_string(node_name, MortonIndexNamingConvention::Potree).value();
+}
+
+TEST_CASE("Potree 2.0 hierarchy is split into chunks")
+{
+  // A chain of nodes from the root down to level 5 plus a second child of the root. With a step
+  // size of 2, the chunks are rooted at 'r', 'r00' and 'r0000'
+  std::vector<potree2::HierarchyEntry> entries = {
+    { index_from_name("r00000"), 60, 6000, 600 }, { index_from_name("r7"), 17, 1700, 170 },
+    { index_from_name("r0"), 10, 1000, 100 },     { index_from_name("r"), 1, 0, 100 },
+    { index_from_name("r000"), 30, 3000, 300 },   { index_from_name("r0000"), 40, 4000, 400 },
+  };
+  const auto hierarchy = potree2::encode_hierarchy(entries, 2);
+
+  // Chunk 'r': r, r0, r7, r00 (proxy)
+  REQUIRE(hierarchy.first_chunk_size == 4 * potree2::HierarchyEntrySize);
+  // Chunk 'r00': r00, r000, r0000 (proxy). Chunk 'r0000': r0000, r00000
+  REQUIRE(hierarchy.data.size() == 9 * potree2::HierarchyEntrySize);
+  REQUIRE(hierarchy.depth == 5);
+
+  const auto root = read_hierarchy_entry(hierarchy.data, 0);
+  REQUIRE(root.type == potree2::NodeType::Normal);
+  REQUIRE(root.child_mask == 0b10000001);
+  REQUIRE(root.point_count == 1);
+  REQUIRE(root.byte_offset == 0);
+  REQUIRE(root.byte_size == 100);
+
+  const auto r0 = read_hierarchy_entry(hierarchy.data, 1);
+  REQUIRE(r0.child_mask == 0b1);
+  REQUIRE(r0.byte_offset == 1000);
+  const auto r7 = read_hierarchy_entry(hierarchy.data, 2);
+  REQUIRE(r7.type == potree2::NodeType::Leaf);
+  REQUIRE(r7.point_count == 17);
+
+  // 'r00' was never persisted, so it has no points
+  const auto r00_proxy = read_hierarchy_entry(hierarchy.data, 3);
+  REQUIRE(r00_proxy.type == potree2::NodeType::Proxy);
+  REQUIRE(r00_proxy.point_count == 0);
+  REQUIRE(r00_proxy.byte_offset == hierarchy.first_chunk_size);
+  REQUIRE(r00_proxy.byte_size == 3 * potree2::HierarchyEntrySize);
+
+  const auto r00 = read_hierarchy_entry(hierarchy.data, 4);
+  REQUIRE(r00.type == potree2::NodeType::Normal);
+  REQUIRE(r00.byte_size == 0);
+  const auto r0000_proxy = read_hierarchy_entry(hierarchy.data, 6);
+  REQUIRE(r0000_proxy.type == potree2::NodeType::Proxy);
+  REQUIRE(r0000_proxy.point_count == 40);
+  REQUIRE(r0000_proxy.byte_offset == 7 * potree2::HierarchyEntrySize);
+  REQUIRE(r0000_proxy.byte_size == 2 * potree2::HierarchyEntrySize);
+
+  const auto r0000 = read_hierarchy_entry(hierarchy.data, 7);
+  REQUIRE(r0000.type == potree2::NodeType::Normal);
+  REQUIRE(r0000.byte_offset == 4000);
+  const auto r00000 = read_hierarchy_entry(hierarchy.data, 8);
+  REQUIRE(r00000.type == potree2::NodeType::Leaf);
+  REQUIRE(r00000.byte_size == 600);
+
+  // An empty octree still has a root node
+  const auto empty = potree2::encode_hierarchy({}, potree2::HierarchyStepSize);
+  REQUIRE(empty.data.size() == potree2::HierarchyEntrySize);
+  REQUIRE(read_hierarchy_entry(empty.data, 0).type == potree2::NodeType::Leaf);
+
+  REQUIRE_THROWS(potree2::encode_hierarchy(entries, 0));
+}
+
+TEST_CASE("Potree2Persistence writes octree.bin, hierarchy.bin and metadata.json")
+{
+  const std::string work_dir = "./_potree2_persistence_test_";
+  fs::remove_all(work_dir);
+  fs::create_directories(work_dir);
+
+  const PointAttributes attributes = { PointAttribute::Position,
+                                       PointAttribute::RGB,
+                                       PointAttribute::Intensity,
+                                       PointAttribute::Classification,
+                                       PointAttribute::GPSTime };
+  const AABB bounds{ { 0, 0, 0 }, { 16, 16, 16 } };
+
+  const std::vector<OctreeNodeIndex64> node_indices = { {}, { 0 }, { 7 }, { 0, 7 }, { 7, 0 } };
+  std::vector<PointBuffer> nodes;
+  for (unsigned int idx = 0; idx < node_indices.size(); ++idx) {
+    nodes.push_back(generate_random_points(1000 + idx * 123, bounds, idx));
+  }
+
+  const auto layout = potree2::point_layout_for_attributes(attributes);
+  // position, rgb, intensity, classification, gps-time
+  REQUIRE(layout.record_size == 12 + 6 + 2 + 1 + 8);
+
+  uint64_t total_point_count = 0;
+  {
+    Potree2Persistence persistence{ work_dir, attributes, attributes, bounds, 0.5f };
+
+    // Persisting a node again replaces its payload
+    persistence.persist_points(nodes[1], bounds, node_indices[0]);
+    for (size_t idx = 0; idx < nodes.size(); ++idx) {
+      persistence.persist_points(nodes[idx], bounds, node_indices[idx]);
+      total_point_count += nodes[idx].count();
+    }
+
+    REQUIRE(!persistence.node_exists({ 1 }));
+    for (size_t idx = 0; idx < nodes.size(); ++idx) {
+      REQUIRE(persistence.node_exists(node_indices[idx]));
+
+      PointBuffer retrieved_points;
+      persistence.retrieve_points(node_indices[idx], retrieved_points);
+      REQUIRE(retrieved_points.count() == nodes[idx].count());
+      for (size_t point_idx = 0; point_idx < nodes[idx].count(); ++point_idx) {
+        const auto& expected = nodes[idx].positions()[point_idx];
+        const auto& actual = retrieved_points.positions()[point_idx];
+        REQUIRE(std::abs(expected.x - actual.x) <= 0.001);
+        REQUIRE(std::abs(expected.y - actual.y) <= 0.001);
+        REQUIRE(std::abs(expected.z - actual.z) <= 0.001);
+      }
+      REQUIRE(retrieved_points.rgbColors() == nodes[idx].rgbColors());
+      REQUIRE(retrieved_points.intensities() == nodes[idx].intensities());
+      REQUIRE(retrieved_points.classifications() == nodes[idx].classifications());
+      REQUIRE(retrieved_points.gps_times() == nodes[idx].gps_times());
+    }
+
+    persistence.finalize();
+    REQUIRE_THROWS(persistence.persist_points(nodes[0], bounds, OctreeNodeIndex64{ 1 }));
+  }
+
+  // The replaced payload of the root node is removed
+  REQUIRE(fs::file_size(work_dir + "/octree.bin") == total_point_count * layout.record_size);
+
+  std::ifstream hierarchy_reader{ work_dir + "/hierarchy.bin", std::ios::in | std::ios::binary };
+  const std::vector<char> hierarchy_file{ std::istreambuf_iterator<char>{ hierarchy_reader },
+                                          std::istreambuf_iterator<char>{} };
+  const auto hierarchy_begin = reinterpret_cast<const std::byte*>(hierarchy_file.data());
+  const std::vector<std::byte> hierarchy{ hierarchy_begin,
+                                          hierarchy_begin + hierarchy_file.size() };
+  REQUIRE(hierarchy.size() == node_indices.size() * potree2::HierarchyEntrySize);
+
+  // Breadth-first order: r, r0, r7, r07, r70
+  uint64_t expected_byte_offset = 0;
+  for (size_t idx = 0; idx < node_indices.size(); ++idx) {
+    const auto entry = read_hierarchy_entry(hierarchy, idx);
+    REQUIRE(entry.point_count == nodes[idx].count());
+    REQUIRE(entry.byte_size == nodes[idx].count() * layout.record_size);
+    expected_byte_offset = std::max(expected_byte_offset, entry.byte_offset + entry.byte_size);
+  }
+  REQUIRE(expected_byte_offset == total_point_count * layout.record_size);
+
+  std::ifstream metadata_reader{ work_dir + "/metadata.json" };
+  const std::string metadata_file{ std::istreambuf_iterator<char>{ metadata_reader },
+                                   std::istreambuf_iterator<char>{} };
+  rapidjson::Document metadata;
+  metadata.Parse(metadata_file.c_str());
+  REQUIRE(!metadata.HasParseError());
+  REQUIRE(std::string{ metadata["version"].GetString() } == "2.0");
+  REQUIRE(std::string{ metadata["encoding"].GetString() } == "DEFAULT");
+  REQUIRE(metadata["points"].GetUint64() == total_point_count);
+  REQUIRE(metadata["hierarchy"]["firstChunkSize"].GetUint64() == hierarchy.size());
+  REQUIRE(metadata["hierarchy"]["depth"].GetUint() == 2);
+  REQUIRE(metadata["spacing"].GetDouble() == 0.5);
+
+  const auto& metadata_attributes = metadata["attributes"];
+  REQUIRE(metadata_attributes.Size() == layout.columns.size());
+  REQUIRE(std::string{ metadata_attributes[0]["name"].GetString() } == "position");
+  REQUIRE(metadata_attributes[0]["min"].Size() == 3);
+  REQUIRE(metadata_attributes[0]["min"][0].GetDouble() >= 0);
+  REQUIRE(metadata_attributes[0]["max"][0].GetDouble() <= 16);
+  REQUIRE(std::string{ metadata_attributes[4]["name"].GetString() } == "gps-time");
+  REQUIRE(metadata_attributes[4]["min"][0].GetDouble() == 1000.0);
+
+  fs::remove_all(work_dir);
+}
@@ -0,0 +1,114 @@
+#include "catch.hpp"
+
+#include "datastructures/OctreeNodeIndex.h"
+#include "datastructures/ShardedMap.h"
+
+#include <thread>
+#include <vector>
+
+TEST_CASE("ShardedMap stores and replaces entries", "[ShardedMap]")
+{
+  ShardedMap<OctreeNodeIndex64, size_t> map;
+  REQUIRE(map.empty());
+
+  map.insert_or_assign(OctreeNodeIndex64{}, 1);
+  map.insert_or_assign(OctreeNodeIndex64{ 3 }, 2);
+  map.insert_or_assign(OctreeNodeIndex64{ 3 }, 3);
+
+  REQUIRE(map.size() == 2);
+  REQUIRE(map.contains(OctreeNodeIndex64{}));
+  REQUIRE(map.contains(OctreeNodeIndex64{ 3 }));
+  REQUIRE(!map.contains(OctreeNodeIndex64{ 3, 0 }));
+
+  const auto entries = map.collect();
+  REQUIRE(entries.size() == 2);
+  REQUIRE(entries.at(OctreeNodeIndex64{}) == 1);
+  REQUIRE(entries.at(OctreeNodeIndex64{ 3 }) == 3);
+
+  auto moved_to_map = std::move(map);
+  REQUIRE(moved_to_map.size() == 2);
+  REQUIRE(!moved_to_map.empty());
+  REQUIRE(moved_to_map.contains(OctreeNodeIndex64{}));
+  REQUIRE(moved_to_map.contains(OctreeNodeIndex64{ 3 }));
+  REQUIRE(moved_to_map.collect() == entries);
+}
+
+TEST_CASE("ShardedMap keeps all entries of concurrent writers", "[ShardedMap]")
+{
+  ShardedMap<OctreeNodeIndex64, size_t> map;
+  constexpr uint8_t NumThreads = 8;
+
+  // Every thread writes all nodes of its own octant down to level 4
+  std::vector<std::thread> threads;
+  for (uint8_t octant = 0; octant < NumThreads; ++octant) {
+    threads.emplace_back([&map, octant]() {
+      std::vector<OctreeNodeIndex64> nodes = { OctreeNodeIndex64{ octant } };
+      for (size_t idx = 0; idx < nodes.size(); ++idx) {
+        map.insert_or_assign(nodes[idx], nodes[idx].levels());
+        if (nodes[idx].levels() == 4)
+          continue;
+        for (uint8_t child = 0; child < 8; ++child) {
+          nodes.push_back(nodes[idx].child(child));
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const auto entries = map.collect();
+  REQUIRE(entries.size() == NumThreads * (1 + 8 + 64 + 512));
+  for (const auto& [node_index, levels] : entries) {
+    REQUIRE(node_index.levels() == levels);
+  }
+}
+
+TEST_CASE("ShardedMap extracts the entries matching a predicate", "[ShardedMap]")
+{
+  ShardedMap<OctreeNodeIndex64, size_t> map;
+  for (uint8_t octant = 0; octant < 8; ++octant) {
+    map.insert_or_assign(OctreeNodeIndex64{ octant }, octant);
+    map.insert_or_assign(OctreeNodeIndex64{ octant, 1 }, octant);
+  }
+
+  const auto extracted = map.extract_if([](const OctreeNodeIndex64& node_index, size_t octant) {
+    return octant == 2 && node_index.levels() == 2;
+  });
+  REQUIRE(extracted.size() == 1);
+  REQUIRE(extracted.at(OctreeNodeIndex64{ 2, 1 }) == 2);
+
+  REQUIRE(map.size() == 15);
+  REQUIRE(!map.contains(OctreeNodeIndex64{ 2, 1 }));
+  REQUIRE(map.contains(OctreeNodeIndex64{ 2 }));
+
+  REQUIRE(map.extract_if([](const auto&, size_t) { return false; }).empty());
+  REQUIRE(map.extract_if([](const auto&, size_t) { return true; }).size() == 15);
+  REQUIRE(map.empty());
+}
+
+TEST_CASE("ShardedMap updates and extracts single entries", "[ShardedMap]")
+{
+  ShardedMap<OctreeNodeIndex64, std::vector<size_t>> map;
+  for (size_t value = 0; value < 4; ++value) {
+    const auto size = map.update(OctreeNodeIndex64{ 3 }, [value](std::vector<size_t>& values) {
+      values.push_back(value);
+      return values.size();
+    });
+    REQUIRE(size == value + 1);
+  }
+  map.update(OctreeNodeIndex64{ 4 }, [](std::vector<size_t>& values) { values.push_back(42); });
+  REQUIRE(map.size() == 2);
+
+  const auto extracted = map.extract(OctreeNodeIndex64{ 3 });
+  REQUIRE(extracted);
+  REQUIRE(*extracted == std::vector<size_t>{ 0, 1, 2, 3 });
+  REQUIRE(!map.extract(OctreeNodeIndex64{ 3 }));
+  REQUIRE(map.size() == 1);
+  REQUIRE(map.contains(OctreeNodeIndex64{ 4 }));
+
+  // A moved-from map has no entries to extract
+  auto moved_to_map = std::move(map);
+  REQUIRE(!map.extract(OctreeNodeIndex64{ 4 }));
+  REQUIRE(moved_to_map.extract(OctreeNodeIndex64{ 4 }) == std::vector<size_t>{ 42 });
+}
@@ -0,0 +1,185 @@
+#include "catch.hpp"
+
+#include "io/PointsPersistence.h"
+#include "math/AABB.h"
+#include "pointcloud/PointAttributes.h"
+
+#include <experimental/filesystem>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace fs = std::experimental::filesystem;
+
+static PointBuffer
+generate_random_points(size_t count, unsigned int seed)
+{
+  std::mt19937 mt{ seed };
+  std::uniform_real_distribution<double> position_dist{ -100, 100 };
+  std::uniform_int_distribution<int> intensity_dist{ 0, 65535 };
+
+  std::vector<Vector3<double>> positions;
+  std::vector<Vector3<uint8_t>> colors;
+  std::vector<uint16_t> intensities;
+  for (size_t idx = 0; idx < count; ++idx) {
+    positions.push_back({ position_dist(mt), position_dist(mt), position_dist(mt) });
+    colors.push_back({ static_cast<uint8_t>(idx), 0, 255 });
+    intensities.push_back(static_cast<uint16_t>(intensity_dist(mt)));
+  }
+
+  return { count, std::move(positions), std::move(colors), {}, std::move(intensities) };
+}
+
+TEST_CASE("TeePersistence writes all sinks and retrieves from a lossless sink")
+{
+  const std::string work_dir = "./_tee_persistence_test_";
+  fs::remove_all(work_dir);
+  fs::create_directories(work_dir + "/bin");
+
+  const PointAttributes attributes = { PointAttribute::Position,
+                                       PointAttribute::RGB,
+                                       PointAttribute::Intensity };
+  const AABB bounds{ { -100, -100, -100 }, { 100, 100, 100 } };
+  const Vector3<double> offset{ 1000, 2000, 3000 };
+  const auto points = generate_random_points(500, 42);
+
+  std::vector<PointsPersistence> sinks, shifted_sinks;
+  sinks.emplace_back(
+    BinaryPersistence{ work_dir + "/bin", attributes, attributes, Compressed::No });
+  sinks.emplace_back(MemoryPersistence{ attributes });
+  shifted_sinks.emplace_back(MemoryPersistence{ attributes });
+  PointsPersistence persistence{ TeePersistence{
+    std::move(sinks), std::move(shifted_sinks), offset, work_dir + "/cache", attributes } };
+
+  // The MemoryPersistence is lossless and faster than BIN, so no cache is needed
+  REQUIRE(!persistence.get<TeePersistence>().uses_cache());
+  REQUIRE(!fs::exists(work_dir + "/cache"));
+  REQUIRE(persistence.is_lossless());
+
+  persistence.persist_points(points, bounds, OctreeNodeIndex64{});
+  persistence.persist_points(std::begin(points), std::end(points), bounds, OctreeNodeIndex64{ 0 });
+
+  REQUIRE(persistence.node_exists(OctreeNodeIndex64{ 0 }));
+  REQUIRE(!persistence.node_exists(OctreeNodeIndex64{ 1 }));
+  REQUIRE(fs::exists(work_dir + "/bin/r.bin"));
+  REQUIRE(fs::exists(work_dir + "/bin/r0.bin"));
+
+  PointBuffer retrieved_points;
+  persistence.retrieve_points(OctreeNodeIndex64{ 0 }, retrieved_points);
+  REQUIRE(retrieved_points.positions() == points.positions());
+  REQUIRE(retrieved_points.rgbColors() == points.rgbColors());
+  REQUIRE(retrieved_points.intensities() == points.intensities());
+
+  persistence.append_points(OctreeNodeIndex64{}, retrieved_points);
+  REQUIRE(retrieved_points.count() == 2 * points.count());
+
+  fs::remove_all(work_dir);
+}
+
+TEST_CASE("TeePersistence moves the points of shifted sinks")
+{
+  const std::string work_dir = "./_tee_persistence_shift_test_";
+  fs::remove_all(work_dir);
+  fs::create_directories(work_dir);
+
+  const PointAttributes attributes = { PointAttribute::Position, PointAttribute::Intensity };
+  const AABB bounds{ { -100, -100, -100 }, { 100, 100, 100 } };
+  const Vector3<double> offset{ 1000, 2000, 3000 };
+  const auto points = generate_random_points(100, 43);
+
+  {
+    std::vector<PointsPersistence> sinks, shifted_sinks;
+    sinks.emplace_back(MemoryPersistence{ attributes });
+    shifted_sinks.emplace_back(
+      BinaryPersistence{ work_dir, attributes, attributes, Compressed::No });
+    TeePersistence tee{ std::move(sinks), std::move(shifted_sinks), offset, "", attributes };
+
+    tee.persist_points(std::begin(points), std::end(points), bounds, OctreeNodeIndex64{});
+
+    // Points are retrieved from the unshifted sink
+    PointBuffer retrieved_points;
+    tee.retrieve_points(OctreeNodeIndex64{}, retrieved_points);
+    REQUIRE(retrieved_points.positions() == points.positions());
+  }
+
+  BinaryPersistence reader{ work_dir, attributes, attributes, Compressed::No };
+  PointBuffer shifted_points;
+  reader.retrieve_points(OctreeNodeIndex64{}, shifted_points);
+  REQUIRE(shifted_points.count() == points.count());
+  for (size_t idx = 0; idx < points.count(); ++idx) {
+    REQUIRE(shifted_points.positions()[idx] == points.positions()[idx] + offset);
+  }
+  REQUIRE(shifted_points.intensities() == points.intensities());
+
+  fs::remove_all(work_dir);
+}
+
+TEST_CASE("TeePersistence caches the points if all sinks are lossy")
+{
+  const std::string work_dir = "./_tee_persistence_cache_test_";
+  fs::remove_all(work_dir);
+
+  const PointAttributes attributes = { PointAttribute::Position, PointAttribute::Intensity };
+  const AABB bounds{ { -100, -100, -100 }, { 100, 100, 100 } };
+  const auto points = generate_random_points(200, 44);
+
+  {
+    // Lossless sinks that only receive shifted points are not used for retrieving points
+    std::vector<PointsPersistence> shifted_sinks;
+    shifted_sinks.emplace_back(MemoryPersistence{ attributes });
+    TeePersistence tee{ {}, std::move(shifted_sinks), { 10, 20, 30 }, work_dir, attributes };
+    REQUIRE(tee.uses_cache());
+    REQUIRE(tee.is_lossless());
+
+    tee.persist_points(points, bounds, OctreeNodeIndex64{});
+    REQUIRE(fs::exists(work_dir + "/r.bin"));
+
+    PointBuffer retrieved_points;
+    tee.retrieve_points(OctreeNodeIndex64{}, retrieved_points);
+    REQUIRE(retrieved_points.positions() == points.positions());
+    REQUIRE(retrieved_points.intensities() == points.intensities());
+  }
+
+  // The cache is removed together with the TeePersistence
+  REQUIRE(!fs::exists(work_dir));
+}
+
+TEST_CASE("TeePersistence persists nodes from several threads at once")
+{
+  const std::string work_dir = "./_tee_persistence_threads_test_";
+  fs::remove_all(work_dir);
+  fs::create_directories(work_dir);
+
+  const PointAttributes attributes = { PointAttribute::Position, PointAttribute::Intensity };
+  const AABB bounds{ { -100, -100, -100 }, { 100, 100, 100 } };
+  const Vector3<double> offset{ 1000, 2000, 3000 };
+  const auto points = generate_random_points(100, 45);
+
+  std::vector<PointsPersistence> sinks, shifted_sinks;
+  sinks.emplace_back(MemoryPersistence{ attributes });
+  sinks.emplace_back(BinaryPersistence{ work_dir, attributes, attributes, Compressed::No });
+  shifted_sinks.emplace_back(MemoryPersistence{ attributes });
+  TeePersistence tee{ std::move(sinks), std::move(shifted_sinks), offset, "", attributes };
+
+  std::vector<std::thread> threads;
+  for (uint8_t thread_idx = 0; thread_idx < 4; ++thread_idx) {
+    threads.emplace_back([&, thread_idx]() {
+      for (uint8_t octant = 0; octant < 8; ++octant) {
+        tee.persist_points(points, bounds, OctreeNodeIndex64{ thread_idx, octant });
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (uint8_t thread_idx = 0; thread_idx < 4; ++thread_idx) {
+    for (uint8_t octant = 0; octant < 8; ++octant) {
+      PointBuffer retrieved_points;
+      tee.retrieve_points(OctreeNodeIndex64{ thread_idx, octant }, retrieved_points);
+      REQUIRE(retrieved_points.positions() == points.positions());
+    }
+  }
+
+  fs::remove_all(work_dir);
+}
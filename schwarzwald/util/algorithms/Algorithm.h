@@ -1,11 +1,77 @@
 #pragma once
 
 #include <algorithm>
+#include <cassert>
 #include <iterator>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "containers/Range.h"
 
+namespace detail {
+/**
+ * Moves [first, last) to 'd_first' one element after another, from front to back. Unlike std::move,
+ * this is defined if 'd_first' lies within [first, last), as long as it does not come after
+ * 'first'. If 'd_first' is 'first', no element is moved onto itself
+ */
+template<typename InIter, typename OutIter>
+OutIter
+move_forward(InIter first, const InIter last, OutIter d_first)
+{
+  if constexpr (std::is_same_v<InIter, OutIter>) {
+    if (first == d_first)
+      return std::next(d_first, std::distance(first, last));
+  }
+  for (; first != last; ++first, ++d_first) {
+    *d_first = std::move(*first);
+  }
+  return d_first;
+}
+} // namespace detail
+
+/**
+ * Single-pass, allocation-free variant of 'stable_partition_with_jumps'. Instead of reordering the
+ * input range, all selected elements are moved to 'selected_out' and all unselected elements are
+ * moved to 'rejected_out', both in the order in which they appear in [begin, end). The predicate
+ * has the same semantics as for 'stable_partition_with_jumps'.
+ *
+ * 'rejected_out' may point to 'begin' of the input range. In this case, all unselected elements
+ * are compacted in place at the front of the input range, since the write position never overtakes
+ * the read position. Returns the end iterators of both output ranges
+ **/
+template<typename Iter, typename SelectedOutIter, typename RejectedOutIter, typename Pred>
+std::pair<SelectedOutIter, RejectedOutIter>
+partition_copy_with_jumps(const Iter begin,
+                          const Iter end,
+                          SelectedOutIter selected_out,
+                          RejectedOutIter rejected_out,
+                          Pred pred)
+{
+  auto current = begin;
+  while (current != end) {
+    const auto selected_and_next = pred(current, end);
+    const auto selected = selected_and_next.first;
+    const auto next = selected_and_next.second;
+    assert(next != current);
+
+    if (selected == next) {
+      // Everything is unselected
+      rejected_out = detail::move_forward(current, next, rejected_out);
+    } else {
+      // Everything prior to the selected element is unselected, then the selected element, then
+      // everything up to 'next' is unselected again
+      rejected_out = detail::move_forward(current, selected, rejected_out);
+      selected_out = detail::move_forward(selected, selected + 1, selected_out);
+      rejected_out = detail::move_forward(selected + 1, next, rejected_out);
+    }
+
+    current = next;
+  }
+
+  return std::make_pair(selected_out, rejected_out);
+}
+
 /*
  * Like std::stable_partition, but the predicate can operate on a whole
  * subrange instead of a single entry at a time. This enables partitioning
@@ -34,29 +100,8 @@ stable_partition_with_jumps(const Iter begin, const Iter end, Pred pred)
   // Selected elements are copied in forward sorted order to the beginning of the buffer,
   // unselected elements are copied in reverse sorted order to the end of the buffer. This way,
   // the buffer grows from front and back until eventually both iterators meet
-  auto selected_insert_position = tmp_buffer_begin;
-  auto unselected_insert_position = tmp_buffer_rbegin;
-
-  auto current = begin;
-  while (current != end) {
-    const auto selected_and_next = pred(current, end);
-    const auto selected = selected_and_next.first;
-    const auto next = selected_and_next.second;
-    assert(next != current);
-
-    if (selected == next) {
-      // Everything is unselected, copy everything to the end of the tmp_buffer
-      unselected_insert_position = std::move(current, next, unselected_insert_position);
-    } else {
-      // Copy everything prior to the selected element to the tmp_buffer, then the selected
-      // element to the
-      unselected_insert_position = std::move(current, selected, unselected_insert_position);
-      selected_insert_position = std::move(selected, selected + 1, selected_insert_position);
-      unselected_insert_position = std::move(selected + 1, next, unselected_insert_position);
-    }
-
-    current = next;
-  }
+  const auto [selected_insert_position, unselected_insert_position] =
+    partition_copy_with_jumps(begin, end, tmp_buffer_begin, tmp_buffer_rbegin, pred);
 
   // Copy everything back into the original range
   const auto pivot_point = std::move(tmp_buffer_begin, selected_insert_position, begin);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <expected.hpp>
+#include <stdexcept>
 #include <string>
 
 #include "types/type_util.h"
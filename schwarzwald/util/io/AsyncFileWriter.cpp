@@ -0,0 +1,666 @@
+#include "io/AsyncFileWriter.h"
+#include "algorithms/Strings.h"
+#include "io/io_util.h"
+#include "terminal/stdout_helper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+// Opening files into the table of registered files and using them in the same chain of operations
+// requires IORING_FEAT_LINKED_FILE, which is checked again at runtime
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) &&                               \
+  defined(__NR_io_uring_register) && defined(IORING_FEAT_LINKED_FILE)
+#define SCHWARZWALD_HAS_IO_URING 1
+#endif
+#endif
+
+namespace {
+std::atomic<AsyncFileWriter*> s_async_file_writer{ nullptr };
+
+// Number of threads of the fallback backend. Writing files is mostly waiting for the kernel, so a
+// few threads are enough to hide the latency of open and close
+constexpr uint32_t WorkerThreads = 4;
+} // namespace
+
+#ifdef SCHWARZWALD_HAS_IO_URING
+/**
+ * Minimal io_uring, set up with raw system calls so that there is no dependency on liburing. Files
+ * are opened as direct descriptors into a table of registered files, which allows submitting the
+ * open, write and close of a file as a single chain of linked operations
+ */
+struct AsyncFileWriter::IOUring
+{
+  enum class Operation : uint64_t
+  {
+    Open,
+    Write,
+    Close,
+    Cancel
+  };
+
+  // Number of files that are written at the same time, i.e. the size of the registered file table
+  constexpr static uint32_t MaxFilesInFlight = 64;
+  // Each file needs at most three submission queue entries at a time
+  constexpr static uint32_t QueueEntries = 4 * MaxFilesInFlight;
+  // Larger files are written with several writes
+  constexpr static size_t MaxBytesPerWrite = size_t{ 1 } << 30;
+
+  /**
+   * Returns nullptr if io_uring or one of the required operations is not supported
+   */
+  static std::unique_ptr<IOUring> create()
+  {
+    auto ring = std::make_unique<IOUring>();
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring->fd = static_cast<int>(syscall(__NR_io_uring_setup, QueueEntries, &params));
+    if (ring->fd < 0)
+      return nullptr;
+
+    if (!(params.features & IORING_FEAT_LINKED_FILE) || !ring->map_queues(params) ||
+        !ring->supports_required_operations() || !ring->register_file_table()) {
+      return nullptr;
+    }
+    return ring;
+  }
+
+  ~IOUring()
+  {
+    if (sqes)
+      munmap(sqes, sqes_size);
+    if (cq_ptr && cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_size);
+    if (sq_ptr)
+      munmap(sq_ptr, sq_size);
+    if (fd >= 0)
+      close(fd);
+  }
+
+  /**
+   * Returns a cleared submission queue entry, or nullptr if the submission queue is full
+   */
+  io_uring_sqe* get_sqe()
+  {
+    const auto head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sqe_tail - head >= sq_entries)
+      return nullptr;
+
+    const auto index = sqe_tail & *sq_mask;
+    sq_array[index] = index;
+    ++sqe_tail;
+    auto sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+  }
+
+  void prepare_open(const WriteRequest& request, uint32_t slot)
+  {
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(request.file_path.c_str());
+    sqe->len = 0644;
+    // Direct descriptors are never inherited, the kernel rejects O_CLOEXEC for them
+    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+    sqe->file_index = slot + 1;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = user_data(slot, Operation::Open);
+  }
+
+  void prepare_write(const WriteRequest& request, size_t offset, uint32_t slot)
+  {
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = static_cast<int32_t>(slot);
+    sqe->addr = reinterpret_cast<uint64_t>(request.data.get() + offset);
+    sqe->len = static_cast<uint32_t>(std::min(request.size - offset, MaxBytesPerWrite));
+    sqe->off = offset;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+    sqe->user_data = user_data(slot, Operation::Write);
+  }
+
+  void prepare_close(uint32_t slot)
+  {
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->user_data = user_data(slot, Operation::Close);
+  }
+
+  /**
+   * Cancels the given operation of the given slot if it has not completed yet. Operations that are
+   * running already can't be cancelled and complete as usual
+   */
+  void prepare_cancel(uint32_t slot, Operation operation)
+  {
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data(slot, operation);
+    sqe->user_data = user_data(slot, Operation::Cancel);
+  }
+
+  /**
+   * Takes back all prepared entries that the kernel has not taken yet and calls
+   * 'on_retracted(slot, operation)' for each of them. The kernel only takes entries while
+   * 'submit_and_wait' runs, so this is safe in between
+   */
+  template<typename OnRetracted>
+  void retract_unsubmitted(OnRetracted on_retracted)
+  {
+    const auto head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    for (auto entry = head; entry != sqe_tail; ++entry) {
+      const auto data = sqes[sq_array[entry & *sq_mask]].user_data;
+      on_retracted(static_cast<uint32_t>(data >> 2), static_cast<Operation>(data & 3));
+    }
+    sqe_tail = head;
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+  }
+
+  /**
+   * Submits all prepared entries and waits until at least 'min_completions' operations are done.
+   * Returns a negative errno value on errors other than interrupts
+   */
+  int submit_and_wait(uint32_t min_completions)
+  {
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+    while (true) {
+      const auto to_submit = sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+      const auto result = syscall(__NR_io_uring_enter,
+                                  fd,
+                                  to_submit,
+                                  min_completions,
+                                  min_completions ? IORING_ENTER_GETEVENTS : 0,
+                                  nullptr,
+                                  0);
+      if (result >= 0)
+        return 0;
+      // The kernel can refuse new submissions while completions are pending, these are reaped by
+      // the caller and the remaining entries are submitted with the next call
+      if (errno == EAGAIN || errno == EBUSY)
+        return 0;
+      if (errno != EINTR)
+        return -errno;
+    }
+  }
+
+  /**
+   * Calls 'on_completion(slot, operation, result)' for all completed operations
+   */
+  template<typename OnCompletion>
+  void reap_completions(OnCompletion on_completion)
+  {
+    auto head = *cq_head;
+    const auto tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const auto& cqe = cqes[head & *cq_mask];
+      on_completion(static_cast<uint32_t>(cqe.user_data >> 2),
+                    static_cast<Operation>(cqe.user_data & 3),
+                    cqe.res);
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  int fd = -1;
+
+private:
+  static uint64_t user_data(uint32_t slot, Operation operation)
+  {
+    return (static_cast<uint64_t>(slot) << 2) | static_cast<uint64_t>(operation);
+  }
+
+  bool map_queues(const io_uring_params& params)
+  {
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const auto single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size = cq_size = std::max(sq_size, cq_size);
+    }
+
+    sq_ptr = map(sq_size, IORING_OFF_SQ_RING);
+    if (!sq_ptr)
+      return false;
+    cq_ptr = single_mmap ? sq_ptr : map(cq_size, IORING_OFF_CQ_RING);
+    if (!cq_ptr)
+      return false;
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(map(sqes_size, IORING_OFF_SQES));
+    if (!sqes)
+      return false;
+
+    const auto sq_bytes = static_cast<std::byte*>(sq_ptr);
+    sq_head = reinterpret_cast<uint32_t*>(sq_bytes + params.sq_off.head);
+    sq_tail = reinterpret_cast<uint32_t*>(sq_bytes + params.sq_off.tail);
+    sq_mask = reinterpret_cast<uint32_t*>(sq_bytes + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<uint32_t*>(sq_bytes + params.sq_off.array);
+    sq_entries = params.sq_entries;
+    sqe_tail = *sq_tail;
+
+    const auto cq_bytes = static_cast<std::byte*>(cq_ptr);
+    cq_head = reinterpret_cast<uint32_t*>(cq_bytes + params.cq_off.head);
+    cq_tail = reinterpret_cast<uint32_t*>(cq_bytes + params.cq_off.tail);
+    cq_mask = reinterpret_cast<uint32_t*>(cq_bytes + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq_bytes + params.cq_off.cqes);
+    return true;
+  }
+
+  void* map(size_t size, off_t offset) const
+  {
+    auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return (ptr == MAP_FAILED) ? nullptr : ptr;
+  }
+
+  bool supports_required_operations() const
+  {
+    constexpr size_t NumOps = 256;
+    std::vector<std::byte> probe_memory(sizeof(io_uring_probe) +
+                                        NumOps * sizeof(io_uring_probe_op));
+    auto probe = reinterpret_cast<io_uring_probe*>(probe_memory.data());
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, NumOps) < 0)
+      return false;
+
+    return std::all_of(std::begin(RequiredOperations),
+                       std::end(RequiredOperations),
+                       [probe](uint8_t operation) {
+                         return operation <= probe->last_op &&
+                                (probe->ops[operation].flags & IO_URING_OP_SUPPORTED);
+                       });
+  }
+
+  bool register_file_table() const
+  {
+    // Direct descriptors need an empty table of registered files. Registering a table of -1 entries
+    // works on all kernels that can open files into the table
+    std::vector<int32_t> empty_table(MaxFilesInFlight, -1);
+    return syscall(__NR_io_uring_register,
+                   fd,
+                   IORING_REGISTER_FILES,
+                   empty_table.data(),
+                   static_cast<uint32_t>(empty_table.size())) >= 0;
+  }
+
+  constexpr static uint8_t RequiredOperations[] = { IORING_OP_OPENAT,
+                                                    IORING_OP_WRITE,
+                                                    IORING_OP_CLOSE,
+                                                    IORING_OP_ASYNC_CANCEL };
+
+  void* sq_ptr = nullptr;
+  size_t sq_size = 0;
+  void* cq_ptr = nullptr;
+  size_t cq_size = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqes_size = 0;
+
+  uint32_t* sq_head = nullptr;
+  uint32_t* sq_tail = nullptr;
+  uint32_t* sq_mask = nullptr;
+  uint32_t* sq_array = nullptr;
+  uint32_t sq_entries = 0;
+  // Tail of the prepared entries, which is published to the kernel on submission
+  uint32_t sqe_tail = 0;
+
+  uint32_t* cq_head = nullptr;
+  uint32_t* cq_tail = nullptr;
+  uint32_t* cq_mask = nullptr;
+  io_uring_cqe* cqes = nullptr;
+};
+#else
+struct AsyncFileWriter::IOUring
+{};
+#endif
+
+AsyncFileWriter::AsyncFileWriter(size_t max_bytes_in_flight, Backend preferred_backend)
+  : _backend(Backend::ThreadPool)
+  , _max_bytes_in_flight(max_bytes_in_flight)
+  , _bytes_in_flight(0)
+  , _failed_writes(0)
+  , _stop(false)
+{
+#ifdef SCHWARZWALD_HAS_IO_URING
+  if (preferred_backend == Backend::IOUring) {
+    _ring = IOUring::create();
+  }
+#endif
+
+  if (_ring) {
+    _backend = Backend::IOUring;
+    _threads.emplace_back([this]() { run_ring(); });
+    return;
+  }
+
+  for (uint32_t idx = 0; idx < WorkerThreads; ++idx) {
+    _threads.emplace_back([this]() { run_worker(); });
+  }
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+  {
+    std::lock_guard guard{ _lock };
+    _stop = true;
+  }
+  _requests_queued.notify_all();
+  for (auto& thread : _threads) {
+    thread.join();
+  }
+
+  auto self = this;
+  s_async_file_writer.compare_exchange_strong(self, nullptr);
+}
+
+void
+AsyncFileWriter::write_file(const std::string& file_path, const void* data, size_t size)
+{
+  auto request = std::make_unique<WriteRequest>();
+  request->file_path = file_path;
+  request->data = std::make_unique<std::byte[]>(size);
+  request->size = size;
+  std::memcpy(request->data.get(), data, size);
+
+  {
+    std::unique_lock lock{ _lock };
+    // A single file that is larger than the limit is still written, but only on its own
+    _requests_finished.wait(lock, [this, size]() {
+      return _bytes_in_flight == 0 || _bytes_in_flight + size <= _max_bytes_in_flight;
+    });
+    _bytes_in_flight += size;
+    ++_pending_writes_per_file[file_path];
+    _queued_requests.push_back(std::move(request));
+  }
+  _requests_queued.notify_one();
+}
+
+void
+AsyncFileWriter::wait_for_file(const std::string& file_path)
+{
+  std::unique_lock lock{ _lock };
+  _requests_finished.wait(lock, [this, &file_path]() {
+    return _pending_writes_per_file.find(file_path) == std::end(_pending_writes_per_file);
+  });
+}
+
+size_t
+AsyncFileWriter::wait_for_all()
+{
+  std::unique_lock lock{ _lock };
+  _requests_finished.wait(lock, [this]() { return _pending_writes_per_file.empty(); });
+  return std::exchange(_failed_writes, 0);
+}
+
+std::vector<std::unique_ptr<AsyncFileWriter::WriteRequest>>
+AsyncFileWriter::take_requests(size_t max_count, bool wait)
+{
+  std::unique_lock lock{ _lock };
+  const auto can_start = [this](const std::unique_ptr<WriteRequest>& request) {
+    return _files_being_written.find(request->file_path) == std::end(_files_being_written);
+  };
+  if (wait) {
+    _requests_queued.wait(lock, [this, &can_start]() {
+      return _stop ||
+             std::any_of(std::begin(_queued_requests), std::end(_queued_requests), can_start);
+    });
+  }
+
+  // Writes to a file that is being written stay queued, so that the writes of each file happen one
+  // after another and in the order in which they were queued
+  std::vector<std::unique_ptr<WriteRequest>> requests;
+  auto iter = std::begin(_queued_requests);
+  while (iter != std::end(_queued_requests) && requests.size() < max_count) {
+    if (!can_start(*iter)) {
+      ++iter;
+      continue;
+    }
+    _files_being_written.insert((*iter)->file_path);
+    requests.push_back(std::move(*iter));
+    iter = _queued_requests.erase(iter);
+  }
+  return requests;
+}
+
+void
+AsyncFileWriter::finish_request(const WriteRequest& request, int error)
+{
+  if (error) {
+    util::write_log(
+      util::concat("Could not write file \"", request.file_path, "\" (", strerror(error), ")\n"));
+  }
+
+  {
+    std::lock_guard guard{ _lock };
+    _bytes_in_flight -= request.size;
+    if (error) {
+      ++_failed_writes;
+    }
+    const auto pending_writes = _pending_writes_per_file.find(request.file_path);
+    if (--pending_writes->second == 0) {
+      _pending_writes_per_file.erase(pending_writes);
+    }
+    _files_being_written.erase(request.file_path);
+  }
+  _requests_finished.notify_all();
+  // Queued writes of the same file can start now
+  _requests_queued.notify_all();
+}
+
+void
+AsyncFileWriter::run_worker()
+{
+  while (true) {
+    const auto requests = take_requests(1, true);
+    if (requests.empty())
+      return;
+
+    const auto& request = *requests.front();
+    errno = 0;
+    const auto success = write_file_unbuffered(request.file_path, request.data.get(), request.size);
+    finish_request(request, success ? 0 : (errno ? errno : EIO));
+  }
+}
+
+void
+AsyncFileWriter::run_worker_pool()
+{
+  std::vector<std::thread> threads;
+  for (uint32_t idx = 1; idx < WorkerThreads; ++idx) {
+    threads.emplace_back([this]() { run_worker(); });
+  }
+  run_worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+#ifdef SCHWARZWALD_HAS_IO_URING
+void
+AsyncFileWriter::run_ring()
+{
+  using Operation = IOUring::Operation;
+
+  struct InFlightWrite
+  {
+    std::unique_ptr<WriteRequest> request;
+    size_t bytes_written = 0;
+    uint32_t pending_operations = 0;
+    int error = 0;
+    bool is_open = false;
+    bool close_cancelled = false;
+  };
+
+  std::vector<InFlightWrite> in_flight(IOUring::MaxFilesInFlight);
+  std::vector<uint32_t> free_slots;
+  for (uint32_t slot = IOUring::MaxFilesInFlight; slot > 0; --slot) {
+    free_slots.push_back(slot - 1);
+  }
+
+  // Once the ring failed, completions are only collected until no operation is pending anymore
+  auto draining = false;
+  const auto on_completion = [&](uint32_t slot, Operation operation, int32_t result) {
+    if (operation == Operation::Cancel)
+      return;
+
+    auto& write = in_flight[slot];
+    --write.pending_operations;
+
+    // Operations that follow a failed or short operation in a chain are cancelled
+    if (result == -ECANCELED) {
+      write.close_cancelled |= (operation == Operation::Close);
+    } else if (result < 0) {
+      if (!write.error) {
+        write.error = -result;
+      }
+    } else if (operation == Operation::Open) {
+      write.is_open = true;
+    } else if (operation == Operation::Write) {
+      if (result == 0 && write.bytes_written < write.request->size && !write.error) {
+        write.error = EIO;
+      }
+      write.bytes_written += static_cast<size_t>(result);
+    } else if (operation == Operation::Close) {
+      write.is_open = false;
+    }
+
+    if (write.pending_operations || draining)
+      return;
+
+    // A short write cancels the close, so the rest of the file is written with a new chain
+    const auto needs_writing = !write.error && write.bytes_written < write.request->size;
+    if (write.is_open && (needs_writing || write.close_cancelled)) {
+      write.close_cancelled = false;
+      if (needs_writing) {
+        _ring->prepare_write(*write.request, write.bytes_written, slot);
+        ++write.pending_operations;
+      }
+      _ring->prepare_close(slot);
+      ++write.pending_operations;
+      return;
+    }
+
+    if (!write.error && write.bytes_written < write.request->size) {
+      write.error = EIO;
+    }
+    finish_request(*write.request, write.error);
+    write = {};
+    free_slots.push_back(slot);
+  };
+
+  while (true) {
+    const auto has_writes_in_flight = free_slots.size() < IOUring::MaxFilesInFlight;
+    auto requests = take_requests(free_slots.size(), !has_writes_in_flight);
+    if (requests.empty() && !has_writes_in_flight)
+      return;
+
+    for (auto& request : requests) {
+      const auto slot = free_slots.back();
+      free_slots.pop_back();
+
+      auto& write = in_flight[slot];
+      write.request = std::move(request);
+      _ring->prepare_open(*write.request, slot);
+      _ring->prepare_write(*write.request, 0, slot);
+      _ring->prepare_close(slot);
+      write.pending_operations = 3;
+    }
+
+    const auto error = _ring->submit_and_wait(1);
+    if (error) {
+      util::write_log(
+        util::concat("io_uring failed (", strerror(-error), "), writing files synchronously\n"));
+      break;
+    }
+    _ring->reap_completions(on_completion);
+  }
+
+  // The kernel may still be writing the files in flight and reading their data. Entries that it
+  // has not taken yet are taken back, all other operations are cancelled and their completions are
+  // collected before the files are touched again
+  draining = true;
+  _ring->retract_unsubmitted(
+    [&in_flight](uint32_t slot, Operation) { --in_flight[slot].pending_operations; });
+  const auto has_pending_operations = [&in_flight]() {
+    return std::any_of(std::begin(in_flight), std::end(in_flight), [](const auto& write) {
+      return write.pending_operations > 0;
+    });
+  };
+  for (uint32_t slot = 0; slot < IOUring::MaxFilesInFlight; ++slot) {
+    if (!in_flight[slot].pending_operations)
+      continue;
+    for (auto operation : { Operation::Open, Operation::Write, Operation::Close }) {
+      _ring->prepare_cancel(slot, operation);
+    }
+  }
+  auto drained = true;
+  while (has_pending_operations()) {
+    if (_ring->submit_and_wait(1)) {
+      drained = false;
+      break;
+    }
+    _ring->reap_completions(on_completion);
+  }
+
+  // Files that were not written completely are written again synchronously, as are all files that
+  // are queued from now on
+  for (auto& write : in_flight) {
+    if (!write.request)
+      continue;
+
+    const auto& request = *write.request;
+    if (!drained) {
+      // The kernel might still read the data, so it is never freed
+      finish_request(request, EIO);
+      write.request.release();
+      continue;
+    }
+    if (!write.error && !write.is_open && write.bytes_written == request.size) {
+      finish_request(request, 0);
+      continue;
+    }
+    const auto success = write_file_unbuffered(request.file_path, request.data.get(), request.size);
+    finish_request(request, success ? 0 : EIO);
+  }
+  if (drained) {
+    // Closes the files that are still open in the table of registered files
+    _ring.reset();
+  }
+  run_worker_pool();
+}
+#else
+void
+AsyncFileWriter::run_ring()
+{
+  run_worker_pool();
+}
+#endif
+
+void
+set_async_file_writer(AsyncFileWriter* writer)
+{
+  s_async_file_writer = writer;
+}
+
+bool
+write_file_async(const std::string& file_path, const void* data, size_t size)
+{
+  if (auto writer = s_async_file_writer.load()) {
+    writer->write_file(file_path, data, size);
+    return true;
+  }
+  return write_file_unbuffered(file_path, data, size);
+}
+
+void
+wait_for_file_write(const std::string& file_path)
+{
+  if (auto writer = s_async_file_writer.load()) {
+    writer->wait_for_file(file_path);
+  }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Writes whole files in the background, so that threads which produce many small files (e.g. the
+ * nodes of an octree) do not have to wait for open, write and close themselves.
+ *
+ * On Linux, all files are written from a dedicated io_uring, which submits the open, write and
+ * close of many files in batches. Where io_uring is not available (other platforms, old kernels or
+ * if it is disabled), a small pool of threads writes the files instead. Writes to the same file are
+ * never running at the same time, they happen in the order in which they were queued.
+ *
+ * The size of all files that are queued or being written is bounded by 'max_bytes_in_flight', so
+ * writers block once the limit is reached instead of piling up copies of their data
+ */
+struct AsyncFileWriter
+{
+  enum class Backend
+  {
+    IOUring,
+    ThreadPool
+  };
+
+  constexpr static size_t DefaultMaxBytesInFlight = 256 * 1024 * 1024;
+
+  explicit AsyncFileWriter(size_t max_bytes_in_flight = DefaultMaxBytesInFlight,
+                           Backend preferred_backend = Backend::IOUring);
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter(AsyncFileWriter&&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(AsyncFileWriter&&) = delete;
+  /**
+   * Waits for all queued writes
+   */
+  ~AsyncFileWriter();
+
+  /**
+   * Queues writing a copy of 'size' bytes starting at 'data' to the given file, replacing any
+   * existing file. Failed writes are logged
+   */
+  void write_file(const std::string& file_path, const void* data, size_t size);
+
+  /**
+   * Blocks until all queued writes to the given file are done
+   */
+  void wait_for_file(const std::string& file_path);
+
+  /**
+   * Blocks until all queued writes are done. Returns the number of writes that failed since the
+   * last call
+   */
+  size_t wait_for_all();
+
+  Backend backend() const { return _backend; }
+
+private:
+  struct WriteRequest
+  {
+    std::string file_path;
+    std::unique_ptr<std::byte[]> data;
+    size_t size;
+  };
+  struct IOUring;
+
+  /**
+   * Takes up to 'max_count' queued requests, skipping requests for files that are being written
+   * already. Blocks until there is at least one request that can be started if 'wait' is set.
+   * Returns no requests once the writer is stopped and no queued request can be started
+   */
+  std::vector<std::unique_ptr<WriteRequest>> take_requests(size_t max_count, bool wait);
+  /**
+   * Marks the given request as done. 'error' is an errno value, or 0 if the file was written
+   */
+  void finish_request(const WriteRequest& request, int error);
+
+  void run_ring();
+  void run_worker();
+  /**
+   * Runs as many workers as the thread pool backend, one of them on the calling thread. Used by the
+   * ring thread once io_uring failed
+   */
+  void run_worker_pool();
+
+  Backend _backend;
+  size_t _max_bytes_in_flight;
+  std::unique_ptr<IOUring> _ring;
+  std::vector<std::thread> _threads;
+
+  std::mutex _lock;
+  std::condition_variable _requests_queued;
+  std::condition_variable _requests_finished;
+  std::deque<std::unique_ptr<WriteRequest>> _queued_requests;
+  // Number of queued or running writes per file, files without pending writes are not stored
+  std::unordered_map<std::string, size_t> _pending_writes_per_file;
+  // Files that are being written by the ring or a worker right now
+  std::unordered_set<std::string> _files_being_written;
+  size_t _bytes_in_flight;
+  size_t _failed_writes;
+  bool _stop;
+};
+
+/**
+ * Makes 'write_file_async' write through the given AsyncFileWriter. Passing nullptr makes
+ * 'write_file_async' write synchronously again. A destroyed AsyncFileWriter resets itself
+ */
+void
+set_async_file_writer(AsyncFileWriter* writer);
+
+/**
+ * Writes the given data to the given file through the AsyncFileWriter set with
+ * 'set_async_file_writer', or synchronously with 'write_file_unbuffered' if there is none. Returns
+ * false if a synchronous write failed, failed background writes are logged
+ */
+bool
+write_file_async(const std::string& file_path, const void* data, size_t size);
+
+/**
+ * Waits for pending background writes of the given file. Call this before reading or checking for
+ * a file that might have been written with 'write_file_async'
+ */
+void
+wait_for_file_write(const std::string& file_path);
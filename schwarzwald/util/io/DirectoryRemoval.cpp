@@ -0,0 +1,195 @@
+#include "io/DirectoryRemoval.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fs = std::experimental::filesystem;
+
+namespace {
+// Number of files that are unlinked as one unit of work. Large enough that threads rarely contend
+// for the queue, small enough that a directory with a few thousand files is spread over all threads
+constexpr size_t FilesPerBatch = 1024;
+// Enumerating a directory is much faster than unlinking its files. Once this many batches are
+// queued, the enumerating thread unlinks its batches itself, which bounds the memory of the queue
+constexpr size_t MaxQueuedBatches = 256;
+
+/**
+ * Work of a directory removal, shared by all threads. An item is either a directory to enumerate
+ * or a batch of files to unlink
+ */
+struct RemovalQueue
+{
+  struct Item
+  {
+    fs::path directory;
+    std::vector<fs::path> files;
+  };
+
+  std::mutex lock;
+  std::condition_variable items_changed;
+  std::deque<Item> items;
+  // Number of items that are queued or being processed. The removal is done once this is zero
+  size_t unfinished_items = 0;
+  size_t queued_batches = 0;
+  // All subdirectories in the order they were found, so every directory comes before its children
+  std::vector<fs::path> directories;
+  size_t failed_removals = 0;
+
+  const fs::path* top_level_directory = nullptr;
+  const std::function<bool(const fs::path&)>* skip = nullptr;
+
+  void push(Item item)
+  {
+    std::lock_guard guard{ lock };
+    if (!item.files.empty()) {
+      ++queued_batches;
+    }
+    ++unfinished_items;
+    items.push_back(std::move(item));
+    items_changed.notify_one();
+  }
+
+  bool has_room_for_batch()
+  {
+    std::lock_guard guard{ lock };
+    return queued_batches < MaxQueuedBatches;
+  }
+
+  void add_failed_removals(size_t count)
+  {
+    if (!count)
+      return;
+    std::lock_guard guard{ lock };
+    failed_removals += count;
+  }
+
+  void unlink_files(const std::vector<fs::path>& files)
+  {
+    size_t failed = 0;
+    for (const auto& file : files) {
+      std::error_code error;
+      if (!fs::remove(file, error) && error) {
+        ++failed;
+      }
+    }
+    add_failed_removals(failed);
+  }
+
+  void enumerate_directory(const fs::path& directory)
+  {
+    const auto is_top_level = (directory == *top_level_directory);
+    std::vector<fs::path> batch;
+
+    std::error_code error;
+    fs::directory_iterator iter{ directory, error };
+    for (; !error && iter != fs::directory_iterator{}; iter.increment(error)) {
+      const auto& entry_path = iter->path();
+      if (is_top_level && *skip && (*skip)(entry_path))
+        continue;
+
+      std::error_code status_error;
+      if (fs::is_directory(iter->symlink_status(status_error))) {
+        {
+          std::lock_guard guard{ lock };
+          directories.push_back(entry_path);
+        }
+        push(Item{ entry_path, {} });
+        continue;
+      }
+
+      batch.push_back(entry_path);
+      if (batch.size() < FilesPerBatch)
+        continue;
+
+      if (has_room_for_batch()) {
+        push(Item{ {}, std::move(batch) });
+      } else {
+        unlink_files(batch);
+      }
+      batch.clear();
+    }
+
+    if (error) {
+      add_failed_removals(1);
+    }
+    unlink_files(batch);
+  }
+
+  void run_worker()
+  {
+    for (;;) {
+      Item item;
+      {
+        std::unique_lock guard{ lock };
+        items_changed.wait(guard, [this]() { return !items.empty() || !unfinished_items; });
+        if (items.empty())
+          return;
+
+        item = std::move(items.front());
+        items.pop_front();
+        if (!item.files.empty()) {
+          --queued_batches;
+        }
+      }
+
+      if (item.files.empty()) {
+        enumerate_directory(item.directory);
+      } else {
+        unlink_files(item.files);
+      }
+
+      std::lock_guard guard{ lock };
+      if (!--unfinished_items) {
+        items_changed.notify_all();
+      }
+    }
+  }
+};
+} // namespace
+
+size_t
+remove_directory_contents(const fs::path& directory,
+                          unsigned num_threads,
+                          const std::function<bool(const fs::path&)>& skip)
+{
+  RemovalQueue queue;
+  queue.top_level_directory = &directory;
+  queue.skip = &skip;
+  queue.push(RemovalQueue::Item{ directory, {} });
+
+  std::vector<std::thread> threads;
+  for (unsigned idx = 1; idx < std::max(num_threads, 1u); ++idx) {
+    threads.emplace_back([&queue]() { queue.run_worker(); });
+  }
+  queue.run_worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // All files are gone, so the directories are empty once their children are removed
+  std::for_each(std::rbegin(queue.directories),
+                std::rend(queue.directories),
+                [&queue](const fs::path& subdirectory) {
+                  std::error_code error;
+                  if (!fs::remove(subdirectory, error) && error) {
+                    ++queue.failed_removals;
+                  }
+                });
+
+  return queue.failed_removals;
+}
+
+size_t
+remove_directory(const fs::path& directory, unsigned num_threads)
+{
+  auto failed_removals = remove_directory_contents(directory, num_threads);
+  std::error_code error;
+  if (!fs::remove(directory, error) && error) {
+    ++failed_removals;
+  }
+  return failed_removals;
+}
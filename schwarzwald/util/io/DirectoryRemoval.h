@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <experimental/filesystem>
+#include <functional>
+
+/**
+ * Removes everything within 'directory', but not 'directory' itself, using 'num_threads' threads.
+ * Top-level entries for which 'skip(entry)' returns true are kept.
+ *
+ * All directories are enumerated concurrently and their files are unlinked in batches by all
+ * threads, so this is fast even if a single directory contains millions of files. Symbolic links
+ * are removed, never followed. Returns the number of files and directories that could not be
+ * removed
+ */
+size_t
+remove_directory_contents(const std::experimental::filesystem::path& directory,
+                          unsigned num_threads,
+                          const std::function<bool(const std::experimental::filesystem::path&)>&
+                            skip = {});
+
+/**
+ * Removes 'directory' and everything within it using 'num_threads' threads, see
+ * 'remove_directory_contents'. Returns the number of files and directories that could not be
+ * removed
+ */
+size_t
+remove_directory(const std::experimental::filesystem::path& directory, unsigned num_threads);
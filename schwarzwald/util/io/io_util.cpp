@@ -8,4 +8,18 @@ concat_path(const std::string& l, const std::string& r)
   std::stringstream ss;
   ss << l << "/" << r;
   return ss.str();
-}
\ No newline at end of file
+}
+
+bool
+write_file_unbuffered(const std::string& file_path, const void* data, size_t size)
+{
+  std::ofstream writer;
+  // The whole file is in memory already, buffering would only add another copy
+  writer.rdbuf()->pubsetbuf(nullptr, 0);
+  writer.open(file_path, std::ios::out | std::ios::binary);
+  if (!writer.is_open())
+    return false;
+
+  writer.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+  return writer.good();
+}
@@ -9,6 +9,13 @@
  */
 std::string concat_path(const std::string &l, const std::string &r);
 
+/**
+ * Writes 'size' bytes starting at 'data' to the given file with a single unbuffered write, replacing
+ * any existing file. Returns false if the file could not be written
+ */
+bool write_file_unbuffered(const std::string &file_path, const void *data,
+                           size_t size);
+
 /**
  * Write binary data to the given file stream
  */
@@ -12,6 +12,8 @@
 
 TaskSystem::TaskSystem() : _run(false) {}
 
+TaskSystem::~TaskSystem() { stop_and_join(); }
+
 void TaskSystem::run(uint32_t concurrency) {
   if (!_workers.empty() || _run) {
     throw std::runtime_error{"Task system already running!"};
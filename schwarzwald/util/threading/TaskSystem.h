@@ -13,6 +13,7 @@
 
 struct TaskSystem {
   TaskSystem();
+  ~TaskSystem();
 
   template <typename Task> decltype(auto) push(Task task) {
     using Ret_t = std::decay_t<std::result_of_t<Task()>>;